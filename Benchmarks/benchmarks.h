@@ -0,0 +1,57 @@
+//----------------------------------------------------------------------------------------
+/**
+* \file       benchmarks.h
+* \brief      Benchmarks of the library components.
+*
+*  Every benchmark gets the command line arguments which follow its name.
+*  Timings are accompanied by hardware counters (see PerfCounters) when
+*  the system provides them.
+*
+*/
+//----------------------------------------------------------------------------------------
+
+#pragma once
+
+/// Compare ceres and the in-house Schur solver (also with mixed precision) on a BAL
+/// problem.
+/**
+Arguments: problem.txt [maxIterations] [numThreads]
+
+\param[in] argc Number of arguments.
+\param[in] argv Arguments.
+\return Zero on success.
+*/
+int runBundleAdjustBenchmark(int argc,char **argv);
+
+/// Compare accuracy and speed of the 5 point solvers on random problems.
+/**
+Arguments: [nProblems]
+
+\param[in] argc Number of arguments.
+\param[in] argv Arguments.
+\return Zero on success.
+*/
+int runFivePointBenchmark(int argc,char **argv);
+
+/// Compare speed and accuracy of the match verifiers on labelled pairs.
+/**
+Arguments: [nPairs | labelled_pairs.txt]
+
+Synthetic pairs (200 by default) see a static scene, possibly an independently
+moving object, and outliers. Labelled pairs are read from a text file:
+\verbatim
+nCams
+width height focal nKeys     (for every camera, focal 0 if unknown)
+x y scale orientation        (for every key)
+nPairs
+cam1 cam2 nMatches           (for every pair)
+key1 key2 dist label         (for every match)
+\endverbatim
+Label is 0 for an incorrect match, the index of the motion (1,2,...) for a correct
+one and -1 if unknown, as in Matlab/GeometricVerification/createGroundTruthMatches.
+
+\param[in] argc Number of arguments.
+\param[in] argv Arguments.
+\return Zero on success.
+*/
+int runVerificationBenchmark(int argc,char **argv);
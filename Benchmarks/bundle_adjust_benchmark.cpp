@@ -0,0 +1,93 @@
+#include "benchmarks.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "YASFM/absolute_pose.h"
+#include "YASFM/bundle_adjust.h"
+#include "YASFM/perf_counters.h"
+#include "YASFM/sfm_data.h"
+#include "YASFM/utils_io.h"
+
+using namespace yasfm;
+using std::cout;
+using std::string;
+using std::vector;
+
+namespace
+{
+
+/// Run bundle adjustment on copies of cams and pts and print the statistics.
+/**
+The counters are reported per residual (observation) and cover only the calling
+thread, i.e. everything when numThreads is 1.
+*/
+void runSolver(const string& name,const OptionsBundleAdjustment& opt,
+  const ptr_vector<Camera>& cams,const vector<Point>& pts,size_t nObs)
+{
+  ptr_vector<Camera> camsCopy;
+  camsCopy.reserve(cams.size());
+  for(const auto& cam : cams)
+    camsCopy.push_back(cam->clone());
+  vector<Point> ptsCopy(pts);
+
+  PerfCounters counters;
+  {
+    PerfRegion region(&counters);
+    bundleAdjust(opt,&camsCopy,&ptsCopy);
+  }
+  double time = counters.values().seconds;
+
+  cout << name << "\ttook: " << time << "s\treprojection error: "
+    << computeAverageReprojectionError(camsCopy,ptsCopy) << "\n";
+  cout << "\t" << formatPerfCounters(counters.values(),double(nObs),"residual") << "\n";
+}
+
+} // namespace
+
+int runBundleAdjustBenchmark(int argc,char **argv)
+{
+  if(argc < 1)
+  {
+    cout << "Usage: ba problem.txt [maxIterations] [numThreads]\n";
+    return EXIT_FAILURE;
+  }
+
+  ptr_vector<Camera> cams;
+  vector<Point> pts;
+  if(!readBALProblem(argv[0],&cams,&pts))
+    return EXIT_FAILURE;
+
+  size_t nObs = 0;
+  for(const auto& pt : pts)
+    nObs += pt.views.size();
+  cout << cams.size() << " cameras, " << pts.size() << " points, "
+    << nObs << " observations\n";
+  cout << "initial reprojection error: "
+    << computeAverageReprojectionError(cams,pts) << "\n";
+
+  OptionsBundleAdjustment opt;
+  auto& solverOptions = opt.get<ceres::Solver::Options>("solverOptions");
+  solverOptions.linear_solver_type = ceres::SPARSE_SCHUR;
+  solverOptions.max_num_iterations = (argc > 1) ? atoi(argv[1]) : 20;
+  if(argc > 2)
+    solverOptions.num_threads = atoi(argv[2]);
+  solverOptions.num_linear_solver_threads = solverOptions.num_threads;
+  solverOptions.function_tolerance = 1e-6;
+  solverOptions.parameter_tolerance = 1e-8;
+  solverOptions.gradient_tolerance = 1e-10;
+  opt.get<bool>("robustify") = true;
+
+  opt.get<bool>("useSchurSolver") = false;
+  runSolver("ceres",opt,cams,pts,nObs);
+
+  opt.get<bool>("useSchurSolver") = true;
+  runSolver("schur",opt,cams,pts,nObs);
+
+  opt.get<bool>("schurMixedPrecision") = true;
+  runSolver("schur mixed",opt,cams,pts,nObs);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,156 @@
+#include "benchmarks.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include "5point/5point.h"
+#include "YASFM/five_point.h"
+#include "YASFM/perf_counters.h"
+
+using namespace yasfm;
+using Eigen::AngleAxisd;
+using std::cout;
+using std::vector;
+
+namespace
+{
+
+/// Random calibrated 5 point problem with known essential matrix.
+struct Problem5pt
+{
+  Vector3d pts1[5];
+  Vector3d pts2[5];
+  Matrix3d E; ///< Ground truth with unit Frobenius norm.
+};
+
+/// Generate points in front of two cameras with random relative pose.
+void generateProblem(std::mt19937 *gen,Problem5pt *pproblem)
+{
+  auto& problem = *pproblem;
+  std::uniform_real_distribution<double> u(-1.,1.);
+  Vector3d axis(u(*gen),u(*gen),u(*gen));
+  Matrix3d R = AngleAxisd(0.5*u(*gen),axis.normalized()).toRotationMatrix();
+  Vector3d t(u(*gen),u(*gen),u(*gen));
+  t.normalize();
+  Matrix3d tx;
+  tx << 0,-t(2),t(1),
+    t(2),0,-t(0),
+    -t(1),t(0),0;
+  problem.E = tx*R;
+  problem.E.normalize();
+  for(int i = 0; i < 5; i++)
+  {
+    Vector3d X(u(*gen),u(*gen),4. + u(*gen));
+    Vector3d Y = R*X + t;
+    problem.pts1[i] = X / X(2);
+    problem.pts2[i] = Y / Y(2);
+  }
+}
+
+/// \return Distance of the closest solution to the ground truth (up to sign).
+double computeError(const Matrix3d& E,const Matrix3d *Es,int nSolutions)
+{
+  double best = std::numeric_limits<double>::infinity();
+  for(int i = 0; i < nSolutions; i++)
+  {
+    Matrix3d Ei = Es[i] / Es[i].norm();
+    best = std::min(best,std::min((Ei - E).norm(),(Ei + E).norm()));
+  }
+  return best;
+}
+
+/// Print accuracy, timing and hardware counters statistics.
+/**
+One solve is what a RANSAC round of the 5 point estimator spends in the solver,
+so the counters are reported per round.
+*/
+void printStats(const char *name,vector<double>& errors,int nSolutions,
+  const PerfCounterValues& counters)
+{
+  double time = counters.seconds;
+  const double failThresh = 1e-6;
+  int nProblems = static_cast<int>(errors.size());
+  std::sort(errors.begin(),errors.end());
+  int nFailed = static_cast<int>(errors.end() -
+    std::upper_bound(errors.begin(),errors.end(),failThresh));
+  cout << name << "\tmedian error: " << errors[nProblems / 2]
+    << "\tfailed: " << double(nFailed) / nProblems * 100. << "%"
+    << "\tavg solutions: " << double(nSolutions) / nProblems
+    << "\ttime: " << time / nProblems * 1e6 << "us\n";
+  cout << "\t" << formatPerfCounters(counters,nProblems,"round") << "\n";
+}
+
+} // namespace
+
+int runFivePointBenchmark(int argc,char **argv)
+{
+  int nProblems = (argc > 0) ? atoi(argv[0]) : 10000;
+  if(nProblems <= 0)
+  {
+    cout << "Usage: fivept [nProblems]\n";
+    return EXIT_FAILURE;
+  }
+
+  std::mt19937 gen(0);
+  vector<Problem5pt> problems(nProblems);
+  for(auto& problem : problems)
+    generateProblem(&gen,&problem);
+
+  // Li-Hartley solver used previously
+  {
+    vector<double> errors(nProblems);
+    int nSolutions = 0;
+    PerfCounters counters;
+    for(int i = 0; i < nProblems; i++)
+    {
+      const auto& problem = problems[i];
+      double pts1[5][3],pts2[5][3];
+      for(int j = 0; j < 5; j++)
+      {
+        for(int k = 0; k < 3; k++)
+        {
+          pts1[j][k] = problem.pts1[j](k);
+          pts2[j][k] = problem.pts2[j](k);
+        }
+      }
+      fivepoint::Ematrix EsRaw[fivepoint::Maxsolutions];
+      int nRoots;
+      bool optimized = true;
+      counters.start();
+      fivepoint::compute_E_matrices(pts1,pts2,EsRaw,nRoots,optimized);
+      counters.stop();
+
+      vector<Matrix3d> Es(nRoots);
+      for(int j = 0; j < nRoots; j++)
+        for(int r = 0; r < 3; r++)
+          for(int c = 0; c < 3; c++)
+            Es[j](r,c) = EsRaw[j][r][c];
+      errors[i] = computeError(problem.E,Es.data(),nRoots);
+      nSolutions += nRoots;
+    }
+    printStats("Li-Hartley",errors,nSolutions,counters.values());
+  }
+
+  {
+    vector<double> errors(nProblems);
+    int nSolutions = 0;
+    PerfCounters counters;
+    for(int i = 0; i < nProblems; i++)
+    {
+      const auto& problem = problems[i];
+      Matrix3d Es[maxNumSolutions5pt];
+      counters.start();
+      int n = solveRelativePose5pt(problem.pts1,problem.pts2,Es);
+      counters.stop();
+      errors[i] = computeError(problem.E,Es,n);
+      nSolutions += n;
+    }
+    printStats("Nister",errors,nSolutions,counters.values());
+  }
+
+  return EXIT_SUCCESS;
+}
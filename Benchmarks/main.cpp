@@ -0,0 +1,34 @@
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include "benchmarks.h"
+#include "YASFM/logging.h"
+
+using std::cout;
+using yasfm::ScopedLoggerStop;
+
+int main(int argc,char **argv)
+{
+  ScopedLoggerStop stopLogger;
+
+  if(argc < 2)
+  {
+    cout << "Usage: Benchmarks <benchmark> [args]\n"
+      << "Benchmarks:\n"
+      << "  ba problem.txt [maxIterations] [numThreads]\n"
+      << "  fivept [nProblems]\n"
+      << "  verify [nPairs | labelled_pairs.txt]\n";
+    return EXIT_FAILURE;
+  }
+
+  if(strcmp(argv[1],"ba") == 0)
+    return runBundleAdjustBenchmark(argc - 2,argv + 2);
+  if(strcmp(argv[1],"fivept") == 0)
+    return runFivePointBenchmark(argc - 2,argv + 2);
+  if(strcmp(argv[1],"verify") == 0)
+    return runVerificationBenchmark(argc - 2,argv + 2);
+
+  cout << "Unknown benchmark: " << argv[1] << "\n";
+  return EXIT_FAILURE;
+}
@@ -0,0 +1,414 @@
+#include "benchmarks.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "YASFM/perf_counters.h"
+#include "YASFM/relative_pose.h"
+#include "YASFM/sfm_data.h"
+#include "YASFM/standard_camera.h"
+
+using namespace yasfm;
+using Eigen::AngleAxisd;
+using std::cout;
+using std::ifstream;
+using std::string;
+using std::vector;
+
+namespace
+{
+
+/// Label of a match which was not labelled.
+const int labelUnknown = -1;
+/// Label of an incorrect match. Correct matches have the index of their motion (>0).
+const int labelOutlier = 0;
+
+/// Camera pairs with labelled matches.
+struct LabelledPairs
+{
+  ptr_vector<Camera> cams;
+  pair_umap<CameraPair> pairs;
+  /// Label of every match of every pair (in the order of pair.matches).
+  pair_umap<vector<int>> labels;
+  /// True if all the cameras have focal and principal point.
+  bool isCalibrated;
+};
+
+/// Synthetic image size and focal length.
+const int synthWidth = 1000;
+const int synthHeight = 750;
+const double synthFocal = 900.;
+
+/// Project point given in the coordinates of a camera with synthetic calibration.
+Vector2d projectSynth(const Vector3d& X)
+{
+  return Vector2d(synthFocal * X(0) / X(2) + 0.5 * (synthWidth - 1),
+    synthFocal * X(1) / X(2) + 0.5 * (synthHeight - 1));
+}
+
+/// Back project pixel to the given depth (synthetic calibration).
+Vector3d backprojectSynth(const Vector2d& x,double depth)
+{
+  return Vector3d(depth * (x(0) - 0.5 * (synthWidth - 1)) / synthFocal,
+    depth * (x(1) - 0.5 * (synthHeight - 1)) / synthFocal,depth);
+}
+
+bool isInSynthImage(const Vector2d& x)
+{
+  return x(0) >= 0. && x(1) >= 0. && x(0) < synthWidth && x(1) < synthHeight;
+}
+
+/// Feature with position, scale and orientation.
+struct SynthFeature
+{
+  Vector2d x;
+  double scale;
+  double orientation;
+};
+
+/// One synthetic match before sorting by distances.
+struct SynthMatch
+{
+  SynthFeature f1,f2;
+  double dist;
+  int label;
+};
+
+/// Generate a correct match of a point moving rigidly between the cameras.
+/**
+The point is seen by the first camera with identity pose. The second camera gets
+the point transformed by (R,t). The second feature has scale and orientation
+consistent with the local transformation of the image.
+
+\return False if the point is not seen by the second camera.
+*/
+bool generateCorrectMatch(std::mt19937 *gen,const Matrix3d& R,const Vector3d& t,
+  const Vector2d& x1,SynthMatch *pmatch)
+{
+  auto& match = *pmatch;
+  std::uniform_real_distribution<double> depthDist(5.,15.),scaleDist(1.5,8.),
+    angleDist(-M_PI,M_PI);
+  std::normal_distribution<double> noise(0.,0.5),angleNoise(0.,0.05),
+    scaleNoise(1.,0.05);
+
+  double depth = depthDist(*gen);
+  match.f1.x = x1;
+  match.f1.scale = scaleDist(*gen);
+  match.f1.orientation = angleDist(*gen);
+  Vector2d dir(cos(match.f1.orientation),sin(match.f1.orientation));
+
+  Vector3d X = R * backprojectSynth(x1,depth) + t;
+  Vector3d Xd = R * backprojectSynth(x1 + match.f1.scale * dir,depth) + t;
+  if(X(2) <= 0. || Xd(2) <= 0.)
+    return false;
+  Vector2d x2 = projectSynth(X);
+  if(!isInSynthImage(x2))
+    return false;
+  Vector2d d2 = projectSynth(Xd) - x2;
+
+  match.f1.x += Vector2d(noise(*gen),noise(*gen));
+  match.f2.x = x2 + Vector2d(noise(*gen),noise(*gen));
+  match.f2.scale = d2.norm() * scaleNoise(*gen);
+  match.f2.orientation = atan2(d2(1),d2(0)) + angleNoise(*gen);
+  return true;
+}
+
+/// Generate a random (incorrect) match.
+void generateOutlierMatch(std::mt19937 *gen,SynthMatch *pmatch)
+{
+  auto& match = *pmatch;
+  std::uniform_real_distribution<double> xDist(0.,synthWidth),yDist(0.,synthHeight),
+    scaleDist(1.5,8.),angleDist(-M_PI,M_PI);
+  for(SynthFeature *f : {&match.f1,&match.f2})
+  {
+    f->x = Vector2d(xDist(*gen),yDist(*gen));
+    f->scale = scaleDist(*gen);
+    f->orientation = angleDist(*gen);
+  }
+  match.label = labelOutlier;
+}
+
+/// \return Random rotation with angle at most maxAngle.
+Matrix3d generateRotation(std::mt19937 *gen,double maxAngle)
+{
+  std::uniform_real_distribution<double> u(-1.,1.);
+  Vector3d axis(u(*gen),u(*gen),u(*gen));
+  return AngleAxisd(maxAngle * u(*gen),axis.normalized()).toRotationMatrix();
+}
+
+/// Create a calibrated camera with the given features.
+unique_ptr<Camera> createSynthCamera(const vector<SynthMatch>& matches,bool first)
+{
+  const float descr = 0.f;
+  auto cam = make_unique<StandardCamera>();
+  cam->setImage("",synthWidth,synthHeight);
+  cam->setFocal(synthFocal);
+  cam->resizeFeatures(static_cast<int>(matches.size()),1);
+  for(int i = 0; i < static_cast<int>(matches.size()); i++)
+  {
+    const auto& f = first ? matches[i].f1 : matches[i].f2;
+    cam->setFeature(i,f.x(0),f.x(1),f.scale,f.orientation,&descr);
+  }
+  return std::move(cam);
+}
+
+/// Generate pairs seeing a static scene and possibly one independently moving object.
+/**
+Every pair has its own two cameras and every key has exactly one match. Some pairs
+are unrelated and have only incorrect matches. Correct matches have lower distances
+on average.
+*/
+void generatePairs(int nPairs,LabelledPairs *pdata)
+{
+  auto& data = *pdata;
+  std::mt19937 gen(0);
+  std::uniform_real_distribution<double> u(0.,1.);
+  std::uniform_int_distribution<int> nStaticDist(40,400),nObjectDist(20,120);
+
+  data.isCalibrated = true;
+  for(int iPair = 0; iPair < nPairs; iPair++)
+  {
+    vector<SynthMatch> matches;
+    if(u(gen) > 0.2)
+    {
+      Matrix3d R = generateRotation(&gen,0.25);
+      Vector3d C(2. * u(gen) - 1.,2. * u(gen) - 1.,0.6 * u(gen) - 0.3);
+      C.normalize();
+      Vector3d t = -R * C;
+
+      int nStatic = nStaticDist(gen);
+      for(int i = 0; i < nStatic; i++)
+      {
+        SynthMatch m;
+        Vector2d x1(u(gen) * synthWidth,u(gen) * synthHeight);
+        if(generateCorrectMatch(&gen,R,t,x1,&m))
+        {
+          m.label = 1;
+          matches.push_back(m);
+        }
+      }
+
+      if(u(gen) < 0.5)
+      {
+        // object occupying a quarter of the first image moves rigidly
+        Matrix3d RObj = generateRotation(&gen,0.3);
+        Vector3d tObj(u(gen) - 0.5,u(gen) - 0.5,u(gen) - 0.5);
+        Vector2d corner(u(gen) * 0.5 * synthWidth,u(gen) * 0.5 * synthHeight);
+        int nObject = nObjectDist(gen);
+        for(int i = 0; i < nObject; i++)
+        {
+          SynthMatch m;
+          Vector2d x1 = corner +
+            Vector2d(u(gen) * 0.5 * synthWidth,u(gen) * 0.5 * synthHeight);
+          if(generateCorrectMatch(&gen,R * RObj,R * tObj + t,x1,&m))
+          {
+            m.label = 2;
+            matches.push_back(m);
+          }
+        }
+      }
+    }
+
+    int nCorrect = static_cast<int>(matches.size());
+    double outlierRatio = (nCorrect > 0) ? (0.2 + 0.6 * u(gen)) : 1.;
+    int nOutliers = (nCorrect > 0) ?
+      static_cast<int>(nCorrect * outlierRatio / (1. - outlierRatio)) :
+      static_cast<int>(nStaticDist(gen));
+    for(int i = 0; i < nOutliers; i++)
+    {
+      SynthMatch m;
+      generateOutlierMatch(&gen,&m);
+      matches.push_back(m);
+    }
+    for(auto& m : matches)
+      m.dist = (m.label == labelOutlier) ? (0.4 + 0.6 * u(gen)) : (0.2 + 0.6 * u(gen));
+    std::sort(matches.begin(),matches.end(),
+      [](const SynthMatch& a,const SynthMatch& b) { return a.dist < b.dist; });
+
+    int cam1 = static_cast<int>(data.cams.size());
+    data.cams.push_back(createSynthCamera(matches,true));
+    data.cams.push_back(createSynthCamera(matches,false));
+    auto& pair = data.pairs[IntPair(cam1,cam1 + 1)];
+    auto& labels = data.labels[IntPair(cam1,cam1 + 1)];
+    for(int i = 0; i < static_cast<int>(matches.size()); i++)
+    {
+      pair.matches.emplace_back(i,i);
+      pair.dists.push_back(matches[i].dist);
+      labels.push_back(matches[i].label);
+    }
+  }
+}
+
+/// Read labelled pairs (see runVerificationBenchmark for the format).
+bool readLabelledPairs(const string& filename,LabelledPairs *pdata)
+{
+  auto& data = *pdata;
+  ifstream file(filename);
+  if(!file.is_open())
+  {
+    YASFM_PRINT_ERROR_FILE_OPEN(filename);
+    return false;
+  }
+
+  const float descr = 0.f;
+  data.isCalibrated = true;
+  int nCams;
+  file >> nCams;
+  for(int iCam = 0; iCam < nCams; iCam++)
+  {
+    int width,height,nKeys;
+    double focal;
+    file >> width >> height >> focal >> nKeys;
+    auto cam = make_unique<StandardCamera>();
+    cam->setImage("",width,height);
+    if(focal > 0.)
+      cam->setFocal(focal);
+    else
+      data.isCalibrated = false;
+    cam->resizeFeatures(nKeys,1);
+    for(int i = 0; i < nKeys; i++)
+    {
+      double x,y,scale,orientation;
+      file >> x >> y >> scale >> orientation;
+      cam->setFeature(i,x,y,scale,orientation,&descr);
+    }
+    data.cams.push_back(std::move(cam));
+  }
+
+  int nPairs;
+  file >> nPairs;
+  for(int iPair = 0; iPair < nPairs; iPair++)
+  {
+    IntPair camsIdx;
+    int nMatches;
+    file >> camsIdx.first >> camsIdx.second >> nMatches;
+    auto& pair = data.pairs[camsIdx];
+    auto& labels = data.labels[camsIdx];
+    pair.matches.resize(nMatches);
+    pair.dists.resize(nMatches);
+    labels.resize(nMatches);
+    for(int i = 0; i < nMatches; i++)
+    {
+      file >> pair.matches[i].first >> pair.matches[i].second >> pair.dists[i]
+        >> labels[i];
+    }
+  }
+
+  if(!file)
+  {
+    YASFM_PRINT_ERROR("Could not parse:\n" << filename);
+    return false;
+  }
+  return true;
+}
+
+/// Verifier of all the pairs.
+typedef void(*VerifyFunction)(const ptr_vector<Camera>& cams,
+  pair_umap<CameraPair> *pairs);
+
+void verifyEpipolar7pt(const ptr_vector<Camera>& cams,pair_umap<CameraPair> *pairs)
+{
+  verifyMatchesEpipolar(OptionsRANSAC(2048,sqrt(5.),16),false,false,cams,pairs);
+}
+
+void verifyEpipolar5pt(const ptr_vector<Camera>& cams,pair_umap<CameraPair> *pairs)
+{
+  verifyMatchesEpipolar(OptionsRANSAC(2048,sqrt(5.),16),false,true,cams,pairs);
+}
+
+void verifyGeometrically(const ptr_vector<Camera>& cams,pair_umap<CameraPair> *pairs)
+{
+  verifyMatchesGeometrically(OptionsGeometricVerification(),false,cams,pairs);
+}
+
+/// Verify copy of the pairs and print speed, precision and recall of the matches.
+void runVerifier(const string& name,VerifyFunction verify,const LabelledPairs& data)
+{
+  pair_umap<CameraPair> pairs(data.pairs);
+  PerfCounters counters;
+  {
+    PerfRegion region(&counters);
+    verify(data.cams,&pairs);
+  }
+  double time = counters.values().seconds;
+
+  size_t nMatches = 0;
+  for(const auto& entry : data.pairs)
+    nMatches += entry.second.matches.size();
+
+  size_t nTruePositive = 0,nFalsePositive = 0,nFalseNegative = 0;
+  for(const auto& entry : data.pairs)
+  {
+    const auto& matches = entry.second.matches;
+    const auto& labels = data.labels.at(entry.first);
+    pair_umap<int> matchIdx;
+    for(int i = 0; i < static_cast<int>(matches.size()); i++)
+      matchIdx[matches[i]] = i;
+
+    vector<bool> isKept(matches.size(),false);
+    auto it = pairs.find(entry.first);
+    if(it != pairs.end())
+    {
+      for(const auto& match : it->second.matches)
+        isKept[matchIdx[match]] = true;
+    }
+
+    for(size_t i = 0; i < matches.size(); i++)
+    {
+      if(labels[i] == labelUnknown)
+        continue;
+      bool isCorrect = labels[i] != labelOutlier;
+      if(isKept[i] && isCorrect)
+        nTruePositive++;
+      else if(isKept[i])
+        nFalsePositive++;
+      else if(isCorrect)
+        nFalseNegative++;
+    }
+  }
+
+  double precision = (nTruePositive + nFalsePositive == 0) ? 1. :
+    double(nTruePositive) / (nTruePositive + nFalsePositive);
+  double recall = (nTruePositive + nFalseNegative == 0) ? 1. :
+    double(nTruePositive) / (nTruePositive + nFalseNegative);
+  cout << name << "\tpairs/s: " << data.pairs.size() / time
+    << "\tkept pairs: " << pairs.size()
+    << "\tprecision: " << precision
+    << "\trecall: " << recall << "\n";
+  cout << "\t" << formatPerfCounters(counters.values(),double(nMatches),"match") << "\n";
+}
+
+} // namespace
+
+int runVerificationBenchmark(int argc,char **argv)
+{
+  LabelledPairs data;
+  int nPairs = (argc > 0) ? atoi(argv[0]) : 200;
+  if(nPairs > 0)
+  {
+    generatePairs(nPairs,&data);
+  } else if(!readLabelledPairs(argv[0],&data))
+  {
+    cout << "Usage: verify [nPairs | labelled_pairs.txt]\n";
+    return EXIT_FAILURE;
+  }
+
+  size_t nMatches = 0;
+  for(const auto& entry : data.pairs)
+    nMatches += entry.second.matches.size();
+  cout << data.cams.size() << " cameras, " << data.pairs.size() << " pairs, "
+    << nMatches << " matches\n";
+
+  runVerifier("epipolar 7pt",&verifyEpipolar7pt,data);
+  if(data.isCalibrated)
+    runVerifier("epipolar 5pt",&verifyEpipolar5pt,data);
+  runVerifier("geometric",&verifyGeometrically,data);
+
+  return EXIT_SUCCESS;
+}
@@ -32,6 +32,11 @@
 #include "YASFM/options_types.h"
 #include "YASFM/utils_io.h"
 #include "YASFM/image_similarity.h"
+#include "YASFM/gps.h"
+#include "YASFM/pair_screening.h"
+#include "YASFM/incremental_smoothing.h"
+#include "YASFM/logging.h"
+#include "YASFM/memory_budget.h"
 #include "Eigen/Dense"
 
 using namespace yasfm;
@@ -49,13 +54,35 @@ using std::string;
 /// All options.
 /*
 Fields:
+// Per pair and per camera messages are aggregated into summaries written with
+// this period (seconds). Non-positive value writes every message.
+double logSummaryPeriod;
+// Memory limit of the whole process in MB shared by all the stages (see
+// MemoryBudget). Non-positive value means unlimited.
+int memoryBudgetMB;
 string ccdDBFilename;
 OptionsSIFTGPU sift;
+// File with dimensions of the images (see readImgDimsManifest). It is written after
+// reading the images when it does not exist. Empty string disables it.
+string imgDimsManifest;
 int maxVocabularySize;
+// Find similar cameras using global descriptors instead of the dense tf-idf
+// similarity matrix. Use for large collections.
+bool useGlobalRetrieval;
+OptionsGlobalRetrieval globalRetrieval;
 int nSimilarCamerasToMatch;
+// Cameras which both have GPS in EXIF and are further apart than this are not
+// considered similar. Units are meters. Non-positive value disables it.
+double gpsRadius;
+// Screen the similar pairs using coarse features before matching the full ones.
+bool usePairScreening;
+OptionsPairScreening pairScreening;
 OptionsFLANN matchingFLANN;
 // Min number of matches defining a poorly matched pair. Default: 16.
 int minNumPairwiseMatches;
+// Match and verify pairs in the order of similarity and stop matching an image
+// once it has this many verified pairs. Non-positive value matches all pairs.
+int nVerifiedPairsToStopMatching;
 OptionsGeometricVerification geometricVerification;
 // The error is symmetric distance. Units are pixels.
 OptionsRANSAC epipolarVerification;
@@ -64,6 +91,9 @@ OptionsRANSAC initialPairRelativePose;
 // Units of the error are pixels.
 OptionsRANSAC homography;
 double minInitPairHomographyProportion;
+// Only this many pairs with the most matches are scored by homography when
+// choosing an initial pair. Non-positive value means all.
+int maxInitPairCandidates;
 // The error is reprojection error. Units are pixels.
 OptionsRANSAC absolutePose;
 int minNumCamToSceneMatches;
@@ -71,6 +101,10 @@ int minNumCamToSceneMatches;
 // and then finds all cameras with N*wellMatchedCamsFactor matches. Default: 0.75
 double wellMatchedCamsFactor;
 OptionsBundleAdjustment bundleAdjust;
+// Keep the reconstruction optimized by incremental smoothing instead of running
+// full bundle adjustment after every batch of added cameras.
+bool useIncrementalSmoothing;
+OptionsIncrementalSmoothing incrementalSmoothing;
 double pointsReprojErrorThresh;
 // Consider a ray from a camera center through a keypoint.
 // Consider next, the largest angle between all such rays
@@ -91,14 +125,27 @@ class IncrementalOptions : public OptionsWrapper
 public:
   IncrementalOptions()
   {
+    opt.emplace("logSummaryPeriod",make_unique<OptTypeWithVal<double>>(5.));
+    opt.emplace("memoryBudgetMB",make_unique<OptTypeWithVal<int>>(0));
     opt.emplace("ccdDBFilename",
       make_unique<OptTypeWithVal<string>>("../resources/camera_ccd_widths.txt"));
     
     OptionsWrapperPtr sift = make_shared<OptionsSIFTGPU>();
     opt.emplace("sift",make_unique<OptTypeWithVal<OptionsWrapperPtr>>(sift));
 
+    opt.emplace("imgDimsManifest",make_unique<OptTypeWithVal<string>>(""));
     opt.emplace("maxVocabularySize",make_unique<OptTypeWithVal<int>>(15000));
+    opt.emplace("useGlobalRetrieval",make_unique<OptTypeWithVal<bool>>(false));
+    OptionsWrapperPtr globalRetrieval = make_shared<OptionsGlobalRetrieval>();
+    opt.emplace("globalRetrieval",
+      make_unique<OptTypeWithVal<OptionsWrapperPtr>>(globalRetrieval));
     opt.emplace("nSimilarCamerasToMatch",make_unique<OptTypeWithVal<int>>(20));
+    opt.emplace("gpsRadius",make_unique<OptTypeWithVal<double>>(0.));
+
+    opt.emplace("usePairScreening",make_unique<OptTypeWithVal<bool>>(false));
+    OptionsWrapperPtr pairScreening = make_shared<OptionsPairScreening>();
+    opt.emplace("pairScreening",
+      make_unique<OptTypeWithVal<OptionsWrapperPtr>>(pairScreening));
 
     int minNumPairwiseMatches = 16;
     OptionsWrapperPtr matchingFLANN = make_shared<OptionsFLANN>();
@@ -106,6 +153,7 @@ public:
       make_unique<OptTypeWithVal<OptionsWrapperPtr>>(matchingFLANN));
     opt.emplace("minNumPairwiseMatches",
       make_unique<OptTypeWithVal<int>>(minNumPairwiseMatches));
+    opt.emplace("nVerifiedPairsToStopMatching",make_unique<OptTypeWithVal<int>>(-1));
 
     OptionsWrapperPtr geometricVerification = make_shared<OptionsGeometricVerification>();
     opt.emplace("geometricVerification",
@@ -124,6 +172,7 @@ public:
     opt.emplace("homography",
       make_unique<OptTypeWithVal<OptionsWrapperPtr>>(homography));
     opt.emplace("minInitPairHomographyProportion",make_unique<OptTypeWithVal<double>>(0.5));
+    opt.emplace("maxInitPairCandidates",make_unique<OptTypeWithVal<int>>(100));
 
     OptionsWrapperPtr absolutePose = make_shared<OptionsRANSAC>(4096,4.,16,0.999999);
     opt.emplace("absolutePose",
@@ -136,6 +185,11 @@ public:
     OptionsWrapperPtr bundleAdjust = make_shared<OptionsBundleAdjustment>();
     opt.emplace("bundleAdjust",
       make_unique<OptTypeWithVal<OptionsWrapperPtr>>(bundleAdjust));
+
+    opt.emplace("useIncrementalSmoothing",make_unique<OptTypeWithVal<bool>>(false));
+    OptionsWrapperPtr incrementalSmoothing = make_shared<OptionsIncrementalSmoothing>();
+    opt.emplace("incrementalSmoothing",
+      make_unique<OptTypeWithVal<OptionsWrapperPtr>>(incrementalSmoothing));
       
     opt.emplace("pointsReprojErrorThresh",make_unique<OptTypeWithVal<double>>(8.));
     opt.emplace("rayAngleThresh",make_unique<OptTypeWithVal<double>>(2.));
@@ -163,12 +217,14 @@ public:
 };
 
 void runSFM(const IncrementalOptions& opt,const string& outDir,
-  const vector<bool>& isCalibrated,const ArrayXXd& homographyScores,
+  const vector<bool>& isCalibrated,HomographyProportions *homographyProportions,
   const uset<int>& camsToIgnoreForInitialization,uset<int> *pexploredCams,
   Dataset *pdata);
 
 int main(int argc,const char* argv[])
 {
+  ScopedLoggerStop stopLogger;
+
   // ======================================
   // See the description of this variable.
   // Camera::maxDescrInMemoryTotal_ = 5000000;
@@ -189,9 +245,23 @@ int main(int argc,const char* argv[])
 
   opt.write(joinPaths(dir,"options.txt"));
 
+  if(opt.get<double>("logSummaryPeriod") > 0.)
+  {
+    logger().setSink(
+      make_unique<SummaryLogSink>(cout,opt.get<double>("logSummaryPeriod")));
+  }
+  if(opt.get<int>("memoryBudgetMB") > 0)
+    memoryBudget().setLimit(size_t(opt.get<int>("memoryBudgetMB")) << 20);
+
   Dataset data(dir);
 
-  data.addCameras<StandardCameraRadial>(imgsSubdir);
+  umap<string,IntPair> imgDims;
+  const string& imgDimsManifest = opt.get<string>("imgDimsManifest");
+  bool hasImgDims = !imgDimsManifest.empty() && ifstream(imgDimsManifest).is_open() &&
+    readImgDimsManifest(imgDimsManifest,&imgDims);
+  data.addCameras<StandardCameraRadial>(imgsSubdir,imgDims);
+  if(!imgDimsManifest.empty() && !hasImgDims)
+    writeImgDimsManifest(imgDimsManifest,data.cams());
   // -> the principal point is always set to the
   // image center in StandardCamera
 
@@ -210,6 +280,9 @@ int main(int argc,const char* argv[])
       cam->constrainFocal(focals[i],opt.get<double>("focalConstraintWeight"));
     }
   }
+  bool useGPS = opt.get<double>("gpsRadius") > 0.;
+  if(useGPS)
+    findGPSInEXIF(true,&data.cams());
 
   detectSiftGPU(opt.getOpt<OptionsSIFTGPU>("sift"),&data.cams());
   data.readKeysColors();
@@ -218,42 +291,82 @@ int main(int argc,const char* argv[])
   
   cout << "Looking for similar camera pairs.\n";
   bool verbose = true;
-  findSimilarCameraPairs(data.cams(),opt.get<int>("maxVocabularySize"),
-    opt.get<int>("nSimilarCamerasToMatch"),verbose,&data.queries());
+  // Stays empty with global retrieval. GPS then only prunes the pairs below.
+  MatrixXf similarity;
+  if(opt.get<bool>("useGlobalRetrieval"))
+  {
+    findSimilarCameraPairs(opt.getOpt<OptionsGlobalRetrieval>("globalRetrieval"),
+      data.cams(),opt.get<int>("nSimilarCamerasToMatch"),&data.queries());
+  } else
+  {
+    VisualVocabulary voc;
+    computeImagesSimilarity(data.cams(),opt.get<int>("maxVocabularySize"),verbose,
+      &similarity,&voc);
+    if(useGPS)
+      weightSimilarityByGPS(data.cams(),opt.get<double>("gpsRadius"),&similarity);
+    findSimilarCameraPairs(similarity,opt.get<int>("nSimilarCamerasToMatch"),
+      &data.queries());
+  }
+  if(useGPS)
+  {
+    int nPruned = pruneCameraPairsByGPS(data.cams(),opt.get<double>("gpsRadius"),
+      &data.queries());
+    cout << "Pruned " << nPruned << " camera pairs by GPS.\n";
+  }
 
   data.writeASCII("similar.txt");
   //data.readASCII("similar.txt");
 
-  matchFeatFLANN(opt.getOpt<OptionsFLANN>("matchingFLANN"),data.cams(),
-    data.queries(),&data.pairs());
-  //matchFeatFLANN(opt.getOpt<OptionsFLANN>("matchingFLANN"),data.cams(),&data.pairs());
-  removePoorlyMatchedPairs(opt.get<int>("minNumPairwiseMatches"),&data.pairs());
-  data.clearDescriptors();
-
-  data.writeASCII("tentatively_matched.txt");
-  //data.readASCII("tentatively_matched.txt");
+  if(opt.get<bool>("usePairScreening"))
+  {
+    cout << "Screening similar camera pairs.\n";
+    ptr_vector<Camera> coarseCams;
+    detectCoarseFeatures(opt.getOpt<OptionsPairScreening>("pairScreening"),
+      data.cams(),&coarseCams);
+    screenPairs(opt.getOpt<OptionsPairScreening>("pairScreening"),coarseCams,
+      &data.queries());
+    data.writeASCII("screened.txt");
+  }
 
-  /*verifyMatchesGeometrically(
-    opt.getOpt<OptionsGeometricVerification>("geometricVerification"),
-    data.cams(),&data.pairs());*/
   bool useCalibratedEpipolarVerif = false;
-  verifyMatchesEpipolar(opt.getOpt<OptionsRANSAC>("epipolarVerification"),
-    useCalibratedEpipolarVerif,data.cams(),&data.pairs());
+  if(opt.get<int>("nVerifiedPairsToStopMatching") > 0)
+  {
+    matchFeatFLANNOrdered(opt.getOpt<OptionsFLANN>("matchingFLANN"),
+      opt.getOpt<OptionsRANSAC>("epipolarVerification"),useCalibratedEpipolarVerif,
+      opt.get<int>("minNumPairwiseMatches"),opt.get<int>("nVerifiedPairsToStopMatching"),
+      data.cams(),similarity,data.queries(),&data.pairs());
+    data.clearDescriptors();
+  } else
+  {
+    matchFeatFLANN(opt.getOpt<OptionsFLANN>("matchingFLANN"),data.cams(),
+      data.queries(),&data.pairs());
+    //matchFeatFLANN(opt.getOpt<OptionsFLANN>("matchingFLANN"),data.cams(),&data.pairs());
+    removePoorlyMatchedPairs(opt.get<int>("minNumPairwiseMatches"),&data.pairs());
+    data.clearDescriptors();
+
+    data.writeASCII("tentatively_matched.txt");
+    //data.readASCII("tentatively_matched.txt");
+
+    /*verifyMatchesGeometrically(
+      opt.getOpt<OptionsGeometricVerification>("geometricVerification"),
+      data.cams(),&data.pairs());*/
+    verifyMatchesEpipolar(opt.getOpt<OptionsRANSAC>("epipolarVerification"),
+      useCalibratedEpipolarVerif,data.cams(),&data.pairs());
+  }
   
+  // The pairs stay as they are from now on, so the memory budget may spill them.
+  // twoViewMatchesToNViewMatches() does not touch its reference to them after
+  // making room, and nothing else holds one.
+  data.setPairsSpillable(true);
   data.writeASCII("matched.txt");
   //data.readASCII("matched.txt");
 
-  cout << "Computing homographies of verified pairs.\n";
-  ArrayXXd homographyProportion;
-  computeHomographyInliersProportion(opt.getOpt<OptionsRANSAC>("homography"),
-    data.cams(),data.pairs(),
-    &homographyProportion);
-
   cout << "Searching for N view matches ... ";
   twoViewMatchesToNViewMatches(data.cams(),data.pairs(),
     &data.nViewMatches());
   cout << "found " << data.nViewMatches().size() << "\n";
-  data.pairs().clear(); // No need for 2 view matches anymore.
+  data.clearPairs(); // No need for 2 view matches anymore.
+  data.setPairsSpillable(false);
 
   vector<bool> isCalibrated(data.numCams(),false);
   for(int i = 0; i < data.numCams(); i++)
@@ -262,17 +375,10 @@ int main(int argc,const char* argv[])
     isCalibrated[i] = cam->f() > 0.;
   }
 
-  ArrayXXd homographyScores(homographyProportion.rows(),homographyProportion.cols());
-  for(int c = 0; c < homographyProportion.cols(); c++)
-  {
-    for(int r = 0; r < homographyProportion.rows(); r++)
-    {
-      if(homographyProportion(r,c) == 0.)
-        homographyScores(r,c) = DBL_MAX;
-      else
-        homographyScores(r,c) = 1. / homographyProportion(r,c);
-    }
-  }
+  // Homographies are estimated only for the initial pair candidates and
+  // remembered for the next models.
+  HomographyProportions homographyProportions(opt.getOpt<OptionsRANSAC>("homography"),
+    data.cams(),data.nViewMatches());
 
   int modelId = 0;
   uset<int> exploredCams;
@@ -285,7 +391,7 @@ int main(int argc,const char* argv[])
 
     Dataset currData = data;
     uset<int> exploredCamsCurr;
-    runSFM(opt,currOutDir,isCalibrated,homographyScores,exploredCams,
+    runSFM(opt,currOutDir,isCalibrated,&homographyProportions,exploredCams,
       &exploredCamsCurr,&currData);
     exploredCams.insert(exploredCamsCurr.begin(),exploredCamsCurr.end());
 
@@ -308,10 +414,15 @@ int main(int argc,const char* argv[])
     << "  " << modelId << " models reconstructed.\n"
     << "  " << data.cams().size() - exploredCams.size()
     << " out of " << data.cams().size() << " cameras left unexplored.\n";
+  if(memoryBudget().limit() > 0)
+  {
+    YASFM_LOG(LogLevelInfo,"Memory budget released "
+      << memoryBudget().nBytesReleased() << " bytes in total");
+  }
 }
 
 void runSFM(const IncrementalOptions& opt,const string& outDir,
-  const vector<bool>& isCalibrated,const ArrayXXd& homographyScores,
+  const vector<bool>& isCalibrated,HomographyProportions *homographyProportions,
   const uset<int>& camsToIgnoreForInitialization,uset<int> *pexploredCams,
   Dataset *pdata)
 {
@@ -319,17 +430,16 @@ void runSFM(const IncrementalOptions& opt,const string& outDir,
   auto& data = *pdata;
   const auto& baOpt = opt.getOpt<OptionsBundleAdjustment>("bundleAdjust");
 
-  double minPairScore = 1. / opt.get<double>("minInitPairHomographyProportion");
-
-  cout << "Choosing initial pair ... ";
   IntPair initPair = chooseInitialCameraPair(opt.get<int>("minNumPairwiseMatches"),
-    minPairScore,isCalibrated,camsToIgnoreForInitialization,
-    data.nViewMatches(),homographyScores);
-  cout << "[" << initPair.first << "," << initPair.second << "]\n";
+    opt.get<double>("minInitPairHomographyProportion"),
+    opt.get<int>("maxInitPairCandidates"),isCalibrated,camsToIgnoreForInitialization,
+    homographyProportions);
+  YASFM_LOG(LogLevelInfo,"Choosing initial pair ... "
+    << "[" << initPair.first << "," << initPair.second << "]");
 
   if(initPair.first < 0 || initPair.second < 0)
   {
-    cout << __func__ << ": No good pairs for initialization\n";
+    YASFM_LOG(LogLevelWarning,__func__ << ": No good pairs for initialization");
     return;
   }
 
@@ -339,8 +449,8 @@ void runSFM(const IncrementalOptions& opt,const string& outDir,
     double maxDim = std::max(cam.imgWidth(),cam.imgHeight());
     double focalPx = opt.get<double>("defaultFocalDividedBySensorSize") * maxDim;
     cam.setFocal(focalPx);
-    cout << "Initial focal of the first camera assumed to be " 
-      << focalPx << " pixels\n";
+    YASFM_LOG(LogLevelInfo,"Initial focal of the first camera assumed to be "
+      << focalPx << " pixels");
   }
 
   if(!isCalibrated[initPair.second])
@@ -349,8 +459,8 @@ void runSFM(const IncrementalOptions& opt,const string& outDir,
     double maxDim = std::max(cam.imgWidth(),cam.imgHeight());
     double focalPx = opt.get<double>("defaultFocalDividedBySensorSize") * maxDim;
     cam.setFocal(focalPx);
-    cout << "Initial focal of the second camera assumed to be "
-      << focalPx << " pixels\n";
+    YASFM_LOG(LogLevelInfo,"Initial focal of the second camera assumed to be "
+      << focalPx << " pixels");
   }
 
   initReconstructionFromCalibratedCamPair(
@@ -359,6 +469,13 @@ void runSFM(const IncrementalOptions& opt,const string& outDir,
 
   bundleAdjust(baOpt,&data.cams(),&data.pts());
 
+  bool useSmoother = opt.get<bool>("useIncrementalSmoothing");
+  // The smoother replaces bundleAdjust so it has to use the same loss.
+  OptionsIncrementalSmoothing smootherOpt =
+    opt.getOpt<OptionsIncrementalSmoothing>("incrementalSmoothing");
+  smootherOpt.get<bool>("robustify") = baOpt.get<bool>("robustify");
+  IncrementalSmoother smoother(smootherOpt);
+
   exploredCams.insert(initPair.first);
   exploredCams.insert(initPair.second);
   while(data.cams().size() > exploredCams.size())
@@ -377,8 +494,6 @@ void runSFM(const IncrementalOptions& opt,const string& outDir,
     {
       exploredCams.insert(camIdx);
       vector<int> inliers;
-      cout << "Trying to resect camera " << camIdx << " using " <<
-        camToSceneMatches[camIdx].size() << " matches ... ";
       //bool success = resectCamera5AndHalfPtRANSAC(opt.absolutePose_,camToSceneMatches[camIdx],
       //  data.points().ptCoord(),&data.cam(camIdx),&inliers);
       bool success = resectCamera6ptLSRANSAC(
@@ -390,16 +505,21 @@ void runSFM(const IncrementalOptions& opt,const string& outDir,
       int maxDim = std::max(cam->imgWidth(),cam->imgHeight());
       if(success && (cam->f() > 0.1*maxDim))
       {
-        cout << "camera successfully added.\n";
+        YASFM_LOG_TAGGED(LogLevelVerbose,"resected cameras",1.,
+          "Trying to resect camera " << camIdx << " using " <<
+          camToSceneMatches[camIdx].size() << " matches ... camera successfully added.");
         vector<int> ptIdxs;
         unzipPairsVectorSecond(camToSceneMatches[camIdx],&ptIdxs);
         data.markCamAsReconstructed(camIdx,ptIdxs,inliers);
 
-        cout << "Bundle adjusting the new camera\n";
+        YASFM_LOG_TAGGED(LogLevelVerbose,"adjusted new cameras",0.,
+          "Bundle adjusting the new camera");
         bundleAdjustOneCam(baOpt,camIdx,&data.cam(camIdx),&data.pts());
       } else
       {
-        cout << "camera could not be added.\n";
+        YASFM_LOG_TAGGED(LogLevelVerbose,"failed resections",1.,
+          "Trying to resect camera " << camIdx << " using " <<
+          camToSceneMatches[camIdx].size() << " matches ... camera could not be added.");
       }
     }
 
@@ -409,27 +529,31 @@ void runSFM(const IncrementalOptions& opt,const string& outDir,
       data.reconstructedCams(),data.cams(),
       &data.nViewMatches(),&matchesToReconstructNow);
 
-    cout << "Reconstructing " << matchesToReconstructNow.size() << " points\n";
+    YASFM_LOG(LogLevelInfo,
+      "Reconstructing " << matchesToReconstructNow.size() << " points");
     reconstructPoints(matchesToReconstructNow,&data.cams(),&data.pts());
     int nPtsRemoved = removeHighReprojErrorPoints(
       opt.get<double>("pointsReprojErrorThresh"),&data.cams(),&data.pts());
-    cout << "Removing " << nPtsRemoved << " points with high reprojection error\n";
+    YASFM_LOG(LogLevelInfo,
+      "Removing " << nPtsRemoved << " points with high reprojection error");
 
     do
     {
-      cout << "Running bundle adjustment with: \n"
+      YASFM_LOG(LogLevelInfo,"Running bundle adjustment with: \n"
         << "  " << data.reconstructedCams().size() << " cams\n"
         << "  " << data.countPtsAlive() << " points\n"
-        << "  " << data.countReconstructedObservations() << " observations\n";
-      bundleAdjust(baOpt,&data.cams(),&data.pts());
+        << "  " << data.countReconstructedObservations() << " observations");
+      if(!useSmoother || smoother.update(&data.cams(),&data.pts()) < 0)
+        bundleAdjust(baOpt,&data.cams(),&data.pts());
       nPtsRemoved = removeHighReprojErrorPoints(
         opt.get<double>("pointsReprojErrorThresh"),&data.cams(),&data.pts());
-      cout << "Removing " << nPtsRemoved << " points with high reprojection error\n";
+      YASFM_LOG(LogLevelInfo,
+        "Removing " << nPtsRemoved << " points with high reprojection error");
     } while(nPtsRemoved > 0);
 
     nPtsRemoved = removeIllConditionedPoints(0.5*opt.get<double>("rayAngleThresh"),
       &data.cams(),&data.pts());
-    cout << "Removing " << nPtsRemoved << " ill conditioned points\n";
+    YASFM_LOG(LogLevelInfo,"Removing " << nPtsRemoved << " ill conditioned points");
 
     writeSFMBundlerFormat(joinPaths(outDir,"bundle" +
       std::to_string(data.reconstructedCams().size()) + ".out"),data);
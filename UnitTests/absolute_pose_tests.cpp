@@ -1,6 +1,8 @@
 #include "stdafx.h"
 #include "CppUnitTest.h"
 #include "absolute_pose.h"
+#include "localization.h"
+#include "standard_camera.h"
 #include "utils_tests.h"
 
 using namespace Microsoft::VisualStudio::CppUnitTestFramework;
@@ -41,6 +43,43 @@ namespace yasfm_tests
       Assert::IsTrue(goodP);
 		}
 
+    TEST_METHOD(resectCameraLSBatchTest)
+    {
+      int nPts = 15;
+      vector<Vector2d> keys;
+      vector<Point> pts(nPts);
+      vector<IntPair> matches;
+
+      Matrix34d P(generateRandomProjection());
+      for(int i = 0; i < nPts; i++)
+      {
+        pts[i].coord = Vector3d::Random();
+        Vector3d proj = P * pts[i].coord.homogeneous();
+        keys.push_back(proj.hnormalized());
+        matches.emplace_back(i,i);
+      }
+      P /= P(2,3);
+
+      // 6pt samples and one with all the matches
+      vector<vector<int>> samples(5);
+      for(int i = 0; i < 5; i++)
+        for(int j = 0; j < 6; j++)
+          samples[i].push_back((2*i + j) % nPts);
+      samples.emplace_back();
+      for(int i = 0; i < nPts; i++)
+        samples.back().push_back(i);
+
+      vector<vector<Matrix34d>> _Ps;
+      resectCameraLSBatch(keys,pts,matches,samples,&_Ps);
+      Assert::IsTrue(_Ps.size() == samples.size());
+      for(auto& samplePs : _Ps)
+      {
+        Assert::IsTrue(samplePs.size() == 1);
+        Matrix34d _P = samplePs[0] / samplePs[0](2,3);
+        Assert::IsTrue((P - _P).norm() < 1e-8);
+      }
+    }
+
     TEST_METHOD(resectCamera5AndHalfPtTest)
     {
       int nPts = 15;
@@ -135,5 +174,52 @@ namespace yasfm_tests
 		}
 	}
 
+	TEST_METHOD(localizeCamerasTest)
+	{
+		Dataset data("../UnitTests/test_dataset");
+		int nModelCams = 4;
+		int nQueries = 2;
+		int nPts = 200;
+
+		// The model cameras see all the points and the queries continue the arc.
+		ptr_vector<Camera> queries;
+		generateArcScene(nModelCams + nQueries,nPts,0.001f,&queries,&data.pts());
+		for(int camIdx = 0; camIdx < nModelCams; camIdx++)
+		{
+			for(auto& pt : data.pts())
+				pt.views.emplace(camIdx,&pt - &data.pts()[0]);
+			data.cams().push_back(std::move(queries[camIdx]));
+		}
+		queries.erase(queries.begin(),queries.begin() + nModelCams);
+		vector<Vector3d> queriesC;
+		for(const auto& query : queries)
+			queriesC.push_back(query->C());
+
+		OptionsLocalization opt;
+		opt.get<bool>("verbose") = false;
+		LocalizationModel model(opt,data);
+		Assert::AreEqual(nPts,model.numIndexedPoints());
+		Assert::AreEqual(128,model.descrDim());
+
+		for(bool useCalibratedQueries : {false,true})
+		{
+			opt.get<bool>("useCalibratedQueries") = useCalibratedQueries;
+			for(auto& query : queries)
+			{
+				auto cam = static_cast<StandardCamera *>(&(*query));
+				cam->setRotation(Matrix3d::Identity());
+				cam->setC(Vector3d::Zero());
+			}
+			vector<LocalizationResult> results;
+			Assert::AreEqual(nQueries,localizeCameras(opt,model,&queries,&results));
+			for(int i = 0; i < nQueries; i++)
+			{
+				Assert::IsTrue(results[i].success);
+				Assert::IsTrue(results[i].inliers.size() > 0.9*nPts);
+				Assert::IsTrue((queries[i]->C() - queriesC[i]).norm() < 0.05);
+			}
+		}
+	}
+
 };
 }
\ No newline at end of file
@@ -1,12 +1,57 @@
 #include "stdafx.h"
 #include "CppUnitTest.h"
 #include "bundle_adjust.h"
+#include "bundle_adjust_schur.h"
 #include "utils_tests.h"
 #include "standard_camera.h"
 #include "absolute_pose.h"
 
 using namespace Microsoft::VisualStudio::CppUnitTestFramework;
 using namespace yasfm;
+using Eigen::AngleAxisd;
+
+namespace
+{
+
+/// Cameras on an arc which all see all the points. The observations have noise
+/// and the cameras and points are perturbed from their true positions.
+void generatePerturbedScene(int nCams,int nPts,ptr_vector<Camera> *pcams,
+  vector<Point> *ppts)
+{
+  auto& cams = *pcams;
+  auto& pts = *ppts;
+  for(int camIdx = 0; camIdx < nCams; camIdx++)
+  {
+    auto cam = make_unique<StandardCamera>("../UnitTests/test_dataset/test0.JPG","");
+    double angle = 0.1*camIdx;
+    cam->setRotation(AngleAxisd(-angle,Vector3d::UnitY()).toRotationMatrix());
+    cam->setC(Vector3d(5.*sin(angle),0.,-5.*cos(angle)));
+    cam->setFocal(1000.);
+    cam->resizeFeatures(nPts,0);
+    cams.push_back(std::move(cam));
+  }
+  pts.resize(nPts);
+  for(int iPt = 0; iPt < nPts; iPt++)
+  {
+    pts[iPt].coord = Vector3d::Random();
+    for(int camIdx = 0; camIdx < nCams; camIdx++)
+    {
+      pts[iPt].views.emplace(camIdx,iPt);
+      Vector2d p = cams[camIdx]->project(pts[iPt]);
+      p += 0.1*Vector2d::Random(); // add noise
+      float dummy;
+      cams[camIdx]->setFeature(iPt,p(0),p(1),0,0,&dummy);
+    }
+    pts[iPt].coord += 0.01*Vector3d::Random();
+  }
+  for(int camIdx = 1; camIdx < nCams; camIdx++)
+  {
+    auto cam = static_cast<StandardCamera *>(&(*cams[camIdx]));
+    cam->setC(cam->C() + 0.01*Vector3d::Random());
+  }
+}
+
+} // namespace
 
 namespace yasfm_tests
 {
@@ -121,5 +166,171 @@ namespace yasfm_tests
       Assert::IsTrue(origErr >= err1);
     }
 
+    TEST_METHOD(bundleAdjustLocalTest)
+    {
+      OptionsBundleAdjustment opt;
+      ptr_vector<Camera> cams;
+      vector<Point> pts;
+
+      int nCams = 4;
+      int nPts = 20;
+      for(int camIdx = 0; camIdx < nCams; camIdx++)
+      {
+        cams.push_back(make_unique<StandardCamera>("../UnitTests/test_dataset/test0.JPG",""));
+        cams.back()->setParams(generateRandomProjection());
+        cams.back()->resizeFeatures(nPts,0);
+      }
+
+      // The first half of the points is seen by all the cameras, the second
+      // half only by the last two which are not in the window.
+      pts.resize(nPts);
+      for(int iPt = 0; iPt < nPts; iPt++)
+      {
+        pts[iPt].coord = Vector3d::Random();
+        for(int camIdx = (iPt < nPts/2) ? 0 : 2; camIdx < nCams; camIdx++)
+        {
+          pts[iPt].views.emplace(camIdx,iPt);
+          cams[camIdx]->visiblePoints().push_back(iPt);
+          Vector2d p = cams[camIdx]->project(pts[iPt]);
+          p += 0.1*Vector2d::Random(); // add noise
+          float dummy;
+          cams[camIdx]->setFeature(iPt,p(0),p(1),0,0,&dummy);
+        }
+      }
+
+      double origErr = computeAverageReprojectionError(cams,pts);
+
+      uset<int> window = {0,1};
+      ptr_vector<Camera> cams1;
+      for(int i = 0; i < nCams; i++)
+        cams1.push_back(cams[i]->clone());
+      vector<Point> pts1 = pts;
+      bundleAdjustLocal(opt,window,&cams1,&pts1);
+      double err1 = computeAverageReprojectionError(cams1,pts1);
+      Assert::IsTrue(origErr >= err1);
+      for(int i = 2; i < nCams; i++)
+      {
+        Matrix34d P = cams[i]->P(),P1 = cams1[i]->P();
+        Assert::IsTrue(P == P1);
+      }
+      for(int i = nPts/2; i < nPts; i++)
+        Assert::IsTrue(pts[i].coord == pts1[i].coord);
+    }
+
+    TEST_METHOD(bundleAdjustSchurMixedPrecisionTest)
+    {
+      OptionsBundleAdjustment opt;
+      opt.get<bool>("useSchurSolver") = true;
+      ptr_vector<Camera> cams;
+      vector<Point> pts;
+
+      int nCams = 4;
+      int nPts = 50;
+      for(int camIdx = 0; camIdx < nCams; camIdx++)
+      {
+        cams.push_back(make_unique<StandardCamera>("../UnitTests/test_dataset/test0.JPG",""));
+        cams.back()->setParams(generateRandomProjection());
+        cams.back()->resizeFeatures(nPts,0);
+      }
+
+      pts.resize(nPts);
+      for(int iPt = 0; iPt < nPts; iPt++)
+      {
+        pts[iPt].coord = Vector3d::Random();
+        for(int camIdx = 0; camIdx < nCams; camIdx++)
+        {
+          pts[iPt].views.emplace(camIdx,iPt);
+          Vector2d p = cams[camIdx]->project(pts[iPt]);
+          p += 0.1*Vector2d::Random(); // add noise
+          float dummy;
+          cams[camIdx]->setFeature(iPt,p(0),p(1),0,0,&dummy);
+        }
+      }
+
+      double origErr = computeAverageReprojectionError(cams,pts);
+
+      ptr_vector<Camera> cams1;
+      for(int i = 0; i < nCams; i++)
+        cams1.push_back(cams[i]->clone());
+      vector<Point> pts1 = pts;
+      bundleAdjust(opt,&cams1,&pts1);
+      double err1 = computeAverageReprojectionError(cams1,pts1);
+
+      opt.get<bool>("schurMixedPrecision") = true;
+      ptr_vector<Camera> cams2;
+      for(int i = 0; i < nCams; i++)
+        cams2.push_back(cams[i]->clone());
+      vector<Point> pts2 = pts;
+      bundleAdjust(opt,&cams2,&pts2);
+      double err2 = computeAverageReprojectionError(cams2,pts2);
+
+      Assert::IsTrue(origErr >= err2);
+      Assert::IsTrue(std::abs(err1 - err2) <= 1e-3*err1);
+    }
+
+    TEST_METHOD(bundleAdjustSchurTest)
+    {
+      int nCams = 5;
+      int nPts = 50;
+      ptr_vector<Camera> cams;
+      vector<Point> pts;
+      generatePerturbedScene(nCams,nPts,&cams,&pts);
+      double origErr = computeAverageReprojectionError(cams,pts);
+
+      // The default tolerances stop before the first step on this small problem.
+      OptionsBundleAdjustment ceresOpt;
+      auto& solverOptions = ceresOpt.get<ceres::Solver::Options>("solverOptions");
+      solverOptions.function_tolerance = 1e-8;
+      solverOptions.parameter_tolerance = 1e-8;
+      OptionsBundleAdjustment schurOpt = ceresOpt;
+      schurOpt.get<bool>("useSchurSolver") = true;
+
+      // The Schur solver has to handle the problem itself (no fallback to ceres).
+      {
+        ptr_vector<Camera> cams1;
+        for(int i = 0; i < nCams; i++)
+          cams1.push_back(cams[i]->clone());
+        vector<Point> pts1 = pts;
+        vector<bool> constantCams(nCams,false),constantPts(nPts,false);
+        Assert::IsTrue(bundleAdjustSchur(schurOpt,constantCams,constantPts,&cams1,&pts1));
+      }
+
+      typedef void (*BundleAdjustFunc)(const OptionsBundleAdjustment&,
+        ptr_vector<Camera>*,vector<Point>*);
+      BundleAdjustFunc funcs[3] = {bundleAdjust,bundleAdjustCams,bundleAdjustPoints};
+      for(int f = 0; f < 3; f++)
+      {
+        ptr_vector<Camera> cams1,cams2;
+        for(int i = 0; i < nCams; i++)
+        {
+          cams1.push_back(cams[i]->clone());
+          cams2.push_back(cams[i]->clone());
+        }
+        vector<Point> pts1 = pts,pts2 = pts;
+        funcs[f](ceresOpt,&cams1,&pts1);
+        funcs[f](schurOpt,&cams2,&pts2);
+        double err1 = computeAverageReprojectionError(cams1,pts1);
+        double err2 = computeAverageReprojectionError(cams2,pts2);
+        Assert::IsTrue(err2 < origErr);
+        Assert::IsTrue(std::abs(err1 - err2) <= 1e-2*err1);
+
+        for(int i = 0; i < nCams; i++)
+        {
+          Matrix34d P = cams[i]->P(),P2 = cams2[i]->P();
+          if(funcs[f] == bundleAdjustPoints)
+            Assert::IsTrue(P == P2);
+          else if(funcs[f] == bundleAdjustCams)
+            Assert::IsTrue(P2.isApprox(cams1[i]->P(),1e-4));
+        }
+        for(int i = 0; i < nPts; i++)
+        {
+          if(funcs[f] == bundleAdjustCams)
+            Assert::IsTrue(pts[i].coord == pts2[i].coord);
+          else if(funcs[f] == bundleAdjustPoints)
+            Assert::IsTrue(pts2[i].coord.isApprox(pts1[i].coord,1e-4));
+        }
+      }
+    }
+
 	};
 }
\ No newline at end of file
@@ -2,7 +2,9 @@
 #include "CppUnitTest.h"
 
 #include "image_similarity.h"
+#include "gps.h"
 #include "standard_camera.h"
+#include "utils.h"
 
 using namespace Microsoft::VisualStudio::CppUnitTestFramework;
 
@@ -128,5 +130,101 @@ namespace yasfm_tests
       Assert::IsTrue(tfidf(0,0) == 1.f * idf(0));
     }
 
+    TEST_METHOD(pruneCameraPairsByGPSTest)
+    {
+      Vector3d origin(50.,14.,200.);
+      Vector3d enu = convertGPSToENU(origin,Vector3d(50.001,14.,200.));
+      Assert::IsTrue(abs(enu(0)) < 1e-6);
+      Assert::IsTrue(abs(enu(1) - 111.2) < 0.1);
+
+      ptr_vector<Camera> cams;
+      for(int i = 0; i < 4; i++)
+        cams.emplace_back(new StandardCamera);
+      cams[0]->setGPS(origin);
+      cams[1]->setGPS(Vector3d(50.001,14.,200.));
+      cams[2]->setGPS(Vector3d(50.1,14.,200.));
+
+      vector<set<int>> queries(4);
+      queries[1].insert(0);
+      queries[2].insert(0);
+      queries[2].insert(1);
+      queries[3].insert(2);
+      int nRemoved = pruneCameraPairsByGPS(cams,150.,&queries);
+      Assert::IsTrue(nRemoved == 2);
+      Assert::IsTrue(queries[1].size() == 1);
+      Assert::IsTrue(queries[2].empty());
+      Assert::IsTrue(queries[3].size() == 1);
+
+      MatrixXf similarity = MatrixXf::Ones(4,4);
+      weightSimilarityByGPS(cams,150.,&similarity);
+      Assert::IsTrue(similarity(0,1) == 1.f);
+      Assert::IsTrue(similarity(1,2) < 0.f);
+      Assert::IsTrue(similarity(2,3) == 1.f);
+    }
+
+    TEST_METHOD(findSimilarCameraPairsGlobalTest)
+    {
+      ptr_vector<Camera> cams;
+      int nCams = 4;
+      int nFeatures = 50;
+      int dim = 128;
+      for(int i = 0; i < nCams; i++)
+      {
+        cams.emplace_back(new StandardCamera);
+        cams[i]->resizeFeatures(nFeatures,dim);
+        for(int iFeat = 0; iFeat < nFeatures; iFeat++)
+        {
+          VectorXf descr = VectorXf::Random(dim);
+          descr.normalize();
+          cams[i]->setFeature(iFeat,0,0,0,0,descr.data());
+        }
+      }
+      for(int i = 0; i < nFeatures; i++)
+      {
+        cams[3]->setFeature(i,0,0,0,0,cams[1]->descr().col(i).data());
+      }
+
+      OptionsGlobalRetrieval opt;
+      opt.get<int>("nCenters") = 16;
+      opt.get<bool>("verbose") = false;
+      vector<set<int>> queries;
+      findSimilarCameraPairs(opt,cams,1,&queries);
+      Assert::IsTrue(queries.size() == nCams);
+      Assert::IsTrue(queries[3].count(1) == 1);
+    }
+
+    TEST_METHOD(searchSmallWorldGraphTest)
+    {
+      int nPoints = 2000;
+      int dim = 16;
+      int k = 10;
+      MatrixXf points = MatrixXf::Random(dim,nPoints);
+      for(int i = 0; i < nPoints; i++)
+        points.col(i).normalize();
+      SmallWorldGraph graph;
+      buildSmallWorldGraph(points,8,32,&graph);
+      Assert::IsTrue(graph.neighbors.size() == nPoints);
+
+      int nQueries = 100;
+      MatrixXf queries = points.leftCols(nQueries);
+      vector<vector<int>> nearest;
+      searchSmallWorldGraph(graph,points,queries,k,64,&nearest);
+      Assert::IsTrue(nearest.size() == nQueries);
+
+      int nCorrect = 0;
+      for(int i = 0; i < nQueries; i++)
+      {
+        Assert::IsTrue(nearest[i].size() == k);
+        Assert::IsTrue(nearest[i][0] == i);
+        VectorXf similarity = points.transpose() * queries.col(i);
+        vector<int> idxs(nPoints);
+        quicksort(nPoints,similarity.data(),&idxs[0]);
+        set<int> exact(idxs.end() - k,idxs.end());
+        for(int idx : nearest[i])
+          nCorrect += static_cast<int>(exact.count(idx));
+      }
+      Assert::IsTrue(nCorrect >= 0.9 * nQueries * k);
+    }
+
 	};
 }
\ No newline at end of file
@@ -0,0 +1,106 @@
+#include "stdafx.h"
+#include "CppUnitTest.h"
+
+#include "incremental_smoothing.h"
+#include "absolute_pose.h"
+#include "bundle_adjust.h"
+#include "standard_camera.h"
+#include "utils_tests.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+using namespace yasfm;
+
+namespace yasfm_tests
+{
+  TEST_CLASS(incremental_smoothing_tests)
+  {
+  public:
+
+    TEST_METHOD(updateTest)
+    {
+      int nCams = 5;
+      int nPts = 40;
+      // Cameras on an arc looking at the points.
+      ptr_vector<Camera> cams;
+      for(int camIdx = 0; camIdx < nCams; camIdx++)
+      {
+        auto cam = make_unique<StandardCamera>("../UnitTests/test_dataset/test0.JPG","");
+        double angle = 0.1*camIdx;
+        cam->setRotation(AngleAxisd(-angle,Vector3d::UnitY()).toRotationMatrix());
+        cam->setC(Vector3d(5.*sin(angle),0.,-5.*cos(angle)));
+        cam->setFocal(1000.);
+        cam->resizeFeatures(nPts,0);
+        cams.push_back(std::move(cam));
+      }
+
+      vector<Point> pts(nPts);
+      for(int iPt = 0; iPt < nPts; iPt++)
+      {
+        pts[iPt].coord = Vector3d::Random();
+        for(int camIdx = 0; camIdx < nCams; camIdx++)
+        {
+          Vector2d p = cams[camIdx]->project(pts[iPt]);
+          p += 0.1*Vector2d::Random(); // add noise
+          float dummy;
+          cams[camIdx]->setFeature(iPt,p(0),p(1),0,0,&dummy);
+        }
+        pts[iPt].coord += 0.01*Vector3d::Random();
+      }
+      for(int camIdx = 1; camIdx < nCams; camIdx++)
+      {
+        auto cam = static_cast<StandardCamera *>(&(*cams[camIdx]));
+        cam->setC(cam->C() + 0.01*Vector3d::Random());
+      }
+      // One gross outlier.
+      cams[0]->key(0) += Vector2d(50.,50.);
+
+      for(bool robustify : {false,true})
+      {
+        OptionsBundleAdjustment baOpt;
+        baOpt.get<bool>("robustify") = robustify;
+        OptionsIncrementalSmoothing opt;
+        opt.get<bool>("robustify") = robustify;
+        opt.get<int>("maxIterations") = 10;
+
+        // The smoother starts with the first three cameras and then the remaining
+        // ones get added.
+        ptr_vector<Camera> cams1;
+        for(int i = 0; i < nCams; i++)
+          cams1.push_back(cams[i]->clone());
+        vector<Point> pts1 = pts;
+        for(auto& pt : pts1)
+        {
+          for(int camIdx = 0; camIdx < 3; camIdx++)
+            pt.views.emplace(camIdx,&pt - &pts1[0]);
+        }
+        IncrementalSmoother smoother(opt);
+        Assert::IsTrue(smoother.update(&cams1,&pts1) >= nPts);
+        for(auto& pt : pts1)
+        {
+          for(int camIdx = 3; camIdx < nCams; camIdx++)
+            pt.views.emplace(camIdx,&pt - &pts1[0]);
+        }
+        for(int i = 0; i < 5; i++)
+          Assert::IsTrue(smoother.update(&cams1,&pts1) >= 0);
+
+        ptr_vector<Camera> cams2;
+        for(int i = 0; i < nCams; i++)
+          cams2.push_back(cams[i]->clone());
+        vector<Point> pts2 = pts;
+        for(int iPt = 0; iPt < nPts; iPt++)
+        {
+          for(int camIdx = 0; camIdx < nCams; camIdx++)
+            pts2[iPt].views.emplace(camIdx,iPt);
+        }
+        double origErr = computeAverageReprojectionError(cams2,pts2);
+        bundleAdjust(baOpt,&cams2,&pts2);
+
+        double err1 = computeAverageReprojectionError(cams1,pts1);
+        double err2 = computeAverageReprojectionError(cams2,pts2);
+        Assert::IsTrue(err1 < origErr);
+        Assert::IsTrue(abs(err1 - err2) < 0.05*err2);
+      }
+    }
+
+  };
+}
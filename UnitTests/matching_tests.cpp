@@ -1,7 +1,14 @@
 #include "stdafx.h"
 #include "CppUnitTest.h"
 
+#include <cstdio>
+#include <sstream>
+
 #include "matching.h"
+#include "pair_screening.h"
+#include "product_quantization.h"
+#include "standard_camera.h"
+#include "utils_tests.h"
 
 using namespace Microsoft::VisualStudio::CppUnitTestFramework;
 
@@ -60,5 +67,251 @@ namespace yasfm_tests
       Assert::IsFalse(unique[2]);
     }
 
+    TEST_METHOD(PQIndexTest)
+    {
+      int n = 2000,dim = 16;
+      MatrixXf data = MatrixXf::Random(dim,n);
+      OptionsPQ opt;
+      opt.get<int>("nSubspaces") = 4;
+      opt.get<int>("nLists") = 16;
+      opt.get<int>("nProbes") = 4;
+      PQIndex index;
+      index.build(opt,data);
+      Assert::AreEqual(index.size(),n);
+
+      std::stringstream file;
+      index.write(file);
+      PQIndex indexRead;
+      Assert::IsTrue(indexRead.read(file));
+      Assert::AreEqual(indexRead.size(),n);
+
+      int nFound = 0;
+      for(int i = 0; i < n; i++)
+      {
+        int idxs[2],idxsRead[2];
+        float sqDists[2],sqDistsRead[2];
+        index.knnSearch(data.col(i).data(),2,idxs,sqDists);
+        indexRead.knnSearch(data.col(i).data(),2,idxsRead,sqDistsRead);
+        Assert::IsTrue(sqDists[0] <= sqDists[1]);
+        Assert::AreEqual(idxs[0],idxsRead[0]);
+        if(idxs[0] == i || idxs[1] == i)
+          nFound++;
+      }
+      Assert::IsTrue(nFound > 0.5*n);
+    }
+
+    TEST_METHOD(orderMatchingJobsTest)
+    {
+      // Chain of images 0-1-...-7 matched in an order which reloads everything.
+      int n = 8;
+      ptr_vector<Camera> cams;
+      for(int i = 0; i < n; i++)
+      {
+        cams.push_back(make_unique<StandardCamera>());
+        cams.back()->resizeFeatures(10,4);
+      }
+      vector<set<int>> queries(n);
+      for(int i = 0; i + 1 < n; i++)
+        queries[i+1].insert(i);
+      queries[n-1].insert(0);
+      size_t maxDescrInMemory = 30;
+
+      vector<IntPair> jobs;
+      size_t nLoads = orderMatchingJobs(cams,queries,maxDescrInMemory,&jobs);
+      Assert::AreEqual(size_t(n),jobs.size());
+      Assert::AreEqual(nLoads,predictDescrLoads(cams,jobs,maxDescrInMemory));
+      Assert::IsTrue(nLoads <= size_t(n + 1));
+      for(size_t k = 0; k < jobs.size(); k++)
+      {
+        Assert::IsTrue(queries[jobs[k].second].count(jobs[k].first) == 1);
+        for(size_t l = 0; l < k; l++)
+          Assert::IsTrue(jobs[k] != jobs[l]);
+      }
+
+      vector<IntPair> inputOrder;
+      for(int j = 0; j < n; j++)
+      {
+        for(int i : queries[j])
+          inputOrder.emplace_back(i,j);
+      }
+      Assert::IsTrue(nLoads <= predictDescrLoads(cams,inputOrder,maxDescrInMemory));
+    }
+
+    TEST_METHOD(matchFeatFLANNBatchTest)
+    {
+      int nCams = 5;
+      int nPts = 100;
+      ptr_vector<Camera> cams;
+      vector<Point> pts;
+      generateArcScene(nCams,nPts,0.01f,&cams,&pts);
+      vector<IntPair> jobs;
+      for(int j = 0; j < nCams; j++)
+      {
+        for(int i = 0; i < j; i++)
+          jobs.emplace_back(i,j);
+      }
+      OptionsFLANN opt;
+      opt.get<bool>("verbose") = false;
+      // Exact search so that the results do not depend on the randomized trees.
+      opt.get<flann::IndexParams>("indexParams") = flann::LinearIndexParams();
+
+      opt.get<int>("batchSize") = 1;
+      pair_umap<CameraPair> pairsSeparately;
+      matchFeatFLANN(opt,cams,jobs,&pairsSeparately);
+      Assert::AreEqual(jobs.size(),pairsSeparately.size());
+
+      // Everything in one batch and batches of two images.
+      for(int batchSize : {100000,2*nPts})
+      {
+        opt.get<int>("batchSize") = batchSize;
+        pair_umap<CameraPair> pairs;
+        matchFeatFLANN(opt,cams,jobs,&pairs);
+        Assert::AreEqual(pairsSeparately.size(),pairs.size());
+        for(const auto& entry : pairsSeparately)
+        {
+          const auto& pair = pairs.at(entry.first);
+          Assert::IsTrue(pair.matches.size() > nPts / 2);
+          Assert::IsTrue(pair.matches == entry.second.matches);
+          Assert::IsTrue(pair.dists == entry.second.dists);
+        }
+      }
+    }
+
+    TEST_METHOD(matchFeatFLANNBatchMemoryLimitTest)
+    {
+      int nCams = 5;
+      int nPts = 100;
+      ptr_vector<Camera> cams;
+      vector<Point> pts;
+      // No descriptor noise, the descriptors get written as unsigned chars.
+      generateArcScene(nCams,nPts,0.f,&cams,&pts);
+      // Store the descriptors in files so that they can be released and read again.
+      vector<string> featsFilenames;
+      for(int camIdx = 0; camIdx < nCams; camIdx++)
+      {
+        auto& cam = *cams[camIdx];
+        vector<Vector2d> keys = cam.keys();
+        MatrixXf descr = cam.descr();
+        featsFilenames.push_back(joinPaths("../UnitTests/test_dataset",
+          "batch" + std::to_string(camIdx) + ".feat.gz"));
+        cam.setFeaturesFilename(featsFilenames.back(),false);
+        cam.resizeFeatures(nPts,static_cast<int>(descr.rows()));
+        for(int i = 0; i < nPts; i++)
+          cam.setFeature(i,keys[i](0),keys[i](1),0,0,&descr(0,i));
+        cam.writeFeatures();
+        cam.clearDescriptors();
+      }
+      vector<IntPair> jobs;
+      for(int j = 0; j < nCams; j++)
+      {
+        for(int i = 0; i < j; i++)
+          jobs.emplace_back(i,j);
+      }
+      OptionsFLANN opt;
+      opt.get<bool>("verbose") = false;
+      opt.get<flann::IndexParams>("indexParams") = flann::LinearIndexParams();
+
+      opt.get<int>("batchSize") = 1;
+      pair_umap<CameraPair> pairsSeparately;
+      matchFeatFLANN(opt,cams,jobs,&pairsSeparately);
+
+      // The queries of one batch do not fit into memory together with the target.
+      size_t maxDescrInMemory = Camera::maxDescrInMemoryTotal_;
+      Camera::maxDescrInMemoryTotal_ = 2*nPts;
+      opt.get<int>("batchSize") = 100000;
+      pair_umap<CameraPair> pairs;
+      matchFeatFLANN(opt,cams,jobs,&pairs);
+      Camera::maxDescrInMemoryTotal_ = maxDescrInMemory;
+
+      Assert::AreEqual(pairsSeparately.size(),pairs.size());
+      for(const auto& entry : pairsSeparately)
+      {
+        const auto& pair = pairs.at(entry.first);
+        Assert::IsTrue(pair.matches.size() > nPts / 2);
+        Assert::IsTrue(pair.matches == entry.second.matches);
+      }
+
+      // No descriptors stay pinned.
+      Camera::releaseDescr(Camera::descrMemoryUsage());
+      Assert::AreEqual(size_t(0),Camera::descrMemoryUsage());
+      for(const auto& fn : featsFilenames)
+        std::remove(fn.c_str());
+    }
+
+    TEST_METHOD(screenPairsTest)
+    {
+      Assert::AreEqual(string("dir/img.coarse.feat.gz"),
+        coarseFeaturesFilename("dir/img.feat.gz"));
+      Assert::AreEqual(string("dir/img.key.coarse.feat.gz"),
+        coarseFeaturesFilename("dir/img.key"));
+
+      // Cameras 0,1,2 see one scene and camera 3 another one.
+      int nPts = 200;
+      ptr_vector<Camera> coarseCams;
+      vector<Point> pts,otherPts;
+      generateArcScene(3,nPts,0.01f,&coarseCams,&pts);
+      generateArcScene(1,nPts,0.01f,&coarseCams,&otherPts);
+
+      vector<set<int>> queries(4);
+      queries[1].insert(0);
+      queries[3].insert(2);
+      OptionsPairScreening opt;
+      opt.get<bool>("verbose") = false;
+      Assert::AreEqual(1,screenPairs(opt,coarseCams,&queries));
+      Assert::IsTrue(queries[1] == set<int>({0}));
+      Assert::IsTrue(queries[3].empty());
+    }
+
+    TEST_METHOD(matchFeatFLANNOrderedTest)
+    {
+      int nCams = 4;
+      int nPts = 100;
+      ptr_vector<Camera> cams;
+      vector<Point> pts;
+      generateArcScene(nCams,nPts,0.01f,&cams,&pts);
+      vector<set<int>> queries(nCams);
+      int nPairsTotal = 0;
+      for(int j = 0; j < nCams; j++)
+      {
+        for(int i = 0; i < j; i++)
+        {
+          queries[j].insert(i);
+          nPairsTotal++;
+        }
+      }
+      OptionsFLANN opt;
+      opt.get<bool>("verbose") = false;
+      OptionsRANSAC verificationOpt(2048,sqrt(5.),16);
+      int minNumMatches = 16;
+
+      pair_umap<CameraPair> allPairs;
+      int nSkipped = matchFeatFLANNOrdered(opt,verificationOpt,false,minNumMatches,
+        nCams,cams,MatrixXf(),queries,&allPairs);
+      Assert::AreEqual(0,nSkipped);
+      Assert::AreEqual(size_t(nPairsTotal),allPairs.size());
+
+      // Every image stops after its first verified pair.
+      pair_umap<CameraPair> pairs;
+      nSkipped = matchFeatFLANNOrdered(opt,verificationOpt,false,minNumMatches,1,cams,
+        MatrixXf(),queries,&pairs);
+      Assert::IsTrue(nSkipped > 0);
+      Assert::AreEqual(size_t(nPairsTotal - nSkipped),pairs.size());
+      vector<int> nVerified(nCams,0);
+      for(const auto& entry : pairs)
+      {
+        nVerified[entry.first.first]++;
+        nVerified[entry.first.second]++;
+        Assert::IsTrue(allPairs.count(entry.first) == 1);
+        const auto& matches = entry.second.matches;
+        Assert::IsTrue(static_cast<int>(matches.size()) >= minNumMatches);
+        int nCorrect = 0;
+        for(const auto& match : matches)
+          nCorrect += (match.first == match.second);
+        Assert::IsTrue(nCorrect > 0.9*matches.size());
+      }
+      for(int camIdx = 0; camIdx < nCams; camIdx++)
+        Assert::IsTrue(nVerified[camIdx] >= 1);
+    }
+
 	};
 }
\ No newline at end of file
@@ -0,0 +1,97 @@
+#include "stdafx.h"
+#include "CppUnitTest.h"
+
+#include "online_sfm.h"
+#include "absolute_pose.h"
+#include "standard_camera.h"
+#include "utils_tests.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+using namespace yasfm;
+
+namespace yasfm_tests
+{
+  TEST_CLASS(online_sfm_tests)
+  {
+  public:
+
+    TEST_METHOD(processCameraTest)
+    {
+      Dataset data("../UnitTests/test_dataset");
+      int nCams = 6;
+      int nPts = 300;
+
+      vector<Point> ptsTrue;
+      generateArcScene(nCams,nPts,0.01f,&data.cams(),&ptsTrue);
+      for(int camIdx = 0; camIdx < nCams; camIdx++)
+      {
+        // The pose is estimated by the reconstruction.
+        auto& cam = *static_cast<StandardCamera *>(&data.cam(camIdx));
+        cam.setRotation(Matrix3d::Identity());
+        cam.setC(Vector3d::Zero());
+      }
+
+      OptionsOnlineSFM opt;
+      opt.get<bool>("verbose") = false;
+      // Registering the cameras schedules the background adjustment and
+      // the following cameras merge it.
+      opt.get<int>("globalBAPeriod") = 2;
+      OnlineSFM online(opt,&data);
+      for(int camIdx = 0; camIdx < nCams; camIdx++)
+        online.processCamera(camIdx);
+      online.finish(false);
+
+      Assert::IsTrue(online.latencies().size() == nCams);
+      Assert::IsTrue(data.reconstructedCams().size() == nCams);
+      Assert::IsTrue(data.countPtsAlive() > nPts / 2);
+      Assert::IsTrue(computeAverageReprojectionError(data.cams(),data.pts()) < 1.);
+    }
+
+    TEST_METHOD(mergeGlobalBATest)
+    {
+      Dataset data("../UnitTests/test_dataset");
+      int nCams = 10;
+      int nPts = 300;
+      vector<Point> ptsTrue;
+      generateArcScene(nCams,nPts,0.01f,&data.cams(),&ptsTrue);
+      for(int camIdx = 0; camIdx < nCams; camIdx++)
+      {
+        auto& cam = *static_cast<StandardCamera *>(&data.cam(camIdx));
+        cam.setRotation(Matrix3d::Identity());
+        cam.setC(Vector3d::Zero());
+      }
+
+      OptionsOnlineSFM opt;
+      opt.get<bool>("verbose") = false;
+      // The next camera is processed right after the adjustment gets scheduled,
+      // i.e. it is registered while the adjustment runs and the merge comes later.
+      opt.get<int>("globalBAPeriod") = 2;
+      // The default tolerances are relative to the parameters including the focal
+      // lengths and stop this small problem right away.
+      for(const char *baName : {"localBundleAdjust","globalBundleAdjust"})
+      {
+        auto& solverOptions = opt.getOpt<OptionsBundleAdjustment>(baName).
+          get<ceres::Solver::Options>("solverOptions");
+        solverOptions.parameter_tolerance = 1e-8;
+        solverOptions.function_tolerance = 1e-8;
+      }
+      OnlineSFM online(opt,&data);
+      double err = 0.;
+      for(int camIdx = 0; camIdx < nCams; camIdx++)
+      {
+        online.processCamera(camIdx);
+        if(!data.reconstructedCams().empty())
+        {
+          double newErr = computeAverageReprojectionError(data.cams(),data.pts());
+          Assert::IsTrue(newErr < 1.);
+          err = newErr;
+        }
+      }
+      online.finish(false);
+      Assert::IsTrue(data.reconstructedCams().size() == nCams);
+      double mergedErr = computeAverageReprojectionError(data.cams(),data.pts());
+      Assert::IsTrue(mergedErr < 1.1*err);
+    }
+
+  };
+}
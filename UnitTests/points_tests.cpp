@@ -1,7 +1,9 @@
 #include "stdafx.h"
 #include "CppUnitTest.h"
 
+#include "memory_budget.h"
 #include "points.h"
+#include "sfm_data.h"
 #include "utils_tests.h"
 #include "standard_camera.h"
 
@@ -87,6 +89,37 @@ namespace yasfm_tests
       Assert::IsTrue(matches[0].count(2) == 1);
     }
 
+    TEST_METHOD(twoViewMatchesToNViewMatchesSpillTest)
+    {
+      Dataset data("../UnitTests/test_dataset");
+      for(int camIdx = 0; camIdx < 4; camIdx++)
+      {
+        data.cams().push_back(make_unique<StandardCamera>());
+        data.cams().back()->resizeFeatures(5,0);
+        for(int i = 0; i < 5; i++)
+        {
+          float dummy;
+          data.cams().back()->setFeature(i,0.,0.,0,0,&dummy);
+        }
+      }
+      data.pairs()[IntPair(0,1)].matches.emplace_back(0,0);
+      data.pairs()[IntPair(1,2)].matches.emplace_back(0,0);
+      data.pairs()[IntPair(2,3)].matches.emplace_back(1,1);
+
+      // The tiny limit makes the budget spill the pairs in the middle of the call.
+      size_t limit = memoryBudget().limit();
+      memoryBudget().setLimit(1);
+      data.setPairsSpillable(true);
+      twoViewMatchesToNViewMatches(data.cams(),data.pairs(),&data.nViewMatches());
+      Assert::IsTrue(data.arePairsSpilled());
+      memoryBudget().setLimit(limit);
+      Assert::IsTrue(data.nViewMatches().size() == 2);
+
+      // The reference has to be requested again.
+      Assert::IsTrue(data.pairs().size() == 3);
+      data.setPairsSpillable(false);
+    }
+
     TEST_METHOD(nViewMatchesToTwoViewMatchesTest)
     {
       vector<NViewMatch> nViewMatches;
@@ -425,6 +458,39 @@ namespace yasfm_tests
       Assert::IsTrue(cams[0]->visiblePoints()[1] == pts.size());
     }
 
+    TEST_METHOD(removePointsViewsTest)
+    {
+      ptr_vector<Camera> cams;
+      vector<Point> pts(5);
+      for(int i = 0; i < 3; i++)
+        cams.push_back(make_unique<StandardCamera>());
+      for(int i = 0; i < (int)pts.size(); i++)
+      {
+        pts[i].views.emplace(0,i);
+        pts[i].views.emplace(1,i);
+        cams[0]->visiblePoints().push_back(i);
+        cams[1]->visiblePoints().push_back(i);
+      }
+      pts[3].viewsToAdd.emplace(2,0);
+      cams[2]->visiblePoints().push_back(3);
+
+      vector<int> ptIdxs;
+      ptIdxs.push_back(1);
+      ptIdxs.push_back(3);
+      removePointsViews(ptIdxs,&cams,&pts);
+      Assert::IsTrue(pts[1].views.empty());
+      Assert::IsTrue(pts[3].views.empty());
+      Assert::IsTrue(pts[3].viewsToAdd.empty());
+      Assert::IsTrue(pts[0].views.size() == 2);
+      for(int i = 0; i < 2; i++)
+      {
+        const auto& visPts = cams[i]->visiblePoints();
+        Assert::IsTrue(visPts.size() == 3);
+        Assert::IsTrue(visPts[0] == 0 && visPts[1] == 2 && visPts[2] == 4);
+      }
+      Assert::IsTrue(cams[2]->visiblePoints().empty());
+    }
+
     TEST_METHOD(isWellConditionedTest)
     {
       double rayAngleThresh = 2; 
@@ -1,6 +1,8 @@
 #include "stdafx.h"
 #include "CppUnitTest.h"
 
+#include <set>
+
 #include "ransac.h"
 #include "utils_tests.h"
 
@@ -20,5 +22,20 @@ namespace UnitTests
       Assert::AreEqual(INT_MAX,sufficientNumberOfRounds(1,100000,5,.95));
 		}
 
+    TEST_METHOD(generateRandomIndicesTest)
+    {
+      std::default_random_engine generator1(5),generator2(5);
+      vector<int> idxs1,idxs2;
+      for(int i = 0; i < 10; i++)
+      {
+        generateRandomIndices(7,10,&generator1,&idxs1);
+        generateRandomIndices(7,10,&generator2,&idxs2);
+        Assert::IsTrue(idxs1 == idxs2);
+        std::set<int> unique(idxs1.begin(),idxs1.end());
+        Assert::AreEqual(size_t(7),unique.size());
+        Assert::IsTrue(*unique.begin() >= 0 && *unique.rbegin() < 10);
+      }
+    }
+
 	};
 }
\ No newline at end of file
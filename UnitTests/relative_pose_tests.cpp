@@ -2,10 +2,14 @@
 #include "CppUnitTest.h"
 
 #include "relative_pose.h"
+#include "five_point.h"
 #include "utils_tests.h"
 #include "standard_camera.h"
 
 using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+using Eigen::AngleAxisd;
+using Eigen::Matrix;
+using Eigen::MatrixXd;
 
 namespace yasfm_tests
 {
@@ -220,6 +224,92 @@ namespace yasfm_tests
       Assert::IsTrue(inliers.size() == 0);
     }
 
+    TEST_METHOD(estimateRelativePose7ptDeterministicTest)
+    {
+      Matrix34d P1(Matrix34d::Identity()),P2(generateRandomProjection());
+      int n = 100;
+      vector<Vector2d> keys1(n),keys2(n);
+      vector<IntPair> matches(n);
+      for(int i = 0; i < n; i++)
+      {
+        Vector3d pt(Vector3d::Random());
+        Vector3d tmp = P1 * pt.homogeneous();
+        keys1[i] = tmp.hnormalized();
+        tmp = P2 * pt.homogeneous();
+        keys2[i] = tmp.hnormalized();
+        if(i % 2 == 0)
+          keys2[i] += Vector2d::Random(); // outlier
+        matches[i] = IntPair(i,i);
+      }
+
+      // The estimations do not depend on each other nor on the threads running them.
+      OptionsRANSAC opt(512,0.01,10);
+      int nRuns = 8;
+      vector<vector<int>> inliers(nRuns);
+      vector<Matrix3d> Fs(nRuns);
+#pragma omp parallel for
+      for(int i = 0; i < nRuns; i++)
+        estimateRelativePose7ptRANSAC(opt,keys1,keys2,matches,&Fs[i],&inliers[i]);
+      Assert::IsTrue(inliers[0].size() >= opt.minInliers());
+      for(int i = 1; i < nRuns; i++)
+      {
+        Assert::IsTrue(inliers[i] == inliers[0]);
+        Assert::IsTrue(Fs[i] == Fs[0]);
+      }
+    }
+
+    TEST_METHOD(estimateRelativePose7ptBatchTest)
+    {
+      Matrix34d P1(Matrix34d::Identity()),P2(generateRandomProjection());
+      Matrix3d ex;
+      crossProdMat(P2.col(3),&ex);
+      Matrix3d F = ex*P2.leftCols(3);
+      F.normalize();
+      F *= sgn(F(0,0));
+
+      int n = 20;
+      vector<Vector2d> keys1(n),keys2(n);
+      vector<IntPair> matches(n);
+      for(int i = 0; i < n; i++)
+      {
+        Vector3d pt(Vector3d::Random());
+        Vector3d tmp = P1 * pt.homogeneous();
+        keys1[i] = tmp.hnormalized();
+        tmp = P2 * pt.homogeneous();
+        keys2[i] = tmp.hnormalized();
+        matches[i] = IntPair(i,i);
+      }
+
+      // not a multiple of the batch size
+      vector<vector<int>> samples(6);
+      for(int i = 0; i < 6; i++)
+        for(int j = 0; j < 7; j++)
+          samples[i].push_back((2*i + j) % n);
+
+      vector<vector<Matrix3d>> _Fs;
+      estimateRelativePose7ptBatch(keys1,keys2,matches,samples,&_Fs);
+      Assert::IsTrue(_Fs.size() == samples.size());
+      for(size_t i = 0; i < samples.size(); i++)
+      {
+        vector<IntPair> selectedMatches;
+        for(int idx : samples[i])
+          selectedMatches.push_back(matches[idx]);
+        vector<Matrix3d> Fs;
+        estimateRelativePose7pt(keys1,keys2,selectedMatches,&Fs);
+        Assert::IsTrue(_Fs[i].size() == Fs.size());
+
+        bool goodF = false;
+        for(auto& _F : _Fs[i])
+        {
+          _F.normalize();
+          _F *= sgn(_F(0,0));
+          goodF |= (_F - F).norm() < 1e-8;
+          Assert::IsTrue(abs(_F.determinant()) < 1e-10);
+        }
+        Assert::IsTrue(goodF);
+      }
+    }
+
     TEST_METHOD(Mediator7ptRANSACRefineTest)
     {
       const int nMatches = 1000;
@@ -343,6 +433,79 @@ namespace yasfm_tests
       }
     }
 
+    TEST_METHOD(solveRelativePose5ptTest)
+    {
+      double tolerance = 1e-8;
+      for(int iTest = 0; iTest < 10; iTest++)
+      {
+        Matrix3d R(generateRandomRotation());
+        Vector3d t(Vector3d::Random());
+        Matrix3d E;
+        crossProdMat(t,&E);
+        E = E*R;
+        E.normalize();
+
+        Vector3d pts1[5],pts2[5];
+        for(int i = 0; i < 5; i++)
+        {
+          Vector3d pt(Vector3d::Random());
+          pt(2) += 3.;
+          pts1[i] = pt / pt(2);
+          Vector3d tmp = R*pt + t;
+          pts2[i] = tmp / tmp(2);
+        }
+
+        Matrix3d Es[maxNumSolutions5pt];
+        int nSolutions = solveRelativePose5pt(pts1,pts2,Es);
+        Assert::IsTrue(nSolutions <= maxNumSolutions5pt);
+        bool found = false;
+        for(int i = 0; i < nSolutions; i++)
+        {
+          Assert::AreEqual(1.,Es[i].norm(),1e-12);
+          for(int j = 0; j < 5; j++)
+            Assert::AreEqual(0.,pts2[j].dot(Es[i]*pts1[j]),tolerance);
+          found |= ((Es[i] - E).norm() < 1e-6) || ((Es[i] + E).norm() < 1e-6);
+        }
+        Assert::IsTrue(found);
+      }
+    }
+
+    TEST_METHOD(Mediator5ptRANSACErrorTest)
+    {
+      Matrix34d P1(Matrix34d::Identity()),P2(Matrix34d::Identity());
+      Matrix3d K1(generateRandomCalibration()),K2(generateRandomCalibration()),
+        R(generateRandomRotation());
+      Vector3d C(Vector3d::Random());
+      P1 = K1*P1;
+      P2.col(3) = -C;
+      P2 = K2 * R * P2;
+
+      StandardCamera cam1,cam2;
+      cam1.setParams(P1);
+      cam2.setParams(P2);
+      int nMatches = 10;
+      cam1.resizeFeatures(nMatches,0);
+      cam2.resizeFeatures(nMatches,0);
+      vector<IntPair> matches(nMatches);
+      for(int i = 0; i < nMatches; i++)
+      {
+        Vector2d key1(Vector2d::Random() * 500.),key2(Vector2d::Random() * 500.);
+        float dummy;
+        cam1.setFeature(i,key1(0),key1(1),0,0,&dummy);
+        cam2.setFeature(i,key2(0),key2(1),0,0,&dummy);
+        matches[i] = IntPair(i,i);
+      }
+
+      Matrix3d E(Matrix3d::Random());
+      Matrix3d F = cam2.K().inverse().transpose() * E * cam1.K().inverse();
+      Mediator5ptRANSAC m(cam1,cam2,matches);
+      for(int i = 0; i < nMatches; i++)
+      {
+        double expected = computeFundMatSampsonDistSquared(cam2.key(i),F,cam1.key(i));
+        Assert::AreEqual(expected,m.computeSquaredError(E,i),1e-9 * expected);
+      }
+    }
+
     TEST_METHOD(estimateFundamentalMatrixTest)
     {
       double tolerance = 1e-12;
@@ -377,6 +540,87 @@ namespace yasfm_tests
       Assert::IsTrue(F.isApprox(_F,1e-5));
     }
 
+    TEST_METHOD(estimateFundamentalMatrixSVDReferenceTest)
+    {
+      // The normal equations square the condition number of the linear system, so
+      // the result is compared to solving the system itself by SVD.
+      auto estimateFundamentalMatrixSVD = [](const vector<Vector2d>& pts1,
+        const vector<Vector2d>& pts2,const vector<IntPair>& matches,
+        const vector<int>& matchesToUse,Matrix3d *pF)
+      {
+        int nUseful = static_cast<int>(matchesToUse.size());
+        Matrix3d C1,C2;
+        matchedPointsCenteringMatrix<true>(pts1,matches,matchesToUse,&C1);
+        matchedPointsCenteringMatrix<false>(pts2,matches,matchesToUse,&C2);
+        MatrixXd A(nUseful,8);
+        VectorXd b(nUseful);
+        for(int i = 0; i < nUseful; i++)
+        {
+          Vector3d pt1 = C1 * pts1[matches[matchesToUse[i]].first].homogeneous();
+          Vector3d pt2 = C2 * pts2[matches[matchesToUse[i]].second].homogeneous();
+          A.row(i) << pt1(0) * pt2(0),pt1(0) * pt2(1),pt1(0) * pt2(2),
+            pt1(1) * pt2(0),pt1(1) * pt2(1),pt1(1) * pt2(2),
+            pt1(2) * pt2(0),pt1(2) * pt2(1);
+          b(i) = -(pt1(2)*pt2(2));
+        }
+        VectorXd f = A.jacobiSvd(Eigen::ComputeThinU | Eigen::ComputeThinV).solve(b);
+        Matrix3d F_;
+        F_.col(0) = f.topRows(3);
+        F_.col(1) = f.middleRows(3,3);
+        F_(0,2) = f(6); F_(1,2) = f(7); F_(2,2) = 1.;
+        closestRank2Matrix(F_,pF);
+        *pF = C2.transpose() * (*pF) * C1;
+      };
+
+      Matrix3d K;
+      K << 1500.,0.,2000.,0.,1500.,1500.,0.,0.,1.;
+      Matrix34d P1,P2;
+      P1 << Matrix3d::Identity(),Vector3d::Zero();
+      P1 = K * P1;
+      Matrix3d R = AngleAxisd(0.1,Vector3d(1.,2.,3.).normalized()).toRotationMatrix();
+      P2 << R,-R*Vector3d(1.,0.5,0.3);
+      P2 = K * P2;
+
+      int n = 2000;
+      for(int nearPlanar = 0; nearPlanar < 2; nearPlanar++)
+      {
+        double depthVariation = nearPlanar ? 1e-3 : 2.;
+        vector<Vector2d> keys1(n),keys2(n);
+        vector<IntPair> matches;
+        vector<int> matchesToUse;
+        for(int i = 0; i < n; i++)
+        {
+          Vector3d pt(Vector3d::Random());
+          pt.topRows(2) *= 4.;
+          pt(2) = 10. + depthVariation * pt(2);
+          Vector3d tmp = P1 * pt.homogeneous();
+          keys1[i] = tmp.hnormalized() + 0.5 * Vector2d::Random();
+          tmp = P2 * pt.homogeneous();
+          keys2[i] = tmp.hnormalized() + 0.5 * Vector2d::Random();
+          matches.emplace_back(i,i);
+          matchesToUse.push_back(i);
+        }
+
+        Matrix3d F,FRef;
+        estimateFundamentalMatrix(keys1,keys2,matches,matchesToUse,1e-12,0,&F);
+        estimateFundamentalMatrixSVD(keys1,keys2,matches,matchesToUse,&FRef);
+
+        double err = 0.,errRef = 0.;
+        for(int i = 0; i < n; i++)
+        {
+          err += computeFundMatSampsonDistSquared(keys2[i],F,keys1[i]);
+          errRef += computeFundMatSampsonDistSquared(keys2[i],FRef,keys1[i]);
+        }
+        Assert::IsTrue(err <= errRef * (1. + 1e-6));
+        if(!nearPlanar)
+        {
+          F /= F.norm() * sgn(F(2,2));
+          FRef /= FRef.norm() * sgn(FRef(2,2));
+          Assert::IsTrue(F.isApprox(FRef,1e-6));
+        }
+      }
+    }
+
     TEST_METHOD(estimateEssentialMatrixTest)
     {
       double tolerance = 1e-12;
@@ -524,6 +768,119 @@ namespace yasfm_tests
       Assert::IsTrue(H.isApprox(_H,1e-5));
     }
 
+    TEST_METHOD(estimateHomographySVDReferenceTest)
+    {
+      // The normal matrix squares the condition number of the DLT system, so the
+      // result is compared to the SVD of the system itself.
+      auto buildSystem = [](const vector<Vector2d>& pts1,const vector<Vector2d>& pts2,
+        const vector<IntPair>& matches,const vector<int>& matchesToUse,Matrix3d *C1,
+        Matrix3d *C2,MatrixXd *pA)
+      {
+        int nUseful = static_cast<int>(matchesToUse.size());
+        matchedPointsCenteringMatrix<true>(pts1,matches,matchesToUse,C1);
+        matchedPointsCenteringMatrix<false>(pts2,matches,matchesToUse,C2);
+        auto& A = *pA;
+        A.setZero(2*nUseful,9);
+        for(int i = 0; i < nUseful; i++)
+        {
+          Vector3d pt1 = (*C1) * pts1[matches[matchesToUse[i]].first].homogeneous();
+          Vector3d pt2 = (*C2) * pts2[matches[matchesToUse[i]].second].homogeneous();
+          A.block(i,0,1,3) = pt1.transpose();
+          A.block(i,6,1,3) = -pt2(0) * pt1.transpose();
+          A.block(i+nUseful,3,1,3) = pt1.transpose();
+          A.block(i+nUseful,6,1,3) = -pt2(1) * pt1.transpose();
+        }
+      };
+      // Residual of the normalized system for a homography in pixels.
+      auto algebraicError = [](const MatrixXd& A,const Matrix3d& C1,const Matrix3d& C2,
+        const Matrix3d& H)
+      {
+        Matrix3d H0 = C2 * H * C1.inverse();
+        Matrix<double,9,1> h;
+        h << H0.row(0).transpose(),H0.row(1).transpose(),H0.row(2).transpose();
+        return (A * h.normalized()).norm();
+      };
+
+      Matrix3d H;
+      H << 1.1,0.05,30.,-0.03,0.95,-20.,1e-5,2e-5,1.;
+      int n = 2000;
+      for(int nearCollinear = 0; nearCollinear < 2; nearCollinear++)
+      {
+        vector<Vector2d> keys1(n),keys2(n);
+        vector<IntPair> matches;
+        vector<int> matchesToUse;
+        for(int i = 0; i < n; i++)
+        {
+          Vector2d r(Vector2d::Random());
+          if(nearCollinear)
+            keys1[i] = Vector2d(2000.,1600.) + 2000. * r(0) * Vector2d(0.8,0.6)
+            + 1e-2 * r(1) * Vector2d(-0.6,0.8);
+          else
+            keys1[i] = Vector2d(2000.,1500.) + r.cwiseProduct(Vector2d(2000.,1500.));
+          Vector3d tmp = H * keys1[i].homogeneous();
+          keys2[i] = tmp.hnormalized() + Vector2d::Random();
+          matches.emplace_back(i,i);
+          matchesToUse.push_back(i);
+        }
+
+        Matrix3d C1,C2;
+        MatrixXd A;
+        buildSystem(keys1,keys2,matches,matchesToUse,&C1,&C2,&A);
+        Eigen::JacobiSVD<MatrixXd> svd(A,Eigen::ComputeFullV);
+        Matrix<double,9,1> hRef = svd.matrixV().rightCols(1);
+        Matrix3d H0Ref;
+        H0Ref << hRef.topRows(3).transpose(),hRef.middleRows(3,3).transpose(),
+          hRef.bottomRows(3).transpose();
+        Matrix3d HRef = C2.inverse() * H0Ref * C1;
+
+        Matrix3d _H;
+        estimateHomography(keys1,keys2,matches,matchesToUse,&_H);
+        double err = algebraicError(A,C1,C2,_H);
+        double errRef = algebraicError(A,C1,C2,HRef);
+        Assert::IsTrue(err <= errRef * (1. + 1e-6));
+        if(!nearCollinear)
+        {
+          _H /= _H(2,2);
+          HRef /= HRef(2,2);
+          Assert::IsTrue(_H.isApprox(HRef,1e-6));
+        }
+      }
+    }
+
+    TEST_METHOD(estimateHomographyBatchTest)
+    {
+      int n = 10;
+      vector<Vector2d> keys1(n),keys2(n);
+      vector<IntPair> matches;
+      Matrix3d H(Matrix3d::Random());
+      H(2,2) = 1.;
+      for(int i = 0; i < n; i++)
+      {
+        keys1[i] = Vector2d::Random();
+        Vector3d tmp = H * keys1[i].homogeneous();
+        keys2[i] = tmp.hnormalized();
+        matches.emplace_back(i,i);
+      }
+
+      // minimal samples and one non-minimal
+      vector<vector<int>> samples(5);
+      for(int i = 0; i < 5; i++)
+        for(int j = 0; j < 4; j++)
+          samples[i].push_back((i + 2*j) % n);
+      samples.emplace_back();
+      for(int i = 0; i < n; i++)
+        samples.back().push_back(i);
+
+      vector<Matrix3d> _Hs;
+      estimateHomographyBatch(keys1,keys2,matches,samples,&_Hs);
+      Assert::IsTrue(_Hs.size() == samples.size());
+      for(auto& _H : _Hs)
+      {
+        _H /= _H(2,2);
+        Assert::IsTrue(H.isApprox(_H,1e-5));
+      }
+    }
+
     TEST_METHOD(findHomographyInliersTest)
     {
       int n = 10;
@@ -45,6 +45,20 @@ public:
     Assert::IsTrue(data.cam(2).imgFilename().compare(fn2) == 0);
   }
 
+  TEST_METHOD(addCamerasWithImgDimsTest)
+  {
+    Dataset data("../UnitTests/test_dataset");
+    umap<string,IntPair> imgDims;
+    imgDims["test1.JPG"] = IntPair(10,20);
+    data.addCameras<StandardCamera>("",imgDims);
+
+    Assert::AreEqual(data.numCams(),3);
+    Assert::AreEqual(data.cam(0).imgWidth(),1100);
+    Assert::AreEqual(data.cam(0).imgHeight(),850);
+    Assert::AreEqual(data.cam(1).imgWidth(),10);
+    Assert::AreEqual(data.cam(1).imgHeight(),20);
+  }
+
   TEST_METHOD(markCamAsReconstructedTest)
   {
     Dataset data("../UnitTests/test_dataset");
@@ -72,6 +86,115 @@ public:
     testCameraPoseGetter<StandardCameraRadial>();
   }
 
+  TEST_METHOD(StandardCameraRadialKeysNormalizedTest)
+  {
+    StandardCameraRadial cam("","",1000,800);
+    int nKeys = 100;
+    cam.resizeFeatures(nKeys,0);
+    for(int i = 0; i < nKeys; i++)
+      cam.setFeature(i,10.*i,(13*i) % 800,1.,0.,nullptr);
+    vector<double> params;
+    cam.params(&params);
+    params[6] = 900.;
+    params[7] = -0.2;
+    params[8] = 0.05;
+    cam.setParams(params);
+
+    vector<Vector2d> normKeys;
+    cam.keysNormalized(&normKeys);
+    Assert::IsTrue(normKeys.size() == nKeys);
+    for(int i = 0; i < nKeys; i++)
+      Assert::IsTrue(normKeys[i].isApprox(cam.keyNormalized(i),1e-12));
+
+    // The table is exact up to the interpolation.
+    cam.setUndistortionTableSize(1024);
+    cam.keysNormalized(&normKeys);
+    double fwd[4] = {0.,params[7],0.,params[8]};
+    for(int i = 0; i < nKeys; i++)
+    {
+      Vector2d distorted = cam.StandardCamera::keyNormalized(i);
+      double r = distorted.norm();
+      Vector2d expected = distorted;
+      if(r > 0.)
+        expected *= undistortRadiusNewton(4,fwd,r) / r;
+      Assert::IsTrue((normKeys[i] - expected).norm() < 1e-6);
+    }
+  }
+
+  TEST_METHOD(sortMatchesByDistsTest)
+  {
+    CameraPair pair;
+    pair.matches = {IntPair(0,0),IntPair(1,1),IntPair(2,2),IntPair(3,3),IntPair(4,4)};
+    pair.dists = {0.3,0.1,0.2,0.5,0.4};
+    vector<int> order,orderTrue = {1,2,0,4,3};
+    findMatchesOrderByDists(pair,&order);
+    assertVectorEquality(orderTrue,order);
+
+    // Groups are sorted separately.
+    pair.groups.resize(2);
+    pair.groups[0].size = 3;
+    pair.groups[1].size = 2;
+    sortMatchesByDists(&pair);
+    vector<double> distsTrue = {0.1,0.2,0.3,0.4,0.5};
+    for(int i = 0; i < 5; i++)
+      Assert::AreEqual(distsTrue[i],pair.dists[i]);
+    Assert::IsTrue(pair.matches[0] == IntPair(1,1));
+    Assert::IsTrue(pair.matches[4] == IntPair(3,3));
+
+    findMatchesOrderByDists(pair,&order);
+    orderTrue = {0,1,2,3,4};
+    assertVectorEquality(orderTrue,order);
+  }
+
+  TEST_METHOD(spillPairsTest)
+  {
+    Dataset data("../UnitTests/test_dataset");
+    auto& pair = data.pairs()[IntPair(0,1)];
+    pair.matches.emplace_back(3,5);
+    pair.matches.emplace_back(4,2);
+    pair.dists.assign(2,0.5);
+    pair.groups.resize(1);
+    pair.groups[0].size = 2;
+    pair.groups[0].type = 'F';
+    pair.groups[0].T = MatrixXd::Identity(3,3);
+
+    data.setPairsSpillable(true);
+    Assert::IsTrue(data.memoryUsage() > 0);
+    Assert::IsTrue(data.releaseMemory(1) > 0);
+    Assert::IsTrue(data.arePairsSpilled());
+    Assert::IsTrue(data.memoryUsage() == 0);
+
+    // Reading back.
+    const auto& pairs = data.pairs();
+    Assert::IsFalse(data.arePairsSpilled());
+    Assert::IsTrue(pairs.size() == 1);
+    const auto& pairRead = pairs.at(IntPair(0,1));
+    Assert::IsTrue(pairRead.matches.size() == 2);
+    Assert::IsTrue(pairRead.matches[1] == IntPair(4,2));
+    Assert::IsTrue(pairRead.dists[0] == 0.5);
+    Assert::IsTrue(pairRead.groups.size() == 1);
+    Assert::IsTrue(pairRead.groups[0].type == 'F');
+    Assert::IsTrue(pairRead.groups[0].T.isIdentity());
+
+    // Copies do not share the spilling.
+    data.releaseMemory(1);
+    Dataset copy(data);
+    Assert::IsTrue(copy.pairs().size() == 1);
+    Assert::IsFalse(copy.releaseMemory(1) > 0);
+    data.setPairsSpillable(false);
+    Assert::IsFalse(data.arePairsSpilled());
+    Assert::IsTrue(data.pairs().size() == 1);
+
+    // Clearing spilled pairs.
+    data.setPairsSpillable(true);
+    data.releaseMemory(1);
+    data.clearPairs();
+    Assert::IsFalse(data.arePairsSpilled());
+    Assert::IsTrue(data.memoryUsage() == 0);
+    Assert::IsTrue(data.pairs().empty());
+    data.setPairsSpillable(false);
+  }
+
   template<class T>
   void testCameraFuctionality()
   {
@@ -122,6 +245,14 @@ public:
     // copy
     unique_ptr<Camera> pcam2(cam.clone());
     Assert::IsTrue(instanceof<T,Camera>(&(*pcam2)));
+
+    // copy without descriptors
+    size_t descrMemory = Camera::descrMemoryUsage();
+    unique_ptr<Camera> pcam3(cam.cloneWithoutDescr());
+    Assert::IsTrue(instanceof<T,Camera>(&(*pcam3)));
+    Assert::IsTrue(pcam3->keys().size() == nFeats);
+    Assert::IsTrue(pcam3->P().isApprox(cam.P()));
+    Assert::IsTrue(Camera::descrMemoryUsage() == descrMemory);
   }
 
   template<class T>
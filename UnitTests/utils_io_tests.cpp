@@ -50,6 +50,26 @@ namespace yasfm_tests
       Assert::IsTrue(h == 850);
     }
 
+    TEST_METHOD(getImgDimsFromHeadersTest)
+    {
+      // The files contain only the headers, so they cannot be decoded.
+      string dir = joinPaths(YASFM_UNIT_TESTS_DIR,"headers");
+      struct Expected { const char *fn; int w,h; };
+      Expected expected[] = {
+        {"header.png",1234,567},
+        {"header.bmp",321,123}, // stored top-down
+        {"header_le.tif",640,480},
+        {"header_be.tif",1024,768},
+        {"header.ppm",800,600}};
+      for(const auto& e : expected)
+      {
+        int w = -1,h = -1;
+        getImgDims(joinPaths(dir,e.fn),&w,&h);
+        Assert::AreEqual(e.w,w);
+        Assert::AreEqual(e.h,h);
+      }
+    }
+
     TEST_METHOD(findFocalLengthInEXIFTest)
     {
       string fn = joinPaths(YASFM_UNIT_TESTS_DIR,"test0.JPG");
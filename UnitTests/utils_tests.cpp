@@ -9,6 +9,7 @@
 
 using namespace Microsoft::VisualStudio::CppUnitTestFramework;
 using Eigen::Vector4d;
+using Eigen::VectorXf;
 using Eigen::JacobiSVD;
 using namespace yasfm;
 using std::array;
@@ -58,6 +59,37 @@ Matrix34d generateRandomProjection()
   return P;
 }
 
+void generateArcScene(int nCams,int nPts,float descrNoise,ptr_vector<Camera> *pcams,
+  vector<Point> *ppts)
+{
+  auto& cams = *pcams;
+  auto& pts = *ppts;
+  int dim = 128;
+  MatrixXf ptsDescr = MatrixXf::Random(dim,nPts).cwiseAbs();
+  pts.resize(nPts);
+  for(int iPt = 0; iPt < nPts; iPt++)
+  {
+    ptsDescr.col(iPt).normalize();
+    pts[iPt].coord = Vector3d::Random();
+  }
+  for(int camIdx = 0; camIdx < nCams; camIdx++)
+  {
+    auto cam = make_unique<StandardCamera>("../UnitTests/test_dataset/test0.JPG","");
+    double angle = 0.1*camIdx;
+    cam->setRotation(Eigen::AngleAxisd(-angle,Vector3d::UnitY()).toRotationMatrix());
+    cam->setC(Vector3d(5.*sin(angle),0.,-5.*cos(angle)));
+    cam->setFocal(1000.);
+    cam->resizeFeatures(nPts,dim);
+    for(int iPt = 0; iPt < nPts; iPt++)
+    {
+      Vector2d p = cam->project(pts[iPt]) + 0.1*Vector2d::Random();
+      VectorXf descr = ptsDescr.col(iPt) + descrNoise*VectorXf::Random(dim);
+      cam->setFeature(iPt,p(0),p(1),1.,0.,descr.data());
+    }
+    cams.push_back(std::move(cam));
+  }
+}
+
 	TEST_CLASS(utils_tests)
 	{
   public:
@@ -114,6 +146,18 @@ Matrix34d generateRandomProjection()
       quicksort(arr2,&order);
 
       assertVectorEquality(orderTrue,order);
+
+      // Ties keep the original order.
+      vector<double> arr3 = {2.,1.,2.,1.};
+      orderTrue = {1,3,0,2};
+      quicksort(arr3,&order);
+      assertVectorEquality(orderTrue,order);
+
+      // Sorted input of a size which used to exhaust the stack.
+      vector<int> arr4(1000000,7);
+      quicksort(arr4,&order);
+      for(int i = 0; i < (int)order.size(); i++)
+        Assert::AreEqual(i,order[i]);
     }
 
     TEST_METHOD(filterVectorTest)
@@ -378,5 +422,20 @@ Matrix34d generateRandomProjection()
       Assert::IsTrue(pt.isApprox(ptApprox,1e-4));
     }
 
+    TEST_METHOD(undistortRadiusNewtonTest)
+    {
+      double fwd[4] = {0.,-0.2,0.,0.05};
+      for(int i = 0; i <= 10; i++)
+      {
+        double r = 0.1*i;
+        double r2 = r*r;
+        double rDistorted = r*(1. + r2*(fwd[1] + r2*fwd[3]));
+
+        double rUndistorted = undistortRadiusNewton(4,fwd,rDistorted);
+
+        Assert::AreEqual(r,rUndistorted,1e-12);
+      }
+    }
+
 	};
 }
\ No newline at end of file
@@ -2,6 +2,7 @@
 #include <string>
 
 #include "Eigen/Dense"
+#include "camera.h"
 #include "utils.h"
 
 using namespace yasfm;
@@ -18,6 +19,13 @@ Matrix3d generateRandomRotation();
 Matrix3d generateRandomCalibration();
 Matrix34d generateRandomProjection();
 
+// Cameras on an arc which all see the same random points. Feature i of every
+// camera is the noisy projection of point i and its descriptor is the unit length
+// descriptor of point i perturbed by uniform noise of magnitude descrNoise.
+// The cameras get appended and the points have no views.
+void generateArcScene(int nCams,int nPts,float descrNoise,ptr_vector<Camera> *cams,
+  vector<Point> *pts);
+
 template <typename T> int sgn(T val) {
   return (T(0) < val) - (val < T(0));
 }
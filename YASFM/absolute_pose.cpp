@@ -3,6 +3,8 @@
 #include <algorithm>
 #include <iostream>
 
+#include "batched_qr.h"
+
 using Eigen::JacobiSVD;
 using Eigen::MatrixXd;
 using Eigen::VectorXd;
@@ -180,16 +182,96 @@ void resectCameraLS(const vector<Vector2d>& keys,const vector<Point>& points,
   P(2,3) = 1.;
 }
 
+void resectCameraLSBatch(const vector<Vector2d>& keys,const vector<Point>& points,
+  const vector<IntPair>& camToSceneMatches,const vector<vector<int>>& samples,
+  vector<vector<Matrix34d>> *pPs)
+{
+  const int nPts = 6;
+  auto& Ps = *pPs;
+  int nSamples = static_cast<int>(samples.size());
+  Ps.resize(nSamples);
+
+  vector<int> sixPtSamples;
+  sixPtSamples.reserve(nSamples);
+  for(int i = 0; i < nSamples; i++)
+  {
+    if(samples[i].size() == nPts)
+    {
+      sixPtSamples.push_back(i);
+    } else
+    {
+      vector<IntPair> selectedMatches;
+      selectedMatches.reserve(samples[i].size());
+      for(int idx : samples[i])
+        selectedMatches.push_back(camToSceneMatches[idx]);
+      Ps[i].resize(1);
+      resectCameraLS(keys,points,selectedMatches,&Ps[i][0]);
+    }
+  }
+  int nSixPt = static_cast<int>(sixPtSamples.size());
+
+  BatchedMatrix<2*nPts,11,batchLanes> A;
+  BatchedMatrix<2*nPts,1,batchLanes> b;
+  BatchedMatrix<11,1,batchLanes> X;
+  BatchedHouseholderQR<2*nPts,11,batchLanes> qr;
+  std::fill(A.data,A.data + 2*nPts*11*batchLanes,0.);
+  for(int first = 0; first < nSixPt; first += batchLanes)
+  {
+    for(int l = 0; l < batchLanes; l++)
+    {
+      // The last batch is padded by repeating the last sample.
+      const auto& sample = samples[sixPtSamples[std::min(first + l,nSixPt - 1)]];
+      for(int i = 0; i < nPts; i++)
+      {
+        const auto& match = camToSceneMatches[sample[i]];
+        const auto& key = keys[match.first];
+        const auto& pt = points[match.second].coord;
+        for(int j = 0; j < 3; j++)
+        {
+          A(2*i,j,l) = pt(j);
+          A(2*i,8 + j,l) = -key.x() * pt(j);
+          A(2*i + 1,4 + j,l) = pt(j);
+          A(2*i + 1,8 + j,l) = -key.y() * pt(j);
+        }
+        A(2*i,3,l) = 1.;
+        A(2*i + 1,7,l) = 1.;
+
+        b(2*i,0,l) = key.x();
+        b(2*i + 1,0,l) = key.y();
+      }
+    }
+
+    qr.compute(A);
+    qr.solve(b,&X);
+
+    for(int l = 0; l < batchLanes && first + l < nSixPt; l++)
+    {
+      Matrix34d P;
+      for(int j = 0; j < 4; j++)
+      {
+        P(0,j) = X(j,0,l);
+        P(1,j) = X(4 + j,0,l);
+      }
+      for(int j = 0; j < 3; j++)
+        P(2,j) = X(8 + j,0,l);
+      P(2,3) = 1.;
+
+      auto& samplePs = Ps[sixPtSamples[first + l]];
+      if(P.allFinite())
+        samplePs.assign(1,P);
+      else
+        samplePs.clear();
+    }
+  }
+}
+
 bool resectCamera3ptRANSAC(const OptionsRANSAC& opt,
   const vector<IntPair>& camToSceneMatches,const vector<Point>& points,
 	Camera *cam, vector<int> *inliers)
 {
 	Matrix34d Rt;
 	vector<Vector2d> calibratedKeys;
-	for (int i = 0; i < cam->keys().size(); i++)
-	{
-		calibratedKeys.push_back(cam->keyNormalized(i));
-	}
+	cam->keysNormalized(&calibratedKeys);
 	bool success = resectCamera3ptRANSAC(opt, camToSceneMatches, calibratedKeys,
     points,&Rt,inliers);
   if(success)
@@ -473,6 +555,17 @@ void MediatorResectioning6ptLSRANSAC::computeTransformation(const vector<int>& i
   resectCameraLS(keys_,points_,selectedMatches,&(*Ps)[0]);
 }
 
+int MediatorResectioning6ptLSRANSAC::batchSize() const
+{
+  return 2*batchLanes;
+}
+
+void MediatorResectioning6ptLSRANSAC::computeTransformations(
+  const vector<vector<int>>& samples,vector<vector<Matrix34d>> *Ps) const
+{
+  resectCameraLSBatch(keys_,points_,camToSceneMatches_,samples,Ps);
+}
+
 MediatorResectioning3ptRANSAC::MediatorResectioning3ptRANSAC(
   const vector<Vector2d>& normKeys,const vector<Point>& points,
 	const vector<IntPair>& camToSceneMatches)
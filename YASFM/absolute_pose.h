@@ -142,6 +142,23 @@ YASFM_API void resectCameraLS(const vector<Vector2d>& keys,
   const vector<Point>& points,const vector<IntPair>& camToSceneMatches,
   Matrix34d *P);
 
+/// Non-minimal solver for projection matrix working on a batch of samples.
+/**
+Batched version of resectCameraLS. Samples of 6 matches are solved batchLanes
+at once using Householder QR. Other samples are passed to resectCameraLS.
+
+\param[in] keys Keys.
+\param[in] points Points.
+\param[in] camToSceneMatches .first of the IntPair is key index and .second a point
+index.
+\param[in] samples Samples of indices to camToSceneMatches.
+\param[out] Ps Estimated projection matrices, one vector per sample. The vector 
+is empty for degenerate samples.
+*/
+YASFM_API void resectCameraLSBatch(const vector<Vector2d>& keys,
+  const vector<Point>& points,const vector<IntPair>& camToSceneMatches,
+  const vector<vector<int>>& samples,vector<vector<Matrix34d>> *Ps);
+
 /// Find camera parameters by plugging 3pt solver into RANSAC.
 /**
 \param[in] opt RANSAC options.
@@ -279,6 +296,17 @@ public:
   \param[out] Ps Resulting projection matrices.
   */
   virtual void computeTransformation(const vector<int>& idxs,vector<Matrix34d> *Ps) const;
+
+  /// \return Number of samples passed to computeTransformations at once.
+  virtual int batchSize() const;
+
+  /// Compute transformations from a batch of minimal samples.
+  /**
+  \param[in] samples Samples of indices of matches.
+  \param[out] Ps Resulting projection matrices, one vector per sample.
+  */
+  virtual void computeTransformations(const vector<vector<int>>& samples,
+    vector<vector<Matrix34d>> *Ps) const;
 };
 
 /// Mediator for 3pt minimal solver.
@@ -0,0 +1,244 @@
+//----------------------------------------------------------------------------------------
+/**
+* \file       batched_qr.h
+* \brief      Householder QR of a batch of small fixed-size matrices.
+*
+*  The matrices are stored as structure of arrays, i.e. the same entry of all
+*  the matrices in the batch is stored contiguously. All the loops over the batch
+*  are innermost and branch free so that the compiler can vectorize them.
+*
+*/
+//----------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+
+#include "defines.h"
+
+////////////////////////////////////////////////////
+///////////////   Declarations   ///////////////////
+////////////////////////////////////////////////////
+
+namespace yasfm
+{
+
+/// Number of matrices solved at once. One AVX2 register holds 4 doubles.
+const int batchLanes = 4;
+
+/// Batch of Rows x Cols matrices stored as structure of arrays.
+/**
+Entry (r,c) of the matrix l is stored at data[(r*Cols + c)*Lanes + l].
+*/
+template<int Rows,int Cols,int Lanes>
+struct BatchedMatrix
+{
+  /// \return Entry (r,c) of the matrix l.
+  double& operator()(int r,int c,int l) { return data[(r*Cols + c)*Lanes + l]; }
+  /// \return Entry (r,c) of the matrix l.
+  double operator()(int r,int c,int l) const { return data[(r*Cols + c)*Lanes + l]; }
+  /// \return Entries (r,c) of all the matrices.
+  double *lanes(int r,int c) { return &data[(r*Cols + c)*Lanes]; }
+  /// \return Entries (r,c) of all the matrices.
+  const double *lanes(int r,int c) const { return &data[(r*Cols + c)*Lanes]; }
+
+  double data[Rows*Cols*Lanes];
+};
+
+/// Householder QR decomposition of a batch of matrices.
+/**
+Works for Rows >= Cols as well as for Rows < Cols. Degenerate columns (zero norm)
+get identity reflection and so the decomposition never produces NaNs by itself.
+*/
+template<int Rows,int Cols,int Lanes>
+class BatchedHouseholderQR
+{
+public:
+  /// Number of Householder reflections.
+  static const int nSteps = (Rows < Cols) ? Rows : Cols;
+
+  /// Decompose A = Q*R.
+  /**
+  \param[in] A Matrices to be decomposed.
+  */
+  void compute(const BatchedMatrix<Rows,Cols,Lanes>& A);
+
+  /// Compute y = Q'*y.
+  /**
+  \param[in,out] y Vectors.
+  */
+  void applyQTranspose(BatchedMatrix<Rows,1,Lanes> *y) const;
+
+  /// Get a column of Q.
+  /**
+  For Rows > Cols, the columns Cols,...,Rows-1 of Q span the nullspace of A'.
+
+  \param[in] col Column index.
+  \param[out] q Columns of Q.
+  */
+  void columnOfQ(int col,BatchedMatrix<Rows,1,Lanes> *q) const;
+
+  /// Solve min ||A*x - b|| (requires Rows >= Cols).
+  /**
+  \param[in] b Right hand sides.
+  \param[out] x Solutions. Rank deficient lanes produce non-finite values.
+  */
+  void solve(const BatchedMatrix<Rows,1,Lanes>& b,BatchedMatrix<Cols,1,Lanes> *x) const;
+
+private:
+  /// Apply k-th reflection to a vector.
+  void applyReflection(int k,BatchedMatrix<Rows,1,Lanes> *y) const;
+
+  /// R in the upper triangle and Householder vectors (without their first
+  /// element) under the diagonal.
+  BatchedMatrix<Rows,Cols,Lanes> qr_;
+  double vFirst_[nSteps][Lanes]; ///< First elements of Householder vectors.
+  double beta_[nSteps][Lanes];   ///< Householder coefficients 2/(v'*v).
+};
+
+} // namespace yasfm
+
+////////////////////////////////////////////////////
+///////////////   Definitions   ////////////////////
+////////////////////////////////////////////////////
+
+namespace yasfm
+{
+
+template<int Rows,int Cols,int Lanes>
+void BatchedHouseholderQR<Rows,Cols,Lanes>::compute(const BatchedMatrix<Rows,Cols,Lanes>& A)
+{
+  qr_ = A;
+  for(int k = 0; k < nSteps; k++)
+  {
+    double normSq[Lanes];
+    for(int l = 0; l < Lanes; l++)
+      normSq[l] = 0.;
+    for(int i = k; i < Rows; i++)
+    {
+      const double *a = qr_.lanes(i,k);
+      for(int l = 0; l < Lanes; l++)
+        normSq[l] += a[l] * a[l];
+    }
+
+    // v = x - alpha*e1 with alpha = -sign(x0)*||x|| to avoid cancellation
+    double *diag = qr_.lanes(k,k);
+    for(int l = 0; l < Lanes; l++)
+    {
+      double x0 = diag[l];
+      double alpha = -std::copysign(std::sqrt(normSq[l]),x0);
+      double v0 = x0 - alpha;
+      double vNormSq = normSq[l] - x0*x0 + v0*v0;
+      vFirst_[k][l] = v0;
+      beta_[k][l] = (vNormSq > 0.) ? (2. / vNormSq) : 0.;
+      diag[l] = (vNormSq > 0.) ? alpha : x0;
+    }
+
+    for(int j = k + 1; j < Cols; j++)
+    {
+      double s[Lanes];
+      const double *akj = qr_.lanes(k,j);
+      for(int l = 0; l < Lanes; l++)
+        s[l] = vFirst_[k][l] * akj[l];
+      for(int i = k + 1; i < Rows; i++)
+      {
+        const double *v = qr_.lanes(i,k);
+        const double *aij = qr_.lanes(i,j);
+        for(int l = 0; l < Lanes; l++)
+          s[l] += v[l] * aij[l];
+      }
+      for(int l = 0; l < Lanes; l++)
+        s[l] *= beta_[k][l];
+
+      double *akjOut = qr_.lanes(k,j);
+      for(int l = 0; l < Lanes; l++)
+        akjOut[l] -= s[l] * vFirst_[k][l];
+      for(int i = k + 1; i < Rows; i++)
+      {
+        const double *v = qr_.lanes(i,k);
+        double *aij = qr_.lanes(i,j);
+        for(int l = 0; l < Lanes; l++)
+          aij[l] -= s[l] * v[l];
+      }
+    }
+  }
+}
+
+template<int Rows,int Cols,int Lanes>
+void BatchedHouseholderQR<Rows,Cols,Lanes>::applyReflection(int k,
+  BatchedMatrix<Rows,1,Lanes> *py) const
+{
+  auto& y = *py;
+  double s[Lanes];
+  const double *yk = y.lanes(k,0);
+  for(int l = 0; l < Lanes; l++)
+    s[l] = vFirst_[k][l] * yk[l];
+  for(int i = k + 1; i < Rows; i++)
+  {
+    const double *v = qr_.lanes(i,k);
+    const double *yi = y.lanes(i,0);
+    for(int l = 0; l < Lanes; l++)
+      s[l] += v[l] * yi[l];
+  }
+  for(int l = 0; l < Lanes; l++)
+    s[l] *= beta_[k][l];
+
+  double *ykOut = y.lanes(k,0);
+  for(int l = 0; l < Lanes; l++)
+    ykOut[l] -= s[l] * vFirst_[k][l];
+  for(int i = k + 1; i < Rows; i++)
+  {
+    const double *v = qr_.lanes(i,k);
+    double *yi = y.lanes(i,0);
+    for(int l = 0; l < Lanes; l++)
+      yi[l] -= s[l] * v[l];
+  }
+}
+
+template<int Rows,int Cols,int Lanes>
+void BatchedHouseholderQR<Rows,Cols,Lanes>::applyQTranspose(
+  BatchedMatrix<Rows,1,Lanes> *y) const
+{
+  for(int k = 0; k < nSteps; k++)
+    applyReflection(k,y);
+}
+
+template<int Rows,int Cols,int Lanes>
+void BatchedHouseholderQR<Rows,Cols,Lanes>::columnOfQ(int col,
+  BatchedMatrix<Rows,1,Lanes> *q) const
+{
+  std::fill(q->data,q->data + Rows*Lanes,0.);
+  std::fill(q->lanes(col,0),q->lanes(col,0) + Lanes,1.);
+  for(int k = nSteps - 1; k >= 0; k--)
+    applyReflection(k,q);
+}
+
+template<int Rows,int Cols,int Lanes>
+void BatchedHouseholderQR<Rows,Cols,Lanes>::solve(const BatchedMatrix<Rows,1,Lanes>& b,
+  BatchedMatrix<Cols,1,Lanes> *px) const
+{
+  static_assert(Rows >= Cols,"Least squares solve requires Rows >= Cols.");
+  auto& x = *px;
+  BatchedMatrix<Rows,1,Lanes> y = b;
+  applyQTranspose(&y);
+  for(int j = Cols - 1; j >= 0; j--)
+  {
+    double *xj = x.lanes(j,0);
+    const double *yj = y.lanes(j,0);
+    for(int l = 0; l < Lanes; l++)
+      xj[l] = yj[l];
+    for(int c = j + 1; c < Cols; c++)
+    {
+      const double *r = qr_.lanes(j,c);
+      const double *xc = x.lanes(c,0);
+      for(int l = 0; l < Lanes; l++)
+        xj[l] -= r[l] * xc[l];
+    }
+    const double *rjj = qr_.lanes(j,j);
+    for(int l = 0; l < Lanes; l++)
+      xj[l] /= rjj[l];
+  }
+}
+
+} // namespace yasfm
@@ -2,9 +2,21 @@
 
 #include <iostream>
 
+#include "bundle_adjust_schur.h"
+#include "memory_budget.h"
+
 using std::cerr;
 using std::cout;
 
+namespace
+{
+
+/// Estimated memory taken by the solvers per observation (residual blocks,
+/// Jacobians and the reduced system).
+const size_t nBytesPerObservation = 1024;
+
+} // namespace
+
 namespace yasfm
 {
 
@@ -32,6 +44,15 @@ void bundleAdjustPoints(const OptionsBundleAdjustment& opt,ptr_vector<Camera> *p
 void bundleAdjust(const OptionsBundleAdjustment& opt,const vector<bool>& constantCams,
   const vector<bool>& constantPoints,ptr_vector<Camera> *pcams,vector<Point> *ppts)
 {
+  size_t nObservations = 0;
+  for(const auto& pt : *ppts)
+    nObservations += pt.views.size();
+  memoryBudget().makeRoom(nObservations * nBytesPerObservation);
+
+  if(opt.get<bool>("useSchurSolver") &&
+    bundleAdjustSchur(opt,constantCams,constantPoints,pcams,ppts))
+    return;
+
   auto& cams = *pcams;
   auto& pts = *ppts;
   bool robustify = opt.get<bool>("robustify");
@@ -96,6 +117,86 @@ void bundleAdjust(const OptionsBundleAdjustment& opt,const vector<bool>& constan
   }
 }
 
+void bundleAdjustLocal(const OptionsBundleAdjustment& opt,
+  const uset<int>& camsToOptimize,ptr_vector<Camera> *pcams,vector<Point> *ppts)
+{
+  auto& cams = *pcams;
+  auto& pts = *ppts;
+  bool robustify = opt.get<bool>("robustify");
+
+  // Points seen by the window. visiblePoints contains also points which are
+  // only to be added, therefore, the views have to be checked.
+  vector<bool> ptUsed(pts.size(),false);
+  vector<int> ptsToUse;
+  for(int camIdx : camsToOptimize)
+  {
+    for(int ptIdx : cams[camIdx]->visiblePoints())
+    {
+      if(!ptUsed[ptIdx] && pts[ptIdx].views.count(camIdx) > 0)
+      {
+        ptUsed[ptIdx] = true;
+        ptsToUse.push_back(ptIdx);
+      }
+    }
+  }
+
+  vector<vector<double>> camParams(cams.size());
+  vector<bool> camParamsUsed(cams.size(),false);
+
+  ceres::Problem problem;
+  for(int ptIdx : ptsToUse)
+  {
+    auto& pt = pts[ptIdx];
+    for(const auto& camKey : pt.views)
+    {
+      int camIdx = camKey.first;
+      auto& cam = *cams[camIdx];
+      if(!camParamsUsed[camIdx])
+      {
+        cam.params(&camParams[camIdx]);
+        camParamsUsed[camIdx] = true;
+      }
+
+      int keyIdx = camKey.second;
+      ceres::CostFunction *costFunction = cam.costFunction(keyIdx);
+
+      // NULL specifies squared loss
+      ceres::LossFunction *lossFunction = robustify ? new ceres::HuberLoss(1.0) : NULL;
+
+      problem.AddResidualBlock(costFunction,
+        lossFunction,
+        &camParams[camIdx][0],
+        &pt.coord(0));
+    }
+  }
+
+  for(size_t camIdx = 0; camIdx < cams.size(); camIdx++)
+  {
+    if(camParamsUsed[camIdx])
+    {
+      ceres::CostFunction *costFunction = cams[camIdx]->constraintsCostFunction();
+
+      problem.AddResidualBlock(costFunction,
+        NULL,
+        &camParams[camIdx][0]);
+
+      if(camsToOptimize.count(static_cast<int>(camIdx)) == 0)
+        problem.SetParameterBlockConstant(&camParams[camIdx][0]);
+    }
+  }
+
+  ceres::Solver::Summary summary;
+  ceres::Solve(opt.get<ceres::Solver::Options>("solverOptions"),&problem,&summary);
+
+  for(int camIdx : camsToOptimize)
+  {
+    if(camParamsUsed[camIdx])
+    {
+      cams[camIdx]->setParams(camParams[camIdx]);
+    }
+  }
+}
+
 void bundleAdjustOneCam(const OptionsBundleAdjustment& opt,int camIdx,Camera *pcam,
   vector<Point> *ppts)
 {
@@ -36,6 +36,27 @@ ceres::Solver::Options solverOptions;
 /// Uses Hubers loss function instead of L2 norm, more robust to outliers, 
 /// if set to true.
 bool robustify;
+
+/// Use the in-house Schur complement solver instead of ceres (see bundleAdjustSchur).
+/// Used by bundleAdjust, bundleAdjustCams and bundleAdjustPoints.
+bool useSchurSolver;
+
+/// The reduced camera system with at most this many variable cameras is solved
+/// by dense Cholesky, larger ones by preconditioned conjugate gradients.
+int schurDenseMaxCams;
+
+/// Conjugate gradients settings.
+int schurMaxPCGIterations;
+double schurPCGTolerance;
+
+/// Evaluate the Jacobians in single precision in the Schur solver (see
+/// Camera::evaluateReprojectionErrorFloat). The residuals and the normal equations
+/// stay in double.
+bool schurMixedPrecision;
+
+/// The Schur solver switches to double precision for this many final iterations,
+/// i.e. once the single precision iterations converge or run out. 0 never switches.
+int schurDoubleRefineIterations;
 */
 class OptionsBundleAdjustment : public OptionsWrapper
 {
@@ -45,6 +66,12 @@ public:
   {
     opt.emplace("solverOptions",make_unique<OptTypeWithVal<ceres::Solver::Options>>());
     opt.emplace("robustify",make_unique<OptTypeWithVal<bool>>(false));
+    opt.emplace("useSchurSolver",make_unique<OptTypeWithVal<bool>>(false));
+    opt.emplace("schurDenseMaxCams",make_unique<OptTypeWithVal<int>>(300));
+    opt.emplace("schurMaxPCGIterations",make_unique<OptTypeWithVal<int>>(500));
+    opt.emplace("schurPCGTolerance",make_unique<OptTypeWithVal<double>>(1e-6));
+    opt.emplace("schurMixedPrecision",make_unique<OptTypeWithVal<bool>>(false));
+    opt.emplace("schurDoubleRefineIterations",make_unique<OptTypeWithVal<int>>(2));
 
     auto& solverOptions = get<ceres::Solver::Options>("solverOptions");
     solverOptions.max_num_iterations = 10;
@@ -94,6 +121,21 @@ YASFM_API void bundleAdjust(const OptionsBundleAdjustment& opt,
   const vector<bool>& constantCams,const vector<bool>& constantPoints,
   ptr_vector<Camera> *cams,vector<Point> *pts);
 
+/// Run bundle adjustment on a local window of cameras.
+/**
+Only points observed by at least one camera from camsToOptimize enter the problem.
+Other cameras observing these points are added as well but are kept constant so
+that they anchor the window. The cost is given by the size of the window and not
+by the size of the whole reconstruction.
+
+\param[in] opt Options.
+\param[in] camsToOptimize Cameras which should be optimized.
+\param[in,out] cams Cameras.
+\param[in,out] pts Points.
+*/
+YASFM_API void bundleAdjustLocal(const OptionsBundleAdjustment& opt,
+  const uset<int>& camsToOptimize,ptr_vector<Camera> *cams,vector<Point> *pts);
+
 /// Run bundle adjustment of one camera and keep all the points fixed.
 /**
 \param[in] opt Options.
@@ -0,0 +1,804 @@
+#include "bundle_adjust_schur.h"
+
+#include <algorithm>
+#include <cmath>
+#include <ctime>
+#include <iostream>
+#include <memory>
+
+#include "Eigen/Dense"
+#include "Eigen/StdVector"
+
+using Eigen::Dynamic;
+using Eigen::LLT;
+using Eigen::Matrix;
+using Eigen::Matrix3d;
+using Eigen::MatrixXd;
+using Eigen::RowMajor;
+using Eigen::Vector2d;
+using Eigen::Vector3d;
+using Eigen::Vector3f;
+using Eigen::VectorXd;
+using std::cout;
+using std::unique_ptr;
+
+namespace
+{
+
+using namespace yasfm;
+
+template<class T>
+using aligned_vector = std::vector<T,Eigen::aligned_allocator<T>>;
+
+/// Levenberg-Marquardt bundle adjuster for cameras with N parameters.
+template<int N>
+class SchurBundleAdjuster
+{
+public:
+  typedef Matrix<double,N,1> VecN;
+  typedef Matrix<double,N,N> MatNN;
+  typedef Matrix<double,N,3> MatN3;
+  typedef Matrix<double,2,N,RowMajor> Mat2N;
+  typedef Matrix<double,2,3,RowMajor> Mat23;
+  typedef Matrix<double,Dynamic,N,RowMajor> MatXN;
+  typedef Matrix<float,N,1> VecNf;
+  typedef Matrix<float,2,N,RowMajor> Mat2Nf;
+  typedef Matrix<float,2,3,RowMajor> Mat23f;
+
+  /// Constructor. Sets up the problem.
+  SchurBundleAdjuster(const OptionsBundleAdjustment& opt,
+    const vector<bool>& constantCams,const vector<bool>& constantPoints,
+    ptr_vector<Camera> *cams,vector<Point> *pts);
+
+  /// Run the optimization and write the results back.
+  void solve();
+
+private:
+  /// Compute the cost (and residuals and Jacobians). Jacobians in single precision
+  /// if useFloat_.
+  /** \param[in] camParams Camera parameters.
+  \param[in] ptCoords Point coordinates.
+  \param[in] computeJacobians Linearize or only compute the cost.
+  \param[in] reuseResiduals Take the residuals from the last evaluation without
+  Jacobians, i.e. the parameters have to be the same as back then.
+  \return The cost. */
+  double evaluate(const aligned_vector<VecN>& camParams,
+    const vector<Vector3d>& ptCoords,bool computeJacobians,bool reuseResiduals = false);
+
+  /// Compute U,g for cameras, V,g for points and W for observations.
+  void buildNormalEquations();
+
+  /// Solve the damped system.
+  /// \return False if the reduced camera system could not be solved.
+  bool computeStep(double mu,aligned_vector<VecN> *dc,vector<Vector3d> *dp,
+    double *predictedReduction);
+
+  /// Solve S*x = b using dense Cholesky.
+  bool solveDense(const vector<aligned_vector<MatNN>>& S,const VectorXd& b,
+    VectorXd *x) const;
+
+  /// Solve S*x = b using block-Jacobi preconditioned conjugate gradients.
+  bool solvePCG(const vector<aligned_vector<MatNN>>& S,const VectorXd& b,
+    VectorXd *x) const;
+
+  /// \return Index of the block of cam d in the row of var cam c.
+  int blockIdx(int c,int d) const;
+
+  struct Observation
+  {
+    int cam; ///< Local camera index.
+    int pt;  ///< Local point index.
+    int key; ///< Key index in the camera.
+  };
+
+  const OptionsBundleAdjustment& opt_;
+  ptr_vector<Camera>& cams_;
+  vector<Point>& pts_;
+  bool robustify_;
+  int nThreads_;
+  bool useFloat_; ///< Evaluate in single precision (schurMixedPrecision).
+  int nRefineIterations_;
+
+  // Problem structure.
+  vector<int> camsGlobal_;  ///< Global index of every local camera.
+  vector<int> camVar_;      ///< Variable index of every local camera (-1 for constant).
+  vector<int> varCams_;     ///< Local index of every variable camera.
+  vector<int> ptsGlobal_;   ///< Global index of every local point.
+  vector<int> ptVar_;       ///< Variable index of every local point (-1 for constant).
+  vector<Observation> obs_; ///< Grouped by points.
+  vector<int> ptObsBegin_;  ///< Observations of point p are [ptObsBegin_[p],ptObsBegin_[p+1]).
+  vector<vector<int>> varCamObs_;       ///< Observations of every variable camera.
+  vector<vector<int>> varCamNeighbors_; ///< Sorted variable cameras sharing a variable point.
+  vector<unique_ptr<ceres::CostFunction>> costs_;
+  vector<unique_ptr<ceres::CostFunction>> constraintCosts_;
+
+  // Parameters.
+  aligned_vector<VecN> camParams_;
+  vector<Vector3d> ptCoords_;
+  aligned_vector<VecNf> camParamsFloat_; ///< Copy of the evaluated parameters.
+  vector<Vector3f> ptCoordsFloat_;       ///< Copy of the evaluated points.
+
+  // Linearization.
+  aligned_vector<Vector2d> unweightedResiduals_; ///< From the last cost evaluation.
+  aligned_vector<Vector2d> r_;
+  aligned_vector<Mat2N> Jc_;
+  aligned_vector<Mat23> Jp_;
+  aligned_vector<MatNN> constraintsJtJ_;
+  aligned_vector<VecN> constraintsJtr_;
+  aligned_vector<MatNN> U_;
+  aligned_vector<VecN> gc_;
+  vector<Matrix3d> V_;
+  vector<Vector3d> gp_;
+  aligned_vector<MatN3> W_;
+};
+
+/// Clamp diagonal used for damping.
+double clampDiag(double d)
+{
+  return std::min(std::max(d,1e-6),1e32);
+}
+
+/// Huber loss with scale 1 (the same as ceres::HuberLoss(1.0)).
+/**
+\param[in] s Squared norm of the residual.
+\param[out] derivative First derivative of the loss (can be NULL).
+\return Loss.
+*/
+double huberLoss(double s,double *derivative)
+{
+  if(s > 1.)
+  {
+    double r = sqrt(s);
+    if(derivative)
+      *derivative = 1. / r;
+    return 2.*r - 1.;
+  } else
+  {
+    if(derivative)
+      *derivative = 1.;
+    return s;
+  }
+}
+
+template<int N>
+SchurBundleAdjuster<N>::SchurBundleAdjuster(const OptionsBundleAdjustment& opt,
+  const vector<bool>& constantCams,const vector<bool>& constantPoints,
+  ptr_vector<Camera> *cams,vector<Point> *pts)
+  : opt_(opt),cams_(*cams),pts_(*pts)
+{
+  const auto& solverOptions = opt.get<ceres::Solver::Options>("solverOptions");
+  robustify_ = opt.get<bool>("robustify");
+  nThreads_ = std::max(1,solverOptions.num_threads);
+  useFloat_ = opt.get<bool>("schurMixedPrecision");
+  nRefineIterations_ = opt.get<int>("schurDoubleRefineIterations");
+
+  vector<int> camLocal(cams_.size(),-1);
+  for(int ptIdx = 0; ptIdx < static_cast<int>(pts_.size()); ptIdx++)
+  {
+    const auto& pt = pts_[ptIdx];
+    if(pt.views.empty())
+      continue;
+
+    int p = static_cast<int>(ptsGlobal_.size());
+    ptsGlobal_.push_back(ptIdx);
+    ptCoords_.push_back(pt.coord);
+    ptObsBegin_.push_back(static_cast<int>(obs_.size()));
+    for(const auto& camKey : pt.views)
+    {
+      int camIdx = camKey.first;
+      if(camLocal[camIdx] < 0)
+      {
+        camLocal[camIdx] = static_cast<int>(camsGlobal_.size());
+        camsGlobal_.push_back(camIdx);
+        vector<double> params;
+        cams_[camIdx]->params(&params);
+        camParams_.push_back(Eigen::Map<const VecN>(&params[0]));
+      }
+      Observation o;
+      o.cam = camLocal[camIdx];
+      o.pt = p;
+      o.key = camKey.second;
+      obs_.push_back(o);
+      costs_.emplace_back(cams_[camIdx]->costFunction(camKey.second));
+    }
+  }
+  ptObsBegin_.push_back(static_cast<int>(obs_.size()));
+
+  int nCams = static_cast<int>(camsGlobal_.size());
+  if(useFloat_)
+  {
+    // Every camera has to support the single precision evaluation.
+    vector<bool> isChecked(nCams,false);
+    for(const auto& o : obs_)
+    {
+      if(isChecked[o.cam])
+        continue;
+      isChecked[o.cam] = true;
+      VecNf params = camParams_[o.cam].template cast<float>();
+      Vector3f coord = ptCoords_[o.pt].template cast<float>();
+      float r[2];
+      if(!cams_[camsGlobal_[o.cam]]->evaluateReprojectionErrorFloat(o.key,params.data(),
+        coord.data(),r,NULL,NULL))
+      {
+        useFloat_ = false;
+        break;
+      }
+    }
+  }
+  camVar_.assign(nCams,-1);
+  for(int c = 0; c < nCams; c++)
+  {
+    constraintCosts_.emplace_back(cams_[camsGlobal_[c]]->constraintsCostFunction());
+    if(!constantCams[camsGlobal_[c]])
+    {
+      camVar_[c] = static_cast<int>(varCams_.size());
+      varCams_.push_back(c);
+    }
+  }
+
+  int nPts = static_cast<int>(ptsGlobal_.size());
+  int nVarPts = 0;
+  ptVar_.assign(nPts,-1);
+  for(int p = 0; p < nPts; p++)
+  {
+    if(!constantPoints[ptsGlobal_[p]])
+      ptVar_[p] = nVarPts++;
+  }
+
+  int nVarCams = static_cast<int>(varCams_.size());
+  varCamObs_.resize(nVarCams);
+  varCamNeighbors_.resize(nVarCams);
+  for(int o = 0; o < static_cast<int>(obs_.size()); o++)
+  {
+    int c = camVar_[obs_[o].cam];
+    if(c >= 0)
+      varCamObs_[c].push_back(o);
+  }
+  for(int p = 0; p < nPts; p++)
+  {
+    if(ptVar_[p] < 0)
+      continue;
+    for(int o1 = ptObsBegin_[p]; o1 < ptObsBegin_[p + 1]; o1++)
+    {
+      int c = camVar_[obs_[o1].cam];
+      if(c < 0)
+        continue;
+      for(int o2 = ptObsBegin_[p]; o2 < ptObsBegin_[p + 1]; o2++)
+      {
+        int d = camVar_[obs_[o2].cam];
+        if(d >= 0)
+          varCamNeighbors_[c].push_back(d);
+      }
+    }
+  }
+  for(int c = 0; c < nVarCams; c++)
+  {
+    auto& neighbors = varCamNeighbors_[c];
+    neighbors.push_back(c); // the diagonal block is always present
+    std::sort(neighbors.begin(),neighbors.end());
+    neighbors.erase(std::unique(neighbors.begin(),neighbors.end()),neighbors.end());
+  }
+
+  size_t nObs = obs_.size();
+  unweightedResiduals_.resize(nObs);
+  r_.resize(nObs);
+  Jc_.resize(nObs);
+  Jp_.resize(nObs);
+  W_.resize(nObs);
+  constraintsJtJ_.resize(nCams);
+  constraintsJtr_.resize(nCams);
+  U_.resize(nVarCams);
+  gc_.resize(nVarCams);
+  V_.resize(nPts);
+  gp_.resize(nPts);
+}
+
+template<int N>
+double SchurBundleAdjuster<N>::evaluate(const aligned_vector<VecN>& camParams,
+  const vector<Vector3d>& ptCoords,bool computeJacobians,bool reuseResiduals)
+{
+  int nObs = static_cast<int>(obs_.size());
+  bool useFloat = useFloat_ && computeJacobians;
+  if(useFloat)
+  {
+    camParamsFloat_.resize(camParams.size());
+    for(size_t c = 0; c < camParams.size(); c++)
+      camParamsFloat_[c] = camParams[c].template cast<float>();
+    ptCoordsFloat_.resize(ptCoords.size());
+    for(size_t p = 0; p < ptCoords.size(); p++)
+      ptCoordsFloat_[p] = ptCoords[p].template cast<float>();
+  }
+
+  double cost = 0.;
+#pragma omp parallel for num_threads(nThreads_) schedule(static) reduction(+:cost)
+  for(int o = 0; o < nObs; o++)
+  {
+    Vector2d r;
+    Mat2N Jc;
+    Mat23 Jp;
+    const double *params[2] = {camParams[obs_[o].cam].data(),ptCoords[obs_[o].pt].data()};
+    bool success;
+    if(useFloat)
+    {
+      // Only the Jacobians in single precision. The residuals decide about
+      // accepting the steps and single precision is too coarse for that.
+      Eigen::Vector2f rf;
+      Mat2Nf Jcf;
+      Mat23f Jpf;
+      success = cams_[camsGlobal_[obs_[o].cam]]->evaluateReprojectionErrorFloat(
+        obs_[o].key,camParamsFloat_[obs_[o].cam].data(),ptCoordsFloat_[obs_[o].pt].data(),
+        rf.data(),Jcf.data(),Jpf.data());
+      if(reuseResiduals)
+        r = unweightedResiduals_[o];
+      else
+        success = success && costs_[o]->Evaluate(params,r.data(),NULL);
+      Jc = Jcf.template cast<double>();
+      Jp = Jpf.template cast<double>();
+    } else
+    {
+      double *jacobians[2] = {Jc.data(),Jp.data()};
+      success = costs_[o]->Evaluate(params,r.data(),computeJacobians ? jacobians : NULL);
+    }
+    if(!success)
+    {
+      r.setZero();
+      Jc.setZero();
+      Jp.setZero();
+    }
+    if(!computeJacobians)
+      unweightedResiduals_[o] = r;
+
+    double s = r.squaredNorm();
+    double derivative = 1.;
+    cost += robustify_ ? huberLoss(s,&derivative) : s;
+    if(computeJacobians)
+    {
+      // Iteratively reweighted least squares.
+      double w = sqrt(derivative);
+      r_[o] = w*r;
+      Jc_[o] = w*Jc;
+      Jp_[o] = w*Jp;
+    }
+  }
+
+  int nCams = static_cast<int>(camsGlobal_.size());
+  for(int c = 0; c < nCams; c++)
+  {
+    const auto& constraintCost = constraintCosts_[c];
+    int nResiduals = constraintCost->num_residuals();
+    const double *params[1] = {camParams[c].data()};
+    VectorXd r(nResiduals);
+    MatXN J(nResiduals,N);
+    double *jacobians[1] = {J.data()};
+    constraintCost->Evaluate(params,r.data(),computeJacobians ? jacobians : NULL);
+    cost += r.squaredNorm();
+    if(computeJacobians)
+    {
+      constraintsJtJ_[c].noalias() = J.transpose() * J;
+      constraintsJtr_[c].noalias() = J.transpose() * r;
+    }
+  }
+
+  return 0.5*cost;
+}
+
+template<int N>
+void SchurBundleAdjuster<N>::buildNormalEquations()
+{
+  int nVarCams = static_cast<int>(varCams_.size());
+#pragma omp parallel for num_threads(nThreads_) schedule(dynamic)
+  for(int c = 0; c < nVarCams; c++)
+  {
+    int cLocal = varCams_[c];
+    U_[c] = constraintsJtJ_[cLocal];
+    gc_[c] = constraintsJtr_[cLocal];
+    for(int o : varCamObs_[c])
+    {
+      U_[c].noalias() += Jc_[o].transpose() * Jc_[o];
+      gc_[c].noalias() += Jc_[o].transpose() * r_[o];
+    }
+  }
+
+  int nPts = static_cast<int>(ptsGlobal_.size());
+#pragma omp parallel for num_threads(nThreads_) schedule(dynamic)
+  for(int p = 0; p < nPts; p++)
+  {
+    if(ptVar_[p] < 0)
+      continue;
+    V_[p].setZero();
+    gp_[p].setZero();
+    for(int o = ptObsBegin_[p]; o < ptObsBegin_[p + 1]; o++)
+    {
+      V_[p].noalias() += Jp_[o].transpose() * Jp_[o];
+      gp_[p].noalias() += Jp_[o].transpose() * r_[o];
+      if(camVar_[obs_[o].cam] >= 0)
+        W_[o].noalias() = Jc_[o].transpose() * Jp_[o];
+    }
+  }
+}
+
+template<int N>
+int SchurBundleAdjuster<N>::blockIdx(int c,int d) const
+{
+  const auto& neighbors = varCamNeighbors_[c];
+  return static_cast<int>(
+    std::lower_bound(neighbors.begin(),neighbors.end(),d) - neighbors.begin());
+}
+
+template<int N>
+bool SchurBundleAdjuster<N>::computeStep(double mu,aligned_vector<VecN> *pdc,
+  vector<Vector3d> *pdp,double *predictedReduction)
+{
+  auto& dc = *pdc;
+  auto& dp = *pdp;
+  int nVarCams = static_cast<int>(varCams_.size());
+  int nPts = static_cast<int>(ptsGlobal_.size());
+
+  // Eliminate points.
+  vector<Matrix3d> Vinv(nPts);
+  vector<Vector3d> Vdiag(nPts);
+#pragma omp parallel for num_threads(nThreads_) schedule(static)
+  for(int p = 0; p < nPts; p++)
+  {
+    if(ptVar_[p] < 0)
+      continue;
+    Matrix3d Vdamped = V_[p];
+    for(int i = 0; i < 3; i++)
+    {
+      Vdiag[p](i) = mu*clampDiag(V_[p](i,i));
+      Vdamped(i,i) += Vdiag[p](i);
+    }
+    Vinv[p] = Vdamped.inverse();
+  }
+
+  // Reduced camera system. Every thread builds whole rows.
+  vector<aligned_vector<MatNN>> S(nVarCams);
+  aligned_vector<VecN> Udiag(nVarCams);
+  VectorXd b(N*nVarCams);
+#pragma omp parallel for num_threads(nThreads_) schedule(dynamic)
+  for(int c = 0; c < nVarCams; c++)
+  {
+    auto& row = S[c];
+    row.assign(varCamNeighbors_[c].size(),MatNN::Zero());
+    MatNN& diagBlock = row[blockIdx(c,c)];
+    diagBlock = U_[c];
+    for(int i = 0; i < N; i++)
+    {
+      Udiag[c](i) = mu*clampDiag(U_[c](i,i));
+      diagBlock(i,i) += Udiag[c](i);
+    }
+
+    VecN bc = -gc_[c];
+    for(int o : varCamObs_[c])
+    {
+      int p = obs_[o].pt;
+      if(ptVar_[p] < 0)
+        continue;
+      MatN3 WVinv = W_[o] * Vinv[p];
+      bc.noalias() += WVinv * gp_[p];
+      for(int o2 = ptObsBegin_[p]; o2 < ptObsBegin_[p + 1]; o2++)
+      {
+        int d = camVar_[obs_[o2].cam];
+        if(d >= 0)
+          row[blockIdx(c,d)].noalias() -= WVinv * W_[o2].transpose();
+      }
+    }
+    b.segment<N>(N*c) = bc;
+  }
+
+  VectorXd x;
+  int denseMaxCams = opt_.get<int>("schurDenseMaxCams");
+  bool success = (nVarCams <= denseMaxCams) ? solveDense(S,b,&x) : solvePCG(S,b,&x);
+  if(!success)
+    return false;
+
+  // Back substitution.
+  dc.assign(camsGlobal_.size(),VecN::Zero());
+  for(int c = 0; c < nVarCams; c++)
+    dc[varCams_[c]] = x.segment<N>(N*c);
+
+  dp.assign(nPts,Vector3d::Zero());
+  double reduction = 0.;
+#pragma omp parallel for num_threads(nThreads_) schedule(static) reduction(+:reduction)
+  for(int p = 0; p < nPts; p++)
+  {
+    if(ptVar_[p] < 0)
+      continue;
+    Vector3d rhs = -gp_[p];
+    for(int o = ptObsBegin_[p]; o < ptObsBegin_[p + 1]; o++)
+    {
+      if(camVar_[obs_[o].cam] >= 0)
+        rhs.noalias() -= W_[o].transpose() * dc[obs_[o].cam];
+    }
+    dp[p] = Vinv[p] * rhs;
+    reduction += dp[p].dot(Vdiag[p].cwiseProduct(dp[p]) - gp_[p]);
+  }
+  for(int c = 0; c < nVarCams; c++)
+  {
+    const auto& d = dc[varCams_[c]];
+    reduction += d.dot(Udiag[c].cwiseProduct(d) - gc_[c]);
+  }
+
+  // L(0) - L(step) for the linearized (and damped) problem.
+  *predictedReduction = 0.5*reduction;
+  return true;
+}
+
+template<int N>
+bool SchurBundleAdjuster<N>::solveDense(const vector<aligned_vector<MatNN>>& S,
+  const VectorXd& b,VectorXd *x) const
+{
+  int nVarCams = static_cast<int>(S.size());
+  MatrixXd dense(MatrixXd::Zero(N*nVarCams,N*nVarCams));
+  for(int c = 0; c < nVarCams; c++)
+  {
+    const auto& neighbors = varCamNeighbors_[c];
+    for(size_t i = 0; i < neighbors.size(); i++)
+      dense.block<N,N>(N*c,N*neighbors[i]) = S[c][i];
+  }
+
+  LLT<MatrixXd> llt(dense);
+  if(llt.info() != Eigen::Success)
+    return false;
+  *x = llt.solve(b);
+  return true;
+}
+
+template<int N>
+bool SchurBundleAdjuster<N>::solvePCG(const vector<aligned_vector<MatNN>>& S,
+  const VectorXd& b,VectorXd *px) const
+{
+  auto& x = *px;
+  int nVarCams = static_cast<int>(S.size());
+  int maxIterations = opt_.get<int>("schurMaxPCGIterations");
+  double tolerance = opt_.get<double>("schurPCGTolerance");
+
+  // Block-Jacobi preconditioner.
+  aligned_vector<MatNN> Minv(nVarCams);
+  for(int c = 0; c < nVarCams; c++)
+  {
+    LLT<MatNN> llt(S[c][blockIdx(c,c)]);
+    if(llt.info() != Eigen::Success)
+      return false;
+    Minv[c] = llt.solve(MatNN::Identity());
+  }
+
+  auto multiplyS = [&](const VectorXd& v,VectorXd *pout)
+  {
+    auto& out = *pout;
+#pragma omp parallel for num_threads(nThreads_) schedule(dynamic)
+    for(int c = 0; c < nVarCams; c++)
+    {
+      VecN sum(VecN::Zero());
+      const auto& neighbors = varCamNeighbors_[c];
+      for(size_t i = 0; i < neighbors.size(); i++)
+        sum.noalias() += S[c][i] * v.segment<N>(N*neighbors[i]);
+      out.segment<N>(N*c) = sum;
+    }
+  };
+  auto precondition = [&](const VectorXd& v,VectorXd *pout)
+  {
+    auto& out = *pout;
+    for(int c = 0; c < nVarCams; c++)
+      out.segment<N>(N*c).noalias() = Minv[c] * v.segment<N>(N*c);
+  };
+
+  x.setZero(b.size());
+  VectorXd r = b;
+  VectorXd z(b.size()),q(b.size());
+  precondition(r,&z);
+  VectorXd p = z;
+  double rz = r.dot(z);
+  double bNorm = b.norm();
+  if(bNorm == 0.)
+    return true;
+  for(int it = 0; it < maxIterations; it++)
+  {
+    multiplyS(p,&q);
+    double pq = p.dot(q);
+    if(pq <= 0.)
+      return it > 0; // not positive definite
+    double alpha = rz / pq;
+    x += alpha*p;
+    r -= alpha*q;
+    if(r.norm() <= tolerance*bNorm)
+      break;
+    precondition(r,&z);
+    double rzNew = r.dot(z);
+    p = z + (rzNew / rz)*p;
+    rz = rzNew;
+  }
+  return true;
+}
+
+template<int N>
+void SchurBundleAdjuster<N>::solve()
+{
+  const auto& solverOptions = opt_.get<ceres::Solver::Options>("solverOptions");
+  bool verbose = solverOptions.minimizer_progress_to_stdout;
+  int nCams = static_cast<int>(camsGlobal_.size());
+  int nPts = static_cast<int>(ptsGlobal_.size());
+
+  clock_t start = clock();
+  double cost = evaluate(camParams_,ptCoords_,true);
+  double initialCost = cost;
+  double mu = 1e-4;
+  double nu = 2.;
+  int iteration = 0;
+  aligned_vector<VecN> dc,camParamsNew(nCams);
+  vector<Vector3d> dp,ptCoordsNew(nPts);
+  bool converged = false;
+  while(true)
+  {
+    if(useFloat_ && nRefineIterations_ > 0 && (converged ||
+      iteration >= solverOptions.max_num_iterations - nRefineIterations_))
+    {
+      // Refine the single precision solution.
+      useFloat_ = false;
+      converged = false;
+      cost = evaluate(camParams_,ptCoords_,true);
+      mu = std::min(mu,1e-4);
+      nu = 2.;
+      if(verbose)
+        cout << "switching to double precision\tcost " << cost << "\n";
+    }
+    if(converged || iteration >= solverOptions.max_num_iterations)
+      break;
+
+    buildNormalEquations();
+
+    double maxGradient = 0.;
+    for(const auto& g : gc_)
+      maxGradient = std::max(maxGradient,g.cwiseAbs().maxCoeff());
+    for(int p = 0; p < nPts; p++)
+    {
+      if(ptVar_[p] >= 0)
+        maxGradient = std::max(maxGradient,gp_[p].cwiseAbs().maxCoeff());
+    }
+    if(maxGradient <= solverOptions.gradient_tolerance)
+    {
+      converged = true;
+      continue;
+    }
+
+    bool stepAccepted = false;
+    while(!stepAccepted && mu < 1e32)
+    {
+      double predictedReduction;
+      if(!computeStep(mu,&dc,&dp,&predictedReduction) || predictedReduction <= 0.)
+      {
+        mu *= nu;
+        nu *= 2.;
+        continue;
+      }
+
+      // Constant parameters do not count, as in ceres.
+      double stepNormSq = 0.,paramsNormSq = 0.;
+      for(int c = 0; c < nCams; c++)
+      {
+        camParamsNew[c] = camParams_[c] + dc[c];
+        if(camVar_[c] < 0)
+          continue;
+        stepNormSq += dc[c].squaredNorm();
+        paramsNormSq += camParams_[c].squaredNorm();
+      }
+      for(int p = 0; p < nPts; p++)
+      {
+        ptCoordsNew[p] = ptCoords_[p] + dp[p];
+        if(ptVar_[p] < 0)
+          continue;
+        stepNormSq += dp[p].squaredNorm();
+        paramsNormSq += ptCoords_[p].squaredNorm();
+      }
+      if(sqrt(stepNormSq) <= solverOptions.parameter_tolerance*
+        (sqrt(paramsNormSq) + solverOptions.parameter_tolerance))
+      {
+        converged = true;
+        break;
+      }
+
+      double newCost = evaluate(camParamsNew,ptCoordsNew,false);
+      double rho = (cost - newCost) / predictedReduction;
+      if(rho > 0.)
+      {
+        stepAccepted = true;
+        if(std::abs(cost - newCost) <= solverOptions.function_tolerance*cost)
+          converged = true;
+        camParams_.swap(camParamsNew);
+        ptCoords_.swap(ptCoordsNew);
+        // The trial evaluation computed the residuals at the new parameters.
+        cost = evaluate(camParams_,ptCoords_,true,true);
+        mu *= std::max(1. / 3.,1. - pow(2.*rho - 1.,3));
+        nu = 2.;
+      } else
+      {
+        mu *= nu;
+        nu *= 2.;
+      }
+    }
+    if(!stepAccepted)
+    {
+      // In single precision this can be only the rounding, the refinement decides.
+      converged = true;
+      continue;
+    }
+
+    iteration++;
+    if(verbose)
+    {
+      cout << "iter " << iteration << "\tcost " << cost << "\tmu " << mu << "\t"
+        << (double)(clock() - start) / (double)CLOCKS_PER_SEC << "s\n";
+    }
+  }
+
+  if(verbose)
+  {
+    cout << "schur bundle adjustment: " << iteration << " iterations, cost "
+      << initialCost << " -> " << cost << "\n";
+  }
+
+  vector<double> params(N);
+  for(int c = 0; c < nCams; c++)
+  {
+    if(camVar_[c] >= 0)
+    {
+      VecN::Map(&params[0]) = camParams_[c];
+      cams_[camsGlobal_[c]]->setParams(params);
+    }
+  }
+  for(int p = 0; p < nPts; p++)
+  {
+    if(ptVar_[p] >= 0)
+      pts_[ptsGlobal_[p]].coord = ptCoords_[p];
+  }
+}
+
+} // namespace
+
+namespace yasfm
+{
+
+bool bundleAdjustSchur(const OptionsBundleAdjustment& opt,
+  const vector<bool>& constantCams,const vector<bool>& constantPoints,
+  ptr_vector<Camera> *pcams,vector<Point> *ppts)
+{
+  auto& cams = *pcams;
+  const auto& pts = *ppts;
+
+  int nParams = -1;
+  vector<double> params;
+  for(const auto& pt : pts)
+  {
+    for(const auto& camKey : pt.views)
+    {
+      cams[camKey.first]->params(&params);
+      int n = static_cast<int>(params.size());
+      if(nParams >= 0 && n != nParams)
+      {
+        YASFM_PRINT_ERROR("All cameras have to have the same number of parameters.");
+        return false;
+      }
+      nParams = n;
+    }
+  }
+
+  if(nParams < 0)
+  {
+    return true; // nothing to optimize
+  } else if(nParams == 7)
+  {
+    SchurBundleAdjuster<7> ba(opt,constantCams,constantPoints,pcams,ppts);
+    ba.solve();
+  } else if(nParams == 9)
+  {
+    SchurBundleAdjuster<9> ba(opt,constantCams,constantPoints,pcams,ppts);
+    ba.solve();
+  } else
+  {
+    YASFM_PRINT_ERROR("Unsupported number of camera parameters: " << nParams << ".");
+    return false;
+  }
+  return true;
+}
+
+} // namespace yasfm
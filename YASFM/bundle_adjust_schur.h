@@ -0,0 +1,49 @@
+//----------------------------------------------------------------------------------------
+/**
+* \file       bundle_adjust_schur.h
+* \brief      Bundle adjustment using explicit Schur complement.
+*
+*  In-house bundle adjustment specialized for cameras with a fixed number
+*  of parameters (StandardCamera and StandardCameraRadial).
+*
+*/
+//----------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <vector>
+
+#include "defines.h"
+#include "sfm_data.h"
+#include "bundle_adjust.h"
+
+using std::vector;
+
+namespace yasfm
+{
+
+/// Run bundle adjustment using the in-house Schur complement solver.
+/**
+Levenberg-Marquardt with fixed-size Jacobian blocks (evaluated by the cameras' cost
+functions), explicit Schur complement with multithreaded point elimination and
+the reduced camera system solved either by dense Cholesky or by block-Jacobi
+preconditioned conjugate gradients (see schurDenseMaxCams). Block operations use
+fixed-size Eigen matrices which get vectorized.
+
+Supported are cameras with 7 (StandardCamera) or 9 (StandardCameraRadial) parameters.
+All the cameras in the problem have to have the same number of parameters.
+Uses max_num_iterations, function_tolerance, parameter_tolerance, gradient_tolerance,
+num_threads and minimizer_progress_to_stdout from solverOptions.
+
+\param[in] opt Options.
+\param[in] constantCams Which cameras should be kept constant.
+\param[in] constantPoints Which points should be kept constant.
+\param[in,out] cams Cameras.
+\param[in,out] pts Points.
+\return False if the cameras are not supported. Nothing is changed in that case.
+*/
+YASFM_API bool bundleAdjustSchur(const OptionsBundleAdjustment& opt,
+  const vector<bool>& constantCams,const vector<bool>& constantPoints,
+  ptr_vector<Camera> *cams,vector<Point> *pts);
+
+} // namespace yasfm
@@ -8,6 +8,7 @@
 
 #include "zlib/zlib.h"
 
+#include "memory_budget.h"
 #include "utils_io.h"
 
 using Eigen::VectorXf;
@@ -19,6 +20,29 @@ using std::ofstream;
 using std::recursive_mutex;
 using std::unique_lock;
 
+namespace
+{
+
+/// Descriptors of all the cameras as one consumer of the memory budget.
+class DescrMemoryConsumer : public yasfm::MemoryConsumer
+{
+public:
+  virtual string memoryConsumerName() const override { return "descriptors"; }
+  virtual size_t memoryUsage() const override
+  {
+    return yasfm::Camera::descrMemoryUsage();
+  }
+  virtual size_t releaseMemory(size_t nBytes) override
+  {
+    return yasfm::Camera::releaseDescr(nBytes);
+  }
+};
+
+DescrMemoryConsumer descrMemoryConsumer;
+std::once_flag descrMemoryConsumerRegistered;
+
+} // namespace
+
 namespace yasfm
 {
 
@@ -26,24 +50,62 @@ recursive_mutex mtx; ///< For locking the static variables.
 size_t Camera::nDescrInMemoryTotal_ = 0;
 list<Camera *> Camera::camsWithLoadedDescr_;
 size_t Camera::maxDescrInMemoryTotal_ = 4000000;
+size_t Camera::nDescrLoads_ = 0;
+size_t Camera::nDescrBytesInMemoryTotal_ = 0;
+
+size_t Camera::numDescrLoads()
+{
+  unique_lock<recursive_mutex> lck(mtx);
+  return nDescrLoads_;
+}
+
+size_t Camera::descrMemoryUsage()
+{
+  unique_lock<recursive_mutex> lck(mtx);
+  return nDescrBytesInMemoryTotal_;
+}
+
+size_t Camera::releaseDescr(size_t nBytes)
+{
+  unique_lock<recursive_mutex> lck(mtx);
+  size_t nReleased = 0;
+  auto it = camsWithLoadedDescr_.begin();
+  while(nReleased < nBytes && it != camsWithLoadedDescr_.end())
+  {
+    Camera *cam = *it;
+    ++it;
+    if(cam->nDescrPins_ == 0)
+    {
+      nReleased += cam->descr_.size() * sizeof(float);
+      cam->clearDescriptors();
+    }
+  }
+  return nReleased;
+}
 
 Camera::Camera()
 {
 	imgWidth_ = -1;
 	imgHeight_ = -1;
+	hasGPS_ = false;
+	nDescrPins_ = 0;
 }
 
-Camera::Camera(const string& imgFilename,const string& featuresDir)
-  : imgFilename_(imgFilename),imgWidth_(-1),imgHeight_(-1)
+Camera::Camera(const string& imgFilename,const string& featuresDir,
+  int imgWidth,int imgHeight)
+  : imgFilename_(imgFilename),imgWidth_(imgWidth),imgHeight_(imgHeight),hasGPS_(false),
+  nDescrPins_(0)
 {
   string fn = extractFilename(imgFilename);
   size_t dotPos = fn.find_last_of(".");
   featsFilename_ = joinPaths(featuresDir,fn.substr(0,dotPos) + ".feat.gz");
 
-  getImgDims(imgFilename,&imgWidth_,&imgHeight_);
+  if(imgWidth_ <= 0 || imgHeight_ <= 0)
+    getImgDims(imgFilename,&imgWidth_,&imgHeight_);
 }
 
 Camera::Camera(istream& file)
+  : hasGPS_(false),nDescrPins_(0)
 {
   file >> imgFilename_;
   file >> imgWidth_ >> imgHeight_;
@@ -55,8 +117,15 @@ Camera::Camera(istream& file)
 }
 
 Camera::Camera(const Camera& o)
+  : nDescrPins_(0)
 {
-  copyIn(o);
+  copyIn(o,true);
+}
+
+Camera::Camera(const Camera& o,bool copyDescr)
+  : nDescrPins_(0)
+{
+  copyIn(o,copyDescr);
 }
 
 Camera::~Camera()
@@ -67,23 +136,31 @@ Camera::~Camera()
 
 Camera& Camera::operator=(const Camera& o)
 {
-  copyIn(o);
+  copyIn(o,true);
   return *this;
 }
 
-void Camera::copyIn(const Camera& o)
+void Camera::copyIn(const Camera& o,bool copyDescr)
 {
   imgFilename_ = o.imgFilename_;
   imgWidth_ = o.imgWidth_;
   imgHeight_ = o.imgHeight_;
   featsFilename_ = o.featsFilename_;
+  hasGPS_ = o.hasGPS_;
+  gps_ = o.gps_;
   keys_ = o.keys_;
   keysScales_ = o.keysScales_;
   keysOrientations_ = o.keysOrientations_;
   keysColors_ = o.keysColors_;
-  if(o.descr_.cols() > 0)
-    allocAndRegisterDescr(int(o.descr_.cols()),int(o.descr_.rows()));
-  descr_ = o.descr_;
+  if(copyDescr)
+  {
+    if(o.descr_.cols() > 0)
+      allocAndRegisterDescr(int(o.descr_.cols()),int(o.descr_.rows()));
+    descr_ = o.descr_;
+  } else
+  {
+    clearDescriptors();
+  }
   visiblePoints_ = o.visiblePoints_;
 }
 
@@ -115,6 +192,7 @@ void Camera::clearDescriptors()
 {
   unique_lock<recursive_mutex> lck(mtx);
   nDescrInMemoryTotal_ -= descr_.cols();
+  nDescrBytesInMemoryTotal_ -= descr_.size() * sizeof(float);
   camsWithLoadedDescr_.remove(this);
   descr_.resize(0,0);
 }
@@ -143,9 +221,32 @@ void Camera::setFeaturesFilename(const string& filename,bool readKeys)
 }
 
 const string& Camera::imgFilename() const { return imgFilename_; }
+const string& Camera::featsFilename() const { return featsFilename_; }
 int Camera::imgWidth() const { return imgWidth_; }
 int Camera::imgHeight() const { return imgHeight_; }
+void Camera::setGPS(const Vector3d& latLonAlt)
+{
+  gps_ = latLonAlt;
+  hasGPS_ = true;
+}
+bool Camera::hasGPS() const { return hasGPS_; }
+const Vector3d& Camera::gps() const { return gps_; }
 const vector<Vector2d>& Camera::keys() const { return keys_; }
+
+void Camera::keysNormalized(vector<Vector2d> *normKeys) const
+{
+  normKeys->resize(keys_.size());
+  for(int i = 0; i < static_cast<int>(keys_.size()); i++)
+    (*normKeys)[i] = keyNormalized(i);
+}
+
+bool Camera::evaluateReprojectionErrorFloat(int keyIdx,const float* const camParams,
+  const float* const point,float *residuals,float *jacobianCam,
+  float *jacobianPoint) const
+{
+  return false;
+}
+
 const Vector2d& Camera::key(int i) const { return keys_[i]; }
 Vector2d& Camera::key(int i)  { return keys_[i]; }
 const vector<double>& Camera::keysScales() const { return keysScales_; }
@@ -158,10 +259,33 @@ vector<int>& Camera::visiblePoints() { return visiblePoints_; }
 const MatrixXf& Camera::descr() 
 { 
   if(descr_.cols() == 0)
+  {
+    {
+      unique_lock<recursive_mutex> lck(mtx);
+      nDescrLoads_++;
+    }
     readFeatures(ReadDescriptors);
+  }
 
   return descr_; 
 }
+
+unique_ptr<Camera> Camera::cloneWithoutDescr() const
+{
+  return clone(false);
+}
+
+void Camera::pinDescr()
+{
+  unique_lock<recursive_mutex> lck(mtx);
+  nDescrPins_++;
+}
+
+void Camera::unpinDescr()
+{
+  unique_lock<recursive_mutex> lck(mtx);
+  nDescrPins_--;
+}
 void Camera::writeASCII(ostream& file) const
 {
   file << imgFilename_ << "\n";
@@ -233,12 +357,26 @@ void Camera::readFeatures(int mode)
 
 void Camera::allocAndRegisterDescr(int num,int dim)
 {
+  // The budget is asked before locking because it locks the cameras when asking
+  // for the usage and releasing.
+  std::call_once(descrMemoryConsumerRegistered,[]()
+  {
+    memoryBudget().registerConsumer(&descrMemoryConsumer,MemoryPriorityReloadable);
+  });
+  memoryBudget().makeRoom(size_t(num) * dim * sizeof(float));
+
   unique_lock<recursive_mutex> lck(mtx);
-  while(nDescrInMemoryTotal_ > maxDescrInMemoryTotal_)
+  auto it = camsWithLoadedDescr_.begin();
+  while(nDescrInMemoryTotal_ > maxDescrInMemoryTotal_ && it != camsWithLoadedDescr_.end())
   {
-    camsWithLoadedDescr_.front()->clearDescriptors();
+    // The limit is exceeded rather than releasing pinned descriptors.
+    Camera *cam = *it;
+    ++it;
+    if(cam->nDescrPins_ == 0)
+      cam->clearDescriptors();
   }
   nDescrInMemoryTotal_ += num;
+  nDescrBytesInMemoryTotal_ += size_t(num) * dim * sizeof(float);
   camsWithLoadedDescr_.push_back(this);
   descr_.resize(dim,num);
 }
@@ -58,17 +58,37 @@ public:
   /// Default 4M which eats 2GB memory (made for a laptop with 8GB of memory).
   YASFM_API static size_t maxDescrInMemoryTotal_;
 
+  /// \return Number of times descr() had to read descriptors from a file (over all
+  /// images).
+  YASFM_API static size_t numDescrLoads();
+
+  /// \return Number of bytes taken by the descriptors of all cameras.
+  YASFM_API static size_t descrMemoryUsage();
+
+  /// Release descriptors which are not pinned, the earliest loaded first.
+  /**
+  Used by the memory budget. Descriptors are also released whenever the number
+  of descriptors exceeds maxDescrInMemoryTotal_.
+
+  \param[in] nBytes Number of bytes which should be released.
+  \return Number of bytes released.
+  */
+  YASFM_API static size_t releaseDescr(size_t nBytes);
+
   /// Constructor. (empty)
   YASFM_API Camera();
 
   /// Constructor. (Reads image dimensions.)
   /**
-  Opens the image file in order to get image dimensions.
+  Opens the image file in order to get image dimensions unless they are given.
 
   \param[in] imgFilename Path to the image file.
   \param[in] featuresDir Directory containg files with features.
+  \param[in] imgWidth Image width. Read from the image if not positive.
+  \param[in] imgHeight Image height. Read from the image if not positive.
   */
-  YASFM_API Camera(const string& imgFilename,const string& featuresDir);
+  YASFM_API Camera(const string& imgFilename,const string& featuresDir,
+    int imgWidth = -1,int imgHeight = -1);
 
   /// Constructor. (Reads everything from the file.)
   /**
@@ -83,6 +103,13 @@ public:
   /// \param[in] o Other camera.
   YASFM_API Camera(const Camera& o);
 
+  /// Copy constructor optionally skipping the descriptors.
+  /**
+  \param[in] o Other camera.
+  \param[in] copyDescr Copy also the descriptors? If not, none are counted as loaded.
+  */
+  YASFM_API Camera(const Camera& o,bool copyDescr);
+
   /// Destructor.
   /** 
   Seems like the destructor has to be virtual so that the destruction
@@ -104,12 +131,14 @@ public:
   /// Cloning. !! HAS TO BE OVERRIDEN BY EVERY DERIVED CLASS IN HIERARCHY !!
   /**
   This is used for cloning when one has only pointer to the Camera.
-  DerivedCamera has to implement clone() like this:
-  { return make_unique<DerivedCamera>(*this); }
+  DerivedCamera has to provide a constructor DerivedCamera(const DerivedCamera& o,
+  bool copyDescr) forwarding copyDescr to its base class and implement clone() like this:
+  { return make_unique<DerivedCamera>(*this,withDescr); }
 
+  \param[in] withDescr Copy also the descriptors?
   \return Base class pointer to the clone of the DerivedCamera.
   */
-  YASFM_API virtual unique_ptr<Camera> clone() const = 0;
+  YASFM_API virtual unique_ptr<Camera> clone(bool withDescr = true) const = 0;
 
   /// Class name. !! HAS TO BE OVERRIDEN BY EVERY DERIVED CLASS IN HIERARCHY !!
   /// \return "DerivedCamera" for DerivedCamera.
@@ -133,6 +162,24 @@ public:
   \return Pointer to the cost function. Deletion is assumed to be handled by ceres.
   */
   YASFM_API virtual ceres::CostFunction* costFunction(int keyIdx) const = 0;
+
+  /// Evaluate the reprojection error of costFunction() in single precision.
+  /**
+  Used by the mixed precision bundle adjustment. Cameras which do not
+  implement it return false and are evaluated in double using costFunction().
+
+  \param[in] keyIdx Index of a key/observation.
+  \param[in] camParams Camera parameters as given by params().
+  \param[in] point 3D point.
+  \param[out] residuals 2 residuals for x and y coordinates.
+  \param[out] jacobianCam Row major 2 x nParams Jacobian with respect to the camera
+  parameters. The Jacobians are not computed if NULL.
+  \param[out] jacobianPoint Row major 2 x 3 Jacobian with respect to the point.
+  \return False if not supported.
+  */
+  YASFM_API virtual bool evaluateReprojectionErrorFloat(int keyIdx,
+    const float* const camParams,const float* const point,float *residuals,
+    float *jacobianCam,float *jacobianPoint) const;
   
   /// Generate ceres parameters cost function.
   /**
@@ -153,6 +200,10 @@ public:
   /// \return Key with undone calibration.
   YASFM_API virtual Vector2d keyNormalized(int i) const = 0;
 
+  /// Undo calibration of all the keys at once. Calls keyNormalized() by default.
+  /// \param[out] normKeys Keys with undone calibration.
+  YASFM_API virtual void keysNormalized(vector<Vector2d> *normKeys) const;
+
   /// \return Projection matrix.
   YASFM_API virtual Matrix34d P() const = 0;
 
@@ -281,12 +332,25 @@ public:
   /// \return Reference to the path to the image file.
   YASFM_API const string& imgFilename() const;
 
+  /// \return Reference to the path to the features file.
+  YASFM_API const string& featsFilename() const;
+
   /// \return Image width.
   YASFM_API int imgWidth() const;
 
   /// \return Image height.
   YASFM_API int imgHeight() const;
 
+  /// Set GPS position.
+  /// \param[in] latLonAlt Latitude and longitude in degrees and altitude in meters.
+  YASFM_API void setGPS(const Vector3d& latLonAlt);
+
+  /// \return True if the GPS position was set.
+  YASFM_API bool hasGPS() const;
+
+  /// \return GPS position. Latitude and longitude in degrees and altitude in meters.
+  YASFM_API const Vector3d& gps() const;
+
   /// \return Const reference to keys.
   YASFM_API const vector<Vector2d>& keys() const;
 
@@ -322,11 +386,31 @@ public:
   WARNING! This might trigger reading from a file and release of descriptors 
   of some other camera if the memory limit is reached.
   WARNING!! The descriptor is not guaranteed to stay in memory for long
-  (depends on the memory limit).
+  (depends on the memory limit) unless pinned by pinDescr().
   \return Const reference to all descriptors (one column is one descriptor).
   */
   YASFM_API const MatrixXf& descr();
 
+  /// Clone without the descriptors.
+  /**
+  Same as clone(false), i.e., the descriptors are neither copied nor counted as
+  loaded, e.g., for snapshots which need only the parameters, keys and visible points.
+  \return Base class pointer to the clone.
+  */
+  YASFM_API unique_ptr<Camera> cloneWithoutDescr() const;
+
+  /// Keep descriptors in memory until unpinDescr() is called.
+  /**
+  Pinned descriptors are skipped when releasing descriptors because of the memory
+  limit, so that references returned by descr() stay valid without copying.
+  Can be called several times, every call has to be paired with unpinDescr().
+  clearDescriptors() releases the descriptors even if they are pinned.
+  */
+  YASFM_API void pinDescr();
+
+  /// Undo one pinDescr().
+  YASFM_API void unpinDescr();
+
   /// \return Indices of points visible in this camera in ascending order.
   YASFM_API const vector<int>& visiblePoints() const;
 
@@ -352,9 +436,15 @@ public:
   /// memory limit is reached.
   YASFM_API void readFeatures(int readMode);
 
-private:
+protected:
   /// Copy in all data.
-  void copyIn(const Camera& o);
+  /**
+  \param[in] o Other camera.
+  \param[in] copyDescr Copy also the descriptors? If not, the descriptors are cleared.
+  */
+  void copyIn(const Camera& o,bool copyDescr);
+
+private:
 
   void allocAndRegisterDescr(int num,int dim);
 
@@ -377,12 +467,16 @@ private:
   int imgWidth_;       ///< Image width.
   int imgHeight_;      ///< Image height.
   string featsFilename_; ///< Path to features file.
+  /// Is gps_ valid? GPS is not written out, it is read from EXIF when needed.
+  bool hasGPS_;
+  Vector3d gps_;       ///< Latitude [deg], longitude [deg] and altitude [m].
 
   vector<Vector2d> keys_;           ///< Keys (features coordinates).
   vector<double> keysScales_;       ///< Keys scales
   vector<double> keysOrientations_; ///< Orientation (angle in radians).
   vector<Vector3uc> keysColors_;    ///< Keys colors.
   MatrixXf descr_;     ///< Descriptors (one column is one descriptor).
+  int nDescrPins_;     ///< Number of pinDescr() calls not undone yet.
   /// Indices of points visible in this camera in ascending order.
   vector<int> visiblePoints_;       
 
@@ -390,6 +484,10 @@ private:
   static size_t nDescrInMemoryTotal_;
   /// Cameras which have their descriptors loaded.
   static list<Camera *> camsWithLoadedDescr_;
+  /// Counter for number of descriptor reads by descr().
+  static size_t nDescrLoads_;
+  /// Number of bytes taken by the descriptors of all cameras.
+  static size_t nDescrBytesInMemoryTotal_;
 };
 
 } // namespace yasfm
\ No newline at end of file
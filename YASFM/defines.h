@@ -39,6 +39,13 @@
 #define YASFM_PRINT_ERROR_FILE_OPEN(filename) \
 (YASFM_PRINT_ERROR("Could not open file:\n" << filename))
 
+// VS2013 does not support thread_local. Only usable for plain data.
+#ifdef _MSC_VER
+#define YASFM_THREAD_LOCAL __declspec(thread)
+#else
+#define YASFM_THREAD_LOCAL __thread
+#endif
+
 ////////////////////////////////////////////////////
 ///////////////   Declarations   ///////////////////
 ////////////////////////////////////////////////////
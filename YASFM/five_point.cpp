@@ -0,0 +1,522 @@
+#include "five_point.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using Eigen::Matrix;
+
+namespace yasfm
+{
+
+int solveRelativePose5pt(const Vector3d *pts1,const Vector3d *pts2,Matrix3d *Es)
+{
+  // Epipolar constraints stored transposed. Column i corresponds to
+  // pts2[i]'*E*pts1[i] = 0 with E stored row-wise.
+  Matrix<double,9,5> At;
+  for(int i = 0; i < 5; i++)
+  {
+    for(int r = 0; r < 3; r++)
+    {
+      for(int c = 0; c < 3; c++)
+      {
+        At(3*r + c,i) = pts2[i](r) * pts1[i](c);
+      }
+    }
+  }
+
+  // The last 4 columns of Q from QR decomposition span the nullspace.
+  Eigen::HouseholderQR<Matrix<double,9,5>> qr(At);
+  Matrix<double,9,9> Q = qr.householderQ();
+  Matrix<double,9,4> basis = Q.rightCols<4>();
+
+  Matrix<double,10,20,Eigen::RowMajor> A;
+  computeConstraints5pt(basis,&A);
+
+  // Gauss-Jordan elimination of the first 10 monomials, i.e. row r reads
+  // monomial_r + G.row(r)*[xz^2 xz x yz^2 yz y z^3 z^2 z 1]' = 0.
+  if(!eliminateConstraints5pt(&A))
+    return 0;
+  auto G = A.rightCols<10>();
+
+  // Rows <e>-z<f>, <g>-z<h> and <i>-z<j> eliminate all the monomials but
+  // x*p(z), y*p(z) and p(z). The polynomials form 3x3 matrix B(z) with B(z)*[x y 1]' = 0.
+  PolyZ B[3][3];
+  for(int i = 0; i < 3; i++)
+  {
+    int ra = 4 + 2*i;
+    int rb = ra + 1;
+    for(int j = 0; j < 2; j++)
+    {
+      auto& p = B[i][j];
+      int c = 3*j;
+      p.deg = 3;
+      p.c[3] = -G(rb,c);
+      p.c[2] = G(ra,c) - G(rb,c + 1);
+      p.c[1] = G(ra,c + 1) - G(rb,c + 2);
+      p.c[0] = G(ra,c + 2);
+    }
+    auto& p = B[i][2];
+    p.deg = 4;
+    p.c[4] = -G(rb,6);
+    p.c[3] = G(ra,6) - G(rb,7);
+    p.c[2] = G(ra,7) - G(rb,8);
+    p.c[1] = G(ra,8) - G(rb,9);
+    p.c[0] = G(ra,9);
+  }
+
+  // det(B(z)) = 0 is polynomial of degree 10.
+  PolyZ det = addPolys(addPolys(
+    multiplyPolys(B[0][0],subtractPolys(multiplyPolys(B[1][1],B[2][2]),
+    multiplyPolys(B[1][2],B[2][1]))),
+    multiplyPolys(B[0][1],subtractPolys(multiplyPolys(B[1][2],B[2][0]),
+    multiplyPolys(B[1][0],B[2][2])))),
+    multiplyPolys(B[0][2],subtractPolys(multiplyPolys(B[1][0],B[2][1]),
+    multiplyPolys(B[1][1],B[2][0]))));
+
+  double zs[maxNumSolutions5pt];
+  int nRoots = findRealRootsSturm(det,zs);
+
+  int nSolutions = 0;
+  for(int iRoot = 0; iRoot < nRoots; iRoot++)
+  {
+    double z = zs[iRoot];
+    Matrix3d Bz;
+    for(int i = 0; i < 3; i++)
+      for(int j = 0; j < 3; j++)
+        Bz(i,j) = evaluatePoly(B[i][j],z);
+
+    // [x y 1] is the nullspace of B(z). Use the best conditioned cross product.
+    Vector3d xy1 = Bz.row(0).cross(Bz.row(1));
+    Vector3d tmp = Bz.row(0).cross(Bz.row(2));
+    if(std::abs(tmp(2)) > std::abs(xy1(2)))
+      xy1 = tmp;
+    tmp = Bz.row(1).cross(Bz.row(2));
+    if(std::abs(tmp(2)) > std::abs(xy1(2)))
+      xy1 = tmp;
+    if(xy1(2) == 0.)
+      continue;
+    Vector3d xyz(xy1(0) / xy1(2),xy1(1) / xy1(2),z);
+    refineSolution5pt(A,&xyz);
+
+    Matrix<double,9,1> e = xyz(0)*basis.col(0) + xyz(1)*basis.col(1) +
+      xyz(2)*basis.col(2) + basis.col(3);
+    auto& E = Es[nSolutions];
+    for(int r = 0; r < 3; r++)
+      for(int c = 0; c < 3; c++)
+        E(r,c) = e(3*r + c);
+    E.normalize();
+    if(E.allFinite())
+      nSolutions++;
+  }
+  return nSolutions;
+}
+
+} // namespace yasfm
+
+namespace
+{
+
+// Linear polynomials have coefficients of x y z 1 and quadratic polynomials
+// of x^2 xy xz y^2 yz z^2 x y z 1.
+
+// The products are written out so that the output stays in registers.
+
+/// out += s*a*b for linear a and b.
+void multiplyAddLinLin(double s,const double *a,const double *b,double *out)
+{
+  out[0] += s * (a[0]*b[0]);
+  out[1] += s * (a[0]*b[1] + a[1]*b[0]);
+  out[2] += s * (a[0]*b[2] + a[2]*b[0]);
+  out[3] += s * (a[1]*b[1]);
+  out[4] += s * (a[1]*b[2] + a[2]*b[1]);
+  out[5] += s * (a[2]*b[2]);
+  out[6] += s * (a[0]*b[3] + a[3]*b[0]);
+  out[7] += s * (a[1]*b[3] + a[3]*b[1]);
+  out[8] += s * (a[2]*b[3] + a[3]*b[2]);
+  out[9] += s * (a[3]*b[3]);
+}
+
+/// out += a*b for quadratic a and linear b.
+void multiplyAddQuadLin(const double *a,const double *b,double *out)
+{
+  out[0] += a[0]*b[0];
+  out[1] += a[3]*b[1];
+  out[2] += a[0]*b[1] + a[1]*b[0];
+  out[3] += a[1]*b[1] + a[3]*b[0];
+  out[4] += a[0]*b[2] + a[2]*b[0];
+  out[5] += a[0]*b[3] + a[6]*b[0];
+  out[6] += a[3]*b[2] + a[4]*b[1];
+  out[7] += a[3]*b[3] + a[7]*b[1];
+  out[8] += a[1]*b[2] + a[2]*b[1] + a[4]*b[0];
+  out[9] += a[1]*b[3] + a[6]*b[1] + a[7]*b[0];
+  out[10] += a[2]*b[2] + a[5]*b[0];
+  out[11] += a[2]*b[3] + a[6]*b[2] + a[8]*b[0];
+  out[12] += a[6]*b[3] + a[9]*b[0];
+  out[13] += a[4]*b[2] + a[5]*b[1];
+  out[14] += a[4]*b[3] + a[7]*b[2] + a[8]*b[1];
+  out[15] += a[7]*b[3] + a[9]*b[1];
+  out[16] += a[5]*b[2];
+  out[17] += a[5]*b[3] + a[8]*b[2];
+  out[18] += a[8]*b[3] + a[9]*b[2];
+  out[19] += a[9]*b[3];
+}
+
+void computeConstraints5pt(const Matrix<double,9,4>& basis,
+  Matrix<double,10,20,Eigen::RowMajor> *pA)
+{
+  auto& A = *pA;
+  double E[9][4];
+  for(int i = 0; i < 9; i++)
+    for(int j = 0; j < 4; j++)
+      E[i][j] = basis(i,j);
+
+  // 2*E*E'*E - trace(E*E')*E = 0, which we write as (E*E' - trace(E*E')/2 * I)*E = 0.
+  double EEt[3][3][10];
+  for(int i = 0; i < 3; i++)
+  {
+    for(int j = i; j < 3; j++)
+    {
+      std::fill(EEt[i][j],EEt[i][j] + 10,0.);
+      for(int k = 0; k < 3; k++)
+        multiplyAddLinLin(1.,E[3*i + k],E[3*j + k],EEt[i][j]);
+      if(i != j)
+        std::copy(EEt[i][j],EEt[i][j] + 10,EEt[j][i]);
+    }
+  }
+  double halfTrace[10];
+  for(int m = 0; m < 10; m++)
+    halfTrace[m] = 0.5 * (EEt[0][0][m] + EEt[1][1][m] + EEt[2][2][m]);
+  for(int i = 0; i < 3; i++)
+    for(int m = 0; m < 10; m++)
+      EEt[i][i][m] -= halfTrace[m];
+
+  double row[20];
+  for(int i = 0; i < 3; i++)
+  {
+    for(int j = 0; j < 3; j++)
+    {
+      std::fill(row,row + 20,0.);
+      for(int k = 0; k < 3; k++)
+        multiplyAddQuadLin(EEt[i][k],E[3*k + j],row);
+      for(int m = 0; m < 20; m++)
+        A(3*i + j,m) = row[m];
+    }
+  }
+
+  // det(E) = 0
+  double cofactors[3][10];
+  for(int j = 0; j < 3; j++)
+  {
+    int c1 = (j + 1) % 3;
+    int c2 = (j + 2) % 3;
+    std::fill(cofactors[j],cofactors[j] + 10,0.);
+    multiplyAddLinLin(1.,E[3 + c1],E[6 + c2],cofactors[j]);
+    multiplyAddLinLin(-1.,E[3 + c2],E[6 + c1],cofactors[j]);
+  }
+  std::fill(row,row + 20,0.);
+  for(int j = 0; j < 3; j++)
+    multiplyAddQuadLin(cofactors[j],E[j],row);
+  for(int m = 0; m < 20; m++)
+    A(9,m) = row[m];
+}
+
+bool eliminateConstraints5pt(Matrix<double,10,20,Eigen::RowMajor> *pA)
+{
+  auto& A = *pA;
+  for(int k = 0; k < 10; k++)
+  {
+    int pivot = k;
+    for(int r = k + 1; r < 10; r++)
+    {
+      if(std::abs(A(r,k)) > std::abs(A(pivot,k)))
+        pivot = r;
+    }
+    if(A(pivot,k) == 0.)
+      return false;
+    if(pivot != k)
+      A.row(pivot).swap(A.row(k));
+
+    double scale = 1. / A(k,k);
+    A(k,k) = 1.;
+    for(int c = k + 1; c < 20; c++)
+      A(k,c) *= scale;
+    for(int r = 0; r < 10; r++)
+    {
+      if(r == k)
+        continue;
+      double factor = A(r,k);
+      A(r,k) = 0.;
+      for(int c = k + 1; c < 20; c++)
+        A(r,c) -= factor * A(k,c);
+    }
+  }
+  return true;
+}
+
+void refineSolution5pt(const Matrix<double,10,20,Eigen::RowMajor>& A,Vector3d *pxyz)
+{
+  auto& xyz = *pxyz;
+  const int maxIterations = 2;
+  // The first 10 columns of A are identity.
+  auto G = A.rightCols<10>();
+  double prevResidual = std::numeric_limits<double>::infinity();
+  Vector3d prevXyz = xyz;
+  for(int iter = 0; iter <= maxIterations; iter++)
+  {
+    double x = xyz(0),y = xyz(1),z = xyz(2);
+    // Monomials in Nister's ordering.
+    Matrix<double,20,1> m;
+    m << x*x*x,y*y*y,x*x*y,x*y*y,x*x*z,x*x,y*y*z,y*y,x*y*z,x*y,
+      x*z*z,x*z,x,y*z*z,y*z,y,z*z*z,z*z,z,1.;
+    Matrix<double,10,1> r = m.head<10>() + G.lazyProduct(m.tail<10>());
+    double residual = r.squaredNorm();
+    if(!(residual < prevResidual))
+    {
+      xyz = prevXyz;
+      break;
+    }
+    // Most of the solutions are accurate already.
+    if(iter == maxIterations || residual <= 1e-20 * m.squaredNorm())
+      break;
+    prevResidual = residual;
+    prevXyz = xyz;
+
+    Matrix<double,20,3> dm;
+    dm.col(0) << 3.*x*x,0.,2.*x*y,y*y,2.*x*z,2.*x,0.,0.,y*z,y,
+      z*z,z,1.,0.,0.,0.,0.,0.,0.,0.;
+    dm.col(1) << 0.,3.*y*y,x*x,2.*x*y,0.,0.,2.*y*z,2.*y,x*z,x,
+      0.,0.,0.,z*z,z,1.,0.,0.,0.,0.;
+    dm.col(2) << 0.,0.,0.,0.,x*x,0.,y*y,0.,x*y,0.,
+      2.*x*z,x,0.,2.*y*z,y,0.,3.*z*z,2.*z,1.,0.;
+    Matrix<double,10,3> J = dm.topRows<10>() + G.lazyProduct(dm.bottomRows<10>());
+    Matrix3d JtJ = J.transpose().lazyProduct(J);
+    Vector3d delta = JtJ.ldlt().solve(J.transpose().lazyProduct(r));
+    if(!delta.allFinite())
+      break;
+    xyz -= delta;
+  }
+}
+
+double evaluatePoly(const PolyZ& p,double z)
+{
+  double z2 = z*z;
+  double even = 0.;
+  double odd = 0.;
+  int i = p.deg;
+  if(i % 2 == 0)
+    even = p.c[i--];
+  for(; i > 0; i -= 2)
+  {
+    odd = odd*z2 + p.c[i];
+    even = even*z2 + p.c[i - 1];
+  }
+  return even + z*odd;
+}
+
+double evaluatePoly(const PolyZ& p,double z,double *derivative)
+{
+  double z2 = z*z;
+  double even = 0.;
+  double odd = 0.;
+  double derEven = 0.;
+  double derOdd = 0.;
+  int i = p.deg;
+  if(i % 2 == 0)
+  {
+    even = p.c[i];
+    derOdd = i * p.c[i];
+    i--;
+  }
+  for(; i > 0; i -= 2)
+  {
+    odd = odd*z2 + p.c[i];
+    even = even*z2 + p.c[i - 1];
+    derEven = derEven*z2 + i * p.c[i];
+    if(i > 1)
+      derOdd = derOdd*z2 + (i - 1) * p.c[i - 1];
+  }
+  *derivative = derEven + z*derOdd;
+  return even + z*odd;
+}
+
+PolyZ addPolys(const PolyZ& a,const PolyZ& b)
+{
+  PolyZ res;
+  res.deg = std::max(a.deg,b.deg);
+  for(int i = 0; i <= res.deg; i++)
+    res.c[i] = (i <= a.deg ? a.c[i] : 0.) + (i <= b.deg ? b.c[i] : 0.);
+  return res;
+}
+
+PolyZ subtractPolys(const PolyZ& a,const PolyZ& b)
+{
+  PolyZ res;
+  res.deg = std::max(a.deg,b.deg);
+  for(int i = 0; i <= res.deg; i++)
+    res.c[i] = (i <= a.deg ? a.c[i] : 0.) - (i <= b.deg ? b.c[i] : 0.);
+  return res;
+}
+
+PolyZ multiplyPolys(const PolyZ& a,const PolyZ& b)
+{
+  PolyZ res;
+  res.deg = a.deg + b.deg;
+  std::fill(res.c,res.c + res.deg + 1,0.);
+  for(int i = 0; i <= a.deg; i++)
+    for(int j = 0; j <= b.deg; j++)
+      res.c[i + j] += a.c[i] * b.c[j];
+  return res;
+}
+
+void normalizePoly(double relTolerance,PolyZ *pp)
+{
+  auto& p = *pp;
+  double maxAbs = 0.;
+  for(int i = 0; i <= p.deg; i++)
+    maxAbs = std::max(maxAbs,std::abs(p.c[i]));
+  while(p.deg >= 0 && std::abs(p.c[p.deg]) <= relTolerance * maxAbs)
+    p.deg--;
+  if(maxAbs > 0.)
+  {
+    for(int i = 0; i <= p.deg; i++)
+      p.c[i] /= maxAbs;
+  }
+}
+
+int countSignChanges(const PolyZ *seq,int nSeq,double z)
+{
+  int nChanges = 0;
+  double prev = 0.;
+  for(int i = 0; i < nSeq; i++)
+  {
+    double val = evaluatePoly(seq[i],z);
+    if(val != 0.)
+    {
+      if(prev * val < 0.)
+        nChanges++;
+      prev = val;
+    }
+  }
+  return nChanges;
+}
+
+double polishRoot(const PolyZ& p,double lo,double hi)
+{
+  double flo = evaluatePoly(p,lo);
+  double fhi = evaluatePoly(p,hi);
+  if(flo == 0.)
+    return lo;
+  if(fhi == 0.)
+    return hi;
+  // A root of even multiplicity. The middle of the tight interval is good enough.
+  if(flo * fhi > 0.)
+    return 0.5 * (lo + hi);
+
+  // Bisect whenever the Newton step leaves the bracket or does not
+  // at least halve the previous step.
+  double z = 0.5 * (lo + hi);
+  double prevStep = hi - lo;
+  for(int iter = 0; iter < 100; iter++)
+  {
+    double dfz;
+    double fz = evaluatePoly(p,z,&dfz);
+    if(fz == 0.)
+      break;
+    if(fz * flo < 0.)
+      hi = z;
+    else
+      lo = z;
+
+    double step = fz / dfz;
+    double zNew = z - step;
+    // Converged. Newton's method converges quadratically so the step after
+    // this one would be far below the precision. This has to be tested before
+    // the safeguard because such tiny steps are dominated by rounding errors.
+    if(std::abs(step) <= 1e-10 * (1. + std::abs(z)))
+      return (zNew >= lo && zNew <= hi) ? zNew : z;
+    if(!(zNew > lo && zNew < hi) || 2. * std::abs(step) > prevStep)
+    {
+      zNew = 0.5 * (lo + hi);
+      step = z - zNew;
+    }
+    prevStep = std::abs(step);
+    z = zNew;
+  }
+  return z;
+}
+
+void isolateRoots(const PolyZ *seq,int nSeq,double lo,double hi,int nChangesLo,
+  int nChangesHi,int depth,double *roots,int *pnRoots)
+{
+  const int maxDepth = 100;
+  int nRootsInside = nChangesLo - nChangesHi;
+  if(nRootsInside <= 0)
+    return;
+  if(nRootsInside == 1 || depth >= maxDepth)
+  {
+    roots[(*pnRoots)++] = polishRoot(seq[0],lo,hi);
+    return;
+  }
+  double mid = 0.5 * (lo + hi);
+  int nChangesMid = countSignChanges(seq,nSeq,mid);
+  isolateRoots(seq,nSeq,lo,mid,nChangesLo,nChangesMid,depth + 1,roots,pnRoots);
+  isolateRoots(seq,nSeq,mid,hi,nChangesMid,nChangesHi,depth + 1,roots,pnRoots);
+}
+
+int findRealRootsSturm(const PolyZ& p,double *roots)
+{
+  const double relTolerance = 1e-14;
+  PolyZ seq[11];
+  seq[0] = p;
+  normalizePoly(relTolerance,&seq[0]);
+  if(seq[0].deg < 1)
+    return 0;
+
+  // Sturm sequence: p, p', -rem(p,p'), ...
+  seq[1].deg = seq[0].deg - 1;
+  for(int i = 0; i <= seq[1].deg; i++)
+    seq[1].c[i] = (i + 1) * seq[0].c[i + 1];
+  normalizePoly(relTolerance,&seq[1]);
+  int nSeq = 2;
+  while(nSeq < 11 && seq[nSeq - 1].deg > 0)
+  {
+    const auto& a = seq[nSeq - 2];
+    const auto& b = seq[nSeq - 1];
+    auto& r = seq[nSeq];
+    r = a;
+    for(int k = a.deg - b.deg; k >= 0; k--)
+    {
+      double q = r.c[b.deg + k] / b.c[b.deg];
+      for(int j = 0; j <= b.deg; j++)
+        r.c[j + k] -= q * b.c[j];
+    }
+    r.deg = b.deg - 1;
+    for(int i = 0; i <= r.deg; i++)
+      r.c[i] = -r.c[i];
+    normalizePoly(relTolerance,&r);
+    if(r.deg < 0)
+      break;
+    nSeq++;
+  }
+
+  // Fujiwara bound on the magnitude of the roots. It is much tighter than
+  // Cauchy bound when the leading coefficient is small.
+  const auto& p0 = seq[0];
+  double bound = 0.;
+  for(int i = 0; i < p0.deg; i++)
+  {
+    double ratio = std::abs(p0.c[i] / p0.c[p0.deg]);
+    if(i == 0)
+      ratio *= 0.5;
+    bound = std::max(bound,std::pow(ratio,1. / (p0.deg - i)));
+  }
+  bound *= 2.;
+
+  int nRoots = 0;
+  isolateRoots(seq,nSeq,-bound,bound,countSignChanges(seq,nSeq,-bound),
+    countSignChanges(seq,nSeq,bound),0,roots,&nRoots);
+  return nRoots;
+}
+
+} // namespace
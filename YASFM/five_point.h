@@ -0,0 +1,155 @@
+//----------------------------------------------------------------------------------------
+/**
+* \file       five_point.h
+* \brief      Minimal solver for calibrated relative pose.
+*
+*  Five point solver for essential matrix which works only with stack memory.
+*
+*/
+//----------------------------------------------------------------------------------------
+
+#pragma once
+
+#include "Eigen\Dense"
+
+#include "defines.h"
+
+using Eigen::Matrix3d;
+using Eigen::Vector3d;
+
+////////////////////////////////////////////////////
+///////////////   Declarations   ///////////////////
+////////////////////////////////////////////////////
+
+namespace yasfm
+{
+
+/// Maximum number of solutions of the 5 point problem.
+const int maxNumSolutions5pt = 10;
+
+/// Estimate essential matrix from 5 correspondences (minimal solver).
+/**
+Finds such essential matrices that pts2[i]'*E*pts1[i] = 0.
+MIND THE ORDER of the input points.
+Follows Nister: An Efficient Solution to the Five-Point Relative Pose Problem.
+The essential matrix constraints are reduced to a polynomial of degree 10 whose
+real roots are isolated by a Sturm sequence and polished by Newton's method.
+Inaccurate solutions (close roots) are refined on the original constraints.
+Nothing is allocated on the heap.
+
+\param[in] pts1 5 normalized points (bearings) in the first camera.
+\param[in] pts2 5 normalized points (bearings) in the second camera.
+\param[out] Es Array for at least maxNumSolutions5pt essential matrices. The
+solutions have unit Frobenius norm.
+\return Number of solutions.
+*/
+YASFM_API int solveRelativePose5pt(const Vector3d *pts1,const Vector3d *pts2,Matrix3d *Es);
+
+} // namespace yasfm
+
+namespace
+{
+
+/// Polynomial in z of degree at most 10, coefficients in ascending powers.
+struct PolyZ
+{
+  double c[11];
+  int deg;
+};
+
+/// Compute the 10 cubic constraints on E = x*X + y*Y + z*Z + W.
+/**
+Monomials are ordered as in the paper by Nister:
+x^3 y^3 x^2y xy^2 x^2z x^2 y^2z y^2 xyz xy xz^2 xz x yz^2 yz y z^3 z^2 z 1.
+
+\param[in] basis Nullspace basis (X,Y,Z,W) stored row-wise in columns.
+\param[out] A Coefficients of the constraints (one per row).
+*/
+void computeConstraints5pt(const Eigen::Matrix<double,9,4>& basis,
+  Eigen::Matrix<double,10,20,Eigen::RowMajor> *A);
+
+/// Gauss-Jordan elimination of the first 10 columns with partial pivoting.
+/**
+\param[in,out] A Constraints. The first 10 columns become identity.
+eturn False if the first 10 columns are singular.
+*/
+bool eliminateConstraints5pt(Eigen::Matrix<double,10,20,Eigen::RowMajor> *A);
+
+/// out += s*a*b for linear polynomials a and b (coefficients of x y z 1).
+/// out is quadratic (coefficients of x^2 xy xz y^2 yz z^2 x y z 1).
+void multiplyAddLinLin(double s,const double *a,const double *b,double *out);
+
+/// out += a*b for quadratic a and linear b. out is cubic in Nister's ordering.
+void multiplyAddQuadLin(const double *a,const double *b,double *out);
+
+/// Polish a solution by Gauss-Newton iterations on all the 10 constraints.
+/**
+The roots of the degree 10 polynomial lose accuracy when two of them are close.
+The original constraints do not suffer from that.
+
+\param[in] A Constraints after eliminateConstraints5pt.
+\param[in,out] xyz Solution (x,y,z).
+*/
+void refineSolution5pt(const Eigen::Matrix<double,10,20,Eigen::RowMajor>& A,
+  Vector3d *xyz);
+
+/// Evaluate polynomial using Horner's scheme.
+/**
+Even and odd coefficients are accumulated separately in z^2 which halves
+the length of the dependency chain.
+*/
+double evaluatePoly(const PolyZ& p,double z);
+
+/// Evaluate polynomial and its derivative using Horner's scheme.
+double evaluatePoly(const PolyZ& p,double z,double *derivative);
+
+/// \return a + b
+PolyZ addPolys(const PolyZ& a,const PolyZ& b);
+
+/// \return a - b
+PolyZ subtractPolys(const PolyZ& a,const PolyZ& b);
+
+/// \return a * b (the degree of the result has to be at most 10)
+PolyZ multiplyPolys(const PolyZ& a,const PolyZ& b);
+
+/// Drop negligible leading coefficients and scale the largest coefficient to 1.
+/**
+\param[in] relTolerance Leading coefficients smaller than relTolerance times
+the largest coefficient are dropped.
+\param[in,out] p Polynomial.
+*/
+void normalizePoly(double relTolerance,PolyZ *p);
+
+/// Count sign changes of a Sturm sequence evaluated at z.
+int countSignChanges(const PolyZ *seq,int nSeq,double z);
+
+/// Find a root in an interval which contains exactly one root.
+/**
+Newton's method safeguarded by bisection.
+*/
+double polishRoot(const PolyZ& p,double lo,double hi);
+
+/// Recursively bisect the interval (lo,hi] until every part contains one root.
+/**
+\param[in] seq Sturm sequence.
+\param[in] nSeq Length of the sequence.
+\param[in] lo Lower end of the interval.
+\param[in] hi Upper end of the interval.
+\param[in] nChangesLo Number of sign changes at lo.
+\param[in] nChangesHi Number of sign changes at hi.
+\param[in] depth Recursion depth.
+\param[out] roots Found roots are appended here.
+\param[in,out] nRoots Number of roots.
+*/
+void isolateRoots(const PolyZ *seq,int nSeq,double lo,double hi,int nChangesLo,
+  int nChangesHi,int depth,double *roots,int *nRoots);
+
+/// Find real roots of a polynomial using a Sturm sequence.
+/**
+\param[in] p Polynomial.
+\param[out] roots Array for at least p.deg roots.
+\return Number of distinct real roots found.
+*/
+int findRealRootsSturm(const PolyZ& p,double *roots);
+
+} // namespace
@@ -0,0 +1,147 @@
+#include "gps.h"
+
+#include <algorithm>
+#include <cmath>
+
+// VS2013 compiler gave many warnings about:
+// 1) conversion size_t <-> int
+// 2) no appropriate delete operator to overloaded new
+// These are in FLANN by design, therefore, we ignore the warnings.
+#pragma warning(push) 
+#pragma warning(disable : 4267 4291)
+#include "FLANN\flann.hpp"
+#pragma warning(pop)
+
+#include "utils.h"
+
+namespace yasfm
+{
+
+Vector3d convertGPSToECEF(const Vector3d& latLonAlt)
+{
+  // WGS84 ellipsoid
+  const double a = 6378137.;
+  const double e2 = 6.69437999014e-3;
+
+  double lat = deg2Rad(latLonAlt(0));
+  double lon = deg2Rad(latLonAlt(1));
+  double alt = latLonAlt(2);
+  double sinLat = sin(lat);
+  double cosLat = cos(lat);
+  double N = a / sqrt(1. - e2*sinLat*sinLat);
+
+  return Vector3d((N + alt)*cosLat*cos(lon),
+    (N + alt)*cosLat*sin(lon),
+    (N*(1. - e2) + alt)*sinLat);
+}
+
+Vector3d convertGPSToENU(const Vector3d& originLatLonAlt,const Vector3d& latLonAlt)
+{
+  double lat = deg2Rad(originLatLonAlt(0));
+  double lon = deg2Rad(originLatLonAlt(1));
+  double sinLat = sin(lat),cosLat = cos(lat);
+  double sinLon = sin(lon),cosLon = cos(lon);
+
+  Vector3d d = convertGPSToECEF(latLonAlt) - convertGPSToECEF(originLatLonAlt);
+  return Vector3d(-sinLon*d(0) + cosLon*d(1),
+    -sinLat*cosLon*d(0) - sinLat*sinLon*d(1) + cosLat*d(2),
+    cosLat*cosLon*d(0) + cosLat*sinLon*d(1) + sinLat*d(2));
+}
+
+void findCamerasWithinGPSRadius(const ptr_vector<Camera>& cams,double radius,
+  vector<vector<int>> *pneighbors)
+{
+  auto& neighbors = *pneighbors;
+  neighbors.clear();
+  neighbors.resize(cams.size());
+
+  vector<int> gpsCams;
+  for(int i = 0; i < int(cams.size()); i++)
+  {
+    if(cams[i]->hasGPS())
+      gpsCams.push_back(i);
+  }
+  if(gpsCams.empty())
+    return;
+
+  const Vector3d& origin = cams[gpsCams[0]]->gps();
+  vector<double> pts(2 * gpsCams.size());
+  for(size_t i = 0; i < gpsCams.size(); i++)
+  {
+    Vector3d enu = convertGPSToENU(origin,cams[gpsCams[i]]->gps());
+    pts[2 * i] = enu(0);
+    pts[2 * i + 1] = enu(1);
+  }
+
+  flann::Matrix<double> ptsFlann(&pts[0],gpsCams.size(),2);
+  flann::Index<flann::L2<double>> index(ptsFlann,flann::KDTreeSingleIndexParams());
+  index.buildIndex();
+
+  // L2 in FLANN is squared distance.
+  vector<vector<int>> indices;
+  vector<vector<double>> dists;
+  flann::SearchParams searchParams(flann::FLANN_CHECKS_UNLIMITED);
+  index.radiusSearch(ptsFlann,indices,dists,float(radius*radius),searchParams);
+
+  for(size_t i = 0; i < gpsCams.size(); i++)
+  {
+    auto& camNeighbors = neighbors[gpsCams[i]];
+    camNeighbors.reserve(indices[i].size());
+    for(int j : indices[i])
+      camNeighbors.push_back(gpsCams[j]);
+    std::sort(camNeighbors.begin(),camNeighbors.end());
+  }
+}
+
+void weightSimilarityByGPS(const ptr_vector<Camera>& cams,double radius,
+  MatrixXf *psimilarity)
+{
+  auto& similarity = *psimilarity;
+  vector<vector<int>> neighbors;
+  findCamerasWithinGPSRadius(cams,radius,&neighbors);
+
+  for(int i = 0; i < int(cams.size()); i++)
+  {
+    if(!cams[i]->hasGPS())
+      continue;
+    for(int j = 0; j < int(cams.size()); j++)
+    {
+      if(cams[j]->hasGPS() &&
+        !std::binary_search(neighbors[i].begin(),neighbors[i].end(),j))
+      {
+        similarity(i,j) = -1.f;
+      }
+    }
+  }
+}
+
+int pruneCameraPairsByGPS(const ptr_vector<Camera>& cams,double radius,
+  vector<set<int>> *pqueries)
+{
+  auto& queries = *pqueries;
+  vector<vector<int>> neighbors;
+  findCamerasWithinGPSRadius(cams,radius,&neighbors);
+
+  int nRemoved = 0;
+  for(int i = 0; i < int(queries.size()); i++)
+  {
+    if(!cams[i]->hasGPS())
+      continue;
+    for(auto it = queries[i].begin(); it != queries[i].end();)
+    {
+      int j = *it;
+      if(cams[j]->hasGPS() &&
+        !std::binary_search(neighbors[i].begin(),neighbors[i].end(),j))
+      {
+        it = queries[i].erase(it);
+        nRemoved++;
+      } else
+      {
+        ++it;
+      }
+    }
+  }
+  return nRemoved;
+}
+
+} // namespace yasfm
@@ -0,0 +1,91 @@
+//----------------------------------------------------------------------------------------
+/**
+* \file       gps.h
+* \brief      Functions for using GPS positions of cameras.
+*
+*  Conversion of GPS positions to local coordinates and pruning of candidate
+*  camera pairs which are too far apart.
+*
+*/
+//----------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <set>
+#include <vector>
+
+#include "Eigen/Dense"
+
+#include "defines.h"
+#include "camera.h"
+
+using Eigen::MatrixXf;
+using Eigen::Vector3d;
+using std::set;
+using std::vector;
+
+////////////////////////////////////////////////////
+///////////////   Declarations   ///////////////////
+////////////////////////////////////////////////////
+
+namespace yasfm
+{
+
+/// Convert GPS position to earth-centered earth-fixed coordinates (WGS84).
+/**
+\param[in] latLonAlt Latitude and longitude in degrees and altitude in meters.
+\return ECEF coordinates in meters.
+*/
+YASFM_API Vector3d convertGPSToECEF(const Vector3d& latLonAlt);
+
+/// Convert GPS position to local east-north-up coordinates (WGS84).
+/**
+\param[in] originLatLonAlt Origin of the local coordinate system.
+\param[in] latLonAlt Latitude and longitude in degrees and altitude in meters.
+\return East, north and up coordinates in meters.
+*/
+YASFM_API Vector3d convertGPSToENU(const Vector3d& originLatLonAlt,
+  const Vector3d& latLonAlt);
+
+/// Find cameras which are within a radius from every camera using their GPS.
+/**
+Cameras are placed into local east-north-up coordinates (origin being the first
+camera with GPS) and searched for by a k-d tree. Only the horizontal distance
+is used because EXIF altitude is often missing or very imprecise.
+
+\param[in] cams Cameras. Those without GPS are ignored.
+\param[in] radius Radius in meters.
+\param[out] neighbors For every camera with GPS, indices of cameras within the
+radius (including itself) in ascending order. Empty for cameras without GPS.
+*/
+YASFM_API void findCamerasWithinGPSRadius(const ptr_vector<Camera>& cams,double radius,
+  vector<vector<int>> *neighbors);
+
+/// Lower similarity of the camera pairs which are too far apart.
+/**
+If both cameras have GPS and they are further than radius from each other, their
+similarity is set to -1 so that they are ranked after all the other cameras
+by findSimilarCameraPairs(). Pairs where at least one camera is missing GPS
+are not changed.
+
+\param[in] cams Cameras.
+\param[in] radius Radius in meters.
+\param[in,out] similarity Symmetric matrix of image level similarity.
+*/
+YASFM_API void weightSimilarityByGPS(const ptr_vector<Camera>& cams,double radius,
+  MatrixXf *similarity);
+
+/// Remove the camera pairs which are too far apart.
+/**
+A pair is removed if both cameras have GPS and they are further than radius from
+each other. Pairs where at least one camera is missing GPS are kept.
+
+\param[in] cams Cameras.
+\param[in] radius Radius in meters.
+\param[in,out] queries Candidate pairs as given by findSimilarCameraPairs().
+\return Number of removed pairs.
+*/
+YASFM_API int pruneCameraPairsByGPS(const ptr_vector<Camera>& cams,double radius,
+  vector<set<int>> *queries);
+
+} // namespace yasfm
@@ -1,13 +1,22 @@
 #include "image_similarity.h"
 
+#include <algorithm>
 #include <ctime>
+#include <functional>
+#include <queue>
 #include <random>
 #include <iostream>
 #include <xmmintrin.h>
 
+#include "Eigen/Eigenvalues"
+
 #include "utils.h"
 
 using Eigen::ArrayXi;
+using Eigen::Map;
+using Eigen::SelfAdjointEigenSolver;
+using std::pair;
+using std::priority_queue;
 using std::uniform_int_distribution;
 using std::cout;
 using std::cerr;
@@ -17,15 +26,20 @@ namespace yasfm
 
 void findSimilarCameraPairs(const ptr_vector<Camera>& cams,
   int maxVocabularySize,int nSimilar,bool verbose,
-  vector<set<int>> *pqueries)
+  vector<set<int>> *queries)
 {
-  auto& queries = *pqueries;
   MatrixXf similarity;
   VisualVocabulary voc;
   computeImagesSimilarity(cams,maxVocabularySize,verbose,
     &similarity,&voc);
+  findSimilarCameraPairs(similarity,nSimilar,queries);
+}
 
-  int nCams = static_cast<int>(cams.size());
+void findSimilarCameraPairs(const MatrixXf& similarity,int nSimilar,
+  vector<set<int>> *pqueries)
+{
+  auto& queries = *pqueries;
+  int nCams = static_cast<int>(similarity.cols());
   queries.resize(nCams);
   for(int iCurr = 0; iCurr < nCams; iCurr++)
   {
@@ -45,6 +59,62 @@ void findSimilarCameraPairs(const ptr_vector<Camera>& cams,
   }
 }
 
+void findSimilarCameraPairs(const OptionsGlobalRetrieval& opt,
+  const ptr_vector<Camera>& cams,int nSimilar,vector<set<int>> *pqueries)
+{
+  auto& queries = *pqueries;
+  int nCams = static_cast<int>(cams.size());
+  bool verbose = opt.get<bool>("verbose");
+  queries.resize(nCams);
+  if(nCams < 2)
+    return;
+
+  if(verbose)
+    cout << "Learning global descriptors ... ";
+  GlobalDescriptorModel model;
+  learnGlobalDescriptorModel(cams,opt.get<int>("nCenters"),opt.get<int>("dim"),
+    opt.get<int>("nPCASamples"),&model);
+  if(verbose)
+    cout << model.projection.rows() << " dimensions used.\n";
+
+  if(verbose)
+    cout << "Computing global descriptors for image:\n";
+  MatrixXf globalDescr;
+  computeGlobalDescriptors(model,cams,verbose,&globalDescr);
+
+  clock_t start = clock();
+  if(verbose)
+    cout << "Building search graph ... ";
+  SmallWorldGraph graph;
+  buildSmallWorldGraph(globalDescr,opt.get<int>("nGraphNeighbors"),
+    opt.get<int>("nBuildCandidates"),&graph);
+  if(verbose)
+    cout << (double)(clock() - start) / (double)CLOCKS_PER_SEC << "s\n";
+
+  // The camera itself is usually found as the most similar one.
+  vector<vector<int>> nearest;
+  searchSmallWorldGraph(graph,globalDescr,globalDescr,nSimilar + 1,
+    opt.get<int>("nSearchCandidates"),&nearest);
+  for(int iCurr = 0; iCurr < nCams; iCurr++)
+  {
+    int nFound = 0;
+    for(int idx : nearest[iCurr])
+    {
+      if(nFound >= nSimilar)
+        break;
+      if(iCurr < idx)
+      {
+        queries[idx].insert(iCurr);
+        nFound++;
+      } else if(iCurr > idx)
+      {
+        queries[iCurr].insert(idx);
+        nFound++;
+      }
+    }
+  }
+}
+
 void computeImagesSimilarity(const ptr_vector<Camera>& cams,
   int maxVocabularySize,bool verbose,MatrixXf *psimilarity,
   VisualVocabulary *voc)
@@ -88,8 +158,19 @@ void randomlySampleVisualWords(const ptr_vector<Camera>& cams,
   int nTotal = sampleSizes.sum();
   double fraction = double(maxVocabularySize)/nTotal;
 
+  // Round the cumulative sizes so that small vocabularies get sampled even
+  // when every camera contributes less than one word.
+  long long nPrev = 0;
+  int prevSampled = 0;
   for(int i = 0; i < nCams; i++)
-    sampleSizes(i) = std::min(sampleSizes(i),static_cast<int>(sampleSizes(i) * fraction));
+  {
+    long long nCurr = nPrev + sampleSizes(i);
+    int currSampled = static_cast<int>(nCurr * fraction);
+    int size = sampleSizes(i);
+    sampleSizes(i) = std::min(size,currSampled - prevSampled);
+    nPrev = nCurr;
+    prevSampled = currSampled;
+  }
   int vocSize = sampleSizes.sum();
 
   std::default_random_engine generator;
@@ -186,6 +267,187 @@ void computeTFIDF(size_t nVisualWords,const vector<vector<int>>& closestVisualWo
   }
 }
 
+void learnGlobalDescriptorModel(const ptr_vector<Camera>& cams,int nCenters,
+  int dim,int nPCASamples,GlobalDescriptorModel *pmodel)
+{
+  auto& model = *pmodel;
+  int nCams = static_cast<int>(cams.size());
+  randomlySampleVisualWords(cams,nCenters,&model.centers);
+  int vladDim = static_cast<int>(model.centers.size());
+  if(vladDim == 0)
+  {
+    model.mean.resize(0);
+    model.projection.resize(0,0);
+    return;
+  }
+
+  // Evenly spread cameras for learning the PCA.
+  int nSamples = nCams;
+  if(nPCASamples > 0 && nPCASamples < nCams)
+    nSamples = nPCASamples;
+  MatrixXf vlads(vladDim,nSamples);
+  for(int i = 0; i < nSamples; i++)
+  {
+    int iCam = static_cast<int>((static_cast<long long>(i) * nCams) / nSamples);
+    VectorXf vlad;
+    computeVLAD(model.centers,cams[iCam]->descr(),&vlad);
+    vlads.col(i) = vlad;
+  }
+  model.mean = vlads.rowwise().mean();
+  vlads.colwise() -= model.mean;
+
+  // Decompose the smaller of the two Gram matrices. The eigenvectors
+  // of the covariance are then either the eigenvectors or vlads*eigenvectors.
+  bool useSamplesGram = nSamples < vladDim;
+  SelfAdjointEigenSolver<MatrixXf> solver;
+  if(useSamplesGram)
+    solver.compute(vlads.transpose() * vlads);
+  else
+    solver.compute(vlads * vlads.transpose());
+  const auto& eigenvalues = solver.eigenvalues();
+  int n = static_cast<int>(eigenvalues.size());
+  float minEigenvalue = 1e-6f * eigenvalues(n - 1);
+  int nComponents = 0;
+  while(nComponents < std::min(dim,n) && eigenvalues(n - 1 - nComponents) > minEigenvalue)
+    nComponents++;
+
+  if(nComponents == 0)
+  {
+    // Not enough data, use the VLAD vectors as they are.
+    model.mean.setZero();
+    model.projection.setIdentity(vladDim,vladDim);
+    return;
+  }
+  model.projection.resize(nComponents,vladDim);
+  for(int i = 0; i < nComponents; i++)
+  {
+    int idx = n - 1 - i;
+    // Whitening divides by sqrt(eigenvalue). The scale is irrelevant since
+    // the descriptors get normalized.
+    if(useSamplesGram)
+    {
+      model.projection.row(i) =
+        (vlads * solver.eigenvectors().col(idx)).transpose() / eigenvalues(idx);
+    } else
+    {
+      model.projection.row(i) =
+        solver.eigenvectors().col(idx).transpose() / sqrt(eigenvalues(idx));
+    }
+  }
+}
+
+void computeVLAD(const MatrixXf& centers,const MatrixXf& descr,VectorXf *pvlad)
+{
+  auto& vlad = *pvlad;
+  int dim = static_cast<int>(centers.rows());
+  int nCenters = static_cast<int>(centers.cols());
+  int nDescr = static_cast<int>(descr.cols());
+  vlad.setZero(centers.size());
+  if(nCenters == 0 || nDescr == 0)
+    return;
+
+  MatrixXf similarity(centers.transpose() * descr);
+  for(int iDescr = 0; iDescr < nDescr; iDescr++)
+  {
+    int iCenter;
+    similarity.col(iDescr).maxCoeff(&iCenter);
+    vlad.segment(iCenter*dim,dim) += descr.col(iDescr) - centers.col(iCenter);
+  }
+
+  for(int iCenter = 0; iCenter < nCenters; iCenter++)
+  {
+    float norm = vlad.segment(iCenter*dim,dim).norm();
+    if(norm != 0.f)
+      vlad.segment(iCenter*dim,dim) /= norm;
+  }
+  float norm = vlad.norm();
+  if(norm != 0.f)
+    vlad /= norm;
+}
+
+void computeGlobalDescriptors(const GlobalDescriptorModel& model,
+  const ptr_vector<Camera>& cams,bool verbose,MatrixXf *pglobalDescr)
+{
+  auto& globalDescr = *pglobalDescr;
+  int nCams = static_cast<int>(cams.size());
+  globalDescr.resize(model.projection.rows(),nCams);
+  clock_t start = clock();
+  VectorXf vlad;
+  for(int iCam = 0; iCam < nCams; iCam++)
+  {
+    if(verbose && iCam % 1000 == 0)
+    {
+      cout << "  " << iCam << "/" << nCams << " ... "
+        << (double)(clock() - start) / (double)CLOCKS_PER_SEC << "s\n";
+    }
+    computeVLAD(model.centers,cams[iCam]->descr(),&vlad);
+    globalDescr.col(iCam).noalias() = model.projection * (vlad - model.mean);
+    float norm = globalDescr.col(iCam).norm();
+    if(norm != 0.f)
+      globalDescr.col(iCam) /= norm;
+  }
+}
+
+void buildSmallWorldGraph(const MatrixXf& points,int nNeighbors,
+  int nCandidates,SmallWorldGraph *pgraph)
+{
+  auto& graph = *pgraph;
+  int nPoints = static_cast<int>(points.cols());
+  size_t maxDegree = 2 * nNeighbors;
+  graph.neighbors.assign(nPoints,vector<int>());
+
+  vector<int> visitedStamp(nPoints,-1);
+  vector<pair<float,int>> nearest,pruned;
+  for(int iPoint = 1; iPoint < nPoints; iPoint++)
+  {
+    searchGraph(graph,points,&points(0,iPoint),std::max(nCandidates,nNeighbors),
+      &visitedStamp,iPoint,&nearest);
+    int n = std::min(nNeighbors,static_cast<int>(nearest.size()));
+    for(int i = 0; i < n; i++)
+    {
+      int neighbor = nearest[i].second;
+      graph.neighbors[iPoint].push_back(neighbor);
+      auto& neighborNeighbors = graph.neighbors[neighbor];
+      neighborNeighbors.push_back(iPoint);
+      if(neighborNeighbors.size() > maxDegree)
+      {
+        // Keep the most similar ones.
+        pruned.clear();
+        for(int idx : neighborNeighbors)
+          pruned.emplace_back(points.col(idx).dot(points.col(neighbor)),idx);
+        std::nth_element(pruned.begin(),pruned.begin() + maxDegree,pruned.end(),
+          std::greater<pair<float,int>>());
+        neighborNeighbors.resize(maxDegree);
+        for(size_t j = 0; j < maxDegree; j++)
+          neighborNeighbors[j] = pruned[j].second;
+      }
+    }
+  }
+}
+
+void searchSmallWorldGraph(const SmallWorldGraph& graph,const MatrixXf& points,
+  const MatrixXf& queries,int k,int nCandidates,vector<vector<int>> *pnearest)
+{
+  auto& nearest = *pnearest;
+  int nQueries = static_cast<int>(queries.cols());
+  nearest.resize(nQueries);
+#pragma omp parallel
+  {
+    vector<int> visitedStamp(points.cols(),-1);
+    vector<pair<float,int>> found;
+#pragma omp for schedule(dynamic,64)
+    for(int iQuery = 0; iQuery < nQueries; iQuery++)
+    {
+      searchGraph(graph,points,&queries(0,iQuery),std::max(nCandidates,k),
+        &visitedStamp,iQuery,&found);
+      int n = std::min(k,static_cast<int>(found.size()));
+      nearest[iQuery].resize(n);
+      for(int i = 0; i < n; i++)
+        nearest[iQuery][i] = found[i].second;
+    }
+  }
+}
+
 } // namespace yasfm
 
 namespace
@@ -212,4 +474,57 @@ float computeDotSIMD(size_t dim,const float* const x,
   return res;
 }
 
+void searchGraph(const yasfm::SmallWorldGraph& graph,const MatrixXf& points,
+  const float* const query,int nCandidates,vector<int> *pvisitedStamp,int stamp,
+  vector<std::pair<float,int>> *pnearest)
+{
+  typedef std::pair<float,int> SimilarityIdx;
+  auto& visitedStamp = *pvisitedStamp;
+  auto& nearest = *pnearest;
+  nearest.clear();
+  if(points.cols() == 0)
+    return;
+  Eigen::Map<const VectorXf> q(query,points.rows());
+  size_t maxFound = static_cast<size_t>(std::max(1,nCandidates));
+
+  // Candidates for expansion with the most similar on top and the found
+  // points with the least similar on top.
+  std::priority_queue<SimilarityIdx> candidates;
+  std::priority_queue<SimilarityIdx,vector<SimilarityIdx>,
+    std::greater<SimilarityIdx>> found;
+  int entry = 0;
+  visitedStamp[entry] = stamp;
+  float entrySimilarity = points.col(entry).dot(q);
+  candidates.emplace(entrySimilarity,entry);
+  found.emplace(entrySimilarity,entry);
+  while(!candidates.empty())
+  {
+    SimilarityIdx curr = candidates.top();
+    if(found.size() >= maxFound && curr.first < found.top().first)
+      break;
+    candidates.pop();
+    for(int neighbor : graph.neighbors[curr.second])
+    {
+      if(visitedStamp[neighbor] == stamp)
+        continue;
+      visitedStamp[neighbor] = stamp;
+      float similarity = points.col(neighbor).dot(q);
+      if(found.size() < maxFound || similarity > found.top().first)
+      {
+        candidates.emplace(similarity,neighbor);
+        found.emplace(similarity,neighbor);
+        if(found.size() > maxFound)
+          found.pop();
+      }
+    }
+  }
+
+  nearest.resize(found.size());
+  for(int i = static_cast<int>(nearest.size()) - 1; i >= 0; i--)
+  {
+    nearest[i] = found.top();
+    found.pop();
+  }
+}
+
 } // namespace
\ No newline at end of file
@@ -4,6 +4,8 @@
 * \brief      Functions relevant to computing image similarity.
 *
 *  Functions relevant to computing image similarity, visual vocabulary, etc.
+*  For large collections, images can also be retrieved using compact global
+*  descriptors (PCA-whitened VLAD) indexed by a navigable small world graph.
 *
 */
 //----------------------------------------------------------------------------------------
@@ -12,20 +14,57 @@
 
 #include <vector>
 #include <set>
+#include <string>
+#include <utility>
 
 #include "Eigen/Dense"
 
 #include "defines.h"
 #include "camera.h"
+#include "options_types.h"
 
 using std::vector;
 using std::set;
+using std::string;
 using Eigen::MatrixXf;
 using Eigen::VectorXf;
 
 namespace yasfm
 {
 
+/// Options for retrieval of similar cameras using global descriptors.
+/**
+Fields:
+// Number of VLAD centers. They are sampled from the descriptors.
+int nCenters;
+// Dimension of the global descriptors after PCA whitening.
+int dim;
+// Number of cameras used for learning the PCA. Non-positive value means all.
+int nPCASamples;
+// Number of neighbors of a node added when it is inserted into the graph.
+int nGraphNeighbors;
+// Number of candidates kept when searching the graph during its construction.
+int nBuildCandidates;
+// Number of candidates kept when searching the graph for similar cameras.
+int nSearchCandidates;
+bool verbose;
+*/
+class OptionsGlobalRetrieval : public OptionsWrapper
+{
+public:
+  /// Constructor setting defaults.
+  YASFM_API OptionsGlobalRetrieval()
+  {
+    opt.emplace("nCenters",make_unique<OptTypeWithVal<int>>(64));
+    opt.emplace("dim",make_unique<OptTypeWithVal<int>>(256));
+    opt.emplace("nPCASamples",make_unique<OptTypeWithVal<int>>(2000));
+    opt.emplace("nGraphNeighbors",make_unique<OptTypeWithVal<int>>(16));
+    opt.emplace("nBuildCandidates",make_unique<OptTypeWithVal<int>>(64));
+    opt.emplace("nSearchCandidates",make_unique<OptTypeWithVal<int>>(64));
+    opt.emplace("verbose",make_unique<OptTypeWithVal<bool>>(true));
+  }
+};
+
 /// Visual vocabulary.
 struct VisualVocabulary
 {
@@ -33,6 +72,25 @@ struct VisualVocabulary
   VectorXf idf;    ///< Inverse document frequency.
 };
 
+/// Model for computing global image descriptors.
+struct GlobalDescriptorModel
+{
+  MatrixXf centers;    ///< VLAD centers in columns.
+  VectorXf mean;       ///< Mean VLAD vector.
+  MatrixXf projection; ///< PCA whitening applied to VLAD vectors minus the mean.
+};
+
+/// Navigable small world graph over a set of points.
+/**
+Every point is connected to points similar to it (similarity is the dot product)
+and, thanks to the incremental construction, also to some distant points. Hence,
+a greedy search of the graph visits only about O(log n) points.
+*/
+struct SmallWorldGraph
+{
+  vector<vector<int>> neighbors; ///< Neighbors of every point.
+};
+
 /// Find similar cameras for every camera.
 /**
 \param[in] cams Cameras with descriptors.
@@ -46,6 +104,31 @@ YASFM_API void findSimilarCameraPairs(const ptr_vector<Camera>& cams,
   int maxVocabularySize,int nSimilar,bool verbose,
   vector<set<int>> *queries);
 
+/// Find similar cameras for every camera given image similarity.
+/**
+\param[in] similarity Symmetric matrix of image level similarity.
+\param[in] nSimilar Number of similar cameras for every camera.
+\param[out] queries For direct pluggin to matching functions. queries[i] are all similar 
+to i-th camera and are all smaller than i (their index is smaller).
+*/
+YASFM_API void findSimilarCameraPairs(const MatrixXf& similarity,int nSimilar,
+  vector<set<int>> *queries);
+
+/// Find similar cameras for every camera using global descriptors.
+/**
+Unlike the tf-idf similarity, this never forms the dense matrix of similarities.
+Every camera gets a global descriptor and the descriptors are indexed by a small
+world graph which is then searched for the nSimilar most similar cameras.
+
+\param[in] opt Options.
+\param[in] cams Cameras with normalized features.
+\param[in] nSimilar Number of similar cameras for every camera.
+\param[out] queries For direct pluggin to matching functions. queries[i] are all similar
+to i-th camera and are all smaller than i (their index is smaller).
+*/
+YASFM_API void findSimilarCameraPairs(const OptionsGlobalRetrieval& opt,
+  const ptr_vector<Camera>& cams,int nSimilar,vector<set<int>> *queries);
+
 /// Compute image level similarity (assumes normalized features).
 /**
 Randomly sample descriptors to create vocabulary. Compute tf-idf for
@@ -95,6 +178,67 @@ feature in that camera.
 YASFM_API void computeTFIDF(size_t nVisualWords,const vector<vector<int>>& closestVisualWord,
   VectorXf *idf,MatrixXf *tfidf);
 
+/// Learn the model for computing global descriptors.
+/**
+Samples VLAD centers using randomlySampleVisualWords() and learns PCA whitening
+from VLAD vectors of a subset of cameras.
+
+\param[in] cams Cameras with normalized features.
+\param[in] nCenters Number of VLAD centers.
+\param[in] dim Dimension of the global descriptors. Can be lowered if there
+is not enough data.
+\param[in] nPCASamples Number of cameras used for learning the PCA. Non-positive
+value means all.
+\param[out] model Learned model.
+*/
+YASFM_API void learnGlobalDescriptorModel(const ptr_vector<Camera>& cams,int nCenters,
+  int dim,int nPCASamples,GlobalDescriptorModel *model);
+
+/// Compute VLAD vector of one image.
+/**
+Sums residuals of descriptors to their closest centers. Every residual sum is
+normalized separately (intra-normalization) and then the whole vector is.
+
+\param[in] centers VLAD centers in columns.
+\param[in] descr Normalized descriptors in columns.
+\param[out] vlad VLAD vector of size centers.size().
+*/
+YASFM_API void computeVLAD(const MatrixXf& centers,const MatrixXf& descr,VectorXf *vlad);
+
+/// Compute global descriptors of all cameras.
+/**
+\param[in] model Model.
+\param[in] cams Cameras with normalized features.
+\param[in] verbose Print status?
+\param[out] globalDescr Normalized global descriptors in columns.
+*/
+YASFM_API void computeGlobalDescriptors(const GlobalDescriptorModel& model,
+  const ptr_vector<Camera>& cams,bool verbose,MatrixXf *globalDescr);
+
+/// Build navigable small world graph by inserting the points one by one.
+/**
+\param[in] points Points in columns.
+\param[in] nNeighbors Number of neighbors of a point found when inserting it.
+Every point keeps at most 2*nNeighbors neighbors.
+\param[in] nCandidates Number of candidates kept during the search for neighbors.
+\param[out] graph Graph.
+*/
+YASFM_API void buildSmallWorldGraph(const MatrixXf& points,int nNeighbors,
+  int nCandidates,SmallWorldGraph *graph);
+
+/// Find points most similar to queries (largest dot product) in the graph.
+/**
+\param[in] graph Graph built from points.
+\param[in] points Points in columns.
+\param[in] queries Query points in columns.
+\param[in] k Number of points to find for every query.
+\param[in] nCandidates Number of candidates kept during the search. Larger
+means more accurate and slower. At least k is used.
+\param[out] nearest Found points for every query ordered by decreasing similarity.
+*/
+YASFM_API void searchSmallWorldGraph(const SmallWorldGraph& graph,const MatrixXf& points,
+  const MatrixXf& queries,int k,int nCandidates,vector<vector<int>> *nearest);
+
 } // namespace yasfm
 
 namespace
@@ -112,4 +256,20 @@ which is the default for Eigen vectors and matrices.
 float computeDotSIMD(size_t dim,const float* const x,
   const float* const y);
 
+/// Best-first search in a small world graph starting from the first point.
+/**
+\param[in] graph Graph. It can be partially built.
+\param[in] points Points in columns.
+\param[in] query Query point.
+\param[in] nCandidates Number of candidates kept (at least one).
+\param[in,out] visitedStamp Stamp of the last search which visited a point.
+Has to be of size points.cols().
+\param[in] stamp Stamp of this search. Has to differ from all in visitedStamp.
+\param[out] nearest Found points together with their similarities ordered by
+decreasing similarity.
+*/
+void searchGraph(const yasfm::SmallWorldGraph& graph,const MatrixXf& points,
+  const float* const query,int nCandidates,vector<int> *visitedStamp,int stamp,
+  vector<std::pair<float,int>> *nearest);
+
 } // namespace
\ No newline at end of file
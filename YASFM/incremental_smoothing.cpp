@@ -0,0 +1,903 @@
+#include "incremental_smoothing.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <map>
+
+#include "Eigen/Dense"
+
+using Eigen::Dynamic;
+using Eigen::LLT;
+using Eigen::Lower;
+using Eigen::Matrix;
+using Eigen::Matrix3d;
+using Eigen::RowMajor;
+using Eigen::Vector2d;
+using Eigen::Vector3d;
+using Eigen::VectorXd;
+using std::cout;
+using std::chrono::duration;
+using std::chrono::steady_clock;
+
+namespace yasfm
+{
+
+/// Interface of the smoothers for the different numbers of camera parameters.
+class IncrementalSmootherImpl
+{
+public:
+  virtual ~IncrementalSmootherImpl() {}
+
+  /// See IncrementalSmoother::update.
+  virtual int update(const OptionsIncrementalSmoothing& opt,
+    ptr_vector<Camera> *cams,vector<Point> *pts) = 0;
+};
+
+} // namespace yasfm
+
+namespace
+{
+
+using namespace yasfm;
+
+/// Diagonal entries are clamped from below before damping.
+const double minDiag = 1e-6;
+
+/// Incremental smoother for cameras with N parameters.
+template<int N>
+class IncrementalSmootherN : public IncrementalSmootherImpl
+{
+public:
+  typedef Matrix<double,N,1> VecN;
+  typedef Matrix<double,N,N> MatNN;
+  typedef Matrix<double,N,3> MatN3;
+  typedef Matrix<double,2,N,RowMajor> Mat2N;
+  typedef Matrix<double,2,3,RowMajor> Mat23;
+  typedef Matrix<double,Dynamic,N,RowMajor> MatXN;
+
+  IncrementalSmootherN() : firstChangedVar_(0),lambda_(-1.),factorizedLambda_(-1.) {}
+
+  virtual int update(const OptionsIncrementalSmoothing& opt,
+    ptr_vector<Camera> *cams,vector<Point> *pts);
+
+private:
+  struct CamState
+  {
+    CamState() : active(false),var(-1),nObs(0),relinearize(false) {}
+    bool active;
+    int var;              ///< Block row in the reduced camera system.
+    VecN est;             ///< Current estimate.
+    VecN lin;             ///< Linearization point.
+    VecN written;         ///< Last value written into the camera.
+    VecN substituted;     ///< est - lin used by the last back-substitution.
+    MatNN JtJ;            ///< Sum of Jc^T*Jc over the observations.
+    int nObs;
+    unique_ptr<ceres::CostFunction> constraintCost;
+    MatNN constraintH;
+    VecN constraintg;
+    bool relinearize;
+    uset<int> pts;        ///< Points whose factors contain this camera.
+  };
+
+  struct PtState
+  {
+    PtState() : active(false),linearized(false),relinearize(false) {}
+    bool active;
+    bool linearized;      ///< The factor is in the reduced camera system.
+    bool relinearize;
+    Vector3d est,lin,written;
+    vector<IntPair> views;  ///< Observations (camera,key) of the factor.
+    vector<unique_ptr<ceres::CostFunction>> costs;
+    Matrix3d V;             ///< Jp^T*Jp.
+    Matrix3d Vinv;          ///< Inverse of the damped V.
+    Vector3d g;             ///< Jp^T*r.
+    vector<MatN3> W;        ///< Jc^T*Jp for every observation.
+    vector<MatNN> JcJc;     ///< Jc^T*Jc for every observation.
+    vector<VecN> Jcr;       ///< Jc^T*r for every observation.
+  };
+
+  /// Detect new and changed cameras and points.
+  /// \return False if some camera is not supported.
+  bool sync(const ptr_vector<Camera>& cams,const vector<Point>& pts);
+
+  /// Make sure that the camera is in the system.
+  bool activateCam(int camIdx,const Camera& cam);
+
+  /// Remove cameras without observations from the system.
+  void deactivateUnobservedCams();
+
+  /// (Re)build the factor of a point from its current views.
+  void buildPointFactor(int ptIdx,const Camera *const *cams,const Point& pt);
+
+  /// Remove the factor of a point from the system.
+  void removePointFactor(int ptIdx);
+
+  void markPointForRelinearization(int ptIdx);
+
+  /// Linearize the constraints of a camera at its linearization point.
+  void linearizeCam(CamState *cam) const;
+
+  /// Linearize the factor of a point at the linearization points.
+  void linearizePoint(PtState *pt) const;
+
+  /// Add (sign=1) or subtract (sign=-1) a camera's constraints into the system.
+  void applyCamFactor(double sign,const CamState& cam);
+
+  /// Add (sign=1) or subtract (sign=-1) a point's factor into the system.
+  void applyPointFactor(double sign,int ptIdx);
+
+  /// \return Block (r,c), r <= c, of the reduced camera system.
+  MatNN& block(int r,int c);
+
+  /// Solve the reduced camera system and update the cameras' estimates.
+  bool solveReducedSystem();
+
+  /// Recompute the rows of the Cholesky factor starting at firstVar.
+  bool factorize(int firstVar);
+
+  /// Update the estimate of a point from the current camera estimates.
+  void backSubstitute(PtState *pt) const;
+
+  /// Cost of the given point factors and of the camera constraints.
+  /**
+  \param[in] ptIdxs Points whose factors are evaluated.
+  \param[out] writtenCost Cost at the last written values.
+  \param[out] estCost Cost at the current estimates.
+  */
+  void evaluateCost(const vector<int>& ptIdxs,double *writtenCost,
+    double *estCost) const;
+
+  /// \return Loss of a squared residual norm s. The weight of the residual for
+  /// iteratively reweighted least squares is returned in weight (can be NULL).
+  double loss(double s,double *weight) const;
+
+  /// \return Root mean square of the linearized projections motion.
+  static double motion(const VecN& d,const MatNN& JtJ,int nObs);
+  static double motion(const Vector3d& d,const Matrix3d& JtJ,int nObs);
+
+  double damping_;
+  int nThreads_;
+  unique_ptr<ceres::LossFunction> loss_;  ///< NULL means squared loss.
+
+  vector<unique_ptr<CamState>> cams_;
+  vector<unique_ptr<PtState>> pts_;
+  vector<int> ptsToRelinearize_;
+
+  // Reduced camera system H*delta = b. Only upper blocks are stored,
+  // block (r,c) in H_[c][r].
+  vector<std::map<int,MatNN>> H_;
+  vector<VecN> b_;
+  vector<int> varToCam_;  ///< -1 for removed cameras.
+
+  // Block Cholesky factor of the damped H with the variables in the order of
+  // their activation. Block (r,c), r > c, is in L_[c][r].
+  vector<std::map<int,MatNN>> L_;
+  vector<MatNN> Ldiag_;     ///< Diagonal blocks (lower triangular).
+  int firstChangedVar_;     ///< Rows of the factor before this one are valid.
+  double lambda_;           ///< Levenberg-Marquardt damping of the cameras.
+  double factorizedLambda_; ///< Damping used by the factor.
+};
+
+template<int N>
+int IncrementalSmootherN<N>::update(const OptionsIncrementalSmoothing& opt,
+  ptr_vector<Camera> *pcams,vector<Point> *ppts)
+{
+  auto& cams = *pcams;
+  auto& pts = *ppts;
+  auto start = steady_clock::now();
+  damping_ = opt.get<double>("damping");
+  nThreads_ = std::max(1,opt.get<int>("numThreads"));
+  double relinearizeThresh = opt.get<double>("relinearizeThresh");
+  double backSubstitutionThresh = opt.get<double>("backSubstitutionThresh");
+  // NULL specifies squared loss
+  loss_.reset(opt.get<bool>("robustify") ? new ceres::HuberLoss(1.0) : NULL);
+  lambda_ = std::max(lambda_,damping_);
+
+  if(!sync(cams,pts))
+    return -1;
+
+  int nRelinearizedPts = 0,nRelinearizedCams = 0,nSubstitutedPts = 0,nRejected = 0;
+  int maxIterations = std::max(1,opt.get<int>("maxIterations"));
+  vector<int> ptsToSubstitute;
+  vector<bool> isToSubstitute(pts.size(),false);
+  vector<CamState *> movedCams;
+  for(int iteration = 0; iteration < maxIterations; iteration++)
+  {
+    for(auto& pcam : cams_)
+    {
+      if(!pcam || !pcam->active || !pcam->relinearize)
+        continue;
+      auto& cam = *pcam;
+      applyCamFactor(-1.,cam);
+      cam.lin = cam.est;
+      cam.substituted.setZero();
+      linearizeCam(&cam);
+      applyCamFactor(1.,cam);
+      cam.relinearize = false;
+      for(int ptIdx : cam.pts)
+        markPointForRelinearization(ptIdx);
+      nRelinearizedCams++;
+    }
+
+    int nToRelinearize = static_cast<int>(ptsToRelinearize_.size());
+    for(int ptIdx : ptsToRelinearize_)
+    {
+      auto& pt = *pts_[ptIdx];
+      if(pt.linearized)
+        applyPointFactor(-1.,ptIdx);
+      pt.lin = pt.est;
+    }
+#pragma omp parallel for num_threads(nThreads_) schedule(dynamic)
+    for(int i = 0; i < nToRelinearize; i++)
+      linearizePoint(&(*pts_[ptsToRelinearize_[i]]));
+    for(int ptIdx : ptsToRelinearize_)
+    {
+      auto& pt = *pts_[ptIdx];
+      applyPointFactor(1.,ptIdx);
+      pt.relinearize = false;
+      if(!isToSubstitute[ptIdx])
+      {
+        isToSubstitute[ptIdx] = true;
+        ptsToSubstitute.push_back(ptIdx);
+      }
+    }
+    nRelinearizedPts += nToRelinearize;
+    ptsToRelinearize_.clear();
+    deactivateUnobservedCams();
+
+    if(!solveReducedSystem())
+    {
+      YASFM_PRINT_ERROR("The reduced camera system could not be solved.");
+      return -1;
+    }
+
+    // Back-substitute points whose cameras moved noticeably.
+    movedCams.clear();
+    for(auto& pcam : cams_)
+    {
+      if(!pcam || !pcam->active)
+        continue;
+      auto& cam = *pcam;
+      VecN change = (cam.est - cam.lin) - cam.substituted;
+      if(motion(change,cam.JtJ,cam.nObs) > backSubstitutionThresh)
+      {
+        movedCams.push_back(&cam);
+        for(int ptIdx : cam.pts)
+        {
+          if(!isToSubstitute[ptIdx])
+          {
+            isToSubstitute[ptIdx] = true;
+            ptsToSubstitute.push_back(ptIdx);
+          }
+        }
+      }
+    }
+    int nToSubstitute = static_cast<int>(ptsToSubstitute.size());
+#pragma omp parallel for num_threads(nThreads_) schedule(static)
+    for(int i = 0; i < nToSubstitute; i++)
+      backSubstitute(&(*pts_[ptsToSubstitute[i]]));
+
+    // Levenberg-Marquardt step acceptance. Only the factors which the step
+    // updates are evaluated. A rejected step is undone and retried with larger
+    // damping. Points waiting for back-substitution stay in the list.
+    double writtenCost,estCost;
+    evaluateCost(ptsToSubstitute,&writtenCost,&estCost);
+    if(estCost > writtenCost)
+    {
+      for(auto& pcam : cams_)
+      {
+        if(pcam && pcam->active)
+          pcam->est = pcam->written;
+      }
+      for(int ptIdx : ptsToSubstitute)
+        pts_[ptIdx]->est = pts_[ptIdx]->written;
+      lambda_ *= 10.;
+      nRejected++;
+      continue;
+    }
+    lambda_ = std::max(damping_,0.1*lambda_);
+    for(auto *cam : movedCams)
+      cam->substituted = cam->est - cam->lin;
+    nSubstitutedPts += nToSubstitute;
+
+    // Find variables which moved too far from their linearization points.
+    for(auto& pcam : cams_)
+    {
+      if(pcam && pcam->active &&
+        motion(pcam->est - pcam->lin,pcam->JtJ,pcam->nObs) > relinearizeThresh)
+        pcam->relinearize = true;
+    }
+    bool anyToRelinearize = false;
+    for(auto& pcam : cams_)
+      anyToRelinearize |= (pcam && pcam->relinearize);
+    for(int ptIdx : ptsToSubstitute)
+    {
+      const auto& pt = *pts_[ptIdx];
+      if(motion(pt.est - pt.lin,pt.V,static_cast<int>(pt.views.size())) >
+        relinearizeThresh)
+      {
+        markPointForRelinearization(ptIdx);
+        anyToRelinearize = true;
+      }
+    }
+
+    // Write the results.
+    vector<double> params(N);
+    for(int camIdx = 0; camIdx < static_cast<int>(cams_.size()); camIdx++)
+    {
+      auto& pcam = cams_[camIdx];
+      if(pcam && pcam->active && pcam->est != pcam->written)
+      {
+        VecN::Map(&params[0]) = pcam->est;
+        cams[camIdx]->setParams(params);
+        pcam->written = pcam->est;
+      }
+    }
+    for(int ptIdx : ptsToSubstitute)
+    {
+      auto& pt = *pts_[ptIdx];
+      pts[ptIdx].coord = pt.est;
+      pt.written = pt.est;
+      isToSubstitute[ptIdx] = false;
+    }
+    ptsToSubstitute.clear();
+
+    if(!anyToRelinearize)
+      break;
+  }
+
+  if(opt.get<bool>("verbose"))
+  {
+    cout << "incremental smoothing: relinearized " << nRelinearizedPts << " points, "
+      << nRelinearizedCams << " cams, back-substituted " << nSubstitutedPts
+      << " points, rejected " << nRejected << " steps\ttook: "
+      << duration<double>(steady_clock::now() - start).count() << "s\n";
+  }
+  return nRelinearizedPts;
+}
+
+template<int N>
+bool IncrementalSmootherN<N>::sync(const ptr_vector<Camera>& cams,
+  const vector<Point>& pts)
+{
+  if(cams_.size() < cams.size())
+    cams_.resize(cams.size());
+  if(pts_.size() < pts.size())
+    pts_.resize(pts.size());
+
+  vector<double> params;
+  for(int camIdx = 0; camIdx < static_cast<int>(cams_.size()); camIdx++)
+  {
+    auto& pcam = cams_[camIdx];
+    if(!pcam || !pcam->active)
+      continue;
+    cams[camIdx]->params(&params);
+    Eigen::Map<const VecN> current(&params[0]);
+    if(current != pcam->written)
+    {
+      pcam->est = current;
+      pcam->written = current;
+      pcam->substituted.setZero();
+      pcam->relinearize = true;
+    }
+  }
+
+  vector<const Camera *> camPtrs(cams.size());
+  for(size_t camIdx = 0; camIdx < cams.size(); camIdx++)
+    camPtrs[camIdx] = &(*cams[camIdx]);
+
+  for(int ptIdx = 0; ptIdx < static_cast<int>(pts.size()); ptIdx++)
+  {
+    const auto& pt = pts[ptIdx];
+    auto& pstate = pts_[ptIdx];
+    if(pt.views.size() < 2)
+    {
+      if(pstate && pstate->active)
+        removePointFactor(ptIdx);
+      continue;
+    }
+
+    bool viewsChanged = !pstate || !pstate->active ||
+      pstate->views.size() != pt.views.size();
+    if(!viewsChanged)
+    {
+      for(const auto& camKey : pstate->views)
+      {
+        auto it = pt.views.find(camKey.first);
+        if(it == pt.views.end() || it->second != camKey.second)
+        {
+          viewsChanged = true;
+          break;
+        }
+      }
+    }
+
+    if(viewsChanged)
+    {
+      for(const auto& camKey : pt.views)
+      {
+        if(!activateCam(camKey.first,*cams[camKey.first]))
+          return false;
+      }
+      if(pstate && pstate->active)
+        removePointFactor(ptIdx);
+      buildPointFactor(ptIdx,&camPtrs[0],pt);
+    } else if(pt.coord != pstate->written)
+    {
+      pstate->est = pt.coord;
+      pstate->written = pt.coord;
+      markPointForRelinearization(ptIdx);
+    }
+  }
+  return true;
+}
+
+template<int N>
+bool IncrementalSmootherN<N>::activateCam(int camIdx,const Camera& camera)
+{
+  auto& pcam = cams_[camIdx];
+  if(pcam && pcam->active)
+    return true;
+
+  vector<double> params;
+  camera.params(&params);
+  if(params.size() != N)
+  {
+    YASFM_PRINT_ERROR("All cameras have to have the same number of parameters.");
+    return false;
+  }
+  if(!pcam)
+    pcam.reset(new CamState);
+  auto& cam = *pcam;
+  cam.active = true;
+  cam.est = Eigen::Map<const VecN>(&params[0]);
+  cam.lin = cam.est;
+  cam.written = cam.est;
+  cam.substituted.setZero();
+  cam.JtJ.setZero();
+  cam.nObs = 0;
+  cam.relinearize = false;
+  cam.pts.clear();
+  cam.constraintCost.reset(camera.constraintsCostFunction());
+
+  cam.var = static_cast<int>(H_.size());
+  H_.emplace_back();
+  b_.push_back(VecN::Zero());
+  varToCam_.push_back(camIdx);
+  block(cam.var,cam.var).setZero();
+
+  linearizeCam(&cam);
+  applyCamFactor(1.,cam);
+  return true;
+}
+
+template<int N>
+void IncrementalSmootherN<N>::deactivateUnobservedCams()
+{
+  for(auto& pcam : cams_)
+  {
+    if(!pcam || !pcam->active || pcam->nObs > 0)
+      continue;
+    auto& cam = *pcam;
+    firstChangedVar_ = std::min(firstChangedVar_,H_[cam.var].begin()->first);
+    H_[cam.var].clear();
+    for(int c = cam.var + 1; c < static_cast<int>(H_.size()); c++)
+      H_[c].erase(cam.var);
+    b_[cam.var].setZero();
+    varToCam_[cam.var] = -1;
+    cam.var = -1;
+    cam.active = false;
+    cam.relinearize = false;
+  }
+}
+
+template<int N>
+void IncrementalSmootherN<N>::buildPointFactor(int ptIdx,const Camera *const *cams,
+  const Point& point)
+{
+  auto& pstate = pts_[ptIdx];
+  if(!pstate)
+    pstate.reset(new PtState);
+  auto& pt = *pstate;
+  pt.active = true;
+  pt.linearized = false;
+  pt.est = point.coord;
+  pt.lin = point.coord;
+  pt.written = point.coord;
+  pt.views.assign(point.views.begin(),point.views.end());
+  pt.costs.clear();
+  for(const auto& camKey : pt.views)
+    pt.costs.emplace_back(cams[camKey.first]->costFunction(camKey.second));
+  size_t nViews = pt.views.size();
+  pt.W.resize(nViews);
+  pt.JcJc.resize(nViews);
+  pt.Jcr.resize(nViews);
+  markPointForRelinearization(ptIdx);
+}
+
+template<int N>
+void IncrementalSmootherN<N>::removePointFactor(int ptIdx)
+{
+  auto& pt = *pts_[ptIdx];
+  if(pt.linearized)
+    applyPointFactor(-1.,ptIdx);
+  pt.linearized = false;
+  pt.active = false;
+  if(pt.relinearize)
+  {
+    pt.relinearize = false;
+    ptsToRelinearize_.erase(
+      std::find(ptsToRelinearize_.begin(),ptsToRelinearize_.end(),ptIdx));
+  }
+}
+
+template<int N>
+void IncrementalSmootherN<N>::markPointForRelinearization(int ptIdx)
+{
+  auto& pt = *pts_[ptIdx];
+  if(!pt.relinearize)
+  {
+    pt.relinearize = true;
+    ptsToRelinearize_.push_back(ptIdx);
+  }
+}
+
+template<int N>
+void IncrementalSmootherN<N>::linearizeCam(CamState *pcam) const
+{
+  auto& cam = *pcam;
+  int nResiduals = cam.constraintCost->num_residuals();
+  const double *params[1] = {cam.lin.data()};
+  VectorXd r(nResiduals);
+  MatXN J(nResiduals,N);
+  double *jacobians[1] = {J.data()};
+  cam.constraintCost->Evaluate(params,r.data(),jacobians);
+  cam.constraintH.noalias() = J.transpose() * J;
+  cam.constraintg.noalias() = J.transpose() * r;
+}
+
+template<int N>
+void IncrementalSmootherN<N>::linearizePoint(PtState *ppt) const
+{
+  auto& pt = *ppt;
+  pt.V.setZero();
+  pt.g.setZero();
+  for(size_t i = 0; i < pt.views.size(); i++)
+  {
+    const double *params[2] = {cams_[pt.views[i].first]->lin.data(),pt.lin.data()};
+    Vector2d r;
+    Mat2N Jc;
+    Mat23 Jp;
+    double *jacobians[2] = {Jc.data(),Jp.data()};
+    if(!pt.costs[i]->Evaluate(params,r.data(),jacobians))
+    {
+      r.setZero();
+      Jc.setZero();
+      Jp.setZero();
+    }
+    // Iteratively reweighted least squares.
+    double w;
+    loss(r.squaredNorm(),&w);
+    r *= w;
+    Jc *= w;
+    Jp *= w;
+    pt.V.noalias() += Jp.transpose() * Jp;
+    pt.g.noalias() += Jp.transpose() * r;
+    pt.W[i].noalias() = Jc.transpose() * Jp;
+    pt.JcJc[i].noalias() = Jc.transpose() * Jc;
+    pt.Jcr[i].noalias() = Jc.transpose() * r;
+  }
+
+  Matrix3d Vdamped = pt.V;
+  for(int i = 0; i < 3; i++)
+    Vdamped(i,i) += damping_*std::max(pt.V(i,i),minDiag);
+  pt.Vinv = Vdamped.inverse();
+}
+
+template<int N>
+void IncrementalSmootherN<N>::applyCamFactor(double sign,const CamState& cam)
+{
+  block(cam.var,cam.var) += sign*cam.constraintH;
+  b_[cam.var] -= sign*cam.constraintg;
+}
+
+template<int N>
+void IncrementalSmootherN<N>::applyPointFactor(double sign,int ptIdx)
+{
+  auto& pt = *pts_[ptIdx];
+  int nViews = static_cast<int>(pt.views.size());
+  for(int i = 0; i < nViews; i++)
+  {
+    auto& cam = *cams_[pt.views[i].first];
+    int vi = cam.var;
+    MatN3 WVinv = pt.W[i] * pt.Vinv;
+    b_[vi] += sign*(WVinv*pt.g - pt.Jcr[i]);
+    block(vi,vi) += sign*pt.JcJc[i];
+    for(int j = i; j < nViews; j++)
+    {
+      int vj = cams_[pt.views[j].first]->var;
+      MatNN B = -WVinv * pt.W[j].transpose();
+      if(vi <= vj)
+        block(vi,vj) += sign*B;
+      else
+        block(vj,vi) += sign*B.transpose();
+    }
+
+    cam.JtJ += sign*pt.JcJc[i];
+    if(sign > 0.)
+    {
+      cam.nObs++;
+      cam.pts.insert(ptIdx);
+    } else
+    {
+      cam.nObs--;
+      cam.pts.erase(ptIdx);
+    }
+  }
+  pt.linearized = (sign > 0.);
+}
+
+template<int N>
+typename IncrementalSmootherN<N>::MatNN& IncrementalSmootherN<N>::block(int r,int c)
+{
+  firstChangedVar_ = std::min(firstChangedVar_,r);
+  auto& col = H_[c];
+  auto it = col.find(r);
+  if(it == col.end())
+    it = col.emplace(r,MatNN::Zero()).first;
+  return it->second;
+}
+
+template<int N>
+bool IncrementalSmootherN<N>::solveReducedSystem()
+{
+  int nVars = static_cast<int>(H_.size());
+  if(lambda_ != factorizedLambda_)
+  {
+    firstChangedVar_ = 0;
+    factorizedLambda_ = lambda_;
+  }
+  // Rows of the factor depend only on the preceding rows and columns of H
+  // so only the part starting at the first changed variable is refactorized.
+  if(!factorize(std::min(firstChangedVar_,nVars)))
+  {
+    firstChangedVar_ = 0;
+    return false;
+  }
+  firstChangedVar_ = nVars;
+
+  vector<VecN> x(b_);
+  for(int c = 0; c < nVars; c++)
+  {
+    Ldiag_[c].template triangularView<Lower>().solveInPlace(x[c]);
+    for(const auto& entry : L_[c])
+      x[entry.first].noalias() -= entry.second * x[c];
+  }
+  for(int c = nVars - 1; c >= 0; c--)
+  {
+    for(const auto& entry : L_[c])
+      x[c].noalias() -= entry.second.transpose() * x[entry.first];
+    Ldiag_[c].template triangularView<Lower>().transpose().solveInPlace(x[c]);
+  }
+
+  for(int v = 0; v < nVars; v++)
+  {
+    if(varToCam_[v] < 0)
+      continue;
+    auto& cam = *cams_[varToCam_[v]];
+    cam.est = cam.lin + x[v];
+  }
+  return true;
+}
+
+template<int N>
+bool IncrementalSmootherN<N>::factorize(int firstVar)
+{
+  int nVars = static_cast<int>(H_.size());
+  L_.resize(nVars);
+  Ldiag_.resize(nVars);
+  for(int c = 0; c < firstVar; c++)
+    L_[c].erase(L_[c].lower_bound(firstVar),L_[c].end());
+
+  // Up-looking block Cholesky. Row k of the factor solves a sparse triangular
+  // system with the rows before it. Its nonzeros are found by walking from the
+  // nonzeros of column k of H up the elimination tree (parent of c is the first
+  // row stored in L_[c]).
+  vector<int> mark(nVars,-1);
+  vector<int> pattern;
+  vector<MatNN> y(nVars);
+  for(int k = firstVar; k < nVars; k++)
+  {
+    L_[k].clear();
+    if(varToCam_[k] < 0)
+    {
+      Ldiag_[k].setIdentity();
+      continue;
+    }
+
+    pattern.clear();
+    mark[k] = k;
+    for(const auto& entry : H_[k])
+    {
+      int c = entry.first;
+      while(mark[c] != k)
+      {
+        mark[c] = k;
+        pattern.push_back(c);
+        y[c].setZero();
+        if(L_[c].empty())
+          break;
+        c = L_[c].begin()->first;
+      }
+    }
+    MatNN diag = MatNN::Zero();
+    for(const auto& entry : H_[k])
+    {
+      if(entry.first == k)
+        diag = entry.second;
+      else
+        y[entry.first] = entry.second;
+    }
+    for(int i = 0; i < N; i++)
+      diag(i,i) += lambda_*std::max(diag(i,i),minDiag);
+
+    std::sort(pattern.begin(),pattern.end());
+    for(int c : pattern)
+    {
+      Ldiag_[c].template triangularView<Lower>().solveInPlace(y[c]);
+      for(const auto& entry : L_[c])
+        y[entry.first].noalias() -= entry.second * y[c];
+      diag.noalias() -= y[c].transpose() * y[c];
+      L_[c].emplace_hint(L_[c].end(),k,y[c].transpose());
+    }
+
+    LLT<MatNN> llt(diag);
+    if(llt.info() != Eigen::Success)
+      return false;
+    Ldiag_[k] = llt.matrixL();
+  }
+  return true;
+}
+
+template<int N>
+void IncrementalSmootherN<N>::backSubstitute(PtState *ppt) const
+{
+  auto& pt = *ppt;
+  Vector3d rhs = -pt.g;
+  for(size_t i = 0; i < pt.views.size(); i++)
+  {
+    const auto& cam = *cams_[pt.views[i].first];
+    rhs.noalias() -= pt.W[i].transpose() * (cam.est - cam.lin);
+  }
+  pt.est = pt.lin + pt.Vinv * rhs;
+}
+
+template<int N>
+void IncrementalSmootherN<N>::evaluateCost(const vector<int>& ptIdxs,
+  double *pwrittenCost,double *pestCost) const
+{
+  double writtenCost = 0.,estCost = 0.;
+  int nPts = static_cast<int>(ptIdxs.size());
+#pragma omp parallel for num_threads(nThreads_) reduction(+:writtenCost,estCost)
+  for(int i = 0; i < nPts; i++)
+  {
+    const auto& pt = *pts_[ptIdxs[i]];
+    for(size_t j = 0; j < pt.views.size(); j++)
+    {
+      const auto& cam = *cams_[pt.views[j].first];
+      const double *written[2] = {cam.written.data(),pt.written.data()};
+      const double *est[2] = {cam.est.data(),pt.est.data()};
+      Vector2d r;
+      if(pt.costs[j]->Evaluate(written,r.data(),NULL))
+        writtenCost += loss(r.squaredNorm(),NULL);
+      if(pt.costs[j]->Evaluate(est,r.data(),NULL))
+        estCost += loss(r.squaredNorm(),NULL);
+    }
+  }
+
+  for(const auto& pcam : cams_)
+  {
+    if(!pcam || !pcam->active)
+      continue;
+    const auto& cam = *pcam;
+    VectorXd r(cam.constraintCost->num_residuals());
+    const double *written[1] = {cam.written.data()};
+    const double *est[1] = {cam.est.data()};
+    cam.constraintCost->Evaluate(written,r.data(),NULL);
+    writtenCost += r.squaredNorm();
+    cam.constraintCost->Evaluate(est,r.data(),NULL);
+    estCost += r.squaredNorm();
+  }
+  *pwrittenCost = writtenCost;
+  *pestCost = estCost;
+}
+
+template<int N>
+double IncrementalSmootherN<N>::loss(double s,double *weight) const
+{
+  if(!loss_)
+  {
+    if(weight)
+      *weight = 1.;
+    return s;
+  }
+  double rho[3];
+  loss_->Evaluate(s,rho);
+  if(weight)
+    *weight = sqrt(rho[1]);
+  return rho[0];
+}
+
+template<int N>
+double IncrementalSmootherN<N>::motion(const VecN& d,const MatNN& JtJ,int nObs)
+{
+  return (nObs > 0) ? sqrt(std::max(0.,d.dot(JtJ*d)) / nObs) : 0.;
+}
+
+template<int N>
+double IncrementalSmootherN<N>::motion(const Vector3d& d,const Matrix3d& JtJ,int nObs)
+{
+  return (nObs > 0) ? sqrt(std::max(0.,d.dot(JtJ*d)) / nObs) : 0.;
+}
+
+} // namespace
+
+namespace yasfm
+{
+
+IncrementalSmoother::IncrementalSmoother(const OptionsIncrementalSmoothing& opt)
+  : opt_(opt)
+{
+}
+
+IncrementalSmoother::~IncrementalSmoother()
+{
+}
+
+int IncrementalSmoother::update(ptr_vector<Camera> *pcams,vector<Point> *ppts)
+{
+  const auto& cams = *pcams;
+  const auto& pts = *ppts;
+  if(!impl_)
+  {
+    int nParams = -1;
+    vector<double> params;
+    for(size_t ptIdx = 0; ptIdx < pts.size() && nParams < 0; ptIdx++)
+    {
+      if(pts[ptIdx].views.size() >= 2)
+      {
+        cams[pts[ptIdx].views.begin()->first]->params(&params);
+        nParams = static_cast<int>(params.size());
+      }
+    }
+
+    if(nParams < 0)
+    {
+      return 0; // nothing to optimize
+    } else if(nParams == 7)
+    {
+      impl_.reset(new IncrementalSmootherN<7>);
+    } else if(nParams == 9)
+    {
+      impl_.reset(new IncrementalSmootherN<9>);
+    } else
+    {
+      YASFM_PRINT_ERROR("Unsupported number of camera parameters: " << nParams << ".");
+      return -1;
+    }
+  }
+
+  int nRelinearized = impl_->update(opt_,pcams,ppts);
+  if(nRelinearized < 0)
+    impl_.reset();
+  return nRelinearized;
+}
+
+void IncrementalSmoother::reset()
+{
+  impl_.reset();
+}
+
+} // namespace yasfm
@@ -0,0 +1,123 @@
+//----------------------------------------------------------------------------------------
+/**
+* \file       incremental_smoothing.h
+* \brief      Incremental smoothing of a growing reconstruction.
+*
+*  Incremental nonlinear least squares (in the spirit of iSAM2) which keeps
+*  the linearized reduced camera system between updates.
+*
+*/
+//----------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "defines.h"
+#include "sfm_data.h"
+#include "options_types.h"
+
+using std::make_unique;
+using std::unique_ptr;
+using std::vector;
+
+namespace yasfm
+{
+
+////////////////////////////////////////////////////
+///////////////   Declarations   ///////////////////
+////////////////////////////////////////////////////
+
+/// Options for incremental smoothing.
+/**
+Fields:
+// A variable gets relinearized once its estimate moves its projections by more
+// than this from the linearization point (root mean square, pixels).
+double relinearizeThresh;
+// Points get back-substituted once the update of their cameras moves the
+// projections by more than this (root mean square, pixels).
+double backSubstitutionThresh;
+// Max number of relinearize and solve iterations in one update.
+int maxIterations;
+// Relative damping of the diagonal. Takes care of the gauge freedom. The damping
+// of the cameras grows from this value when steps get rejected.
+double damping;
+// Use Huber loss (the same as OptionsBundleAdjustment::robustify).
+bool robustify;
+int numThreads;
+bool verbose;
+*/
+class OptionsIncrementalSmoothing : public OptionsWrapper
+{
+public:
+  /// Constructor setting defaults.
+  YASFM_API OptionsIncrementalSmoothing()
+  {
+    opt.emplace("relinearizeThresh",make_unique<OptTypeWithVal<double>>(0.5));
+    opt.emplace("backSubstitutionThresh",make_unique<OptTypeWithVal<double>>(0.05));
+    opt.emplace("maxIterations",make_unique<OptTypeWithVal<int>>(3));
+    opt.emplace("damping",make_unique<OptTypeWithVal<double>>(1e-4));
+    opt.emplace("robustify",make_unique<OptTypeWithVal<bool>>(false));
+    opt.emplace("numThreads",make_unique<OptTypeWithVal<int>>(8));
+    opt.emplace("verbose",make_unique<OptTypeWithVal<bool>>(false));
+  }
+};
+
+class IncrementalSmootherImpl;
+
+/// Incremental smoothing of a reconstruction which grows by cameras and points.
+/**
+Every point together with its observations is one factor. The factors are
+linearized and the points eliminated (Schur complement) into a reduced camera
+system which is kept between the updates. An update linearizes only the new
+factors and the factors of variables which moved by more than relinearizeThresh
+from their linearization points. The reduced camera system is solved by block
+Cholesky with the cameras in the order in which they were added. Only the rows of
+the factor starting at the first changed camera are recomputed. Points are
+back-substituted only when they were relinearized or their cameras moved noticeably.
+A step is kept only if it does not increase the cost of the factors it updates.
+Otherwise, it is undone and the damping of the cameras is increased
+(Levenberg-Marquardt).
+
+Supported are cameras with 7 (StandardCamera) or 9 (StandardCameraRadial)
+parameters. All the cameras have to have the same number of parameters.
+Observations of every point are taken from Point::views and points with less than
+2 views are ignored. Changes done to the cameras and points outside of the smoother
+(e.g. by bundleAdjust) are detected and the affected factors get relinearized.
+*/
+class IncrementalSmoother
+{
+public:
+  /// Constructor.
+  /**
+  \param[in] opt Options.
+  */
+  YASFM_API IncrementalSmoother(const OptionsIncrementalSmoothing& opt);
+
+  /// Destructor.
+  YASFM_API ~IncrementalSmoother();
+
+  /// Bring the smoother up to date with the reconstruction and optimize it.
+  /**
+  \param[in,out] cams Cameras.
+  \param[in,out] pts Points.
+  \return Number of relinearized point factors. -1 if the cameras are not supported
+  or the system could not be solved. The smoother gets reset in that case.
+  */
+  YASFM_API int update(ptr_vector<Camera> *cams,vector<Point> *pts);
+
+  /// Forget everything. The next update starts from scratch.
+  YASFM_API void reset();
+
+private:
+  /// Forbidden.
+  IncrementalSmoother(const IncrementalSmoother& o);
+  /// Forbidden.
+  IncrementalSmoother& operator=(const IncrementalSmoother& o);
+
+  OptionsIncrementalSmoothing opt_;
+  unique_ptr<IncrementalSmootherImpl> impl_;
+};
+
+} // namespace yasfm
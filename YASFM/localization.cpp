@@ -0,0 +1,404 @@
+#include "localization.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <mutex>
+
+#include "absolute_pose.h"
+
+using std::cout;
+using std::ifstream;
+using std::mutex;
+using std::ofstream;
+using std::unique_lock;
+using std::chrono::duration;
+using std::chrono::steady_clock;
+
+namespace
+{
+
+/// Guards reading of the query descriptors. Camera's descriptors cache is not
+/// safe to be used from several threads at once.
+mutex queryDescrMtx;
+
+/// \return Seconds elapsed since start.
+double secondsSince(const steady_clock::time_point& start)
+{
+  return duration<double>(steady_clock::now() - start).count();
+}
+
+} // namespace
+
+namespace yasfm
+{
+
+LocalizationModel::LocalizationModel(const flann::IndexParams& indexParams,
+  const Dataset& data)
+  : pts_(data.pts()),dim_(0),isValid_(true)
+{
+  computeDescriptors(false,data);
+  buildFLANNIndex(indexParams);
+}
+
+LocalizationModel::LocalizationModel(const OptionsLocalization& opt,
+  const Dataset& data)
+  : pts_(data.pts()),dim_(0),isValid_(true)
+{
+  computeDescriptors(opt.get<bool>("useMedoidDescriptors"),data);
+  if(opt.get<bool>("usePQ"))
+  {
+    pqIndex_.reset(new PQIndex);
+    pqIndex_->build(opt.getOpt<OptionsPQ>("pq"),descr_);
+    descr_.resize(0,0);
+  } else
+  {
+    buildFLANNIndex(opt.getOpt<OptionsFLANN>("matchingFLANN").
+      get<flann::IndexParams>("indexParams"));
+  }
+}
+
+LocalizationModel::LocalizationModel(const string& filename,const Dataset& data)
+  : pts_(data.pts()),dim_(0),isValid_(false)
+{
+  ifstream file(filename,std::ios::binary);
+  if(!file.is_open())
+  {
+    YASFM_PRINT_ERROR_FILE_OPEN(filename);
+    return;
+  }
+  int nRows = 0;
+  file.read(reinterpret_cast<char *>(&nRows),sizeof(int));
+  rowToPoint_.resize(std::max(0,nRows));
+  if(nRows > 0)
+    file.read(reinterpret_cast<char *>(&rowToPoint_[0]),sizeof(int)*nRows);
+  pqIndex_.reset(new PQIndex);
+  isValid_ = file && pqIndex_->read(file) && pqIndex_->size() == nRows;
+  for(int ptIdx : rowToPoint_)
+    isValid_ = isValid_ && ptIdx >= 0 && ptIdx < static_cast<int>(pts_.size());
+  if(!isValid_)
+  {
+    YASFM_PRINT_ERROR("Could not read localization model:\n" << filename);
+    rowToPoint_.clear();
+    pqIndex_.reset();
+    return;
+  }
+  dim_ = pqIndex_->dim();
+}
+
+bool LocalizationModel::write(const string& filename) const
+{
+  if(!pqIndex_)
+  {
+    YASFM_PRINT_ERROR("Only compressed models can be written.");
+    return false;
+  }
+  ofstream file(filename,std::ios::binary);
+  if(!file.is_open())
+  {
+    YASFM_PRINT_ERROR_FILE_OPEN(filename);
+    return false;
+  }
+  int nRows = numIndexedPoints();
+  file.write(reinterpret_cast<const char *>(&nRows),sizeof(int));
+  if(nRows > 0)
+    file.write(reinterpret_cast<const char *>(&rowToPoint_[0]),sizeof(int)*nRows);
+  pqIndex_->write(file);
+  return static_cast<bool>(file);
+}
+
+void LocalizationModel::computeDescriptors(bool useMedoid,const Dataset& data)
+{
+  // Group observations by cameras so that the descriptors of every camera
+  // are read only once.
+  vector<vector<IntPair>> camsKeysPts(data.numCams());
+  for(int ptIdx = 0; ptIdx < static_cast<int>(pts_.size()); ptIdx++)
+  {
+    for(const auto& camKey : pts_[ptIdx].views)
+    {
+      camsKeysPts[camKey.first].emplace_back(camKey.second,ptIdx);
+    }
+  }
+
+  MatrixXf sums;
+  vector<MatrixXf> observations; // only for medoids
+  vector<int> nObservations(pts_.size(),0);
+  for(int camIdx = 0; camIdx < data.numCams(); camIdx++)
+  {
+    if(camsKeysPts[camIdx].empty())
+      continue;
+
+    // Make sure that we own these descriptors and they do not get deleted.
+    MatrixXf camDescr = data.cams()[camIdx]->descr();
+    if(dim_ == 0)
+    {
+      dim_ = static_cast<int>(camDescr.rows());
+      if(useMedoid)
+      {
+        observations.resize(pts_.size());
+        for(size_t ptIdx = 0; ptIdx < pts_.size(); ptIdx++)
+          observations[ptIdx].resize(dim_,pts_[ptIdx].views.size());
+      } else
+      {
+        sums.setZero(dim_,pts_.size());
+      }
+    }
+    for(const auto& keyPt : camsKeysPts[camIdx])
+    {
+      if(useMedoid)
+        observations[keyPt.second].col(nObservations[keyPt.second]) =
+          camDescr.col(keyPt.first);
+      else
+        sums.col(keyPt.second) += camDescr.col(keyPt.first);
+      nObservations[keyPt.second]++;
+    }
+  }
+
+  for(int ptIdx = 0; ptIdx < static_cast<int>(pts_.size()); ptIdx++)
+  {
+    if(nObservations[ptIdx] > 0)
+      rowToPoint_.push_back(ptIdx);
+  }
+
+  int nRows = numIndexedPoints();
+  descr_.resize(dim_,nRows);
+  for(int row = 0; row < nRows; row++)
+  {
+    int ptIdx = rowToPoint_[row];
+    if(useMedoid)
+    {
+      const auto& obs = observations[ptIdx];
+      descr_.col(row) = obs.col(findMedoid(obs));
+    } else
+    {
+      descr_.col(row) = sums.col(ptIdx);
+      float norm = descr_.col(row).norm();
+      if(norm > 0.f)
+        descr_.col(row) /= norm;
+    }
+  }
+}
+
+void LocalizationModel::buildFLANNIndex(const flann::IndexParams& indexParams)
+{
+  int nRows = numIndexedPoints();
+  if(nRows > 0)
+  {
+    // Column major is row major transposed.
+    flann::Matrix<float> descrFlann(descr_.data(),nRows,dim_);
+    index_.reset(new flann::Index<flann::L2<float>>(descrFlann,indexParams));
+    index_->buildIndex();
+  }
+}
+
+bool LocalizationModel::isValid() const { return isValid_; }
+bool LocalizationModel::isCompressed() const { return static_cast<bool>(pqIndex_); }
+const vector<Point>& LocalizationModel::pts() const { return pts_; }
+int LocalizationModel::numIndexedPoints() const
+{
+  return static_cast<int>(rowToPoint_.size());
+}
+int LocalizationModel::descrDim() const { return dim_; }
+
+void LocalizationModel::findCamToSceneMatches(const OptionsFLANN& opt,
+  const MatrixXf& descr,vector<IntPair> *pcamToSceneMatches) const
+{
+  auto& camToSceneMatches = *pcamToSceneMatches;
+  camToSceneMatches.clear();
+  if((!index_ && !pqIndex_) || descr.cols() == 0)
+    return;
+  if(descr.rows() != dim_)
+  {
+    YASFM_PRINT_ERROR("Query descriptors dimension " << descr.rows()
+      << " does not match the model dimension " << dim_ << ".");
+    return;
+  }
+
+  CameraPair pair;
+  if(pqIndex_)
+  {
+    matchFeatPQ(opt,*pqIndex_,descr,&pair);
+  } else
+  {
+    // Switch to row major and transpose (=exchange nrows and ncols)
+    flann::Matrix<float> descrFlann(
+      const_cast<float*>(descr.data()),descr.cols(),descr.rows());
+    matchFeatFLANN(opt,*index_,descrFlann,&pair);
+  }
+
+  camToSceneMatches.reserve(pair.matches.size());
+  for(const auto& match : pair.matches)
+  {
+    camToSceneMatches.emplace_back(match.first,rowToPoint_[match.second]);
+  }
+}
+
+bool localizeCamera(const OptionsLocalization& opt,
+  const LocalizationModel& model,Camera *query,LocalizationResult *presult)
+{
+  auto& result = *presult;
+  auto start = steady_clock::now();
+  result.success = false;
+  result.P.setZero();
+  result.inliers.clear();
+  result.matchingTime = 0.;
+  result.poseTime = 0.;
+
+  MatrixXf descr;
+  {
+    unique_lock<mutex> lck(queryDescrMtx);
+    descr = query->descr();
+  }
+
+  auto matchingStart = steady_clock::now();
+  model.findCamToSceneMatches(opt.getOpt<OptionsFLANN>("matchingFLANN"),descr,
+    &result.camToSceneMatches);
+  result.matchingTime = secondsSince(matchingStart);
+
+  if(static_cast<int>(result.camToSceneMatches.size()) >=
+    opt.get<int>("minNumCamToSceneMatches"))
+  {
+    auto poseStart = steady_clock::now();
+    const auto& absolutePose = opt.getOpt<OptionsRANSAC>("absolutePose");
+    if(opt.get<bool>("useCalibratedQueries"))
+    {
+      vector<Vector2d> normKeys;
+      query->keysNormalized(&normKeys);
+      // The solver works with normalized keys.
+      OptionsRANSAC normalizedPose(absolutePose);
+      normalizedPose.get<double>("errorThresh") /= query->K()(0,0);
+      Matrix34d Rt;
+      result.success = resectCamera3ptRANSAC(normalizedPose,result.camToSceneMatches,
+        normKeys,model.pts(),&Rt,&result.inliers);
+      if(result.success)
+      {
+        Matrix3d R = Rt.leftCols(3);
+        query->setRotation(R);
+        query->setC(-R.transpose()*Rt.col(3));
+      }
+    } else
+    {
+      result.success = resectCamera6ptLSRANSAC(absolutePose,result.camToSceneMatches,
+        model.pts(),query,&result.inliers);
+    }
+    if(result.success)
+      result.P = query->P();
+    result.poseTime = secondsSince(poseStart);
+  }
+
+  result.totalTime = secondsSince(start);
+  return result.success;
+}
+
+int localizeCameras(const OptionsLocalization& opt,
+  const LocalizationModel& model,ptr_vector<Camera> *pqueries,
+  vector<LocalizationResult> *presults)
+{
+  auto& queries = *pqueries;
+  auto& results = *presults;
+  bool verbose = opt.get<bool>("verbose");
+  int nQueries = static_cast<int>(queries.size());
+  results.resize(nQueries);
+
+  auto start = steady_clock::now();
+  int nLocalized = 0;
+#pragma omp parallel
+  {
+#pragma omp for schedule(dynamic) reduction(+:nLocalized)
+    for(int i = 0; i < nQueries; i++)
+    {
+      if(localizeCamera(opt,model,&(*queries[i]),&results[i]))
+        nLocalized++;
+    }
+  }
+
+  if(verbose)
+  {
+    for(int i = 0; i < nQueries; i++)
+    {
+      const auto& result = results[i];
+      cout << "localizing: " << i << "\t" << result.camToSceneMatches.size()
+        << " matches\t" << result.inliers.size() << " inliers\t"
+        << (result.success ? "success" : "failure") << "\t"
+        << "took: " << result.totalTime << "s\n";
+    }
+    cout << "localized " << nLocalized << "/" << nQueries << " queries in "
+      << secondsSince(start) << "s\n";
+  }
+  return nLocalized;
+}
+
+} // namespace yasfm
+
+namespace
+{
+
+void matchFeatPQ(const OptionsFLANN& opt,const PQIndex& index,const MatrixXf& queryDescr,
+  CameraPair *pair)
+{
+  int numQueries = static_cast<int>(queryDescr.cols());
+  auto& outMatches = pair->matches;
+  auto& outDists = pair->dists;
+  outMatches.clear();
+  outDists.clear();
+  outMatches.reserve(numQueries);
+  outDists.reserve(numQueries);
+
+  bool filterByRatio = opt.filterByRatio();
+  float thresh = opt.get<float>("ratioThresh");
+  float sqThresh = thresh*thresh; // squared distances are returned
+  int k = filterByRatio ? 2 : 1;
+  int nearestNeighbors[2];
+  float dists[2];
+  for(int i = 0; i < numQueries; i++)
+  {
+    index.knnSearch(queryDescr.col(i).data(),k,nearestNeighbors,dists);
+    if(nearestNeighbors[0] < 0)
+      continue;
+    if(filterByRatio)
+    {
+      float ratio = (dists[0] / dists[1]);
+      if(ratio < sqThresh)
+      {
+        outMatches.emplace_back(i,nearestNeighbors[0]);
+        outDists.push_back(sqrt(ratio));
+      }
+    } else
+    {
+      outMatches.emplace_back(i,nearestNeighbors[0]);
+      outDists.push_back(dists[0]);
+    }
+  }
+
+  if(opt.get<bool>("onlyUniques"))
+  {
+    vector<bool> unique;
+    findUniqueMatches(outMatches,index.size(),&unique);
+    filterVector(unique,&outMatches);
+    filterVector(unique,&outDists);
+  }
+  sortMatchesByDists(pair);
+}
+
+int findMedoid(const MatrixXf& descr)
+{
+  int n = static_cast<int>(descr.cols());
+  int best = 0;
+  float bestSum = std::numeric_limits<float>::max();
+  for(int i = 0; i < n; i++)
+  {
+    float sum = 0.f;
+    for(int j = 0; j < n; j++)
+      sum += (descr.col(i) - descr.col(j)).norm();
+    if(sum < bestSum)
+    {
+      bestSum = sum;
+      best = i;
+    }
+  }
+  return best;
+}
+
+} // namespace
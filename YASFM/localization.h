@@ -0,0 +1,267 @@
+//----------------------------------------------------------------------------------------
+/**
+* \file       localization.h
+* \brief      Localization of query images in a frozen model.
+*
+*  Localization of query images in a reconstruction which is not modified.
+*
+*/
+//----------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Eigen/Dense"
+
+#include "defines.h"
+#include "sfm_data.h"
+#include "options_types.h"
+#include "matching.h"
+#include "product_quantization.h"
+#include "ransac.h"
+
+using Eigen::MatrixXf;
+using std::make_shared;
+using std::make_unique;
+using std::string;
+using std::unique_ptr;
+using std::vector;
+
+namespace yasfm
+{
+
+////////////////////////////////////////////////////
+///////////////   Declarations   ///////////////////
+////////////////////////////////////////////////////
+
+/// Options for localization in a frozen model.
+/**
+Fields:
+// Index parameters are used for building the model index. Search parameters and
+// the ratio test for querying it.
+OptionsFLANN matchingFLANN;
+// Use the medoid of the descriptors of the observations of a point instead of
+// their normalized mean.
+bool useMedoidDescriptors;
+// Compress the point descriptors using product quantization instead of building
+// a FLANN index. Only the ratio test and onlyUniques of matchingFLANN are used then.
+bool usePQ;
+OptionsPQ pq;
+// The error is reprojection error. Units are pixels (also when useCalibratedQueries
+// is set).
+OptionsRANSAC absolutePose;
+int minNumCamToSceneMatches;
+// Use the calibrated 3pt solver. The query cameras have to have their focal set.
+// Otherwise, the uncalibrated 6pt solver is used.
+bool useCalibratedQueries;
+bool verbose;
+*/
+class OptionsLocalization : public OptionsWrapper
+{
+public:
+  /// Constructor setting defaults.
+  YASFM_API OptionsLocalization()
+  {
+    int minNumCamToSceneMatches = 16;
+
+    OptionsWrapperPtr matchingFLANN = make_shared<OptionsFLANN>();
+    matchingFLANN->get<float>("ratioThresh") = 0.7f;
+    matchingFLANN->get<bool>("verbose") = false;
+    opt.emplace("matchingFLANN",
+      make_unique<OptTypeWithVal<OptionsWrapperPtr>>(matchingFLANN));
+    opt.emplace("useMedoidDescriptors",make_unique<OptTypeWithVal<bool>>(false));
+    opt.emplace("usePQ",make_unique<OptTypeWithVal<bool>>(false));
+    OptionsWrapperPtr pq = make_shared<OptionsPQ>();
+    opt.emplace("pq",make_unique<OptTypeWithVal<OptionsWrapperPtr>>(pq));
+
+    OptionsWrapperPtr absolutePose =
+      make_shared<OptionsRANSAC>(4096,4.,minNumCamToSceneMatches,0.999999);
+    opt.emplace("absolutePose",
+      make_unique<OptTypeWithVal<OptionsWrapperPtr>>(absolutePose));
+
+    opt.emplace("minNumCamToSceneMatches",
+      make_unique<OptTypeWithVal<int>>(minNumCamToSceneMatches));
+    opt.emplace("useCalibratedQueries",make_unique<OptTypeWithVal<bool>>(false));
+    opt.emplace("verbose",make_unique<OptTypeWithVal<bool>>(true));
+  }
+
+  template<class T>
+  const T& getOpt(const string& name) const
+  {
+    return *static_cast<T *>(&(*get<OptionsWrapperPtr>(name)));
+  }
+
+  template<class T>
+  T& getOpt(const string& name)
+  {
+    return *static_cast<T *>(&(*get<OptionsWrapperPtr>(name)));
+  }
+};
+
+/// Immutable model used for localization.
+/**
+Holds a copy of the points, one descriptor per point (the normalized mean or
+the medoid of the descriptors of its observations) and either a FLANN index built
+over them or their product quantized codes. Compressed models take nSubspaces bytes
+per point instead of the full descriptors and can be written next to the
+reconstruction and read back without reading any descriptors.
+Once constructed, the model is only read and can be shared by any number
+of threads.
+*/
+class LocalizationModel
+{
+public:
+  /// Constructor. Builds the model from a reconstruction.
+  /**
+  Reads descriptors of the reconstructed cameras (the dataset itself is not modified
+  except for the descriptors cache of its cameras). Uses the mean descriptors.
+
+  \param[in] indexParams Parameters of the FLANN index over the point descriptors.
+  \param[in] data Reconstruction.
+  */
+  YASFM_API LocalizationModel(const flann::IndexParams& indexParams,const Dataset& data);
+
+  /// Constructor. Builds the model from a reconstruction.
+  /**
+  Reads descriptors of the reconstructed cameras (the dataset itself is not modified
+  except for the descriptors cache of its cameras).
+
+  \param[in] opt Options. Uses matchingFLANN index params, useMedoidDescriptors,
+  usePQ and pq.
+  \param[in] data Reconstruction.
+  */
+  YASFM_API LocalizationModel(const OptionsLocalization& opt,const Dataset& data);
+
+  /// Constructor. Reads a compressed model written by write().
+  /**
+  Check isValid() afterwards.
+
+  \param[in] filename Model filename.
+  \param[in] data Reconstruction the model was built from.
+  */
+  YASFM_API LocalizationModel(const string& filename,const Dataset& data);
+
+  /// Write a compressed model (the points are not written).
+  /**
+  \param[in] filename Model filename.
+  \return False if the model is not compressed or the file could not be written.
+  */
+  YASFM_API bool write(const string& filename) const;
+
+  /// \return False if reading of the model failed.
+  YASFM_API bool isValid() const;
+
+  /// \return True if the descriptors are product quantized.
+  YASFM_API bool isCompressed() const;
+
+  /// \return Points of the model.
+  YASFM_API const vector<Point>& pts() const;
+
+  /// \return Number of points which have a descriptor (i.e. are searchable).
+  YASFM_API int numIndexedPoints() const;
+
+  /// \return Dimension of the descriptors.
+  YASFM_API int descrDim() const;
+
+  /// Find camera to scene matches using the ratio test.
+  /**
+  \param[in] opt Matching options. Only search params, ratioThresh and onlyUniques
+  are used.
+  \param[in] descr Query descriptors (one column is one descriptor).
+  \param[out] camToSceneMatches Matches. .first is key index and .second point index.
+  */
+  YASFM_API void findCamToSceneMatches(const OptionsFLANN& opt,const MatrixXf& descr,
+    vector<IntPair> *camToSceneMatches) const;
+
+private:
+  /// Forbidden.
+  LocalizationModel(const LocalizationModel& o);
+  /// Forbidden.
+  LocalizationModel& operator=(const LocalizationModel& o);
+
+  /// Compute one descriptor per point which has observations.
+  /// \param[in] useMedoid Use medoids instead of normalized means.
+  /// \param[in] data Reconstruction.
+  void computeDescriptors(bool useMedoid,const Dataset& data);
+
+  /// Build FLANN index over descr_.
+  /// \param[in] indexParams FLANN index parameters.
+  void buildFLANNIndex(const flann::IndexParams& indexParams);
+
+  vector<Point> pts_;
+  int dim_;
+  bool isValid_;
+  MatrixXf descr_;          ///< One column per indexed point (empty if compressed).
+  vector<int> rowToPoint_;  ///< Point index of every descriptor.
+  unique_ptr<flann::Index<flann::L2<float>>> index_;
+  unique_ptr<PQIndex> pqIndex_;
+};
+
+/// Result of localization of one query image.
+typedef struct LocalizationResult
+{
+  bool success;
+  /// Projection matrix of the query (set only on success).
+  Matrix34d P;
+  /// .first is key index and .second point index of the model.
+  vector<IntPair> camToSceneMatches;
+  /// Indices into camToSceneMatches.
+  vector<int> inliers;
+  double matchingTime; ///< Seconds.
+  double poseTime;     ///< Seconds.
+  double totalTime;    ///< Seconds (including reading of the descriptors).
+} LocalizationResult;
+
+/// Localize one query camera in a frozen model.
+/**
+The query has to have features. Its parameters are set on success.
+
+\param[in] opt Options.
+\param[in] model Model.
+\param[in,out] query Query camera.
+\param[out] result Result.
+\return True on success.
+*/
+YASFM_API bool localizeCamera(const OptionsLocalization& opt,
+  const LocalizationModel& model,Camera *query,LocalizationResult *result);
+
+/// Localize a batch of query cameras concurrently in a frozen model.
+/**
+The queries have to have features. Their parameters are set on success.
+The model is shared between the threads and not modified.
+
+\param[in] opt Options.
+\param[in] model Model.
+\param[in,out] queries Query cameras.
+\param[out] results Results. One per query.
+\return Number of successfully localized queries.
+*/
+YASFM_API int localizeCameras(const OptionsLocalization& opt,
+  const LocalizationModel& model,ptr_vector<Camera> *queries,
+  vector<LocalizationResult> *results);
+
+} // namespace yasfm
+
+namespace
+{
+
+/// Match features using a product quantized index.
+/**
+Counterpart of matchFeatFLANN. Filters by ratio of the approximate distances
+and/or uniqueness.
+
+\param[in] opt Options. Only ratioThresh and onlyUniques are used.
+\param[in] index Built index.
+\param[in] queryDescr Query descriptors (one column is one descriptor).
+\param[out] pair Resulting matched camera pair.
+*/
+void matchFeatPQ(const OptionsFLANN& opt,const PQIndex& index,const MatrixXf& queryDescr,
+  CameraPair *pair);
+
+/// \return Index of the descriptor with the smallest sum of distances to the others.
+int findMedoid(const MatrixXf& descr);
+
+} // namespace
@@ -0,0 +1,256 @@
+#include "logging.h"
+
+#include <iostream>
+
+using std::condition_variable;
+using std::lock_guard;
+using std::mutex;
+using std::unique_lock;
+using std::chrono::duration;
+using std::chrono::steady_clock;
+
+namespace
+{
+
+/// The buffer of a thread is handed over to the writer once it has this many records.
+const size_t maxBufferedRecords = 256;
+/// The writer collects the buffers of all threads with this period (seconds).
+const double maxBufferedTime = 0.1;
+
+} // namespace
+
+namespace yasfm
+{
+
+StreamLogSink::StreamLogSink(ostream& out)
+  : out_(out)
+{
+}
+
+void StreamLogSink::write(const LogRecord& record)
+{
+  out_ << record.message << "\n";
+}
+
+void StreamLogSink::flush()
+{
+  out_.flush();
+}
+
+SummaryLogSink::SummaryLogSink(ostream& out,double period)
+  : out_(out),period_(period),lastWrite_(steady_clock::now())
+{
+}
+
+void SummaryLogSink::write(const LogRecord& record)
+{
+  if(record.tag.empty())
+  {
+    writeSummaries();
+    out_ << record.message << "\n";
+  } else
+  {
+    auto& summary = summaries_[record.tag];
+    summary.count++;
+    summary.value += record.value;
+    if(duration<double>(steady_clock::now() - lastWrite_).count() >= period_)
+      writeSummaries();
+  }
+}
+
+void SummaryLogSink::flush()
+{
+  writeSummaries();
+  out_.flush();
+}
+
+void SummaryLogSink::writeSummaries()
+{
+  for(const auto& entry : summaries_)
+  {
+    out_ << entry.first << ": " << entry.second.count << " records";
+    if(entry.second.value != 0.)
+      out_ << ", total " << entry.second.value;
+    out_ << "\n";
+  }
+  summaries_.clear();
+  lastWrite_ = steady_clock::now();
+}
+
+Logger Logger::instance_;
+
+Logger& Logger::instance()
+{
+  return instance_;
+}
+
+Logger::Logger()
+  : level_(LogLevelVerbose),nQueued_(0),nWritten_(0),stopped_(false),
+  sink_(new StreamLogSink(std::cout))
+{
+}
+
+Logger::~Logger()
+{
+  stop();
+}
+
+void Logger::setLevel(LogLevel level)
+{
+  level_.store(level);
+}
+
+LogLevel Logger::level() const
+{
+  return LogLevel(level_.load());
+}
+
+void Logger::setSink(unique_ptr<LogSink> sink)
+{
+  flush();
+  lock_guard<mutex> lock(sinkMtx_);
+  sink_ = std::move(sink);
+}
+
+void Logger::log(LogLevel level,const string& tag,const string& message,double value)
+{
+  if(level <= LogLevelInfo || stopped_)
+  {
+    // Records of other threads which are still buffered were logged earlier.
+    {
+      lock_guard<mutex> lock(mtx_);
+      collectBuffers();
+      queue_.push_back({level,tag,message,value});
+      nQueued_++;
+    }
+    flush();
+    return;
+  }
+
+  ThreadBuffer *buffer = threadBuffer();
+  vector<LogRecord> records;
+  {
+    lock_guard<mutex> lock(buffer->mtx);
+    buffer->records.push_back({level,tag,message,value});
+    if(buffer->records.size() >= maxBufferedRecords)
+      records.swap(buffer->records);
+  }
+  // The buffer lock is released before taking the queue lock because the writer
+  // takes them in the opposite order.
+  if(!records.empty())
+  {
+    {
+      lock_guard<mutex> lock(mtx_);
+      queue_.insert(queue_.end(),records.begin(),records.end());
+      nQueued_ += records.size();
+      if(stopped_)
+        writeQueue();
+    }
+    queuedCv_.notify_one();
+  }
+  // stop() could have collected the buffers before the record was added.
+  if(stopped_)
+    flush();
+}
+
+void Logger::flush()
+{
+  {
+    unique_lock<mutex> lock(mtx_);
+    collectBuffers();
+    if(stopped_)
+    {
+      writeQueue();
+    } else if(!queue_.empty())
+    {
+      if(!writer_.joinable())
+        writer_ = std::thread(&Logger::runWriter,this);
+      queuedCv_.notify_one();
+      size_t target = nQueued_;
+      writtenCv_.wait(lock,[&]() { return nWritten_ >= target; });
+    }
+  }
+  lock_guard<mutex> sinkLock(sinkMtx_);
+  sink_->flush();
+}
+
+void Logger::stop()
+{
+  {
+    lock_guard<mutex> lock(mtx_);
+    stopped_ = true;
+  }
+  queuedCv_.notify_one();
+  if(writer_.joinable())
+    writer_.join();
+  // The writer wrote out everything it collected. Records which got buffered
+  // afterwards are written here.
+  flush();
+}
+
+Logger::ThreadBuffer *Logger::threadBuffer()
+{
+  static YASFM_THREAD_LOCAL ThreadBuffer *buffer = nullptr;
+  if(!buffer)
+  {
+    lock_guard<mutex> lock(mtx_);
+    buffers_.emplace_back(new ThreadBuffer);
+    buffer = buffers_.back().get();
+    // Started lazily because starting a thread during static initialization
+    // of a DLL deadlocks.
+    if(!stopped_ && !writer_.joinable())
+      writer_ = std::thread(&Logger::runWriter,this);
+  }
+  return buffer;
+}
+
+void Logger::collectBuffers()
+{
+  for(auto& buffer : buffers_)
+  {
+    lock_guard<mutex> bufferLock(buffer->mtx);
+    queue_.insert(queue_.end(),buffer->records.begin(),buffer->records.end());
+    nQueued_ += buffer->records.size();
+    buffer->records.clear();
+  }
+}
+
+void Logger::writeQueue()
+{
+  lock_guard<mutex> sinkLock(sinkMtx_);
+  for(const auto& record : queue_)
+    sink_->write(record);
+  nWritten_ += queue_.size();
+  queue_.clear();
+  writtenCv_.notify_all();
+}
+
+void Logger::runWriter()
+{
+  unique_lock<mutex> lock(mtx_);
+  while(true)
+  {
+    queuedCv_.wait_for(lock,duration<double>(maxBufferedTime),
+      [this]() { return !queue_.empty() || stopped_; });
+    collectBuffers();
+    if(queue_.empty())
+    {
+      if(stopped_)
+        break;
+      continue;
+    }
+    vector<LogRecord> records;
+    records.swap(queue_);
+    lock.unlock();
+    {
+      lock_guard<mutex> sinkLock(sinkMtx_);
+      for(const auto& record : records)
+        sink_->write(record);
+    }
+    lock.lock();
+    nWritten_ += records.size();
+    writtenCv_.notify_all();
+  }
+}
+
+} // namespace yasfm
@@ -0,0 +1,265 @@
+//----------------------------------------------------------------------------------------
+/**
+* \file       logging.h
+* \brief      Asynchronous logging with levels.
+*
+*  Records are buffered per thread and written by a background thread so that
+*  logging from hot loops does not wait for the console.
+*
+*/
+//----------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "defines.h"
+
+using std::ostream;
+using std::string;
+using std::unique_ptr;
+using std::vector;
+
+/// Log a message (anything which can be streamed) if the level is enabled.
+/**
+The message is not even formatted when the level is disabled.
+*/
+#define YASFM_LOG(level,message) YASFM_LOG_TAGGED(level,"",0.,message)
+
+/// Log a tagged message with a value if the level is enabled.
+/**
+Tagged records are the ones which can be aggregated by a sink, e.g. one record
+per matched pair with the number of matches as the value.
+*/
+#define YASFM_LOG_TAGGED(level,tag,value,message) \
+do \
+{ \
+  if(yasfm::logger().isEnabled(level)) \
+  { \
+    std::ostringstream yasfmLogStream; \
+    yasfmLogStream << message; \
+    yasfm::logger().log(level,tag,yasfmLogStream.str(),value); \
+  } \
+} while(0)
+
+////////////////////////////////////////////////////
+///////////////   Declarations   ///////////////////
+////////////////////////////////////////////////////
+
+namespace yasfm
+{
+
+/// Log levels. A level includes all the levels with a lower value.
+enum LogLevel
+{
+  LogLevelError = 0,
+  LogLevelWarning = 1,
+  /// Progress of the pipeline (once per stage or iteration).
+  LogLevelInfo = 2,
+  /// Per pair, per camera or per iteration of the inner loops.
+  LogLevelVerbose = 3
+};
+
+/// One log record.
+struct LogRecord
+{
+  LogLevel level;
+  string tag;     ///< Empty for records which should not be aggregated.
+  string message; ///< One line without the end of line.
+  double value;   ///< Value summed by aggregating sinks.
+};
+
+/// Destination of log records. Only called from one thread at a time.
+class LogSink
+{
+public:
+  /// Destructor.
+  YASFM_API virtual ~LogSink() {}
+
+  /// Write one record.
+  /// \param[in] record Record.
+  YASFM_API virtual void write(const LogRecord& record) = 0;
+
+  /// Write out everything which is pending.
+  YASFM_API virtual void flush() {}
+};
+
+/// Writes every record as one line.
+class StreamLogSink : public LogSink
+{
+public:
+  /// Constructor.
+  /// \param[in] out Stream which has to outlive the sink.
+  YASFM_API StreamLogSink(ostream& out);
+
+  /// Write one record.
+  YASFM_API virtual void write(const LogRecord& record) override;
+
+  /// Flush the stream.
+  YASFM_API virtual void flush() override;
+
+private:
+  ostream& out_;
+};
+
+/// Aggregates tagged records into periodic summaries.
+/**
+Tagged records are counted and their values summed per tag. The summaries are
+written when period elapses, before every untagged record and on flush.
+Untagged records are written as lines.
+*/
+class SummaryLogSink : public LogSink
+{
+public:
+  /// Constructor.
+  /**
+  \param[in] out Stream which has to outlive the sink.
+  \param[in] period Period of writing the summaries in seconds.
+  */
+  YASFM_API SummaryLogSink(ostream& out,double period);
+
+  /// Write one record.
+  YASFM_API virtual void write(const LogRecord& record) override;
+
+  /// Write the summaries and flush the stream.
+  YASFM_API virtual void flush() override;
+
+private:
+  /// Aggregated records of one tag.
+  struct TagSummary
+  {
+    int count;
+    double value;
+  };
+
+  /// Write out and reset the summaries.
+  void writeSummaries();
+
+  ostream& out_;
+  double period_;
+  std::chrono::steady_clock::time_point lastWrite_;
+  std::map<string,TagSummary> summaries_;
+};
+
+/// Asynchronous logger. Use logger() to get the instance.
+/**
+Records are appended to a buffer of the calling thread. A background writer
+thread collects the buffers periodically or once one of them is large. Records
+at level LogLevelInfo and more severe flush all the buffers and wait for the
+writer so that they stay ordered with direct writes to the console. The default sink is
+StreamLogSink(std::cout) and the default level is LogLevelVerbose.
+*/
+class Logger
+{
+public:
+  /// \return The instance.
+  YASFM_API static Logger& instance();
+
+  /// Destructor. Stops the writer.
+  YASFM_API ~Logger();
+
+  /// Set the most verbose level which is logged.
+  /// \param[in] level Level.
+  YASFM_API void setLevel(LogLevel level);
+
+  /// \return The most verbose level which is logged.
+  YASFM_API LogLevel level() const;
+
+  /// \return True if records of the level are logged.
+  bool isEnabled(LogLevel level) const
+  {
+    return int(level) <= level_.load(std::memory_order_relaxed);
+  }
+
+  /// Set the sink. Pending records are written to the old sink first.
+  /// \param[in] sink New sink.
+  YASFM_API void setSink(unique_ptr<LogSink> sink);
+
+  /// Log a record. Prefer the macros YASFM_LOG and YASFM_LOG_TAGGED.
+  /**
+  \param[in] level Level.
+  \param[in] tag Tag for aggregation. Empty if the record should not be aggregated.
+  \param[in] message One line without the end of line.
+  \param[in] value Value summed by aggregating sinks.
+  */
+  YASFM_API void log(LogLevel level,const string& tag,const string& message,
+    double value);
+
+  /// Write out the records of all threads and wait until they are written.
+  YASFM_API void flush();
+
+  /// Write out all the records and stop the writer thread.
+  /**
+  Records logged afterwards are written synchronously. Call this before
+  returning from main (see ScopedLoggerStop), joining a thread while a DLL
+  unloads can deadlock.
+  */
+  YASFM_API void stop();
+
+private:
+  /// Records of one thread.
+  struct ThreadBuffer
+  {
+    std::mutex mtx;
+    vector<LogRecord> records;
+  };
+
+  Logger();
+  Logger(const Logger&) = delete;
+  Logger& operator=(const Logger&) = delete;
+
+  /// \return Buffer of the calling thread (created on first use).
+  ThreadBuffer *threadBuffer();
+
+  /// Move records of all threads to the queue. Requires mtx_ locked.
+  void collectBuffers();
+
+  /// Write the queue in the calling thread. Requires mtx_ locked.
+  void writeQueue();
+
+  /// Main loop of the writer thread.
+  void runWriter();
+
+  static Logger instance_;
+
+  std::atomic<int> level_;
+
+  std::mutex mtx_; ///< Guards all the members below except sink_.
+  std::condition_variable queuedCv_;
+  std::condition_variable writtenCv_;
+  vector<LogRecord> queue_;
+  size_t nQueued_;  ///< Number of records ever queued.
+  size_t nWritten_; ///< Number of records ever written.
+  std::atomic<bool> stopped_; ///< Set under mtx_, log() reads it without it.
+  ptr_vector<ThreadBuffer> buffers_;
+  std::thread writer_;
+
+  std::mutex sinkMtx_; ///< Guards sink_.
+  unique_ptr<LogSink> sink_;
+};
+
+/// \return The logger instance.
+inline Logger& logger() { return Logger::instance(); }
+
+/// Stops the logger when it goes out of scope.
+/**
+Create one at the beginning of main so that the logger gets stopped on every exit
+path before its static instance is destroyed.
+*/
+class ScopedLoggerStop
+{
+public:
+  ~ScopedLoggerStop() { logger().stop(); }
+};
+
+} // namespace yasfm
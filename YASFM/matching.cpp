@@ -2,8 +2,14 @@
 
 #include "Eigen/Dense"
 
+#include <algorithm>
+#include <cassert>
 #include <ctime>
 #include <iostream>
+#include <unordered_set>
+
+#include "logging.h"
+#include "relative_pose.h"
 
 using std::cerr;
 using std::cout;
@@ -44,109 +50,534 @@ void matchFeatFLANN(const OptionsFLANN& opt,const ptr_vector<Camera>& cams,
 }
 
 void matchFeatFLANN(const OptionsFLANN& opt,const ptr_vector<Camera>& cams,
-	const vector<set<int>>& queries, pair_umap<CameraPair> *ppairs, 
+	const vector<set<int>>& queries, pair_umap<CameraPair> *pairs, 
   MatchingCallbackFunctionPtr callbackFunction, void * callbackObjectPtr)
+{
+  bool verbose = opt.get<bool>("verbose");
+  vector<IntPair> jobs;
+  size_t predictedLoads = 0;
+  size_t nDescrTotal = 0;
+  for(const auto& cam : cams)
+    nDescrTotal += cam->keys().size();
+  // No order saves loads when all the descriptors stay in memory.
+  if(opt.get<bool>("orderByLocality") && nDescrTotal > Camera::maxDescrInMemoryTotal_)
+  {
+    predictedLoads = orderMatchingJobs(cams,queries,Camera::maxDescrInMemoryTotal_,&jobs);
+  } else
+  {
+    int numQueries = static_cast<int>(queries.size());
+    for(int j = 0; j < numQueries; j++)
+    {
+      for(int i : queries[j])
+        jobs.emplace_back(i,j);
+    }
+    if(verbose)
+      predictedLoads = predictDescrLoads(cams,jobs,Camera::maxDescrInMemoryTotal_);
+  }
+
+  size_t loadsBefore = Camera::numDescrLoads();
+  matchFeatFLANN(opt,cams,jobs,pairs,callbackFunction,callbackObjectPtr);
+  if(verbose)
+  {
+    YASFM_LOG(LogLevelInfo,"descriptor loads: " << Camera::numDescrLoads() - loadsBefore
+      << " (predicted " << predictedLoads << ")");
+  }
+}
+
+void matchFeatFLANN(const OptionsFLANN& opt,const ptr_vector<Camera>& cams,
+  const vector<IntPair>& jobs,pair_umap<CameraPair> *ppairs,
+  MatchingCallbackFunctionPtr callbackFunction,void * callbackObjectPtr)
 {
   int pairsDone = 0;
   auto& pairs = *ppairs;
   bool verbose = opt.get<bool>("verbose");
-  size_t sz = 0;
-  for(const auto& entry : queries)
+  size_t sz = jobs.size();
+  pairs.reserve(pairs.size() + sz);
+
+  clock_t start,end;
+  int currTarget = -1;
+  const MatrixXf *targetDescr = nullptr;
+  unique_ptr<flann::Index<flann::L2<float>>> index;
+  const auto& searchParams = opt.get<flann::SearchParams>("searchParams");
+  size_t batchSize = static_cast<size_t>(std::max(1,opt.get<int>("batchSize")));
+  int nn = opt.filterByRatio() ? 2 : 1;
+  auto& workspace = threadWorkspace();
+  vector<size_t> batchStarts;
+  size_t jobIdx = 0;
+  while(jobIdx < jobs.size())
   {
-    sz += entry.size();
+    int j = jobs[jobIdx].second;
+    if(cams[j]->keys().empty())
+    {
+      jobIdx++;
+      continue; // no reason to build the trees
+    }
+
+    if(j != currTarget)
+    {
+      // The index refers to the descriptors, so they must not get released.
+      if(currTarget >= 0)
+        cams[currTarget]->unpinDescr();
+      cams[j]->pinDescr();
+      targetDescr = &cams[j]->descr();
+      // Switch to row major and transpose (=exchange nrows and ncols)
+      flann::Matrix<float> targetDescrFlann(const_cast<float*>(targetDescr->data()),
+        targetDescr->cols(),targetDescr->rows());
+
+      index.reset(new flann::Index<flann::L2<float>>(targetDescrFlann,
+        opt.get<flann::IndexParams>("indexParams")));
+      index->buildIndex();
+      currTarget = j;
+    }
+
+    // Queries of the following jobs with the same target are searched at once so
+    // that FLANN starts its threads once per batch instead of once per pair.
+    // The rows are counted from the descriptors to be copied, which stay pinned
+    // until the batch is searched.
+    int dim = static_cast<int>(targetDescr->rows());
+    size_t batchEnd = jobIdx;
+    size_t nRows = 0;
+    batchStarts.clear();
+    while(batchEnd < jobs.size() && jobs[batchEnd].second == j)
+    {
+      auto& query = *cams[jobs[batchEnd].first];
+      size_t nQueryFeats = static_cast<size_t>(query.descr().cols());
+      assert(nQueryFeats == query.keys().size());
+      if(nRows > 0 && nRows + nQueryFeats > batchSize)
+        break;
+      query.pinDescr();
+      batchStarts.push_back(nRows);
+      nRows += nQueryFeats;
+      batchEnd++;
+    }
+    batchStarts.push_back(nRows);
+
+    float *batchDescr;
+    if(batchEnd - jobIdx == 1)
+    {
+      // A single query is searched directly in its descriptors.
+      batchDescr = const_cast<float*>(cams[jobs[jobIdx].first]->descr().data());
+    } else
+    {
+      workspace.queryDescr.resize(nRows*dim);
+      for(size_t k = jobIdx; k < batchEnd; k++)
+      {
+        const auto& queryDescr = cams[jobs[k].first]->descr();
+        std::copy(queryDescr.data(),queryDescr.data() + queryDescr.size(),
+          workspace.queryDescr.begin() + batchStarts[k - jobIdx]*dim);
+      }
+      batchDescr = workspace.queryDescr.data();
+    }
+
+    if(verbose)
+      start = clock();
+    auto& nearestNeighbors = workspace.nearestNeighbors;
+    auto& dists = workspace.dists;
+    if(nearestNeighbors.size() < nRows*nn)
+    {
+      nearestNeighbors.resize(nRows*nn);
+      dists.resize(nRows*nn);
+    }
+    if(nRows > 0)
+    {
+      flann::Matrix<float> batchDescrFlann(batchDescr,nRows,dim);
+      flann::Matrix<size_t> nearestNeighborsFlann(nearestNeighbors.data(),nRows,nn);
+      flann::Matrix<float> distsFlann(dists.data(),nRows,nn);
+      index->knnSearch(batchDescrFlann,nearestNeighborsFlann,distsFlann,nn,searchParams);
+    }
+    if(verbose)
+      end = clock();
+
+    for(size_t k = jobIdx; k < batchEnd; k++)
+    {
+      int i = jobs[k].first;
+      IntPair pairIdx(i,j);
+      size_t firstRow = batchStarts[k - jobIdx];
+      int nQueries = static_cast<int>(batchStarts[k - jobIdx + 1] - firstRow);
+      filterNearestNeighbors(opt,nearestNeighbors.data() + firstRow*nn,
+        dists.data() + firstRow*nn,nQueries,index->size(),&pairs[pairIdx]);
+      cams[i]->unpinDescr();
+      pairsDone++;
+      int nMatches = static_cast<int>(pairs[pairIdx].matches.size());
+      if(callbackFunction != NULL&&callbackObjectPtr != NULL)
+      {
+        double progress = static_cast<double>(pairsDone) / sz;
+        callbackFunction(callbackObjectPtr,pairIdx,nMatches,progress);
+      }
+      if(verbose)
+      {
+        YASFM_LOG_TAGGED(LogLevelVerbose,"matched pairs",nMatches,
+          "matching: " << i << " -> " << j << "\t"
+          << "found " << nMatches << " matches" << "\t"
+          << "batch of " << batchEnd - jobIdx << " took: "
+          << (double)(end - start) / (double)CLOCKS_PER_SEC << "s");
+      }
+    }
+    jobIdx = batchEnd;
   }
-  pairs.reserve(sz);
+  if(currTarget >= 0)
+    cams[currTarget]->unpinDescr();
+  // The concatenated queries of a batch take up to batchSize descriptors.
+  releaseThreadWorkspace();
+  if(verbose)
+    logger().flush();
+}
 
-  clock_t start,end;
+size_t orderMatchingJobs(const ptr_vector<Camera>& cams,const vector<set<int>>& queries,
+  size_t maxDescrInMemory,vector<IntPair> *pjobs)
+{
+  auto& jobs = *pjobs;
+  int nCams = static_cast<int>(cams.size());
+  vector<size_t> nDescr(nCams);
+  for(int i = 0; i < nCams; i++)
+    nDescr[i] = cams[i]->keys().size();
+
+  // Descriptors needed by a target and targets which need a camera.
+  vector<size_t> targetDescr(nCams,0);
+  vector<vector<int>> neededBy(nCams);
+  vector<bool> isDone(nCams,true);
+  int nTargetsLeft = 0;
+  size_t nJobs = 0;
   int numQueries = static_cast<int>(queries.size());
   for(int j = 0; j < numQueries; j++)
   {
-    if(queries[j].empty() || cams[j]->keys().empty())
-      continue; // no reason to build the trees
+    if(queries[j].empty())
+      continue;
+    isDone[j] = false;
+    nTargetsLeft++;
+    nJobs += queries[j].size();
+    targetDescr[j] = nDescr[j];
+    neededBy[j].push_back(j);
+    for(int i : queries[j])
+    {
+      targetDescr[j] += nDescr[i];
+      neededBy[i].push_back(j);
+    }
+  }
+
+  vector<int> order;
+  computeReverseCuthillMcKeeOrder(nCams,queries,&order);
+  vector<int> rank(nCams);
+  for(int k = 0; k < nCams; k++)
+    rank[order[k]] = k;
+
+  jobs.clear();
+  jobs.reserve(nJobs);
+  DescrCacheSimulator cache(nDescr,maxDescrInMemory);
+  size_t orderPos = 0;
+  vector<size_t> residentDescr(nCams,0);
+  vector<int> candidates;
+  while(nTargetsLeft > 0)
+  {
+    candidates.clear();
+    for(int c : cache.resident())
+    {
+      for(int t : neededBy[c])
+      {
+        if(isDone[t])
+          continue;
+        if(residentDescr[t] == 0)
+          candidates.push_back(t);
+        residentDescr[t] += nDescr[c];
+      }
+    }
+
+    int best = -1;
+    double bestScore = 0.;
+    for(int t : candidates)
+    {
+      // Targets with no descriptors are free.
+      double score = (targetDescr[t] == 0) ? 1. :
+        double(residentDescr[t]) / double(targetDescr[t]);
+      if(best < 0 || score > bestScore || (score == bestScore && rank[t] < rank[best]))
+      {
+        best = t;
+        bestScore = score;
+      }
+      residentDescr[t] = 0;
+    }
+    if(best < 0)
+    {
+      while(isDone[order[orderPos]])
+        orderPos++;
+      best = order[orderPos];
+    }
+
+    // Resident queries first, the rest in the reverse Cuthill-McKee order.
+    cache.access(best);
+    cache.setPinned(best);
+    vector<int> targetQueries(queries[best].begin(),queries[best].end());
+    std::sort(targetQueries.begin(),targetQueries.end(),[&](int a,int b)
+    {
+      bool aResident = cache.isResident(a);
+      bool bResident = cache.isResident(b);
+      if(aResident != bResident)
+        return aResident;
+      return rank[a] < rank[b];
+    });
+    for(int i : targetQueries)
+    {
+      cache.access(i);
+      jobs.emplace_back(i,best);
+    }
+    isDone[best] = true;
+    nTargetsLeft--;
+  }
+  return cache.nLoads();
+}
+
+size_t predictDescrLoads(const ptr_vector<Camera>& cams,const vector<IntPair>& jobs,
+  size_t maxDescrInMemory)
+{
+  vector<size_t> nDescr(cams.size());
+  for(size_t i = 0; i < cams.size(); i++)
+    nDescr[i] = cams[i]->keys().size();
+
+  DescrCacheSimulator cache(nDescr,maxDescrInMemory);
+  int currTarget = -1;
+  for(const auto& job : jobs)
+  {
+    if(job.second != currTarget)
+    {
+      cache.access(job.second);
+      cache.setPinned(job.second);
+      currTarget = job.second;
+    }
+    cache.access(job.first);
+  }
+  return cache.nLoads();
+}
+
+int matchFeatFLANNOrdered(const OptionsFLANN& opt,
+  const OptionsRANSAC& verificationOpt,bool useCalibratedEG,int minNumMatches,
+  int nVerifiedPairsToStop,const ptr_vector<Camera>& cams,const MatrixXf& similarity,
+  const vector<set<int>>& queries,pair_umap<CameraPair> *ppairs)
+{
+  auto& pairs = *ppairs;
+  bool verbose = opt.get<bool>("verbose");
+  int nCams = static_cast<int>(cams.size());
+
+  // Candidates of every image. Pairs keep their orientation from queries.
+  vector<vector<IntPair>> candidates(nCams);
+  int nPairsTotal = 0;
+  for(int j = 0; j < static_cast<int>(queries.size()); j++)
+  {
+    for(int i : queries[j])
+    {
+      candidates[i].emplace_back(i,j);
+      candidates[j].emplace_back(i,j);
+      nPairsTotal++;
+    }
+  }
+
+  vector<int> nVerified(nCams,0);
+  std::unordered_set<IntPair,IntPairHash> processed;
+  clock_t start = clock();
+  for(int c = 0; c < nCams; c++)
+  {
+    auto& camCandidates = candidates[c];
+    if(camCandidates.empty() || cams[c]->keys().empty() || 
+      nVerified[c] >= nVerifiedPairsToStop)
+      continue;
+    // Later images often have all their candidates processed already, so do not
+    // build the index for nothing.
+    bool anyUnprocessed = std::any_of(camCandidates.begin(),camCandidates.end(),
+      [&](const IntPair& p) { return processed.count(p) == 0; });
+    if(!anyUnprocessed)
+      continue;
+
+    auto other = [c](const IntPair& p) { return (p.first == c) ? p.second : p.first; };
+    if(similarity.size() > 0)
+    {
+      std::stable_sort(camCandidates.begin(),camCandidates.end(),
+        [&](const IntPair& p1,const IntPair& p2)
+      {
+        return similarity(c,other(p1)) > similarity(c,other(p2));
+      });
+    }
 
-    // Make sure that we own these descriptors and they do not get deleted.
-    MatrixXf targetDescr = cams[j]->descr();
+    // The index refers to the descriptors, so they must not get released.
+    cams[c]->pinDescr();
+    const auto& targetDescr = cams[c]->descr();
     // Switch to row major and transpose (=exchange nrows and ncols)
     flann::Matrix<float> targetDescrFlann(
       const_cast<float*>(targetDescr.data()),targetDescr.cols(),targetDescr.rows());
-
     flann::Index<flann::L2<float>> index(targetDescrFlann,
       opt.get<flann::IndexParams>("indexParams"));
     index.buildIndex();
 
-    for(int i : queries[j])
+    for(const auto& pairIdx : camCandidates)
     {
-      const auto& queryDescr = cams[i]->descr();
+      if(nVerified[c] >= nVerifiedPairsToStop)
+        break;
+      if(!processed.insert(pairIdx).second)
+        continue;
+
+      int o = other(pairIdx);
+      const auto& queryDescr = cams[o]->descr();
       flann::Matrix<float> queryDescrFlann(
         const_cast<float*>(queryDescr.data()),queryDescr.cols(),queryDescr.rows());
+      pair_umap<CameraPair> currPair;
+      auto& pair = currPair[pairIdx];
+      matchFeatFLANN(opt,index,queryDescrFlann,&pair);
+      if(pairIdx.first == c)
+      {
+        // Matched o -> c but the pair is c -> o.
+        for(auto& match : pair.matches)
+          std::swap(match.first,match.second);
+      }
+      int nMatches = static_cast<int>(pair.matches.size());
+
+      removePoorlyMatchedPairs(minNumMatches,&currPair);
+      if(!currPair.empty())
+      {
+        verifyMatchesEpipolar(verificationOpt,false,useCalibratedEG,cams,&currPair);
+        removePoorlyMatchedPairs(minNumMatches,&currPair);
+      }
       if(verbose)
       {
-        cout << "matching: " << i << " -> " << j << "\t";
-        start = clock();
+        int nVerifiedMatches = currPair.empty() ? 0 :
+          static_cast<int>(currPair[pairIdx].matches.size());
+        YASFM_LOG_TAGGED(LogLevelVerbose,"verified matches",nVerifiedMatches,
+          "matching: " << pairIdx.first << " -> " << pairIdx.second << "\t"
+          << "found " << nMatches << " matches\t"
+          << "verified " << nVerifiedMatches << " matches");
       }
-      IntPair pairIdx(i,j);
-      matchFeatFLANN(opt,index,queryDescrFlann,&pairs[pairIdx]);
-      pairsDone++;
-      int nMatches = static_cast<int>(pairs[pairIdx].matches.size());
-      if(callbackFunction != NULL&&callbackObjectPtr != NULL)
-      {
-        double progress = static_cast<double>(pairsDone) / sz;
-        callbackFunction(callbackObjectPtr,pairIdx,nMatches,progress);
-      }
-      if(verbose)
-      {
-        end = clock();
-        cout << "found " << nMatches << " matches" << "\t";
-        cout << "took: " << (double)(end - start) / (double)CLOCKS_PER_SEC << "s\n";
+      if(!currPair.empty())
+      {
+        nVerified[pairIdx.first]++;
+        nVerified[pairIdx.second]++;
+        pairs[pairIdx] = std::move(currPair[pairIdx]);
       }
     }
+    cams[c]->unpinDescr();
   }
+  releaseThreadWorkspace();
+
+  int nSkipped = nPairsTotal - static_cast<int>(processed.size());
+  if(verbose)
+  {
+    YASFM_LOG(LogLevelInfo,"matched " << processed.size() << "/" << nPairsTotal
+      << " pairs, " << nSkipped << " pairs saved by early stopping\t"
+      << "took: " << (double)(clock() - start) / (double)CLOCKS_PER_SEC << "s");
+  }
+  return nSkipped;
 }
 
 void matchFeatFLANN(const OptionsFLANN& opt,const flann::Index<flann::L2<float>>& index,
   const flann::Matrix<float>& queryDescr,CameraPair *pair)
 {
-  int numQueries = static_cast<int>(queryDescr.rows);
-  AutoMemReleaseFlannMatrix<size_t> nearestNeighbors(numQueries,2);
-  AutoMemReleaseFlannMatrix<float> dists(numQueries,2);
+  size_t numQueries = queryDescr.rows;
+  int nn = opt.filterByRatio() ? 2 : 1;
+  auto& workspace = threadWorkspace();
+  if(workspace.nearestNeighbors.size() < numQueries*nn)
+  {
+    workspace.nearestNeighbors.resize(numQueries*nn);
+    workspace.dists.resize(numQueries*nn);
+  }
+  flann::Matrix<size_t> nearestNeighbors(workspace.nearestNeighbors.data(),numQueries,nn);
+  flann::Matrix<float> dists(workspace.dists.data(),numQueries,nn);
+  index.knnSearch(queryDescr,nearestNeighbors,dists,nn,
+    opt.get<flann::SearchParams>("searchParams"));
+  filterNearestNeighbors(opt,nearestNeighbors.ptr(),dists.ptr(),
+    static_cast<int>(numQueries),index.size(),pair);
+}
+
+void findUniqueMatches(const vector<IntPair>& matches,size_t numFeats2,
+  vector<bool> *puniqueMatches)
+{
+  auto& uniqueMatches = *puniqueMatches;
+  // -1 means that a feature from feats2 was not matched to any from feats1
+  vector<int> target2match(numFeats2,-1);
+
+  int numMatches = static_cast<int>(matches.size());
+  uniqueMatches.resize(numMatches,true);
+  for(int matchIdx = 0; matchIdx < numMatches; matchIdx++)
+  {
+    int prevMatch = target2match[matches[matchIdx].second];
+    if(prevMatch == -1)
+    {
+      target2match[matches[matchIdx].second] = matchIdx;
+    } else
+    {
+      uniqueMatches[matchIdx] = false;
+      uniqueMatches[prevMatch] = false;
+    }
+  }
+}
+
+} // namespace yasfm
+
+namespace
+{
+
+MatchingWorkspace*& threadWorkspacePtr()
+{
+  static YASFM_THREAD_LOCAL MatchingWorkspace *workspace = nullptr;
+  return workspace;
+}
+
+MatchingWorkspace& threadWorkspace()
+{
+  auto& workspace = threadWorkspacePtr();
+  if(!workspace)
+    workspace = new MatchingWorkspace;
+  return *workspace;
+}
+
+void releaseThreadWorkspace()
+{
+  auto& workspace = threadWorkspacePtr();
+  delete workspace;
+  workspace = nullptr;
+}
+
+void filterNearestNeighbors(const OptionsFLANN& opt,const size_t *nearestNeighbors,
+  const float *dists,int numQueries,size_t numTargetFeats,CameraPair *pair)
+{
   auto& outMatches = pair->matches;
   auto& outDists = pair->dists;
-  const auto& searchParams = opt.get<flann::SearchParams>("searchParams");
   outMatches.clear();
   outDists.clear();
-  outMatches.reserve(numQueries);
-  outDists.reserve(numQueries);
 
   if(opt.filterByRatio())
   {
     float thresh = opt.get<float>("ratioThresh");
     float sqThresh = thresh*thresh; // flann returns squared distances
-    index.knnSearch(queryDescr,nearestNeighbors.data,dists.data,2,searchParams);
+    int nPassed = 0;
+    for(int i = 0; i < numQueries; i++)
+    {
+      if(dists[2*i] < sqThresh * dists[2*i + 1])
+        nPassed++;
+    }
+    outMatches.reserve(nPassed);
+    outDists.reserve(nPassed);
     for(int i = 0; i < numQueries; i++)
     {
       // Ratio of the distance to the nearest neighbor over the distance 
       // to the second nearest neighbor
-      float ratio = (dists.data[i][0] / dists.data[i][1]);
+      float ratio = (dists[2*i] / dists[2*i + 1]);
       if(ratio < sqThresh)
       {
-        outMatches.emplace_back(i,static_cast<int>(nearestNeighbors.data[i][0]));
+        outMatches.emplace_back(i,static_cast<int>(nearestNeighbors[2*i]));
         outDists.push_back(sqrt(ratio)); // Do not use actual distance of descriptors
       }
     }
   } else
   {
-    index.knnSearch(queryDescr,nearestNeighbors.data,dists.data,1,searchParams);
+    outMatches.reserve(numQueries);
+    outDists.reserve(numQueries);
     for(int i = 0; i < numQueries; i++)
     {
-      outMatches.emplace_back(i,static_cast<int>(nearestNeighbors.data[i][0]));
-      outDists.push_back(dists.data[i][0]);
+      outMatches.emplace_back(i,static_cast<int>(nearestNeighbors[i]));
+      outDists.push_back(dists[i]);
     }
   }
 
   vector<bool> unique; // empty means that the unique option is turned off
   if(opt.get<bool>("onlyUniques"))
   {
-    findUniqueMatches(outMatches,index.size(),&unique);
+    findUniqueMatches(outMatches,numTargetFeats,&unique);
   }
 
   if(!unique.empty())
@@ -154,29 +585,96 @@ void matchFeatFLANN(const OptionsFLANN& opt,const flann::Index<flann::L2<float>>
     filterVector(unique,&outMatches);
     filterVector(unique,&outDists);
   }
+  sortMatchesByDists(pair);
 }
 
-void findUniqueMatches(const vector<IntPair>& matches,size_t numFeats2,
-  vector<bool> *puniqueMatches)
+DescrCacheSimulator::DescrCacheSimulator(const vector<size_t>& nDescr,
+  size_t maxDescrInMemory)
+  : nDescr_(nDescr),maxDescrInMemory_(maxDescrInMemory),nDescrInMemory_(0),nLoads_(0),
+  pinned_(-1),isResident_(nDescr.size(),false)
 {
-  auto& uniqueMatches = *puniqueMatches;
-  // -1 means that a feature from feats2 was not matched to any from feats1
-  vector<int> target2match(numFeats2,-1);
+}
 
-  int numMatches = static_cast<int>(matches.size());
-  uniqueMatches.resize(numMatches,true);
-  for(int matchIdx = 0; matchIdx < numMatches; matchIdx++)
-  {
-    int prevMatch = target2match[matches[matchIdx].second];
-    if(prevMatch == -1)
+bool DescrCacheSimulator::access(int camIdx)
+{
+  if(isResident_[camIdx])
+    return false;
+
+  auto it = resident_.begin();
+  while(nDescrInMemory_ > maxDescrInMemory_ && it != resident_.end())
+  {
+    if(*it == pinned_)
     {
-      target2match[matches[matchIdx].second] = matchIdx;
-    } else
+      ++it;
+      continue;
+    }
+    nDescrInMemory_ -= nDescr_[*it];
+    isResident_[*it] = false;
+    it = resident_.erase(it);
+  }
+  resident_.push_back(camIdx);
+  isResident_[camIdx] = true;
+  nDescrInMemory_ += nDescr_[camIdx];
+  nLoads_++;
+  return true;
+}
+
+void DescrCacheSimulator::setPinned(int camIdx) { pinned_ = camIdx; }
+bool DescrCacheSimulator::isResident(int camIdx) const { return isResident_[camIdx]; }
+const list<int>& DescrCacheSimulator::resident() const { return resident_; }
+size_t DescrCacheSimulator::nLoads() const { return nLoads_; }
+
+void computeReverseCuthillMcKeeOrder(int nVertices,const vector<set<int>>& queries,
+  vector<int> *porder)
+{
+  auto& order = *porder;
+  vector<vector<int>> neighbors(nVertices);
+  for(int j = 0; j < static_cast<int>(queries.size()); j++)
+  {
+    for(int i : queries[j])
     {
-      uniqueMatches[matchIdx] = false;
-      uniqueMatches[prevMatch] = false;
-    }
+      neighbors[i].push_back(j);
+      neighbors[j].push_back(i);
+    }
+  }
+  auto byDegree = [&](int a,int b)
+  {
+    if(neighbors[a].size() != neighbors[b].size())
+      return neighbors[a].size() < neighbors[b].size();
+    return a < b;
+  };
+  for(auto& vertexNeighbors : neighbors)
+    std::sort(vertexNeighbors.begin(),vertexNeighbors.end(),byDegree);
+
+  vector<int> vertices(nVertices);
+  for(int v = 0; v < nVertices; v++)
+    vertices[v] = v;
+  std::sort(vertices.begin(),vertices.end(),byDegree);
+
+  order.clear();
+  order.reserve(nVertices);
+  vector<bool> visited(nVertices,false);
+  for(int start : vertices)
+  {
+    if(visited[start])
+      continue;
+    visited[start] = true;
+    size_t head = order.size();
+    order.push_back(start);
+    while(head < order.size())
+    {
+      int v = order[head++];
+      for(int u : neighbors[v])
+      {
+        if(!visited[u])
+        {
+          visited[u] = true;
+          order.push_back(u);
+        }
+      }
+    }
   }
+  std::reverse(order.begin(),order.end());
 }
 
-} // namespace yasfm
\ No newline at end of file
+} // namespace
@@ -24,6 +24,7 @@
 
 #pragma once
 
+#include <list>
 #include <set>
 #include <vector>
 
@@ -36,10 +37,15 @@
 #include "FLANN\flann.hpp"
 #pragma warning(pop)
 
+#include "Eigen/Dense"
+
 #include "defines.h"
 #include "sfm_data.h"
 #include "options_types.h"
+#include "ransac.h"
 
+using Eigen::MatrixXf;
+using std::list;
 using std::set;
 using std::vector;
 using namespace yasfm;
@@ -81,6 +87,17 @@ float ratioThresh;
 /// different features in feats1 matched to the same feature in feats2
 bool onlyUniques;
 
+/// Reorder the pairs so that descriptors are read from files as few times
+/// as possible (see orderMatchingJobs). Skipped when the descriptors of all
+/// images fit into Camera::maxDescrInMemoryTotal_. Off by default because
+/// the ordering costs up to cubic time in the number of images.
+bool orderByLocality;
+
+/// Maximum number of query descriptors searched at once. Queries of consecutive
+/// pairs with the same target image are searched in one batch. Images larger
+/// than this are searched alone.
+int batchSize;
+
 /// Verbosity.
 bool verbose;
 */
@@ -97,6 +114,8 @@ public:
     get<flann::SearchParams>("searchParams").cores = 8;
     opt.emplace("ratioThresh",make_unique<OptTypeWithVal<float>>(0.6f));
     opt.emplace("onlyUniques",make_unique<OptTypeWithVal<bool>>(true));
+    opt.emplace("orderByLocality",make_unique<OptTypeWithVal<bool>>(false));
+    opt.emplace("batchSize",make_unique<OptTypeWithVal<int>>(100000));
     opt.emplace("verbose",make_unique<OptTypeWithVal<bool>>(true));
   }
 
@@ -141,6 +160,82 @@ YASFM_API void matchFeatFLANN(const OptionsFLANN& opt,const ptr_vector<Camera>&
 	const vector<set<int>>& queries, pair_umap<CameraPair> *pairs, 
 	MatchingCallbackFunctionPtr callbackFunction = NULL, void * callbackObjectPtr = NULL);
 
+/// Match features of pairs in the given order.
+/**
+Finds matches from img jobs[k].first to img jobs[k].second. The index of the target
+image is built whenever the target changes, so jobs with the same target
+should be consecutive. Queries of consecutive jobs with the same target are
+concatenated and searched at once (see batchSize in OptionsFLANN).
+
+\param[in] opt Options.
+\param[in] cams Cameras. Have to have descriptors.
+\param[in] jobs Pairs (query,target) in the order of matching.
+\param[out] pairs Resulting matched camera pairs.
+\param[out] callbackFunction Optional. Function to be called after finishing 
+matching of one pair.
+\param[out] callbackObjectPtr Optional. Object to be passed to callbackFunction.
+*/
+YASFM_API void matchFeatFLANN(const OptionsFLANN& opt,const ptr_vector<Camera>& cams,
+  const vector<IntPair>& jobs,pair_umap<CameraPair> *pairs,
+  MatchingCallbackFunctionPtr callbackFunction = NULL,void * callbackObjectPtr = NULL);
+
+/// Order matching jobs so that descriptors are read from files as few times as possible.
+/**
+The descriptors cache of cameras (see Camera::descr()) is simulated. The next
+target is chosen greedily as the one with the largest fraction of its descriptors
+and the descriptors of its queries already in memory. When no remaining target
+shares an image with the cache, the first remaining one in reverse Cuthill-McKee
+order of the query graph is taken, so that images matched together stay close
+in the order. Queries in memory are matched first for every target.
+
+\param[in] cams Cameras. Have to have keys.
+\param[in] queries Candidate pairs as in the matchFeatFLANN.
+\param[in] maxDescrInMemory Capacity of the cache (Camera::maxDescrInMemoryTotal_).
+\param[out] jobs Pairs (query,target) grouped by targets.
+\return Predicted number of descriptor loads (see predictDescrLoads).
+*/
+YASFM_API size_t orderMatchingJobs(const ptr_vector<Camera>& cams,
+  const vector<set<int>>& queries,size_t maxDescrInMemory,vector<IntPair> *jobs);
+
+/// Predict how many times matchFeatFLANN reads descriptors for an order of jobs.
+/**
+Assumes that no descriptors are in memory at the beginning.
+
+\param[in] cams Cameras. Have to have keys.
+\param[in] jobs Pairs (query,target) in the order of matching.
+\param[in] maxDescrInMemory Capacity of the cache (Camera::maxDescrInMemoryTotal_).
+\return Number of descriptor loads.
+*/
+YASFM_API size_t predictDescrLoads(const ptr_vector<Camera>& cams,
+  const vector<IntPair>& jobs,size_t maxDescrInMemory);
+
+/// Match and verify features in the order of image similarity with early stopping.
+/**
+Every image processes its candidate pairs (all pairs from queries containing it) 
+in descending similarity. Every pair is matched and immediately verified 
+using epipolar geometry (see verifyMatchesEpipolar). Once an image has 
+nVerifiedPairsToStop verified pairs, its remaining candidates are skipped 
+(they still get matched if the other image needs more verified pairs).
+
+\param[in] opt Matching options.
+\param[in] verificationOpt Options for estimating the epipolar geometry.
+\param[in] useCalibratedEG Uses 5pt instead of 7pt. All cameras have to be calibrated.
+\param[in] minNumMatches Minimum number of matches of a pair before and after 
+the verification.
+\param[in] nVerifiedPairsToStop Number of verified pairs of an image after which
+the image stops matching.
+\param[in] cams Cameras. Have to have descriptors.
+\param[in] similarity Symmetric matrix of image level similarity. If empty,
+the candidates are processed in the order of queries.
+\param[in] queries Candidate pairs as in the matchFeatFLANN.
+\param[out] pairs Resulting verified camera pairs.
+\return Number of skipped (saved) pairs.
+*/
+YASFM_API int matchFeatFLANNOrdered(const OptionsFLANN& opt,
+  const OptionsRANSAC& verificationOpt,bool useCalibratedEG,int minNumMatches,
+  int nVerifiedPairsToStop,const ptr_vector<Camera>& cams,const MatrixXf& similarity,
+  const vector<set<int>>& queries,pair_umap<CameraPair> *pairs);
+
 /// Match features.
 /**
 Finds matches based on already built and ready flann::Index. Optionally filters 
@@ -171,29 +266,97 @@ YASFM_API void findUniqueMatches(const vector<IntPair>& matches,size_t numFeats2
 namespace
 {
 
-/// Takes care of memory management of flann::Matrix<T>.
-template<typename T>
-class AutoMemReleaseFlannMatrix
+/// Buffers for nearest neighbor search reused by all matching of one thread.
+/**
+The buffers only grow, so they end up sized to the largest batch. The functions
+matching many pairs release them when they finish.
+*/
+struct MatchingWorkspace
+{
+  vector<float> queryDescr;         ///< Concatenated query descriptors of a batch.
+  vector<size_t> nearestNeighbors;  ///< Row major indices of nearest neighbors.
+  vector<float> dists;              ///< Row major squared distances.
+};
+
+/// \return Workspace pointer of the calling thread. Null when not allocated.
+MatchingWorkspace*& threadWorkspacePtr();
+
+/// \return Workspace of the calling thread. Allocated on the first use.
+MatchingWorkspace& threadWorkspace();
+
+/// Free the workspace of the calling thread. The next use allocates a new one.
+void releaseThreadWorkspace();
+
+/// Simulation of the descriptors cache of cameras.
+/**
+Before loading, descriptors are released in the order in which they were loaded
+while there is more of them than the capacity, the same as Camera does. The target
+which is being matched is pinned.
+*/
+class DescrCacheSimulator
 {
 public:
+  /// Constructor.
+  /**
+  \param[in] nDescr Number of descriptors of every camera.
+  \param[in] maxDescrInMemory Capacity.
+  */
+  DescrCacheSimulator(const vector<size_t>& nDescr,size_t maxDescrInMemory);
 
-  /// Constructor. Allocates data.
-  AutoMemReleaseFlannMatrix(int nRows,int nCols)
-    : data(new T[nRows*nCols],nRows,nCols)
-  {
-  }
+  /// Access descriptors of a camera.
+  /// \param[in] camIdx Camera index.
+  /// \return True if the descriptors had to be loaded.
+  bool access(int camIdx);
 
-  /// Destructor. Deallocates data.
-  ~AutoMemReleaseFlannMatrix() { delete[] data.ptr(); }
+  /// Pin descriptors of a camera (unpins the previous one).
+  /// \param[in] camIdx Camera index.
+  void setPinned(int camIdx);
 
-  flann::Matrix<T> data;
+  /// \return True if descriptors of the camera are in memory.
+  bool isResident(int camIdx) const;
 
-private:
-  /// Forbidden.
-  AutoMemReleaseFlannMatrix(const AutoMemReleaseFlannMatrix& o) {}
+  /// \return Cameras with descriptors in memory in the order of loading.
+  const list<int>& resident() const;
 
-  /// Forbidden.
-  AutoMemReleaseFlannMatrix& operator=(const AutoMemReleaseFlannMatrix& o) {}
+  /// \return Number of loads so far.
+  size_t nLoads() const;
+
+private:
+  const vector<size_t>& nDescr_;
+  size_t maxDescrInMemory_;
+  size_t nDescrInMemory_;
+  size_t nLoads_;
+  int pinned_;
+  list<int> resident_;
+  vector<bool> isResident_;
 };
 
+/// Filter nearest neighbors of query features into matches.
+/**
+Uses ratio and/or uniqueness as matchFeatFLANN does.
+
+\param[in] opt Options.
+\param[in] nearestNeighbors Row major numQueries x k indices of target features,
+where k is 2 when filtering by ratio and 1 otherwise.
+\param[in] dists Row major numQueries x k squared distances.
+\param[in] numQueries Number of query features.
+\param[in] numTargetFeats Number of target features.
+\param[out] pair Resulting matched camera pair.
+*/
+void filterNearestNeighbors(const OptionsFLANN& opt,const size_t *nearestNeighbors,
+  const float *dists,int numQueries,size_t numTargetFeats,CameraPair *pair);
+
+/// Compute reverse Cuthill-McKee order of the graph of the queries.
+/**
+Breadth first search started from a vertex of the minimal degree in every
+component, neighbors visited in the order of increasing degree. The order is
+then reversed. Consecutive vertices in the order tend to be adjacent.
+
+\param[in] nVertices Number of vertices.
+\param[in] queries Edges i-j for every i from queries[j].
+\param[out] order All the vertices.
+*/
+void computeReverseCuthillMcKeeOrder(int nVertices,const vector<set<int>>& queries,
+  vector<int> *order);
+
 } // namespace
\ No newline at end of file
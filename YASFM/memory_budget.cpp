@@ -0,0 +1,122 @@
+#include "memory_budget.h"
+
+#include <algorithm>
+
+#include "logging.h"
+
+using std::lock_guard;
+using std::mutex;
+
+namespace yasfm
+{
+
+MemoryBudget MemoryBudget::instance_;
+
+MemoryBudget& MemoryBudget::instance()
+{
+  return instance_;
+}
+
+MemoryBudget::MemoryBudget()
+  : limit_(0),nBytesReleased_(0)
+{
+}
+
+void MemoryBudget::setLimit(size_t nBytes)
+{
+  lock_guard<mutex> lock(mtx_);
+  limit_ = nBytes;
+  ownerThread_ = std::this_thread::get_id();
+}
+
+size_t MemoryBudget::limit() const
+{
+  lock_guard<mutex> lock(mtx_);
+  return limit_;
+}
+
+void MemoryBudget::registerConsumer(MemoryConsumer *consumer,MemoryPriority priority)
+{
+  lock_guard<mutex> lock(mtx_);
+  for(const auto& entry : consumers_)
+  {
+    if(entry.consumer == consumer)
+      return;
+  }
+  auto it = std::upper_bound(consumers_.begin(),consumers_.end(),priority,
+    [](MemoryPriority p,const ConsumerEntry& entry) { return p < entry.priority; });
+  consumers_.insert(it,{consumer,priority});
+}
+
+void MemoryBudget::unregisterConsumer(MemoryConsumer *consumer)
+{
+  lock_guard<mutex> lock(mtx_);
+  consumers_.erase(std::remove_if(consumers_.begin(),consumers_.end(),
+    [consumer](const ConsumerEntry& entry) { return entry.consumer == consumer; }),
+    consumers_.end());
+}
+
+size_t MemoryBudget::usage() const
+{
+  lock_guard<mutex> lock(mtx_);
+  return usageLocked();
+}
+
+bool MemoryBudget::makeRoom(size_t nBytes)
+{
+  lock_guard<mutex> lock(mtx_);
+  if(limit_ == 0)
+    return true;
+
+  // An allocation larger than the limit gets everything which can be released.
+  size_t currUsage = usageLocked();
+  if(std::this_thread::get_id() != ownerThread_)
+    return currUsage + nBytes <= limit_;
+  for(const auto& entry : consumers_)
+  {
+    if(currUsage + nBytes <= limit_)
+      break;
+    size_t nReleased = entry.consumer->releaseMemory(currUsage + nBytes - limit_);
+    nBytesReleased_ += nReleased;
+    currUsage -= std::min(currUsage,nReleased);
+    YASFM_LOG(LogLevelVerbose,"Memory budget: " << entry.consumer->memoryConsumerName()
+      << " released " << nReleased << " bytes");
+  }
+  return currUsage + nBytes <= limit_;
+}
+
+size_t MemoryBudget::nBytesReleased() const
+{
+  lock_guard<mutex> lock(mtx_);
+  return nBytesReleased_;
+}
+
+void MemoryBudget::logUsage() const
+{
+  vector<std::pair<string,size_t>> usages;
+  size_t currLimit;
+  {
+    lock_guard<mutex> lock(mtx_);
+    for(const auto& entry : consumers_)
+    {
+      usages.emplace_back(entry.consumer->memoryConsumerName(),
+        entry.consumer->memoryUsage());
+    }
+    currLimit = limit_;
+  }
+  YASFM_LOG(LogLevelInfo,"Memory budget: limit " << currLimit << " bytes");
+  for(const auto& usage : usages)
+  {
+    YASFM_LOG(LogLevelInfo,"  " << usage.first << ": " << usage.second << " bytes");
+  }
+}
+
+size_t MemoryBudget::usageLocked() const
+{
+  size_t total = 0;
+  for(const auto& entry : consumers_)
+    total += entry.consumer->memoryUsage();
+  return total;
+}
+
+} // namespace yasfm
@@ -0,0 +1,149 @@
+//----------------------------------------------------------------------------------------
+/**
+* \file       memory_budget.h
+* \brief      Process-wide memory budget shared by all the stages.
+*
+*  Components holding large data which they can give up (descriptors which can
+*  be read again, pairs which can be written to a file) register as consumers.
+*  Components about to allocate a lot ask the budget to make room and the
+*  consumers are asked to shrink.
+*
+*/
+//----------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "defines.h"
+
+using std::string;
+using std::vector;
+
+////////////////////////////////////////////////////
+///////////////   Declarations   ///////////////////
+////////////////////////////////////////////////////
+
+namespace yasfm
+{
+
+/// Order in which the consumers are asked to shrink. Lower first.
+enum MemoryPriority
+{
+  /// Data which can be read again from its files, e.g. descriptors.
+  MemoryPriorityReloadable = 0,
+  /// Data which has to be written out before releasing, e.g. pairs.
+  MemoryPrioritySpillable = 1
+};
+
+/// Component holding memory which it can release on request.
+class MemoryConsumer
+{
+public:
+  /// Destructor.
+  YASFM_API virtual ~MemoryConsumer() {}
+
+  /// \return Name used in reports.
+  YASFM_API virtual string memoryConsumerName() const = 0;
+
+  /// \return Number of bytes held (an estimate is fine). Has to be cheap.
+  YASFM_API virtual size_t memoryUsage() const = 0;
+
+  /// Release memory. Must not call MemoryBudget::makeRoom().
+  /**
+  \param[in] nBytes Number of bytes which should be released.
+  \return Number of bytes released.
+  */
+  YASFM_API virtual size_t releaseMemory(size_t nBytes) = 0;
+};
+
+/// Process-wide memory budget. Use memoryBudget() to get the instance.
+/**
+The budget is unlimited by default. It is enforced only when makeRoom() is called,
+i.e. before large allocations, so every stage keeps running when over the limit,
+only slower because of the released data. Consumers are asked to shrink in the
+order of priorities and then of registration. Consumers register only while their
+data is not needed by the running stage, e.g. the pairs are spillable only
+between the stages working with them, so that a stage never loses its working set.
+
+Only the thread which set the limit (the one owning the data) makes the consumers
+shrink. Other threads, e.g. a background bundle adjustment, could otherwise
+release data which the owner holds references to. makeRoom() called from them
+only reports whether the allocation fits.
+*/
+class MemoryBudget
+{
+public:
+  /// \return The instance.
+  YASFM_API static MemoryBudget& instance();
+
+  /// Set the limit. The calling thread becomes the owner thread.
+  /// \param[in] nBytes Limit in bytes. 0 means unlimited.
+  YASFM_API void setLimit(size_t nBytes);
+
+  /// \return The limit in bytes. 0 means unlimited.
+  YASFM_API size_t limit() const;
+
+  /// Register a consumer. It has to unregister before it is destroyed.
+  /**
+  \param[in] consumer Consumer.
+  \param[in] priority Priority.
+  */
+  YASFM_API void registerConsumer(MemoryConsumer *consumer,MemoryPriority priority);
+
+  /// Unregister a consumer. Does nothing if it is not registered.
+  /// \param[in] consumer Consumer.
+  YASFM_API void unregisterConsumer(MemoryConsumer *consumer);
+
+  /// \return Number of bytes held by all the consumers.
+  YASFM_API size_t usage() const;
+
+  /// Ask the consumers to shrink so that an allocation fits in the limit.
+  /**
+  If the allocation is larger than the limit itself, the consumers release all
+  they can and false is returned. Nothing is released if not called from the
+  owner thread.
+
+  \param[in] nBytes Size of the allocation which is about to be made.
+  \return False if the consumers could not release enough memory. The caller
+  is expected to allocate anyway.
+  */
+  YASFM_API bool makeRoom(size_t nBytes);
+
+  /// \return Number of bytes released by all the consumers so far.
+  YASFM_API size_t nBytesReleased() const;
+
+  /// Log the usage of every consumer (LogLevelInfo).
+  YASFM_API void logUsage() const;
+
+private:
+  /// A registered consumer.
+  struct ConsumerEntry
+  {
+    MemoryConsumer *consumer;
+    MemoryPriority priority;
+  };
+
+  MemoryBudget();
+  MemoryBudget(const MemoryBudget&) = delete;
+  MemoryBudget& operator=(const MemoryBudget&) = delete;
+
+  /// \return Number of bytes held by all the consumers. Requires mtx_ locked.
+  size_t usageLocked() const;
+
+  static MemoryBudget instance_;
+
+  mutable std::mutex mtx_; ///< Guards all the members.
+  size_t limit_;
+  std::thread::id ownerThread_; ///< Thread which set the limit.
+  size_t nBytesReleased_;
+  vector<ConsumerEntry> consumers_; ///< Ordered by priorities.
+};
+
+/// \return The memory budget instance.
+inline MemoryBudget& memoryBudget() { return MemoryBudget::instance(); }
+
+} // namespace yasfm
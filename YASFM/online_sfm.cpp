@@ -0,0 +1,673 @@
+#include "online_sfm.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+
+#include "absolute_pose.h"
+#include "image_similarity.h"
+#include "points.h"
+#include "relative_pose.h"
+#include "standard_camera.h"
+#include "utils.h"
+#include "utils_io.h"
+
+using Eigen::ArrayXf;
+using Eigen::VectorXf;
+using std::cerr;
+using std::cout;
+using std::set;
+using std::chrono::duration;
+using std::chrono::steady_clock;
+
+namespace yasfm
+{
+
+OnlineSFM::OnlineSFM(const OptionsOnlineSFM& opt,Dataset *data)
+  : opt_(opt),data_(*data),nIndexedCams_(0),initialPair_(-1,-1),
+  nRegisteredSinceGlobalBA_(0)
+{
+}
+
+OnlineSFM::~OnlineSFM()
+{
+  if(globalBA_.valid())
+    globalBA_.wait();
+}
+
+bool OnlineSFM::processCamera(int camIdx)
+{
+  auto start = steady_clock::now();
+  bool verbose = opt_.get<bool>("verbose");
+  auto& cams = data_.cams();
+
+  // Pick up the result of the background adjustment if it is ready.
+  mergeGlobalBA(false);
+
+  int nCams = data_.numCams();
+  isCalibrated_.resize(nCams,false);
+  neighbors_.resize(nCams);
+  data_.queries().resize(nCams);
+
+  auto& cam = *cams[camIdx];
+  if(cam.keys().empty())
+  {
+    vector<int> camsToUse(1,camIdx);
+    detectSiftGPU(opt_.getOpt<OptionsSIFTGPU>("sift"),camsToUse,&cams);
+  }
+  cam.readKeysColors();
+  initCalibration(camIdx);
+
+  vector<int> candidates;
+  findCandidates(camIdx,&candidates);
+  if(words_.cols() > 0)
+    indexCamera(camIdx);
+
+  matchAndVerify(camIdx,candidates);
+
+  bool registered = false;
+  if(data_.reconstructedCams().empty())
+  {
+    pendingCams_.insert(camIdx);
+    registered = tryInitialize();
+  } else
+  {
+    registered = registerCamera(camIdx);
+    if(registered)
+    {
+      int nRetriesLeft = opt_.get<int>("maxPendingRetries");
+      retryPending(camIdx,&nRetriesLeft);
+    } else
+    {
+      pendingCams_.insert(camIdx);
+    }
+  }
+
+  double seconds = duration<double>(steady_clock::now() - start).count();
+  latencies_.push_back(seconds);
+  if(verbose)
+  {
+    cout << "camera " << camIdx << ": " << candidates.size() << " candidates, "
+      << (registered ? "registered" : "pending") << ", "
+      << data_.reconstructedCams().size() << " cams in the model, took "
+      << seconds << "s\n";
+  }
+  return data_.reconstructedCams().count(camIdx) > 0;
+}
+
+void OnlineSFM::finish(bool runGlobalBA)
+{
+  mergeGlobalBA(true);
+  if(runGlobalBA && !data_.reconstructedCams().empty())
+  {
+    bundleAdjust(opt_.getOpt<OptionsBundleAdjustment>("globalBundleAdjust"),
+      &data_.cams(),&data_.pts());
+    removeHighReprojErrorPoints(opt_.get<double>("pointsReprojErrorThresh"),
+      &data_.cams(),&data_.pts());
+  }
+}
+
+const vector<double>& OnlineSFM::latencies() const
+{
+  return latencies_;
+}
+
+double OnlineSFM::latencyPercentile(double p) const
+{
+  if(latencies_.empty())
+    return 0.;
+  vector<double> sorted(latencies_);
+  std::sort(sorted.begin(),sorted.end());
+  int n = static_cast<int>(sorted.size());
+  int rank = static_cast<int>(ceil(0.01 * p * n));
+  rank = std::min(n,std::max(1,rank));
+  return sorted[rank - 1];
+}
+
+void OnlineSFM::printLatencyReport(ostream& out) const
+{
+  double maxLatency = latencies_.empty() ? 0. :
+    *std::max_element(latencies_.begin(),latencies_.end());
+  out << "Per-image latency over " << latencies_.size() << " images:\n"
+    << "  p50: " << latencyPercentile(50.) << "s\n"
+    << "  p99: " << latencyPercentile(99.) << "s\n"
+    << "  max: " << maxLatency << "s\n";
+}
+
+void OnlineSFM::initCalibration(int camIdx)
+{
+  StandardCamera *cam = static_cast<StandardCamera *>(&data_.cam(camIdx));
+  if(cam->f() > 0.)
+  {
+    isCalibrated_[camIdx] = true;
+    return;
+  }
+
+  const auto& ccdDBFilename = opt_.get<string>("ccdDBFilename");
+  double focal = 0.;
+  if(!ccdDBFilename.empty())
+    focal = findFocalLengthInEXIF(ccdDBFilename,*cam,false);
+
+  if(focal > 0.)
+  {
+    cam->setFocal(focal);
+    cam->constrainFocal(focal,opt_.get<double>("focalConstraintWeight"));
+    isCalibrated_[camIdx] = true;
+  } else
+  {
+    double maxDim = std::max(cam->imgWidth(),cam->imgHeight());
+    cam->setFocal(opt_.get<double>("defaultFocalDividedBySensorSize") * maxDim);
+  }
+}
+
+void OnlineSFM::findCandidates(int camIdx,vector<int> *pcandidates)
+{
+  auto& candidates = *pcandidates;
+  int nCandidates = opt_.get<int>("nCandidates");
+
+  if(words_.cols() == 0 && camIdx + 1 >= opt_.get<int>("nVocabularyBootstrapCams"))
+    buildVocabulary(camIdx);
+
+  if(words_.cols() == 0)
+  {
+    // Not enough images for a vocabulary. Prefer the most recent ones.
+    for(int i = camIdx - 1; i >= std::max(0,camIdx - nCandidates); i--)
+      candidates.push_back(i);
+    return;
+  }
+
+  vector<pair<int,float>> histogram;
+  computeWordHistogram(camIdx,&histogram);
+
+  vector<float> scores(camIdx,0.f);
+  for(const auto& entry : histogram)
+  {
+    int word = entry.first;
+    if(docFreq_[word] == 0)
+      continue;
+    float idf = log(float(nIndexedCams_) / docFreq_[word]);
+    float queryWeight = entry.second * idf * idf;
+    for(const auto& camFreq : invertedFile_[word])
+    {
+      if(camFreq.first < camIdx)
+        scores[camFreq.first] += queryWeight * camFreq.second;
+    }
+  }
+
+  vector<int> order(camIdx);
+  if(camIdx > 0)
+    quicksort(camIdx,&scores[0],&order[0]);
+  for(int i = camIdx - 1; i >= std::max(0,camIdx - nCandidates); i--)
+  {
+    if(scores[order[i]] > 0.f)
+      candidates.push_back(order[i]);
+  }
+}
+
+void OnlineSFM::buildVocabulary(int nCamsToIndex)
+{
+  bool verbose = opt_.get<bool>("verbose");
+  if(verbose)
+    cout << "Sampling words to create vocabulary ... ";
+  randomlySampleVisualWords(data_.cams(),opt_.get<int>("maxVocabularySize"),&words_);
+  if(verbose)
+    cout << words_.cols() << " words used.\n";
+
+  invertedFile_.clear();
+  invertedFile_.resize(words_.cols());
+  docFreq_.assign(words_.cols(),0);
+  nIndexedCams_ = 0;
+  for(int i = 0; i < nCamsToIndex; i++)
+    indexCamera(i);
+}
+
+void OnlineSFM::indexCamera(int camIdx)
+{
+  vector<pair<int,float>> histogram;
+  computeWordHistogram(camIdx,&histogram);
+  for(const auto& entry : histogram)
+  {
+    invertedFile_[entry.first].emplace_back(camIdx,entry.second);
+    docFreq_[entry.first]++;
+  }
+  nIndexedCams_++;
+}
+
+void OnlineSFM::computeWordHistogram(int camIdx,vector<pair<int,float>> *phistogram)
+{
+  auto& histogram = *phistogram;
+  auto& cam = data_.cam(camIdx);
+  cam.pinDescr();
+  const MatrixXf& descr = cam.descr();
+  int nKeys = static_cast<int>(descr.cols());
+
+  // Process the descriptors in blocks so that the similarity matrix stays small.
+  const int blockSize = 512;
+  umap<int,float> counts;
+  MatrixXf similarity;
+  for(int first = 0; first < nKeys; first += blockSize)
+  {
+    int n = std::min(blockSize,nKeys - first);
+    similarity.noalias() = words_.transpose() * descr.middleCols(first,n);
+    for(int iKey = 0; iKey < n; iKey++)
+    {
+      int word;
+      similarity.col(iKey).maxCoeff(&word);
+      counts[word] += 1.f;
+    }
+  }
+  cam.unpinDescr();
+
+  float norm = 0.f;
+  for(const auto& entry : counts)
+    norm += entry.second*entry.second;
+  norm = sqrt(norm);
+
+  histogram.clear();
+  histogram.reserve(counts.size());
+  for(const auto& entry : counts)
+    histogram.emplace_back(entry.first,entry.second / norm);
+}
+
+void OnlineSFM::matchAndVerify(int camIdx,const vector<int>& candidates)
+{
+  if(candidates.empty())
+    return;
+
+  auto& cams = data_.cams();
+  int minNumPairwiseMatches = opt_.get<int>("minNumPairwiseMatches");
+
+  vector<set<int>> queries(data_.numCams());
+  queries[camIdx].insert(candidates.begin(),candidates.end());
+  data_.queries()[camIdx].insert(candidates.begin(),candidates.end());
+
+  pair_umap<CameraPair> pairs;
+  matchFeatFLANN(opt_.getOpt<OptionsFLANN>("matchingFLANN"),cams,queries,&pairs);
+  removePoorlyMatchedPairs(minNumPairwiseMatches,&pairs);
+
+  bool useCalibratedEpipolarVerif = false;
+  verifyMatchesEpipolar(opt_.getOpt<OptionsRANSAC>("epipolarVerification"),
+    opt_.get<bool>("verbose"),useCalibratedEpipolarVerif,cams,&pairs);
+  removePoorlyMatchedPairs(minNumPairwiseMatches,&pairs);
+
+  for(auto& entry : pairs)
+  {
+    // Candidates always precede the new camera.
+    int other = entry.first.first;
+    neighbors_[other].push_back(camIdx);
+    neighbors_[camIdx].push_back(other);
+    data_.pairs()[entry.first] = std::move(entry.second);
+  }
+}
+
+bool OnlineSFM::tryInitialize()
+{
+  int minNumPairwiseMatches = opt_.get<int>("minNumPairwiseMatches");
+  auto& nViewMatches = data_.nViewMatches();
+
+  // All the cameras are pending while the model is empty.
+  nViewMatches.clear();
+  twoViewMatchesToNViewMatches(data_.cams(),data_.pairs(),&nViewMatches);
+
+  uset<int> camsToIgnore;
+  for(int i = 0; i < data_.numCams(); i++)
+  {
+    if(pendingCams_.count(i) == 0)
+      camsToIgnore.insert(i);
+  }
+
+  IntPair initPair = chooseInitialCameraPair(minNumPairwiseMatches,isCalibrated_,
+    camsToIgnore,nViewMatches);
+  if(initPair.first < 0 || initPair.second < 0)
+  {
+    nViewMatches.clear();
+    return false;
+  }
+
+  // The model is empty, so a failed attempt is undone by clearing the
+  // reconstruction and restoring the parameters of the pair.
+  vector<double> params0,params1;
+  data_.cam(initPair.first).params(&params0);
+  data_.cam(initPair.second).params(&params1);
+  initReconstructionFromCalibratedCamPair(
+    opt_.getOpt<OptionsRANSAC>("initialPairRelativePose"),
+    opt_.get<double>("pointsReprojErrorThresh"),initPair,&data_);
+  // The remaining n-view matches are not used. New points are triangulated
+  // from the verified pairs.
+  nViewMatches.clear();
+  if(data_.countPtsAlive() < minNumPairwiseMatches)
+  {
+    data_.clearReconstruction();
+    data_.cam(initPair.first).setParams(params0);
+    data_.cam(initPair.second).setParams(params1);
+    return false;
+  }
+
+  bundleAdjust(opt_.getOpt<OptionsBundleAdjustment>("globalBundleAdjust"),
+    &data_.cams(),&data_.pts());
+
+  initialPair_ = initPair;
+  pendingCams_.erase(initPair.first);
+  pendingCams_.erase(initPair.second);
+  nRegisteredSinceGlobalBA_ += 2;
+
+  int nRetriesLeft = opt_.get<int>("maxPendingRetries");
+  retryPending(initPair.first,&nRetriesLeft);
+  retryPending(initPair.second,&nRetriesLeft);
+  return true;
+}
+
+bool OnlineSFM::registerCamera(int camIdx)
+{
+  auto& cams = data_.cams();
+  auto& pts = data_.pts();
+  bool verbose = opt_.get<bool>("verbose");
+
+  vector<IntPair> camToSceneMatches;
+  findCamToSceneMatches(camIdx,&camToSceneMatches);
+  int nCamToSceneMatches = static_cast<int>(camToSceneMatches.size());
+  if(nCamToSceneMatches < opt_.get<int>("minNumCamToSceneMatches"))
+    return false;
+
+  vector<int> inliers;
+  bool success = resectCamera6ptLSRANSAC(opt_.getOpt<OptionsRANSAC>("absolutePose"),
+    camToSceneMatches,pts,cams[camIdx].get(),&inliers);
+
+  StandardCamera *cam = static_cast<StandardCamera *>(cams[camIdx].get());
+  int maxDim = std::max(cam->imgWidth(),cam->imgHeight());
+  if(!success || cam->f() <= 0.1*maxDim)
+  {
+    if(verbose)
+      cout << "camera " << camIdx << " could not be resected\n";
+    return false;
+  }
+
+  vector<int> ptIdxs;
+  unzipPairsVectorSecond(camToSceneMatches,&ptIdxs);
+  for(const auto& match : camToSceneMatches)
+    pts[match.second].viewsToAdd.emplace(camIdx,match.first);
+  data_.markCamAsReconstructed(camIdx,ptIdxs,inliers);
+
+  auto& visPts = cam->visiblePoints();
+  for(int inlier : inliers)
+    visPts.push_back(ptIdxs[inlier]);
+  std::sort(visPts.begin(),visPts.end());
+  visPts.erase(std::unique(visPts.begin(),visPts.end()),visPts.end());
+
+  triangulateNewPoints(camIdx);
+
+  uset<int> window;
+  chooseLocalWindow(camIdx,&window);
+  bundleAdjustLocal(opt_.getOpt<OptionsBundleAdjustment>("localBundleAdjust"),
+    window,&cams,&pts);
+  removeLocalOutliers(window);
+
+  nRegisteredSinceGlobalBA_++;
+  scheduleGlobalBA();
+
+  pendingCams_.erase(camIdx);
+  return true;
+}
+
+void OnlineSFM::findCamToSceneMatches(int camIdx,
+  vector<IntPair> *camToSceneMatches) const
+{
+  const auto& cams = data_.cams();
+  const auto& pts = data_.pts();
+  const auto& reconstructed = data_.reconstructedCams();
+
+  uset<int> usedKeys,usedPts;
+  for(int other : neighbors_[camIdx])
+  {
+    if(reconstructed.count(other) == 0)
+      continue;
+
+    umap<int,int> keyToPt;
+    for(int ptIdx : cams[other]->visiblePoints())
+    {
+      auto it = pts[ptIdx].views.find(other);
+      if(it != pts[ptIdx].views.end())
+        keyToPt[it->second] = ptIdx;
+    }
+
+    bool swapped;
+    const CameraPair *pair = findPair(other,camIdx,&swapped);
+    if(!pair)
+      continue;
+    for(const auto& match : pair->matches)
+    {
+      int otherKey = swapped ? match.second : match.first;
+      int key = swapped ? match.first : match.second;
+      auto it = keyToPt.find(otherKey);
+      if(it != keyToPt.end() && usedKeys.count(key) == 0 &&
+        usedPts.count(it->second) == 0)
+      {
+        usedKeys.insert(key);
+        usedPts.insert(it->second);
+        camToSceneMatches->emplace_back(key,it->second);
+      }
+    }
+  }
+}
+
+void OnlineSFM::triangulateNewPoints(int camIdx)
+{
+  auto& cams = data_.cams();
+  auto& pts = data_.pts();
+  const auto& reconstructed = data_.reconstructedCams();
+  double rayAngleThresh = opt_.get<double>("rayAngleThresh");
+
+  uset<int> usedKeys;
+  for(int ptIdx : cams[camIdx]->visiblePoints())
+  {
+    auto it = pts[ptIdx].views.find(camIdx);
+    if(it != pts[ptIdx].views.end())
+      usedKeys.insert(it->second);
+  }
+
+  vector<SplitNViewMatch> matchesToReconstruct;
+  for(int other : neighbors_[camIdx])
+  {
+    if(reconstructed.count(other) == 0)
+      continue;
+
+    uset<int> otherUsedKeys;
+    for(int ptIdx : cams[other]->visiblePoints())
+    {
+      auto it = pts[ptIdx].views.find(other);
+      if(it != pts[ptIdx].views.end())
+        otherUsedKeys.insert(it->second);
+    }
+
+    bool swapped;
+    const CameraPair *pair = findPair(other,camIdx,&swapped);
+    if(!pair)
+      continue;
+    for(const auto& match : pair->matches)
+    {
+      int otherKey = swapped ? match.second : match.first;
+      int key = swapped ? match.first : match.second;
+      if(usedKeys.count(key) > 0 || otherUsedKeys.count(otherKey) > 0)
+        continue;
+
+      SplitNViewMatch m;
+      m.observedPart.emplace(other,otherKey);
+      m.observedPart.emplace(camIdx,key);
+      if(isWellConditioned(rayAngleThresh,cams,m.observedPart))
+      {
+        usedKeys.insert(key);
+        otherUsedKeys.insert(otherKey);
+        matchesToReconstruct.push_back(m);
+      }
+    }
+  }
+  reconstructPoints(matchesToReconstruct,&cams,&pts);
+}
+
+void OnlineSFM::chooseLocalWindow(int camIdx,uset<int> *window) const
+{
+  const auto& reconstructed = data_.reconstructedCams();
+  int maxSize = opt_.get<int>("localBAWindow");
+
+  vector<int> others;
+  vector<int> nMatches;
+  for(int other : neighbors_[camIdx])
+  {
+    bool swapped;
+    const CameraPair *pair = findPair(other,camIdx,&swapped);
+    if(reconstructed.count(other) > 0 && pair)
+    {
+      others.push_back(other);
+      nMatches.push_back(static_cast<int>(pair->matches.size()));
+    }
+  }
+
+  window->insert(camIdx);
+  vector<int> order;
+  quicksort(nMatches,&order);
+  for(int i = static_cast<int>(order.size()) - 1; i >= 0; i--)
+  {
+    if(static_cast<int>(window->size()) >= maxSize)
+      break;
+    window->insert(others[order[i]]);
+  }
+}
+
+void OnlineSFM::removeLocalOutliers(const uset<int>& window)
+{
+  auto& cams = data_.cams();
+  auto& pts = data_.pts();
+  double thresh = opt_.get<double>("pointsReprojErrorThresh");
+
+  uset<int> ptsToCheck;
+  for(int camIdx : window)
+    ptsToCheck.insert(cams[camIdx]->visiblePoints().begin(),
+      cams[camIdx]->visiblePoints().end());
+
+  vector<int> ptsToRemove;
+  for(int ptIdx : ptsToCheck)
+  {
+    auto& pt = pts[ptIdx];
+    if(pt.views.empty())
+      continue;
+    double err = 0.;
+    for(const auto& camKey : pt.views)
+    {
+      const auto& cam = *cams[camKey.first];
+      err += (cam.project(pt) - cam.key(camKey.second)).norm();
+    }
+    err /= pt.views.size();
+    if(err > thresh)
+      ptsToRemove.push_back(ptIdx);
+  }
+  removePointsViews(ptsToRemove,&cams,&pts);
+}
+
+void OnlineSFM::retryPending(int camIdx,int *nRetriesLeft)
+{
+  for(int other : neighbors_[camIdx])
+  {
+    if(*nRetriesLeft <= 0)
+      return;
+    if(pendingCams_.count(other) > 0)
+    {
+      (*nRetriesLeft)--;
+      registerCamera(other);
+    }
+  }
+}
+
+void OnlineSFM::scheduleGlobalBA()
+{
+  int period = opt_.get<int>("globalBAPeriod");
+  if(period <= 0 || nRegisteredSinceGlobalBA_ < period || globalBA_.valid())
+    return;
+
+  nRegisteredSinceGlobalBA_ = 0;
+  snapshot_ = make_unique<GlobalBASnapshot>();
+  snapshot_->cams.resize(data_.numCams());
+  for(int camIdx : data_.reconstructedCams())
+    snapshot_->cams[camIdx] = data_.cam(camIdx).cloneWithoutDescr();
+  snapshot_->pts = data_.pts();
+
+  // Without a fixed gauge the snapshot could drift away from the frame of the
+  // cameras registered in the meantime.
+  vector<bool> constantCams(data_.numCams(),false);
+  constantCams[initialPair_.first] = true;
+  constantCams[initialPair_.second] = true;
+  vector<bool> constantPts(snapshot_->pts.size(),false);
+
+  GlobalBASnapshot *snapshot = snapshot_.get();
+  const OptionsBundleAdjustment *baOpt =
+    &opt_.getOpt<OptionsBundleAdjustment>("globalBundleAdjust");
+  globalBA_ = std::async(std::launch::async,[snapshot,baOpt,constantCams,constantPts]()
+  {
+    bundleAdjust(*baOpt,constantCams,constantPts,&snapshot->cams,&snapshot->pts);
+  });
+}
+
+void OnlineSFM::mergeGlobalBA(bool wait)
+{
+  if(!globalBA_.valid())
+    return;
+  if(!wait &&
+    globalBA_.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+    return;
+
+  globalBA_.get();
+
+  // Local adjustments of the snapshot cameras done in the meantime are overwritten
+  // by the globally adjusted values.
+  auto& snapCams = snapshot_->cams;
+  for(size_t camIdx = 0; camIdx < snapCams.size(); camIdx++)
+  {
+    if(snapCams[camIdx])
+    {
+      vector<double> params;
+      snapCams[camIdx]->params(&params);
+      data_.cam(camIdx).setParams(params);
+    }
+  }
+  auto& pts = data_.pts();
+  for(size_t ptIdx = 0; ptIdx < snapshot_->pts.size(); ptIdx++)
+  {
+    if(!pts[ptIdx].views.empty())
+      pts[ptIdx].coord = snapshot_->pts[ptIdx].coord;
+  }
+
+  // The cameras registered in the meantime are fitted to the merged model.
+  uset<int> newCams;
+  for(int camIdx : data_.reconstructedCams())
+  {
+    if(camIdx >= static_cast<int>(snapCams.size()) || !snapCams[camIdx])
+      newCams.insert(camIdx);
+  }
+  snapshot_.reset();
+  if(!newCams.empty())
+  {
+    bundleAdjustLocal(opt_.getOpt<OptionsBundleAdjustment>("localBundleAdjust"),
+      newCams,&data_.cams(),&data_.pts());
+    removeLocalOutliers(newCams);
+  }
+}
+
+const CameraPair *OnlineSFM::findPair(int cam1,int cam2,bool *swapped) const
+{
+  const auto& pairs = data_.pairs();
+  auto it = pairs.find(IntPair(cam1,cam2));
+  if(it != pairs.end())
+  {
+    *swapped = false;
+    return &it->second;
+  }
+  it = pairs.find(IntPair(cam2,cam1));
+  if(it != pairs.end())
+  {
+    *swapped = true;
+    return &it->second;
+  }
+  return nullptr;
+}
+
+} // namespace yasfm
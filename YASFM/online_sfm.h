@@ -0,0 +1,286 @@
+//----------------------------------------------------------------------------------------
+/**
+* \file       online_sfm.h
+* \brief      Online (streaming) reconstruction.
+*
+*  Online reconstruction which updates the model with every newly arriving image.
+*
+*/
+//----------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <future>
+#include <memory>
+#include <ostream>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Eigen/Dense"
+
+#include "defines.h"
+#include "sfm_data.h"
+#include "options_types.h"
+#include "features.h"
+#include "matching.h"
+#include "ransac.h"
+#include "bundle_adjust.h"
+
+using Eigen::MatrixXf;
+using std::future;
+using std::make_shared;
+using std::make_unique;
+using std::ostream;
+using std::pair;
+using std::string;
+using std::unique_ptr;
+using std::vector;
+
+namespace yasfm
+{
+
+////////////////////////////////////////////////////
+///////////////   Declarations   ///////////////////
+////////////////////////////////////////////////////
+
+/// Options for online reconstruction.
+/**
+Fields:
+OptionsSIFTGPU sift;
+OptionsFLANN matchingFLANN;
+// The error is symmetric distance. Units are pixels.
+OptionsRANSAC epipolarVerification;
+// Units of the error are pixels.
+OptionsRANSAC initialPairRelativePose;
+// The error is reprojection error. Units are pixels.
+OptionsRANSAC absolutePose;
+// Run for every new camera on a small window of cameras (keep the number
+// of iterations low to keep the latency bounded).
+OptionsBundleAdjustment localBundleAdjust;
+// Run in the background every globalBAPeriod registered cameras.
+OptionsBundleAdjustment globalBundleAdjust;
+// Database with ccd widths. Empty disables EXIF focal search.
+string ccdDBFilename;
+// The vocabulary for retrieval is created once this many images arrive.
+// Before that, all the previous images are candidates (at most nCandidates).
+int nVocabularyBootstrapCams;
+int maxVocabularySize;
+// Number of retrieved images to match every new image to.
+int nCandidates;
+int minNumPairwiseMatches;
+int minNumCamToSceneMatches;
+// Maximum number of cameras optimized by the local bundle adjustment.
+int localBAWindow;
+// Global bundle adjustment is scheduled after this many registered cameras.
+// Non-positive value disables the global bundle adjustment.
+int globalBAPeriod;
+// Maximum number of previously unregistered cameras retried after a new camera
+// gets registered.
+int maxPendingRetries;
+double pointsReprojErrorThresh;
+// Use degrees.
+double rayAngleThresh;
+double focalConstraintWeight;
+// Used when the focal could not be found in EXIF.
+double defaultFocalDividedBySensorSize;
+bool verbose;
+*/
+class OptionsOnlineSFM : public OptionsWrapper
+{
+public:
+  /// Constructor setting defaults.
+  YASFM_API OptionsOnlineSFM()
+  {
+    int minNumPairwiseMatches = 16;
+
+    OptionsWrapperPtr sift = make_shared<OptionsSIFTGPU>();
+    opt.emplace("sift",make_unique<OptTypeWithVal<OptionsWrapperPtr>>(sift));
+
+    OptionsWrapperPtr matchingFLANN = make_shared<OptionsFLANN>();
+    matchingFLANN->get<bool>("verbose") = false;
+    opt.emplace("matchingFLANN",
+      make_unique<OptTypeWithVal<OptionsWrapperPtr>>(matchingFLANN));
+
+    OptionsWrapperPtr epipolarVerification =
+      make_shared<OptionsRANSAC>(2048,sqrt(5.),minNumPairwiseMatches);
+    opt.emplace("epipolarVerification",
+      make_unique<OptTypeWithVal<OptionsWrapperPtr>>(epipolarVerification));
+
+    OptionsWrapperPtr initialPairRelativePose = make_shared<OptionsRANSAC>(512,1.25,10);
+    opt.emplace("initialPairRelativePose",
+      make_unique<OptTypeWithVal<OptionsWrapperPtr>>(initialPairRelativePose));
+
+    OptionsWrapperPtr absolutePose = make_shared<OptionsRANSAC>(4096,4.,16,0.999999);
+    opt.emplace("absolutePose",
+      make_unique<OptTypeWithVal<OptionsWrapperPtr>>(absolutePose));
+
+    OptionsWrapperPtr localBundleAdjust = make_shared<OptionsBundleAdjustment>();
+    localBundleAdjust->get<ceres::Solver::Options>("solverOptions").max_num_iterations = 5;
+    opt.emplace("localBundleAdjust",
+      make_unique<OptTypeWithVal<OptionsWrapperPtr>>(localBundleAdjust));
+
+    OptionsWrapperPtr globalBundleAdjust = make_shared<OptionsBundleAdjustment>();
+    opt.emplace("globalBundleAdjust",
+      make_unique<OptTypeWithVal<OptionsWrapperPtr>>(globalBundleAdjust));
+
+    opt.emplace("ccdDBFilename",make_unique<OptTypeWithVal<string>>(""));
+    opt.emplace("nVocabularyBootstrapCams",make_unique<OptTypeWithVal<int>>(30));
+    opt.emplace("maxVocabularySize",make_unique<OptTypeWithVal<int>>(15000));
+    opt.emplace("nCandidates",make_unique<OptTypeWithVal<int>>(10));
+    opt.emplace("minNumPairwiseMatches",
+      make_unique<OptTypeWithVal<int>>(minNumPairwiseMatches));
+    opt.emplace("minNumCamToSceneMatches",
+      make_unique<OptTypeWithVal<int>>(minNumPairwiseMatches));
+    opt.emplace("localBAWindow",make_unique<OptTypeWithVal<int>>(8));
+    opt.emplace("globalBAPeriod",make_unique<OptTypeWithVal<int>>(20));
+    opt.emplace("maxPendingRetries",make_unique<OptTypeWithVal<int>>(2));
+    opt.emplace("pointsReprojErrorThresh",make_unique<OptTypeWithVal<double>>(8.));
+    opt.emplace("rayAngleThresh",make_unique<OptTypeWithVal<double>>(2.));
+    opt.emplace("focalConstraintWeight",make_unique<OptTypeWithVal<double>>(0.0001));
+    opt.emplace("defaultFocalDividedBySensorSize",
+      make_unique<OptTypeWithVal<double>>(1.083)); // assume angle of view 55 degrees
+    opt.emplace("verbose",make_unique<OptTypeWithVal<bool>>(true));
+  }
+
+  template<class T>
+  const T& getOpt(const string& name) const
+  {
+    return *static_cast<T *>(&(*get<OptionsWrapperPtr>(name)));
+  }
+
+  template<class T>
+  T& getOpt(const string& name)
+  {
+    return *static_cast<T *>(&(*get<OptionsWrapperPtr>(name)));
+  }
+};
+
+/// Online reconstruction updating the model with every arriving image.
+/**
+Every new image gets features, is retrieved against a persistent inverted file
+and matched to its top candidates. Verified matches are used to register the camera
+with resectCamera6ptLSRANSAC and to triangulate new points. Only a local bundle
+adjustment runs for every image. The global bundle adjustment runs on a snapshot
+in a background thread and its result is merged back when it finishes. It keeps
+the initial pair constant, so that the snapshot stays in the frame of the live
+model, and the cameras registered in the meantime get adjusted locally after
+the merge.
+Cameras which cannot be registered right away are kept pending and retried when
+one of their neighbors gets registered.
+
+Cameras are assumed to be derived from StandardCamera.
+*/
+class OnlineSFM
+{
+public:
+  /// Constructor.
+  /**
+  \param[in] opt Options.
+  \param[in,out] data Dataset which gets updated. It has to outlive this object.
+  */
+  YASFM_API OnlineSFM(const OptionsOnlineSFM& opt,Dataset *data);
+
+  /// Destructor. Waits for the background bundle adjustment.
+  YASFM_API ~OnlineSFM();
+
+  /// Add a new image and update the model.
+  /**
+  \param[in] filename Path to an image file.
+  \param[in] isSubdir true if the filename is relative to the working dir.
+  \return True if the camera was registered.
+  */
+  template<class T>
+  bool addImage(const string& filename,bool isSubdir = true);
+
+  /// Process a camera which was already added to the dataset.
+  /**
+  Features are detected only if the camera has no keys.
+
+  \param[in] camIdx Index of the camera.
+  \return True if the camera was registered.
+  */
+  YASFM_API bool processCamera(int camIdx);
+
+  /// Wait for the background bundle adjustment and merge it.
+  /// \param[in] runGlobalBA Run one more (blocking) global bundle adjustment.
+  YASFM_API void finish(bool runGlobalBA);
+
+  /// \return Per-image latencies in seconds (in the order of arrival).
+  YASFM_API const vector<double>& latencies() const;
+
+  /// Latency percentile.
+  /**
+  \param[in] p Percentile in [0,100], e.g., 50 or 99.
+  \return Latency in seconds (nearest rank). 0 if no image was processed.
+  */
+  YASFM_API double latencyPercentile(double p) const;
+
+  /// Print number of processed images, p50, p99 and maximum latency.
+  /// \param[in,out] out Output stream.
+  YASFM_API void printLatencyReport(ostream& out) const;
+
+private:
+  /// Snapshot of the reconstruction optimized in the background.
+  struct GlobalBASnapshot
+  {
+    ptr_vector<Camera> cams; ///< Only reconstructed cameras are non-null.
+    vector<Point> pts;
+  };
+
+  /// Forbidden.
+  OnlineSFM(const OnlineSFM& o);
+  /// Forbidden.
+  OnlineSFM& operator=(const OnlineSFM& o);
+
+  void initCalibration(int camIdx);
+  void findCandidates(int camIdx,vector<int> *candidates);
+  void buildVocabulary(int nCamsToIndex);
+  void indexCamera(int camIdx);
+  void computeWordHistogram(int camIdx,vector<pair<int,float>> *histogram);
+  void matchAndVerify(int camIdx,const vector<int>& candidates);
+  bool tryInitialize();
+  bool registerCamera(int camIdx);
+  void findCamToSceneMatches(int camIdx,vector<IntPair> *camToSceneMatches) const;
+  void triangulateNewPoints(int camIdx);
+  void chooseLocalWindow(int camIdx,uset<int> *window) const;
+  void removeLocalOutliers(const uset<int>& window);
+  void retryPending(int camIdx,int *nRetriesLeft);
+  void scheduleGlobalBA();
+  void mergeGlobalBA(bool wait);
+  const CameraPair *findPair(int cam1,int cam2,bool *swapped) const;
+
+  OptionsOnlineSFM opt_;
+  Dataset& data_;
+
+  vector<bool> isCalibrated_;
+  vector<vector<int>> neighbors_; ///< Cameras with a verified pair.
+  uset<int> pendingCams_;         ///< Processed but not registered cameras.
+
+  MatrixXf words_; ///< Visual words in columns (empty before bootstrap).
+  /// For every word, cameras containing it with their normalized term frequency.
+  vector<vector<pair<int,float>>> invertedFile_;
+  vector<int> docFreq_;  ///< Number of indexed cameras containing a word.
+  int nIndexedCams_;
+
+  IntPair initialPair_; ///< Fixes the gauge of the global adjustments.
+  int nRegisteredSinceGlobalBA_;
+  future<void> globalBA_;
+  unique_ptr<GlobalBASnapshot> snapshot_;
+
+  vector<double> latencies_;
+};
+
+////////////////////////////////////////////////////
+///////////////   Definitions   ////////////////////
+////////////////////////////////////////////////////
+
+template<class T>
+bool OnlineSFM::addImage(const string& filename,bool isSubdir)
+{
+  data_.addCamera<T>(filename,isSubdir);
+  return processCamera(data_.numCams() - 1);
+}
+
+} // namespace yasfm
@@ -0,0 +1,87 @@
+#include "pair_screening.h"
+
+#include <ctime>
+#include <fstream>
+#include <iostream>
+
+#include "relative_pose.h"
+
+using std::cout;
+using std::ifstream;
+
+namespace yasfm
+{
+
+string coarseFeaturesFilename(const string& featsFilename)
+{
+  const string ext(".feat.gz");
+  size_t pos = featsFilename.rfind(ext);
+  if(pos != string::npos && pos + ext.length() == featsFilename.length())
+    return featsFilename.substr(0,pos) + ".coarse" + ext;
+  else
+    return featsFilename + ".coarse" + ext;
+}
+
+void detectCoarseFeatures(const OptionsPairScreening& opt,
+  const ptr_vector<Camera>& cams,ptr_vector<Camera> *pcoarseCams)
+{
+  auto& coarseCams = *pcoarseCams;
+  coarseCams.clear();
+  coarseCams.reserve(cams.size());
+
+  vector<int> camsToDetect;
+  for(int camIdx = 0; camIdx < static_cast<int>(cams.size()); camIdx++)
+  {
+    coarseCams.push_back(cams[camIdx]->cloneWithoutDescr());
+    string fn = coarseFeaturesFilename(cams[camIdx]->featsFilename());
+    coarseCams.back()->setFeaturesFilename(fn,false);
+    if(ifstream(fn).good())
+      coarseCams.back()->readFeatures(Camera::ReadKeys); // colors are not needed
+    else
+      camsToDetect.push_back(camIdx);
+  }
+
+  if(!camsToDetect.empty())
+  {
+    detectSiftGPU(opt.getOpt<OptionsSIFTGPU>("sift"),camsToDetect,&coarseCams);
+  }
+}
+
+int screenPairs(const OptionsPairScreening& opt,
+  const ptr_vector<Camera>& coarseCams,vector<set<int>> *pqueries)
+{
+  auto& queries = *pqueries;
+  bool verbose = opt.get<bool>("verbose");
+  int minNumMatches = opt.get<int>("minNumMatches");
+
+  int nPairsIn = 0;
+  for(const auto& entry : queries)
+    nPairsIn += static_cast<int>(entry.size());
+
+  clock_t start = clock();
+  pair_umap<CameraPair> coarsePairs;
+  matchFeatFLANN(opt.getOpt<OptionsFLANN>("matchingFLANN"),coarseCams,queries,
+    &coarsePairs);
+  removePoorlyMatchedPairs(minNumMatches,&coarsePairs);
+  for(const auto& cam : coarseCams)
+    cam->clearDescriptors();
+
+  verifyMatchesEpipolar(opt.getOpt<OptionsRANSAC>("epipolarVerification"),false,
+    opt.get<bool>("useCalibratedEG"),coarseCams,&coarsePairs);
+  removePoorlyMatchedPairs(minNumMatches,&coarsePairs);
+
+  for(auto& entry : queries)
+    entry.clear();
+  for(const auto& entry : coarsePairs)
+    queries[entry.first.second].insert(entry.first.first);
+
+  int nPairsOut = static_cast<int>(coarsePairs.size());
+  if(verbose)
+  {
+    cout << "screening: " << nPairsOut << "/" << nPairsIn << " pairs passed\t"
+      << "took: " << (double)(clock() - start) / (double)CLOCKS_PER_SEC << "s\n";
+  }
+  return nPairsOut;
+}
+
+} // namespace yasfm
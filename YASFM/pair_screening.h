@@ -0,0 +1,129 @@
+//----------------------------------------------------------------------------------------
+/**
+* \file       pair_screening.h
+* \brief      Coarse-to-fine screening of camera pairs.
+*
+*  Screening of candidate camera pairs using small sets of coarse features before
+*  they get matched using the full sets.
+*
+*/
+//----------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "defines.h"
+#include "sfm_data.h"
+#include "options_types.h"
+#include "features.h"
+#include "matching.h"
+#include "ransac.h"
+
+using std::make_shared;
+using std::make_unique;
+using std::set;
+using std::string;
+using std::vector;
+
+namespace yasfm
+{
+
+////////////////////////////////////////////////////
+///////////////   Declarations   ///////////////////
+////////////////////////////////////////////////////
+
+/// Options for coarse screening of camera pairs.
+/**
+Fields:
+// Detection of the coarse features. Defaults: firstOctave 1, softmaxFeatures 500.
+OptionsSIFTGPU sift;
+OptionsFLANN matchingFLANN;
+// The error is symmetric distance. Units are pixels (of the full image).
+OptionsRANSAC epipolarVerification;
+// Pairs with less tentative matches are rejected before the verification.
+int minNumMatches;
+// Uses 5pt instead of 7pt. All cameras have to be calibrated.
+bool useCalibratedEG;
+bool verbose;
+*/
+class OptionsPairScreening : public OptionsWrapper
+{
+public:
+  /// Constructor setting defaults.
+  YASFM_API OptionsPairScreening()
+  {
+    int minNumMatches = 8;
+
+    OptionsWrapperPtr sift = make_shared<OptionsSIFTGPU>();
+    sift->get<int>("firstOctave") = 1;
+    sift->get<int>("softmaxFeatures") = 500;
+    sift->get<int>("verbosityLevel") = 0;
+    opt.emplace("sift",make_unique<OptTypeWithVal<OptionsWrapperPtr>>(sift));
+
+    OptionsWrapperPtr matchingFLANN = make_shared<OptionsFLANN>();
+    matchingFLANN->get<bool>("verbose") = false;
+    opt.emplace("matchingFLANN",
+      make_unique<OptTypeWithVal<OptionsWrapperPtr>>(matchingFLANN));
+
+    // Coarse keys are less precise, hence the larger threshold.
+    OptionsWrapperPtr epipolarVerification =
+      make_shared<OptionsRANSAC>(1024,2.*sqrt(5.),minNumMatches);
+    opt.emplace("epipolarVerification",
+      make_unique<OptTypeWithVal<OptionsWrapperPtr>>(epipolarVerification));
+
+    opt.emplace("minNumMatches",make_unique<OptTypeWithVal<int>>(minNumMatches));
+    opt.emplace("useCalibratedEG",make_unique<OptTypeWithVal<bool>>(false));
+    opt.emplace("verbose",make_unique<OptTypeWithVal<bool>>(true));
+  }
+
+  template<class T>
+  const T& getOpt(const string& name) const
+  {
+    return *static_cast<T *>(&(*get<OptionsWrapperPtr>(name)));
+  }
+
+  template<class T>
+  T& getOpt(const string& name)
+  {
+    return *static_cast<T *>(&(*get<OptionsWrapperPtr>(name)));
+  }
+};
+
+/// Get the filename of coarse features stored alongside the full ones.
+/**
+\param[in] featsFilename Filename of the full features (e.g. img.feat.gz).
+\return Filename of the coarse features (e.g. img.coarse.feat.gz).
+*/
+YASFM_API string coarseFeaturesFilename(const string& featsFilename);
+
+/// Prepare cameras with coarse features.
+/**
+Clones the cameras without their descriptors and points the clones to coarse
+features files stored alongside the full ones. Coarse features which already exist get read, the rest
+get detected and written.
+
+\param[in] opt Options (only sift is used).
+\param[in] cams Cameras with full features.
+\param[out] coarseCams Cameras with coarse features (same indexing as cams).
+*/
+YASFM_API void detectCoarseFeatures(const OptionsPairScreening& opt,
+  const ptr_vector<Camera>& cams,ptr_vector<Camera> *coarseCams);
+
+/// Screen candidate pairs using coarse features.
+/**
+Matches and epipolar-verifies every query pair using the coarse features and
+keeps only the pairs which pass, i.e., have at least minNumMatches verified matches.
+
+\param[in] opt Options.
+\param[in] coarseCams Cameras with coarse features (see detectCoarseFeatures).
+\param[in,out] queries Queries as in matchFeatFLANN. Only the pairs which pass remain.
+\return Number of pairs which passed.
+*/
+YASFM_API int screenPairs(const OptionsPairScreening& opt,
+  const ptr_vector<Camera>& coarseCams,vector<set<int>> *queries);
+
+} // namespace yasfm
@@ -0,0 +1,240 @@
+#include "perf_counters.h"
+
+#include <sstream>
+
+#ifdef __linux__
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using std::ostringstream;
+using std::chrono::duration;
+using std::chrono::steady_clock;
+
+namespace
+{
+
+#ifdef __linux__
+
+/// Open a disabled counter of the calling thread.
+/**
+\param[in] event Event.
+\return File descriptor or -1 if the event cannot be counted.
+*/
+int openCounter(yasfm::PerfEvent event)
+{
+  perf_event_attr attr;
+  memset(&attr,0,sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HARDWARE;
+  switch(event)
+  {
+  case yasfm::PerfEventCycles:
+    attr.config = PERF_COUNT_HW_CPU_CYCLES;
+    break;
+  case yasfm::PerfEventInstructions:
+    attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+    break;
+  case yasfm::PerfEventLLCMisses:
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    break;
+  case yasfm::PerfEventBranchMisses:
+    attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+    break;
+  default:
+    return -1;
+  }
+  attr.disabled = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+  long fd = syscall(__NR_perf_event_open,&attr,0,-1,-1,0);
+  return static_cast<int>(fd);
+}
+
+/// Read a counter scaled by the time it was actually counting.
+/**
+\param[in] fd File descriptor.
+\return Count or -1 if the read failed.
+*/
+long long readCounter(int fd)
+{
+  // value, time enabled, time running
+  unsigned long long data[3];
+  if(read(fd,data,sizeof(data)) != sizeof(data))
+    return -1;
+  if(data[2] == 0)
+    return 0;
+  if(data[2] == data[1])
+    return static_cast<long long>(data[0]);
+  return static_cast<long long>(double(data[0]) * (double(data[1]) / data[2]));
+}
+
+#endif
+
+} // namespace
+
+namespace yasfm
+{
+
+PerfCounterValues::PerfCounterValues()
+  : seconds(0.)
+{
+  for(int i = 0; i < PerfEventCount; i++)
+    counts[i] = 0;
+}
+
+bool PerfCounterValues::has(PerfEvent event) const
+{
+  return counts[event] >= 0;
+}
+
+double PerfCounterValues::ipc() const
+{
+  if(!has(PerfEventCycles) || !has(PerfEventInstructions) ||
+    counts[PerfEventCycles] == 0)
+    return 0.;
+  return double(counts[PerfEventInstructions]) / counts[PerfEventCycles];
+}
+
+PerfCounters::PerfCounters()
+  : isRunning_(false)
+{
+  for(int i = 0; i < PerfEventCount; i++)
+  {
+#ifdef __linux__
+    fds_[i] = openCounter(PerfEvent(i));
+#else
+    fds_[i] = -1;
+#endif
+  }
+  reset();
+}
+
+PerfCounters::~PerfCounters()
+{
+#ifdef __linux__
+  for(int i = 0; i < PerfEventCount; i++)
+  {
+    if(fds_[i] >= 0)
+      close(fds_[i]);
+  }
+#endif
+}
+
+bool PerfCounters::isAvailable() const
+{
+  for(int i = 0; i < PerfEventCount; i++)
+  {
+    if(fds_[i] >= 0)
+      return true;
+  }
+  return false;
+}
+
+void PerfCounters::start()
+{
+  if(isRunning_)
+    return;
+  isRunning_ = true;
+#ifdef __linux__
+  for(int i = 0; i < PerfEventCount; i++)
+  {
+    if(fds_[i] >= 0)
+    {
+      ioctl(fds_[i],PERF_EVENT_IOC_RESET,0);
+      ioctl(fds_[i],PERF_EVENT_IOC_ENABLE,0);
+    }
+  }
+#endif
+  start_ = steady_clock::now();
+}
+
+void PerfCounters::stop()
+{
+  if(!isRunning_)
+    return;
+  values_.seconds += duration<double>(steady_clock::now() - start_).count();
+  isRunning_ = false;
+#ifdef __linux__
+  for(int i = 0; i < PerfEventCount; i++)
+  {
+    if(fds_[i] < 0)
+      continue;
+    ioctl(fds_[i],PERF_EVENT_IOC_DISABLE,0);
+    long long count = readCounter(fds_[i]);
+    if(count < 0)
+    {
+      // Do not report partial counts.
+      close(fds_[i]);
+      fds_[i] = -1;
+      values_.counts[i] = -1;
+    } else
+    {
+      values_.counts[i] += count;
+    }
+  }
+#endif
+}
+
+void PerfCounters::reset()
+{
+  values_ = PerfCounterValues();
+  for(int i = 0; i < PerfEventCount; i++)
+  {
+    if(fds_[i] < 0)
+      values_.counts[i] = -1;
+  }
+}
+
+const PerfCounterValues& PerfCounters::values() const
+{
+  return values_;
+}
+
+PerfRegion::PerfRegion(PerfCounters *counters)
+  : counters_(counters)
+{
+  counters_->start();
+}
+
+PerfRegion::~PerfRegion()
+{
+  counters_->stop();
+}
+
+string formatPerfCounters(const PerfCounterValues& values,double nUnits,
+  const string& unitName)
+{
+  ostringstream out;
+  out << values.seconds << "s";
+  if(values.has(PerfEventCycles) && values.has(PerfEventInstructions))
+    out << " IPC: " << values.ipc();
+  if(nUnits > 0.)
+  {
+    string perUnit = "/" + unitName + ": ";
+    if(values.has(PerfEventCycles))
+      out << " cycles" << perUnit << values.counts[PerfEventCycles] / nUnits;
+    if(values.has(PerfEventLLCMisses))
+      out << " LLC misses" << perUnit << values.counts[PerfEventLLCMisses] / nUnits;
+    if(values.has(PerfEventBranchMisses))
+      out << " branch misses" << perUnit << values.counts[PerfEventBranchMisses] / nUnits;
+  } else
+  {
+    if(values.has(PerfEventLLCMisses))
+      out << " LLC misses: " << values.counts[PerfEventLLCMisses];
+    if(values.has(PerfEventBranchMisses))
+      out << " branch misses: " << values.counts[PerfEventBranchMisses];
+  }
+  bool hasAny = false;
+  for(int i = 0; i < PerfEventCount; i++)
+    hasAny |= values.has(PerfEvent(i));
+  if(!hasAny)
+    out << " (hardware counters unavailable)";
+  return out.str();
+}
+
+} // namespace yasfm
@@ -0,0 +1,143 @@
+//----------------------------------------------------------------------------------------
+/**
+* \file       perf_counters.h
+* \brief      Hardware performance counters around code regions.
+*
+*  Counts cycles, instructions, last level cache misses and branch misses using
+*  Linux perf_event. Elsewhere, or when the kernel does not allow the counters,
+*  only the wall time is measured.
+*
+*/
+//----------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <chrono>
+#include <string>
+
+#include "defines.h"
+
+using std::string;
+
+////////////////////////////////////////////////////
+///////////////   Declarations   ///////////////////
+////////////////////////////////////////////////////
+
+namespace yasfm
+{
+
+/// Events counted by PerfCounters.
+enum PerfEvent
+{
+  PerfEventCycles = 0,
+  PerfEventInstructions = 1,
+  PerfEventLLCMisses = 2,
+  PerfEventBranchMisses = 3,
+  /// Number of the events.
+  PerfEventCount = 4
+};
+
+/// Accumulated values of the counters.
+struct PerfCounterValues
+{
+  /// Constructor setting all to zero.
+  YASFM_API PerfCounterValues();
+
+  /// \return True if the event was counted.
+  YASFM_API bool has(PerfEvent event) const;
+
+  /// \return Instructions per cycle or 0 if they were not counted.
+  YASFM_API double ipc() const;
+
+  /// Counts of the events, scaled if the kernel multiplexed the counters.
+  /// Negative for events which could not be counted.
+  long long counts[PerfEventCount];
+  double seconds; ///< Wall time.
+};
+
+/// Hardware performance counters of the calling thread.
+/**
+The counters are opened by the constructor. Events which cannot be counted (not
+Linux, perf_event_paranoid too high, no PMU in a virtual machine, ...) are
+marked as such in the values and the rest still works. Only the thread which
+created the counters is counted, so threads of OpenMP or ceres are not.
+
+Typical usage:
+\code
+PerfCounters counters;
+for(...)
+{
+  PerfRegion region(&counters);
+  // measured code
+}
+cout << formatPerfCounters(counters.values(),nMatches,"match");
+\endcode
+*/
+class PerfCounters
+{
+public:
+  /// Constructor. Opens the counters.
+  YASFM_API PerfCounters();
+
+  /// Destructor. Closes the counters.
+  YASFM_API ~PerfCounters();
+
+  /// \return True if at least one event can be counted.
+  YASFM_API bool isAvailable() const;
+
+  /// Start counting. Does nothing if already started.
+  YASFM_API void start();
+
+  /// Stop counting and add the counts to the values.
+  YASFM_API void stop();
+
+  /// Set the values to zero.
+  YASFM_API void reset();
+
+  /// \return Values accumulated over all the start()/stop() periods.
+  YASFM_API const PerfCounterValues& values() const;
+
+private:
+  PerfCounters(const PerfCounters&) = delete;
+  PerfCounters& operator=(const PerfCounters&) = delete;
+
+  int fds_[PerfEventCount]; ///< File descriptors of the counters. -1 if not opened.
+  bool isRunning_;
+  std::chrono::steady_clock::time_point start_;
+  PerfCounterValues values_;
+};
+
+/// Counts the scope in which it lives.
+class PerfRegion
+{
+public:
+  /// Constructor. Starts the counters.
+  /// \param[in,out] counters Counters which have to outlive the region.
+  YASFM_API explicit PerfRegion(PerfCounters *counters);
+
+  /// Destructor. Stops the counters.
+  YASFM_API ~PerfRegion();
+
+private:
+  PerfRegion(const PerfRegion&) = delete;
+  PerfRegion& operator=(const PerfRegion&) = delete;
+
+  PerfCounters *counters_;
+};
+
+/// Format the values as one line.
+/**
+For example:
+"0.52s IPC: 1.87 cycles/match: 410 LLC misses/match: 3.1 branch misses/match: 12.4".
+Events which were not counted are left out.
+
+\param[in] values Values.
+\param[in] nUnits Number of processed units (matches, rounds, residuals, ...).
+Non-positive value leaves out the per unit counts.
+\param[in] unitName Name of the unit.
+\return Formatted values.
+*/
+YASFM_API string formatPerfCounters(const PerfCounterValues& values,double nUnits,
+  const string& unitName);
+
+} // namespace yasfm
@@ -4,6 +4,7 @@
 #include <iostream>
 #include <queue>
 
+#include "memory_budget.h"
 #include "utils.h"
 
 using Eigen::JacobiSVD;
@@ -27,6 +28,18 @@ void twoViewMatchesToNViewMatches(const ptr_vector<Camera>& cams,
   vector<uset<int>> matchedCams;
   convertMatchesToLocalRepresentation(cams,pairs,&matchedCams,&matches);
 
+  // The pairs are not used anymore, so they can be spilled. They must not be
+  // accessed below, because spilling empties them. Every key of a matched camera
+  // ends up in at most one n-view match.
+  size_t nBytesPerKey = sizeof(NViewMatch::value_type) + sizeof(void *);
+  size_t nBytes = 0;
+  for(size_t i = 0; i < cams.size(); i++)
+  {
+    if(!matchedCams[i].empty())
+      nBytes += cams[i]->keys().size() * nBytesPerKey;
+  }
+  memoryBudget().makeRoom(nBytes);
+
   vector<vector<bool>> visitedFeats;
   visitedFeats.resize(cams.size());
   for(size_t i = 0; i < cams.size(); i++)
@@ -346,7 +359,7 @@ int removeIllConditionedPoints(double rayAngleThresh,
   auto& cams = *pcams;
   auto& pts = *ppts;
   int nPts = static_cast<int>(pts.size());
-  int nPtsRemoved = 0;
+  vector<int> ptsToRemove;
   for(int ptIdx = 0; ptIdx < nPts; ptIdx++)
   {
     bool wellConditioned = false;
@@ -367,12 +380,10 @@ int removeIllConditionedPoints(double rayAngleThresh,
       }
     }
     if(!wellConditioned && !pt.views.empty())
-    {
-      nPtsRemoved++;
-      removePointViews(ptIdx,&pt,&cams);
-    }
+      ptsToRemove.push_back(ptIdx);
   }
-  return nPtsRemoved;
+  removePointsViews(ptsToRemove,&cams,&pts);
+  return static_cast<int>(ptsToRemove.size());
 }
 
 int removeHighReprojErrorPoints(double avgReprojErrThresh,ptr_vector<Camera> *pcams,
@@ -381,7 +392,7 @@ int removeHighReprojErrorPoints(double avgReprojErrThresh,ptr_vector<Camera> *pc
   auto& cams = *pcams;
   auto& pts = *ppts;
   int nPts = static_cast<int>(pts.size());
-  int nPtsRemoved = 0;
+  vector<int> ptsToRemove;
   for(int ptIdx = 0; ptIdx < nPts; ptIdx++)
   {
     auto& pt = pts[ptIdx];
@@ -396,12 +407,10 @@ int removeHighReprojErrorPoints(double avgReprojErrThresh,ptr_vector<Camera> *pc
     if(!pt.views.empty())
       err /= pt.views.size();
     if(err > avgReprojErrThresh)
-    {
-      nPtsRemoved++;
-      removePointViews(ptIdx,&pt,&cams);
-    }
+      ptsToRemove.push_back(ptIdx);
   }
-  return nPtsRemoved;
+  removePointsViews(ptsToRemove,&cams,&pts);
+  return static_cast<int>(ptsToRemove.size());
 }
 
 void removePointViews(int ptIdx,Point *pt,ptr_vector<Camera> *pcams)
@@ -425,6 +434,42 @@ void removePointViews(int ptIdx,Point *pt,ptr_vector<Camera> *pcams)
   pt->viewsToAdd.clear();
 }
 
+void removePointsViews(const vector<int>& ptIdxs,ptr_vector<Camera> *pcams,
+  vector<Point> *ppts)
+{
+  auto& cams = *pcams;
+  auto& pts = *ppts;
+  if(ptIdxs.empty())
+    return;
+
+  vector<bool> isRemoved(pts.size(),false);
+  vector<bool> camAffected(cams.size(),false);
+  for(int ptIdx : ptIdxs)
+  {
+    auto& pt = pts[ptIdx];
+    isRemoved[ptIdx] = true;
+    for(const auto& camKey : pt.views)
+      camAffected[camKey.first] = true;
+    for(const auto& camKey : pt.viewsToAdd)
+      camAffected[camKey.first] = true;
+    pt.views.clear();
+    pt.viewsToAdd.clear();
+  }
+
+  // Every affected list is compacted once, which keeps the order.
+  int nPts = static_cast<int>(pts.size());
+  for(size_t camIdx = 0; camIdx < cams.size(); camIdx++)
+  {
+    if(!camAffected[camIdx])
+      continue;
+    auto& visPts = cams[camIdx]->visiblePoints();
+    visPts.erase(std::remove_if(visPts.begin(),visPts.end(),[&](int ptIdx)
+    {
+      return ptIdx < nPts && isRemoved[ptIdx];
+    }),visPts.end());
+  }
+}
+
 } // namespace yasfm
 
 namespace
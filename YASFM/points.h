@@ -43,8 +43,16 @@ E.g. from img0 to img1 and img1 to img0. Then you should have the matches consis
 Meaning that if feature0 in img0 matches to feature1 in img1, then no other feature 
 from img1 should match to feature0.
 
+The pairs are not accessed after they are converted to an internal representation.
+Only then the memory budget is asked for room, so spillable pairs (see
+Dataset::setPairsSpillable()) can be spilled while the n-view matches are built.
+Hence, pairs may be emptied by the time this returns. Callers passing
+Dataset::pairs() of spillable pairs must call Dataset::pairs() again to access
+them afterwards. Implementations must not touch pairs after making room.
+
 \param[in] cams Cameras. Needed to know total number of keys in all cameras.
-\param[in] pairs Two view matches.
+\param[in] pairs Two view matches. Might be emptied by the memory budget during
+the call (see above).
 \param[out] nViewMatches Found consistent n-view matches.
 */
 YASFM_API void twoViewMatchesToNViewMatches(const ptr_vector<Camera>& cams,
@@ -240,6 +248,19 @@ YASFM_API int removeHighReprojErrorPoints(double avgReprojErrThresh,
 */
 YASFM_API void removePointViews(int ptIdx,Point *pt,ptr_vector<Camera> *cams);
 
+/// Remove views and viewsToAdd of many points and corresponding entries in cams.
+/**
+Has the same effect as calling removePointViews for every point but visible
+points list of every affected camera is traversed only once, so the cost is
+linear in the number of views and visible points instead of quadratic.
+
+\param[in] ptIdxs Indices of the points.
+\param[in,out] cams Cameras with visiblePoints.
+\param[in,out] pts Points.
+*/
+YASFM_API void removePointsViews(const vector<int>& ptIdxs,ptr_vector<Camera> *cams,
+  vector<Point> *pts);
+
 } // namespace yasfm
 
 namespace
@@ -0,0 +1,302 @@
+#include "product_quantization.h"
+
+#include <algorithm>
+#include <limits>
+#include <numeric>
+
+using Eigen::Map;
+using Eigen::VectorXf;
+
+namespace yasfm
+{
+
+PQIndex::PQIndex()
+  : dim_(0),nSubspaces_(0),subDim_(0),nProbes_(1),size_(0)
+{
+}
+
+void PQIndex::build(const OptionsPQ& opt,const MatrixXf& data)
+{
+  dim_ = static_cast<int>(data.rows());
+  size_ = static_cast<int>(data.cols());
+  nSubspaces_ = opt.get<int>("nSubspaces");
+  nProbes_ = opt.get<int>("nProbes");
+  listsIdxs_.clear();
+  listsCodes_.clear();
+  subspaceCentroids_.clear();
+  if(nSubspaces_ <= 0 || dim_ % nSubspaces_ != 0)
+  {
+    YASFM_PRINT_ERROR("Number of subspaces " << nSubspaces_
+      << " does not divide the dimension " << dim_ << ".");
+    size_ = 0;
+    return;
+  }
+  subDim_ = dim_ / nSubspaces_;
+  if(size_ == 0)
+    return;
+
+  std::mt19937 gen(0);
+  int nIterations = opt.get<int>("kmeansIterations");
+
+  // Training sample.
+  int nTrain = std::min(size_,opt.get<int>("maxTrainingSize"));
+  vector<int> idxs(size_);
+  std::iota(idxs.begin(),idxs.end(),0);
+  std::shuffle(idxs.begin(),idxs.end(),gen);
+  MatrixXf train(dim_,nTrain);
+  for(int i = 0; i < nTrain; i++)
+    train.col(i) = data.col(idxs[i]);
+
+  int nLists = std::max(1,std::min(opt.get<int>("nLists"),nTrain));
+  kmeans(train,nLists,nIterations,&gen,&coarseCentroids_);
+
+  for(int i = 0; i < nTrain; i++)
+  {
+    float sqDist;
+    int list = findClosestCentroid(coarseCentroids_,train.col(i).data(),&sqDist);
+    train.col(i) -= coarseCentroids_.col(list);
+  }
+  int nCentroids = std::min(nSubspaceCentroids,nTrain);
+  subspaceCentroids_.resize(nSubspaces_);
+  for(int iSub = 0; iSub < nSubspaces_; iSub++)
+  {
+    MatrixXf subTrain = train.middleRows(iSub*subDim_,subDim_);
+    kmeans(subTrain,nCentroids,nIterations,&gen,&subspaceCentroids_[iSub]);
+  }
+
+  // Encode everything.
+  vector<int> lists(size_);
+  vector<unsigned char> codes(size_t(size_)*nSubspaces_);
+#pragma omp parallel
+  {
+    VectorXf residual(dim_);
+#pragma omp for
+    for(int i = 0; i < size_; i++)
+    {
+      float sqDist;
+      lists[i] = findClosestCentroid(coarseCentroids_,data.col(i).data(),&sqDist);
+      residual = data.col(i) - coarseCentroids_.col(lists[i]);
+      for(int iSub = 0; iSub < nSubspaces_; iSub++)
+      {
+        codes[size_t(i)*nSubspaces_ + iSub] = static_cast<unsigned char>(
+          findClosestCentroid(subspaceCentroids_[iSub],&residual(iSub*subDim_),&sqDist));
+      }
+    }
+  }
+
+  listsIdxs_.resize(nLists);
+  listsCodes_.resize(nLists);
+  for(int i = 0; i < size_; i++)
+  {
+    listsIdxs_[lists[i]].push_back(i);
+    auto code = codes.begin() + size_t(i)*nSubspaces_;
+    listsCodes_[lists[i]].insert(listsCodes_[lists[i]].end(),code,code + nSubspaces_);
+  }
+}
+
+void PQIndex::knnSearch(const float *query,int k,int *indices,float *sqDists) const
+{
+  for(int i = 0; i < k; i++)
+  {
+    indices[i] = -1;
+    sqDists[i] = std::numeric_limits<float>::max();
+  }
+  if(size_ == 0)
+    return;
+
+  Map<const VectorXf> q(query,dim_);
+  int nLists = static_cast<int>(coarseCentroids_.cols());
+  vector<std::pair<float,int>> listsDists(nLists);
+  for(int list = 0; list < nLists; list++)
+    listsDists[list] = {(coarseCentroids_.col(list) - q).squaredNorm(),list};
+  int nProbes = std::min(std::max(1,nProbes_),nLists);
+  std::partial_sort(listsDists.begin(),listsDists.begin() + nProbes,listsDists.end());
+
+  VectorXf residual(dim_);
+  vector<float> table(size_t(nSubspaces_)*nSubspaceCentroids);
+  for(int iProbe = 0; iProbe < nProbes; iProbe++)
+  {
+    int list = listsDists[iProbe].second;
+    residual = q - coarseCentroids_.col(list);
+    computeDistanceTable(residual.data(),&table[0]);
+
+    const auto& idxs = listsIdxs_[list];
+    const unsigned char *code = listsCodes_[list].data();
+    for(size_t j = 0; j < idxs.size(); j++,code += nSubspaces_)
+    {
+      float sqDist = 0.f;
+      for(int iSub = 0; iSub < nSubspaces_; iSub++)
+        sqDist += table[iSub*nSubspaceCentroids + code[iSub]];
+      if(sqDist >= sqDists[k-1])
+        continue;
+      // Insertion into the sorted k best.
+      int pos = k-1;
+      while(pos > 0 && sqDists[pos-1] > sqDist)
+      {
+        sqDists[pos] = sqDists[pos-1];
+        indices[pos] = indices[pos-1];
+        pos--;
+      }
+      sqDists[pos] = sqDist;
+      indices[pos] = idxs[j];
+    }
+  }
+}
+
+void PQIndex::computeDistanceTable(const float *residual,float *table) const
+{
+  for(int iSub = 0; iSub < nSubspaces_; iSub++)
+  {
+    const auto& centroids = subspaceCentroids_[iSub];
+    Map<const VectorXf> r(residual + iSub*subDim_,subDim_);
+    float *subTable = table + iSub*nSubspaceCentroids;
+    for(int c = 0; c < centroids.cols(); c++)
+      subTable[c] = (centroids.col(c) - r).squaredNorm();
+  }
+}
+
+int PQIndex::size() const { return size_; }
+int PQIndex::dim() const { return dim_; }
+int PQIndex::nProbes() const { return nProbes_; }
+void PQIndex::setNProbes(int nProbes) { nProbes_ = nProbes; }
+
+void PQIndex::write(ostream& file) const
+{
+  int nLists = static_cast<int>(coarseCentroids_.cols());
+  int nCentroids = subspaceCentroids_.empty() ? 0 :
+    static_cast<int>(subspaceCentroids_[0].cols());
+  int header[] = {dim_,nSubspaces_,nProbes_,size_,nLists,nCentroids};
+  file.write(reinterpret_cast<const char *>(header),sizeof(header));
+  file.write(reinterpret_cast<const char *>(coarseCentroids_.data()),
+    sizeof(float)*coarseCentroids_.size());
+  for(const auto& centroids : subspaceCentroids_)
+  {
+    file.write(reinterpret_cast<const char *>(centroids.data()),
+      sizeof(float)*centroids.size());
+  }
+  for(int list = 0; list < nLists; list++)
+  {
+    int listSize = static_cast<int>(listsIdxs_[list].size());
+    file.write(reinterpret_cast<const char *>(&listSize),sizeof(int));
+    if(listSize == 0)
+      continue;
+    file.write(reinterpret_cast<const char *>(&listsIdxs_[list][0]),
+      sizeof(int)*listSize);
+    file.write(reinterpret_cast<const char *>(&listsCodes_[list][0]),
+      listsCodes_[list].size());
+  }
+}
+
+bool PQIndex::read(istream& file)
+{
+  int header[6];
+  file.read(reinterpret_cast<char *>(header),sizeof(header));
+  dim_ = header[0];
+  nSubspaces_ = header[1];
+  nProbes_ = header[2];
+  size_ = header[3];
+  int nLists = header[4];
+  int nCentroids = header[5];
+  if(!file || nSubspaces_ <= 0 || dim_ % nSubspaces_ != 0 ||
+    nCentroids > nSubspaceCentroids)
+  {
+    size_ = 0;
+    return false;
+  }
+  subDim_ = dim_ / nSubspaces_;
+
+  coarseCentroids_.resize(dim_,nLists);
+  file.read(reinterpret_cast<char *>(coarseCentroids_.data()),
+    sizeof(float)*coarseCentroids_.size());
+  subspaceCentroids_.resize(nSubspaces_);
+  for(auto& centroids : subspaceCentroids_)
+  {
+    centroids.resize(subDim_,nCentroids);
+    file.read(reinterpret_cast<char *>(centroids.data()),sizeof(float)*centroids.size());
+  }
+  listsIdxs_.resize(nLists);
+  listsCodes_.resize(nLists);
+  for(int list = 0; list < nLists; list++)
+  {
+    int listSize = 0;
+    file.read(reinterpret_cast<char *>(&listSize),sizeof(int));
+    listsIdxs_[list].resize(listSize);
+    listsCodes_[list].resize(size_t(listSize)*nSubspaces_);
+    if(listSize == 0)
+      continue;
+    file.read(reinterpret_cast<char *>(&listsIdxs_[list][0]),sizeof(int)*listSize);
+    file.read(reinterpret_cast<char *>(&listsCodes_[list][0]),
+      listsCodes_[list].size());
+  }
+
+  if(!file)
+  {
+    size_ = 0;
+    return false;
+  }
+  return true;
+}
+
+} // namespace yasfm
+
+namespace
+{
+
+int findClosestCentroid(const MatrixXf& centroids,const float *x,float *sqDist)
+{
+  Map<const VectorXf> xMapped(x,centroids.rows());
+  int best = 0;
+  *sqDist = std::numeric_limits<float>::max();
+  for(int c = 0; c < centroids.cols(); c++)
+  {
+    float d = (centroids.col(c) - xMapped).squaredNorm();
+    if(d < *sqDist)
+    {
+      *sqDist = d;
+      best = c;
+    }
+  }
+  return best;
+}
+
+void kmeans(const MatrixXf& data,int k,int nIterations,std::mt19937 *gen,
+  MatrixXf *pcentroids)
+{
+  auto& centroids = *pcentroids;
+  int n = static_cast<int>(data.cols());
+  vector<int> idxs(n);
+  std::iota(idxs.begin(),idxs.end(),0);
+  std::shuffle(idxs.begin(),idxs.end(),*gen);
+  centroids.resize(data.rows(),k);
+  for(int c = 0; c < k; c++)
+    centroids.col(c) = data.col(idxs[c]);
+
+  vector<int> assignment(n);
+  for(int iter = 0; iter < nIterations; iter++)
+  {
+#pragma omp parallel for
+    for(int i = 0; i < n; i++)
+    {
+      float sqDist;
+      assignment[i] = findClosestCentroid(centroids,data.col(i).data(),&sqDist);
+    }
+
+    vector<int> counts(k,0);
+    centroids.setZero();
+    for(int i = 0; i < n; i++)
+    {
+      centroids.col(assignment[i]) += data.col(i);
+      counts[assignment[i]]++;
+    }
+    std::uniform_int_distribution<int> randomIdx(0,n-1);
+    for(int c = 0; c < k; c++)
+    {
+      if(counts[c] > 0)
+        centroids.col(c) /= float(counts[c]);
+      else
+        centroids.col(c) = data.col(randomIdx(*gen)); // reseed empty cluster
+    }
+  }
+}
+
+} // namespace
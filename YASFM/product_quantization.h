@@ -0,0 +1,168 @@
+//----------------------------------------------------------------------------------------
+/**
+* \file       product_quantization.h
+* \brief      Compressed nearest neighbor search using product quantization.
+*
+*  Inverted file with product quantized residuals (IVFADC) for searching
+*  in millions of descriptors which do not fit in memory as floats.
+*
+*/
+//----------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <istream>
+#include <ostream>
+#include <random>
+#include <vector>
+
+#include "Eigen/Dense"
+
+#include "defines.h"
+#include "options_types.h"
+
+using Eigen::MatrixXf;
+using std::istream;
+using std::ostream;
+using std::vector;
+
+////////////////////////////////////////////////////
+///////////////   Declarations   ///////////////////
+////////////////////////////////////////////////////
+
+namespace yasfm
+{
+
+/// Options for product quantization.
+/**
+Fields:
+// Number of subvectors every vector is split into. Every subvector is encoded
+// by one byte. Has to divide the dimension of the vectors.
+int nSubspaces;
+// Number of coarse centroids (lists of the inverted file).
+int nLists;
+// Number of the closest lists which are searched for every query.
+int nProbes;
+// Maximum number of vectors used for training the quantizers.
+int maxTrainingSize;
+int kmeansIterations;
+*/
+class OptionsPQ : public OptionsWrapper
+{
+public:
+  /// Constructor setting defaults.
+  YASFM_API OptionsPQ()
+  {
+    opt.emplace("nSubspaces",make_unique<OptTypeWithVal<int>>(16));
+    opt.emplace("nLists",make_unique<OptTypeWithVal<int>>(1024));
+    opt.emplace("nProbes",make_unique<OptTypeWithVal<int>>(8));
+    opt.emplace("maxTrainingSize",make_unique<OptTypeWithVal<int>>(100000));
+    opt.emplace("kmeansIterations",make_unique<OptTypeWithVal<int>>(10));
+  }
+};
+
+/// Inverted file with product quantized residuals.
+/**
+Every vector is assigned to the closest coarse centroid and the residual is
+encoded by nSubspaces bytes, i.e. one centroid of 256 per subvector. Distances
+to queries are computed asymmetrically, i.e. the queries are not quantized and
+their distances to all the subspace centroids are precomputed into a table.
+Follows Jegou, Douze, Schmid: Product Quantization for Nearest Neighbor Search.
+Once built, the index is only read and can be shared by any number of threads.
+*/
+class PQIndex
+{
+public:
+  /// Number of centroids of one subspace (one byte).
+  static const int nSubspaceCentroids = 256;
+
+  /// Constructor. (empty)
+  YASFM_API PQIndex();
+
+  /// Train the quantizers and encode the vectors.
+  /**
+  \param[in] opt Options.
+  \param[in] data Vectors (one column is one vector).
+  */
+  YASFM_API void build(const OptionsPQ& opt,const MatrixXf& data);
+
+  /// Find approximate nearest neighbors of a query.
+  /**
+  \param[in] query Query vector.
+  \param[in] k Number of neighbors.
+  \param[out] indices Indices (columns of the data) of k neighbors ordered by
+  distances. -1 when there are fewer candidates.
+  \param[out] sqDists Approximate squared distances of the neighbors.
+  */
+  YASFM_API void knnSearch(const float *query,int k,int *indices,float *sqDists) const;
+
+  /// \return Number of encoded vectors.
+  YASFM_API int size() const;
+
+  /// \return Dimension of the vectors.
+  YASFM_API int dim() const;
+
+  /// \return Number of lists searched by every query.
+  YASFM_API int nProbes() const;
+
+  /// Set number of lists searched by every query.
+  /// \param[in] nProbes Number of lists.
+  YASFM_API void setNProbes(int nProbes);
+
+  /// Write in binary format.
+  /// \param[in,out] file Opened binary file.
+  YASFM_API void write(ostream& file) const;
+
+  /// Read as written by write().
+  /**
+  \param[in,out] file Opened binary file.
+  \return False if the file could not be read.
+  */
+  YASFM_API bool read(istream& file);
+
+private:
+  /// Compute squared distances of a residual to all the subspace centroids.
+  /**
+  \param[in] residual Residual of the query.
+  \param[out] table Squared distances. nSubspaceCentroids for every subspace.
+  */
+  void computeDistanceTable(const float *residual,float *table) const;
+
+  int dim_;
+  int nSubspaces_;
+  int subDim_;
+  int nProbes_;
+  int size_;
+  MatrixXf coarseCentroids_;             ///< One centroid per column.
+  vector<MatrixXf> subspaceCentroids_;   ///< One centroid per column.
+  vector<vector<int>> listsIdxs_;
+  /// nSubspaces_ bytes per vector of the list.
+  vector<vector<unsigned char>> listsCodes_;
+};
+
+} // namespace yasfm
+
+namespace
+{
+
+/// Find the closest centroid.
+/**
+\param[in] centroids Centroids (one column is one centroid).
+\param[in] x Vector.
+\param[out] sqDist Squared distance to the closest centroid.
+\return Index of the closest centroid.
+*/
+int findClosestCentroid(const MatrixXf& centroids,const float *x,float *sqDist);
+
+/// Cluster vectors using Lloyd's algorithm initialized by randomly chosen vectors.
+/**
+\param[in] data Vectors (one column is one vector).
+\param[in] k Number of clusters. Has to be at most the number of vectors.
+\param[in] nIterations Number of iterations.
+\param[in,out] gen Random generator.
+\param[out] centroids Centroids (one column is one centroid).
+*/
+void kmeans(const MatrixXf& data,int k,int nIterations,std::mt19937 *gen,
+  MatrixXf *centroids);
+
+} // namespace
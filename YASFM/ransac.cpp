@@ -6,12 +6,12 @@
 
 namespace yasfm
 {
-
-std::default_random_engine generator;
 
-void generateRandomIndices(int numToGenerate,int numOverall,vector<int> *pidxs)
+void generateRandomIndices(int numToGenerate,int numOverall,
+  std::default_random_engine *pgenerator,vector<int> *pidxs)
 {
   auto& idxs = *pidxs;
+  auto& generator = *pgenerator;
 
   if(idxs.size() < numToGenerate)
     idxs.resize(numToGenerate);
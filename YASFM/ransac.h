@@ -13,6 +13,7 @@
 
 #include <iostream>
 #include <ostream>
+#include <random>
 #include <vector>
 #include <memory>
 
@@ -51,6 +52,13 @@ double confidence;
 // optimization of non-linear function using LM method. 
 // (Not all ransac mediators implement refine phase.)
 double refineTolerance;
+
+/// Maximum number of rejected samples (see MediatorRANSAC::isPermittedSelection).
+int maxSampleSelectionSkips;
+
+/// Seed of the random generator. Every estimation starts from it so that the results
+/// do not depend on the order in which the estimations run (possibly in parallel).
+int seed;
 */
 class OptionsRANSAC : public OptionsWrapper
 {
@@ -64,6 +72,7 @@ public:
     opt.emplace("confidence",make_unique<OptTypeWithVal<double>>(0.95));
     opt.emplace("refineTolerance",make_unique<OptTypeWithVal<double>>(1e-12));
     opt.emplace("maxSampleSelectionSkips",make_unique<OptTypeWithVal<int>>(100000));
+    opt.emplace("seed",make_unique<OptTypeWithVal<int>>(0));
   }
 
   /// Constructor.
@@ -75,6 +84,7 @@ public:
     opt.emplace("confidence",make_unique<OptTypeWithVal<double>>(confidence));
     opt.emplace("refineTolerance",make_unique<OptTypeWithVal<double>>(1e-12));
     opt.emplace("maxSampleSelectionSkips",make_unique<OptTypeWithVal<int>>(100000));
+    opt.emplace("seed",make_unique<OptTypeWithVal<int>>(0));
   }
 
   // Shortcuts
@@ -85,6 +95,7 @@ public:
   YASFM_API double refineTolerance() const { return get<double>("refineTolerance"); }
   YASFM_API int maxSampleSelectionSkips() const
   { return get<int>("maxSampleSelectionSkips"); }
+  YASFM_API int seed() const { return get<int>("seed"); }
 };
 
 /// Base, interface like, class for access to data used in RANSAC like frameworks.
@@ -105,6 +116,25 @@ public:
   \param[out] Ms Resulting transformations.
   */
   virtual void computeTransformation(const vector<int>& idxs,vector<MatType> *Ms) const = 0;
+
+  /// \return Preferred number of samples passed to computeTransformations at once.
+  virtual int batchSize() const
+  { return 1; }
+
+  /// Compute transformations from a batch of minimal samples.
+  /**
+  The default implementation calls computeTransformation for every sample.
+
+  \param[in] samples Samples, i.e. indices of matches, one vector per sample.
+  \param[out] Ms Resulting transformations, one vector per sample.
+  */
+  virtual void computeTransformations(const vector<vector<int>>& samples,
+    vector<vector<MatType>> *Ms) const
+  {
+    Ms->resize(samples.size());
+    for(size_t i = 0; i < samples.size(); i++)
+      computeTransformation(samples[i],&(*Ms)[i]);
+  }
   
   /// Compute squared error for one match.
   /**
@@ -138,7 +168,7 @@ public:
 Run simple RANSAC, i.e.:
 for numRounds:
   generate random minimal sample
-  compute the transformation
+  compute the transformation (m.batchSize() samples at once)
   for every found transformation
     count support
     if better than the best so far
@@ -163,7 +193,7 @@ Run PROSAC (termination criterion is slighly different that in the original pape
 i.e.:
 for numRounds:
   generate random minimal sample (prefer first the matches earlier in the ordering)
-  compute the transformation
+  compute the transformation (m.batchSize() samples at once)
   for every found transformation
     count support
     if better than the best so far
@@ -204,9 +234,11 @@ Generate non-repeating numToGenerate integers in the interval [0,numOverall-1].
 
 \param[in] numToGenerate Number of indices to generate.
 \param[in] numOverall Total number of data.
+\param[in,out] generator Random generator.
 \param[out] idxs Generated indices.
 */
-void generateRandomIndices(int numToGenerate,int numOverall,vector<int> *idxs);
+void generateRandomIndices(int numToGenerate,int numOverall,
+  std::default_random_engine *generator,vector<int> *idxs);
 
 /// Determine sufficient number of rounds that must happen.
 /**
@@ -262,10 +294,38 @@ int estimateTransformRANSAC(const MediatorRANSAC<MatType>& m,const OptionsRANSAC
   int maxInliers = -1;
   vector<int> idxs;
   idxs.resize(minMatches);
+  int batchSize = std::max(1,m.batchSize());
+  vector<vector<int>> samples;
+  samples.reserve(batchSize);
+  vector<vector<MatType>> hypotheses;
+  std::default_random_engine generator(opt.seed());
+
+  // Compute hypotheses from the collected samples and keep the best one.
+  auto evaluateSamples = [&]()
+  {
+    m.computeTransformations(samples,&hypotheses);
+    samples.clear();
+    for(const auto& sampleHypotheses : hypotheses)
+    {
+      for(const auto& Mcurr : sampleHypotheses)
+      {
+        int nInliers = findInliers(m,Mcurr,sqThresh);
+        if(maxInliers < nInliers)
+        {
+          maxInliers = nInliers;
+          M = Mcurr;
+
+          ransacRounds = std::min(ransacRounds,
+            sufficientNumberOfRounds(maxInliers,nMatches,minMatches,confidence));
+        }
+      }
+    }
+  };
+
   int nSampleSelectionSkips = 0;
   for(int round = 0; round < (ransacRounds+nSampleSelectionSkips); round++)
   {
-    generateRandomIndices(minMatches,nMatches,&idxs);
+    generateRandomIndices(minMatches,nMatches,&generator,&idxs);
 
     if(!m.isPermittedSelection(idxs))
     {
@@ -276,22 +336,12 @@ int estimateTransformRANSAC(const MediatorRANSAC<MatType>& m,const OptionsRANSAC
         break;
     }
 
-    vector<MatType> hypotheses;
-    m.computeTransformation(idxs,&hypotheses);
-
-    for(const auto& Mcurr : hypotheses)
-    {
-      int nInliers = findInliers(m,Mcurr,sqThresh);
-      if(maxInliers < nInliers)
-      {
-        maxInliers = nInliers;
-        M = Mcurr;
-
-        ransacRounds = std::min(ransacRounds,
-          sufficientNumberOfRounds(maxInliers,nMatches,minMatches,confidence));
-      }
-    }
+    samples.push_back(idxs);
+    if(static_cast<int>(samples.size()) >= batchSize)
+      evaluateSamples();
   }
+  if(!samples.empty())
+    evaluateSamples();
 
   if(maxInliers >= opt.minInliers())
   {
@@ -344,6 +394,40 @@ int _commonEstimateTransformLOPROSAC(const MediatorRANSAC<MatType>& m,const Opti
   int nSamplesDrawn = 1;
   int nSampleSelectionSkips = 0;
   double avgSamplesDrawn = computeInitAvgSamplesDrawnPROSAC(ransacRounds,nMatches,minMatches);
+  int batchSize = std::max(1,m.batchSize());
+  vector<vector<int>> samples;
+  samples.reserve(batchSize);
+  vector<vector<MatType>> hypotheses;
+  std::default_random_engine generator(opt.seed());
+
+  // Compute hypotheses from the collected samples and keep the best one.
+  auto evaluateSamples = [&]()
+  {
+    m.computeTransformations(samples,&hypotheses);
+    samples.clear();
+    for(auto& sampleHypotheses : hypotheses)
+    {
+      for(auto& Mcurr : sampleHypotheses)
+      {
+        tentativeInliers.clear();
+        int nInliers = findInliers(m,Mcurr,sqThresh,&tentativeInliers);
+        if(maxInliers < nInliers)
+        {
+          if(DoLocalOpt)
+          {
+            m.refine(opt.refineTolerance(),tentativeInliers,&Mcurr);
+            nInliers = findInliers(m,Mcurr,sqThresh);
+          }
+
+          maxInliers = nInliers;
+          M = Mcurr;
+
+          ransacRounds = std::min(ransacRounds,
+            sufficientNumberOfRounds(maxInliers,nMatches,minMatches,confidence));
+        }
+      }
+    }
+  };
 
   for(int round = 0; round < (ransacRounds+nSampleSelectionSkips); round++)
   {
@@ -360,10 +444,10 @@ int _commonEstimateTransformLOPROSAC(const MediatorRANSAC<MatType>& m,const Opti
     // === generate random indices ===
     if(round > nSamplesDrawn)
     {
-      generateRandomIndices(minMatches,nMatches,&idxs);
+      generateRandomIndices(minMatches,nMatches,&generator,&idxs);
     } else
     {
-      generateRandomIndices(minMatches - 1,nUsedMatches - 1,&idxs);
+      generateRandomIndices(minMatches - 1,nUsedMatches - 1,&generator,&idxs);
       idxs[minMatches - 1] = nUsedMatches - 1;
       for(size_t i = 0; i < idxs.size(); i++)
       {
@@ -381,29 +465,12 @@ int _commonEstimateTransformLOPROSAC(const MediatorRANSAC<MatType>& m,const Opti
         break;
     }
 
-    vector<MatType> hypotheses;
-    m.computeTransformation(idxs,&hypotheses);
-
-    for(auto& Mcurr : hypotheses)
-    {
-      tentativeInliers.clear();
-      int nInliers = findInliers(m,Mcurr,sqThresh,&tentativeInliers);
-      if(maxInliers < nInliers)
-      {
-        if(DoLocalOpt)
-        {
-          m.refine(opt.refineTolerance(),tentativeInliers,&Mcurr);
-          nInliers = findInliers(m,Mcurr,sqThresh);
-        }
-
-        maxInliers = nInliers;
-        M = Mcurr;
-
-        ransacRounds = std::min(ransacRounds,
-          sufficientNumberOfRounds(maxInliers,nMatches,minMatches,confidence));
-      }
-    }
+    samples.push_back(idxs);
+    if(static_cast<int>(samples.size()) >= batchSize)
+      evaluateSamples();
   }
+  if(!samples.empty())
+    evaluateSamples();
 
   if(maxInliers >= opt.minInliers())
   {
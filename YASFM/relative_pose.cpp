@@ -1,12 +1,15 @@
 #include "relative_pose.h"
 
+#include <algorithm>
 #include <ctime>
 #include <iostream>
 #include <list>
 
-#include "5point/5point.h"
+#include "batched_qr.h"
 #include "ceres/ceres.h"
 
+#include "five_point.h"
+#include "logging.h"
 #include "points.h"
 
 using Eigen::JacobiSVD;
@@ -61,24 +64,8 @@ IntPair chooseInitialCameraPair(int minMatches,double minScore,
   const vector<bool>& isCalibrated,const uset<int>& camsToIgnore,
   const vector<NViewMatch>& nViewMatches,const ArrayXXd& scores)
 {
-  size_t nCams = isCalibrated.size();
-  ArrayXXi numMatches(ArrayXXi::Zero(nCams,nCams));
-
-  for(const auto& nViewMatch : nViewMatches)
-  {
-    for(auto camKey1 = nViewMatch.begin(); camKey1 != nViewMatch.end(); ++camKey1)
-    {
-      int cam1 = camKey1->first;
-      auto camKey2(camKey1);
-      ++camKey2;
-      for(; camKey2 != nViewMatch.end(); ++camKey2)
-      {
-        int cam2 = camKey2->first;
-        numMatches(cam1,cam2)++;
-        numMatches(cam2,cam1)++;
-      }
-    }
-  }
+  ArrayXXi numMatches;
+  countPairsMatches(static_cast<int>(isCalibrated.size()),nViewMatches,&numMatches);
   return chooseInitialCameraPair(minMatches,minScore,isCalibrated,camsToIgnore,
     numMatches,scores);
 }
@@ -142,6 +129,108 @@ IntPair chooseInitialCameraPair(int minMatches,double minScore,
     return IntPair(-1,-1);
 }
 
+HomographyProportions::HomographyProportions(const OptionsRANSAC& opt,
+  const ptr_vector<Camera>& cams,const vector<NViewMatch>& nViewMatches)
+  : opt_(opt),cams_(cams),nViewMatches_(nViewMatches)
+{
+  countPairsMatches(static_cast<int>(cams.size()),nViewMatches,&numMatches_);
+}
+
+const ArrayXXi& HomographyProportions::numMatches() const
+{
+  return numMatches_;
+}
+
+void HomographyProportions::compute(const vector<IntPair>& pairs)
+{
+  vector<IntPair> toCompute;
+  pair_umap<int> toComputeIdx;
+  for(const auto& pair : pairs)
+  {
+    IntPair key(std::min(pair.first,pair.second),std::max(pair.first,pair.second));
+    if(proportions_.count(key) == 0 && toComputeIdx.count(key) == 0)
+    {
+      toComputeIdx[key] = static_cast<int>(toCompute.size());
+      toCompute.push_back(key);
+    }
+  }
+  if(toCompute.empty())
+    return;
+
+  // Gather matches of all the pairs in one pass over the n-view matches.
+  vector<vector<IntPair>> matches(toCompute.size());
+  for(const auto& nViewMatch : nViewMatches_)
+  {
+    for(auto camKey1 = nViewMatch.begin(); camKey1 != nViewMatch.end(); ++camKey1)
+    {
+      auto camKey2(camKey1);
+      ++camKey2;
+      for(; camKey2 != nViewMatch.end(); ++camKey2)
+      {
+        bool swapped = camKey1->first > camKey2->first;
+        const auto& first = swapped ? *camKey2 : *camKey1;
+        const auto& second = swapped ? *camKey1 : *camKey2;
+        auto it = toComputeIdx.find(IntPair(first.first,second.first));
+        if(it != toComputeIdx.end())
+          matches[it->second].emplace_back(first.second,second.second);
+      }
+    }
+  }
+
+  int nToCompute = static_cast<int>(toCompute.size());
+  vector<double> proportions(nToCompute,1.);
+#pragma omp parallel for schedule(dynamic)
+  for(int i = 0; i < nToCompute; i++)
+  {
+    if(matches[i].empty())
+      continue;
+    Matrix3d H;
+    vector<int> inliers;
+    bool success = estimateHomographyRANSAC(opt_,cams_[toCompute[i].first]->keys(),
+      cams_[toCompute[i].second]->keys(),matches[i],&H,&inliers);
+    if(success)
+      proportions[i] = static_cast<double>(inliers.size()) / matches[i].size();
+  }
+  for(int i = 0; i < nToCompute; i++)
+    proportions_[toCompute[i]] = proportions[i];
+}
+
+double HomographyProportions::proportion(const IntPair& pair) const
+{
+  IntPair key(std::min(pair.first,pair.second),std::max(pair.first,pair.second));
+  return proportions_.at(key);
+}
+
+int HomographyProportions::numComputed() const
+{
+  return static_cast<int>(proportions_.size());
+}
+
+IntPair chooseInitialCameraPair(int minMatches,double maxProportion,
+  int maxCandidates,const vector<bool>& isCalibrated,const uset<int>& camsToIgnore,
+  HomographyProportions *proportions)
+{
+  int nCams = static_cast<int>(isCalibrated.size());
+  uset<int> camsToUse;
+  for(int i = 0; i < nCams; i++)
+    if(isCalibrated[i] && camsToIgnore.count(i) == 0)
+      camsToUse.insert(i);
+
+  IntPair best = ::chooseInitialCameraPair(minMatches,maxProportion,maxCandidates,
+    camsToUse,proportions);
+
+  if(best.first == -1 || best.second == -1)
+  {
+    for(int i = 0; i < nCams; i++)
+      if(!isCalibrated[i] && camsToIgnore.count(i) == 0)
+        camsToUse.insert(i);
+
+    best = ::chooseInitialCameraPair(minMatches,maxProportion,maxCandidates,
+      camsToUse,proportions);
+  }
+  return best;
+}
+
 void initReconstructionFromCamPair(const OptionsRANSAC& solverOpt,
   double pointsReprojErrorThresh,const IntPair& initPair,Dataset *data)
 {
@@ -369,12 +458,9 @@ void verifyMatchesEpipolar(const OptionsRANSAC& solverOpt,
     auto &pair = it->second;
     const auto& cam1 = *cams[camsIdx.first];
     const auto& cam2 = *cams[camsIdx.second];
+    int nMatches = static_cast<int>(pair.matches.size());
     if(verbose)
-    {
-      cout << "verifying: " << camsIdx.first << " -> " << camsIdx.second << "\t";
-      cout << pair.matches.size();
       start = clock();
-    }
 
     bool success;
     Matrix3d F;
@@ -415,10 +501,14 @@ void verifyMatchesEpipolar(const OptionsRANSAC& solverOpt,
     if(verbose)
     {
       end = clock();
-      cout << "->" << nInliers << " matches" << "\t";
-      cout << "took: " << (double)(end - start) / (double)CLOCKS_PER_SEC << "s\n";
+      YASFM_LOG_TAGGED(LogLevelVerbose,"verified matches",nInliers,
+        "verifying: " << camsIdx.first << " -> " << camsIdx.second << "\t"
+        << nMatches << "->" << nInliers << " matches" << "\t"
+        << "took: " << (double)(end - start) / (double)CLOCKS_PER_SEC << "s");
     }
   }
+  if(verbose)
+    logger().flush();
 }
 
 bool estimateRelativePose7ptPROSAC(const OptionsRANSAC& opt,
@@ -427,7 +517,7 @@ bool estimateRelativePose7ptPROSAC(const OptionsRANSAC& opt,
 {
   Mediator7ptRANSAC m(keys1,keys2,pair.matches);
   vector<int> matchesOrder;
-  yasfm::quicksort(pair.dists,&matchesOrder);
+  findMatchesOrderByDists(pair,&matchesOrder);
   int nInliers = estimateTransformPROSAC(m,opt,matchesOrder,F,inliers);
   return (nInliers > 0);
 }
@@ -478,6 +568,80 @@ void estimateRelativePose7pt(const vector<Vector2d>& keys1,const vector<Vector2d
   VectorXd f1 = svd.matrixV().col(7);
   VectorXd f2 = svd.matrixV().col(8);
 
+  fundamentalMatricesFrom7ptNullspace(f1,f2,pFs);
+}
+
+void estimateRelativePose7ptBatch(const vector<Vector2d>& keys1,
+  const vector<Vector2d>& keys2,const vector<IntPair>& matches,
+  const vector<vector<int>>& samples,vector<vector<Matrix3d>> *pFs)
+{
+  const int minPts = 7;
+  auto& Fs = *pFs;
+  int nSamples = static_cast<int>(samples.size());
+  for(const auto& sample : samples)
+  {
+    if(sample.size() < minPts)
+    {
+      YASFM_PRINT_ERROR("Cannot estimate transformation (too few points). "
+        << sample.size() << " given but " << minPts << " needed.");
+      Fs.clear();
+      return;
+    }
+  }
+  Fs.resize(nSamples);
+
+  // The equations are stored transposed, so that the last two columns
+  // of Q from QR decomposition span the nullspace.
+  BatchedMatrix<9,minPts,batchLanes> At;
+  BatchedHouseholderQR<9,minPts,batchLanes> qr;
+  BatchedMatrix<9,1,batchLanes> f1Batch,f2Batch;
+  VectorXd f1(9),f2(9);
+  for(int first = 0; first < nSamples; first += batchLanes)
+  {
+    for(int l = 0; l < batchLanes; l++)
+    {
+      // The last batch is padded by repeating the last sample.
+      const auto& sample = samples[std::min(first + l,nSamples - 1)];
+      for(int i = 0; i < minPts; i++)
+      {
+        const auto& pt1 = keys1[matches[sample[i]].first];
+        const auto& pt2 = keys2[matches[sample[i]].second];
+        At(0,i,l) = pt1(0) * pt2(0);
+        At(1,i,l) = pt1(0) * pt2(1);
+        At(2,i,l) = pt1(0);
+        At(3,i,l) = pt1(1) * pt2(0);
+        At(4,i,l) = pt1(1) * pt2(1);
+        At(5,i,l) = pt1(1);
+        At(6,i,l) = pt2(0);
+        At(7,i,l) = pt2(1);
+        At(8,i,l) = 1.;
+      }
+    }
+
+    qr.compute(At);
+    qr.columnOfQ(7,&f1Batch);
+    qr.columnOfQ(8,&f2Batch);
+
+    for(int l = 0; l < batchLanes && first + l < nSamples; l++)
+    {
+      for(int i = 0; i < 9; i++)
+      {
+        f1(i) = f1Batch(i,0,l);
+        f2(i) = f2Batch(i,0,l);
+      }
+      fundamentalMatricesFrom7ptNullspace(f1,f2,&Fs[first + l]);
+    }
+  }
+}
+
+} // namespace yasfm
+
+namespace
+{
+
+void fundamentalMatricesFrom7ptNullspace(const VectorXd& f1,const VectorXd& f2,
+  vector<Matrix3d> *pFs)
+{
   // The solutions space corresponds to lambda*f1 + mu*f2.
   // Since F is determined up to a scale, we can normalize these:
   // lambda + mu = 1. Hence lambda*f1 + (1-lambda)*f2 generates the 
@@ -523,14 +687,17 @@ void estimateRelativePose7pt(const vector<Vector2d>& keys1,const vector<Vector2d
   }
 }
 
+} // namespace
+
+namespace yasfm
+{
+
 bool estimateRelativePose5ptRANSAC(const OptionsRANSAC& opt,
   const Camera& cam1,const Camera& cam2,const vector<IntPair>& matches,
   Matrix3d *E,vector<int> *inliers)
 {
-  Matrix3d F;
   Mediator5ptRANSAC m(cam1,cam2,matches);
-  int nInliers = estimateTransformRANSAC(m,opt,&F,inliers);
-  *E = cam2.K().transpose() * F * cam1.K();
+  int nInliers = estimateTransformRANSAC(m,opt,E,inliers);
   return (nInliers > 0);
 }
 
@@ -539,12 +706,10 @@ bool estimateRelativePose5ptPROSAC(const OptionsRANSAC& opt,
   const Camera& cam1,const Camera& cam2,const CameraPair& pair,Matrix3d *E,
   vector<int> *inliers)
 {
-  Matrix3d F;
   Mediator5ptRANSAC m(cam1,cam2,pair.matches);
   vector<int> matchesOrder;
-  yasfm::quicksort(pair.dists,&matchesOrder);
-  int nInliers = estimateTransformPROSAC(m,opt,matchesOrder,&F,inliers);
-  *E = cam2.K().transpose() * F * cam1.K();
+  findMatchesOrderByDists(pair,&matchesOrder);
+  int nInliers = estimateTransformPROSAC(m,opt,matchesOrder,E,inliers);
   return (nInliers > 0);
 }
 
@@ -560,28 +725,16 @@ void estimateRelativePose5pt(const vector<Vector3d>& pts1Norm,
     pEs->clear();
     return;
   }
-  auto& Es = *pEs;
-  double matchedPts1[minPts][3],matchedPts2[minPts][3];
-  for(size_t i = 0; i < minPts; i++)
-  {
-    memcpy(matchedPts1[i],pts1Norm[matches[i].first].data(),3 * sizeof(double));
-    memcpy(matchedPts2[i],pts2Norm[matches[i].second].data(),3 * sizeof(double));
-  }
-  
-  fivepoint::Ematrix EsRaw[fivepoint::Maxsolutions];
-  int nRoots;
-  bool optimized = true;
-  fivepoint::compute_E_matrices(matchedPts1,matchedPts2,EsRaw,nRoots,optimized);
-  
-  Es.resize(nRoots);
-  for(int i = 0; i < nRoots; i++)
+  Vector3d matchedPts1[minPts],matchedPts2[minPts];
+  for(int i = 0; i < minPts; i++)
   {
-    // Es are column major. Hence we put rows in columns and then transpose.
-    memcpy(Es[i].col(0).data(),&(EsRaw[i][0]),3 * sizeof(double));
-    memcpy(Es[i].col(1).data(),&(EsRaw[i][1]),3 * sizeof(double));
-    memcpy(Es[i].col(2).data(),&(EsRaw[i][2]),3 * sizeof(double));
-    Es[i].transposeInPlace();
+    matchedPts1[i] = pts1Norm[matches[i].first];
+    matchedPts2[i] = pts2Norm[matches[i].second];
   }
+
+  Matrix3d Es[maxNumSolutions5pt];
+  int nSolutions = solveRelativePose5pt(matchedPts1,matchedPts2,Es);
+  pEs->assign(Es,Es + nSolutions);
 }
 
 void estimateFundamentalMatrix(const vector<Vector2d>& pts1,
@@ -605,14 +758,15 @@ void estimateFundamentalMatrix(const vector<Vector2d>& pts1,
   matchedPointsCenteringMatrix<true>(pts1,matches,matchesToUse,&C1);
   matchedPointsCenteringMatrix<false>(pts2,matches,matchesToUse,&C2);
 
-  MatrixXd A(nUseful,8);
-  VectorXd b(nUseful);
+  // Normal matrix of the rows [a b], where a*f = b and f(8) = 1.
+  Matrix<double,9,9> N(Matrix<double,9,9>::Zero());
+  Matrix<double,9,1> row;
   for(int i = 0; i < nUseful; i++)
   {
     Vector3d pt1 = C1 * pts1[matches[matchesToUse[i]].first].homogeneous();
     Vector3d pt2 = C2 * pts2[matches[matchesToUse[i]].second].homogeneous();
 
-    A.row(i) <<
+    row <<
       pt1(0) * pt2(0),
       pt1(0) * pt2(1),
       pt1(0) * pt2(2),
@@ -620,12 +774,12 @@ void estimateFundamentalMatrix(const vector<Vector2d>& pts1,
       pt1(1) * pt2(1),
       pt1(1) * pt2(2),
       pt1(2) * pt2(0),
-      pt1(2) * pt2(1);
-
-    b(i) = -(pt1(2)*pt2(2));
+      pt1(2) * pt2(1),
+      pt1(2) * pt2(2);
+    N.noalias() += row * row.transpose();
   }
 
-  VectorXd f = A.jacobiSvd(Eigen::ComputeThinU | Eigen::ComputeThinV).solve(b);
+  Matrix<double,8,1> f = N.topLeftCorner<8,8>().ldlt().solve(-N.topRightCorner<8,1>());
 
   // Not rank 2 yet.
   Matrix3d F_;
@@ -896,7 +1050,7 @@ bool estimateHomographyPROSAC(const OptionsRANSAC& opt,const vector<Vector2d>& p
 {
   MediatorHomographyRANSAC m(pts1,pts2,pair.matches);
   vector<int> matchesOrder;
-  yasfm::quicksort(pair.dists,&matchesOrder);
+  findMatchesOrderByDists(pair,&matchesOrder);
   int nInliers = estimateTransformPROSAC(m,opt,matchesOrder,H,inliers);
   return (nInliers > 0);
 }
@@ -916,12 +1070,9 @@ void verifyMatchesGeometrically(const OptionsGeometricVerification& opt,
     IntPair camsIdx = it->first;
     auto &pair = it->second;
 
+    int nMatches = static_cast<int>(pair.matches.size());
     if(verbose)
-    {
-      cout << "verifying: " << camsIdx.first << " -> " << camsIdx.second << "\t";
-      cout << pair.matches.size();
       start = clock();
-    }
 
     vector<int> inliers;
     int nInliers = verifyMatchesGeometrically(opt,
@@ -939,6 +1090,7 @@ void verifyMatchesGeometrically(const OptionsGeometricVerification& opt,
       }
       pair.matches = newMatches;
       pair.dists = newDists;
+      sortMatchesByDists(&pair);
       ++it;
     } else
     {
@@ -948,10 +1100,14 @@ void verifyMatchesGeometrically(const OptionsGeometricVerification& opt,
     if(verbose)
     {
       end = clock();
-      cout << "->" << inliers.size() << " matches" << "\t";
-      cout << "took: " << (double)(end - start) / (double)CLOCKS_PER_SEC << "s\n";
+      YASFM_LOG_TAGGED(LogLevelVerbose,"verified matches",double(inliers.size()),
+        "verifying: " << camsIdx.first << " -> " << camsIdx.second << "\t"
+        << nMatches << "->" << inliers.size() << " matches" << "\t"
+        << "took: " << (double)(end - start) / (double)CLOCKS_PER_SEC << "s");
     }
   }
+  if(verbose)
+    logger().flush();
 }
 
 void estimateFundamentalMatrixParallax(const vector<Vector2d>& keys1,
@@ -1030,7 +1186,7 @@ void growHomographies(const OptionsGeometricVerification& opt,
 {
   vector<IntPair> allMatches(camPair.matches.size());
   vector<int> orderedToInputOrder;
-  yasfm::quicksort(camPair.dists,&orderedToInputOrder);
+  findMatchesOrderByDists(camPair,&orderedToInputOrder);
   for(size_t i = 0; i < allMatches.size(); i++)
     allMatches[i] = camPair.matches[orderedToInputOrder[i]];
 
@@ -1171,7 +1327,7 @@ bool estimateRelativePose7ptKnownHsLOPROSAC(const OptionsRANSAC& opt,
 {
   Mediator7ptKnownHsRANSAC m(keys1,keys2,pair.matches,nGroups,groupId);
   vector<int> matchesOrder;
-  yasfm::quicksort(pair.dists,&matchesOrder);
+  findMatchesOrderByDists(pair,&matchesOrder);
   int nInliers = estimateTransformLOPROSAC(m,opt,matchesOrder,F,inliers);
   return (nInliers > 0);
 }
@@ -1672,23 +1828,27 @@ void estimateAffinity(const vector<Vector2d>& keys1,
 {
   auto& A = *pA;
   int nUseful = static_cast<int>(matchesToUse.size());
-  MatrixXd M(MatrixXd::Zero(2*nUseful,6));
-  VectorXd b(2*nUseful);
+
+  Matrix3d C1,C2;
+  matchedPointsCenteringMatrix<true>(keys1,matches,matchesToUse,&C1);
+  matchedPointsCenteringMatrix<false>(keys2,matches,matchesToUse,&C2);
+
+  // Both rows of the affinity share the normal matrix.
+  Matrix3d M(Matrix3d::Zero());
+  Matrix<double,3,2> b(Matrix<double,3,2>::Zero());
   for(int i = 0; i < nUseful; i++)
   {
-    const auto& key1 = keys1[matches[matchesToUse[i]].first];
-    const auto& key2 = keys2[matches[matchesToUse[i]].second];
-    M.block(i,0,1,3) = key1.homogeneous().transpose();
-    M.block(i+nUseful,3,1,3) = key1.homogeneous().transpose();
-    b(i) = key2(0);
-    b(i+nUseful) = key2(1);
+    Vector3d pt1 = C1 * keys1[matches[matchesToUse[i]].first].homogeneous();
+    Vector3d pt2 = C2 * keys2[matches[matchesToUse[i]].second].homogeneous();
+    M.noalias() += pt1 * pt1.transpose();
+    b.noalias() += pt1 * pt2.topRows(2).transpose();
   }
-  VectorXd a = M.jacobiSvd(Eigen::ComputeThinU | Eigen::ComputeThinV).solve(b);
-  A.row(0) = a.topRows(3).transpose();
-  A.row(1) = a.bottomRows(3).transpose();
-  A(2,0) = 0.;
-  A(2,1) = 0.;
-  A(2,2) = 1.;
+  Matrix<double,3,2> a = M.ldlt().solve(b);
+  Matrix3d A0;
+  A0.topRows(2) = a.transpose();
+  A0.row(2) << 0.,0.,1.;
+
+  A = C2.inverse() * A0 * C1;
 }
 
 void estimateHomography(const vector<Vector2d>& pts1,
@@ -1702,20 +1862,34 @@ void estimateHomography(const vector<Vector2d>& pts1,
   matchedPointsCenteringMatrix<true>(pts1,matches,matchesToUse,&C1);
   matchedPointsCenteringMatrix<false>(pts2,matches,matchesToUse,&C2);
 
-  MatrixXd A(MatrixXd::Zero(2*nUseful,9));
+  // The rows of the system are [pt1' 0 -x2*pt1'] and [0 pt1' -y2*pt1'],
+  // so the normal matrix consists of these sums of pt1*pt1'.
+  Matrix3d sumPP(Matrix3d::Zero()),sumXPP(Matrix3d::Zero()),
+    sumYPP(Matrix3d::Zero()),sumRPP(Matrix3d::Zero());
   for(int i = 0; i < nUseful; i++)
   {
     Vector3d pt1 = C1 * pts1[matches[matchesToUse[i]].first].homogeneous();
     Vector3d pt2 = C2 * pts2[matches[matchesToUse[i]].second].homogeneous();
 
-    A.block(i,0,1,3) = pt1.transpose();
-    A.block(i,6,1,3) = -pt2(0) * pt1.transpose();
-    A.block(i+nUseful,3,1,3) = pt1.transpose();
-    A.block(i+nUseful,6,1,3) = -pt2(1) * pt1.transpose();
+    Matrix3d PP = pt1 * pt1.transpose();
+    sumPP += PP;
+    sumXPP += pt2(0) * PP;
+    sumYPP += pt2(1) * PP;
+    sumRPP += pt2.topRows(2).squaredNorm() * PP;
   }
 
-  JacobiSVD<MatrixXd> svd(A,Eigen::ComputeThinU | Eigen::ComputeFullV);
-  VectorXd h = svd.matrixV().rightCols(1);
+  Matrix<double,9,9> N(Matrix<double,9,9>::Zero());
+  N.block<3,3>(0,0) = sumPP;
+  N.block<3,3>(3,3) = sumPP;
+  N.block<3,3>(6,6) = sumRPP;
+  N.block<3,3>(0,6) = -sumXPP;
+  N.block<3,3>(6,0) = -sumXPP;
+  N.block<3,3>(3,6) = -sumYPP;
+  N.block<3,3>(6,3) = -sumYPP;
+
+  // Eigenvalues are sorted in increasing order.
+  Eigen::SelfAdjointEigenSolver<Matrix<double,9,9>> eig(N);
+  Matrix<double,9,1> h = eig.eigenvectors().col(0);
   Matrix3d H0;
   H0.row(0) = h.topRows(3).transpose();
   H0.row(1) = h.middleRows(3,3).transpose();
@@ -1724,6 +1898,70 @@ void estimateHomography(const vector<Vector2d>& pts1,
   H = C2.inverse() * H0 * C1;
 }
 
+void estimateHomographyBatch(const vector<Vector2d>& pts1,
+  const vector<Vector2d>& pts2,const vector<IntPair>& matches,
+  const vector<vector<int>>& samples,vector<Matrix3d> *pHs)
+{
+  const int minPts = 4;
+  auto& Hs = *pHs;
+  int nSamples = static_cast<int>(samples.size());
+  Hs.resize(nSamples);
+
+  vector<int> minimalSamples;
+  minimalSamples.reserve(nSamples);
+  for(int i = 0; i < nSamples; i++)
+  {
+    if(samples[i].size() == minPts)
+      minimalSamples.push_back(i);
+    else
+      estimateHomography(pts1,pts2,matches,samples[i],&Hs[i]);
+  }
+  int nMinimal = static_cast<int>(minimalSamples.size());
+
+  // The equations are stored transposed, so that the last column
+  // of Q from QR decomposition spans the nullspace.
+  BatchedMatrix<9,2*minPts,batchLanes> At;
+  BatchedHouseholderQR<9,2*minPts,batchLanes> qr;
+  BatchedMatrix<9,1,batchLanes> h;
+  Matrix3d C1[batchLanes],C2[batchLanes];
+  for(int first = 0; first < nMinimal; first += batchLanes)
+  {
+    for(int l = 0; l < batchLanes; l++)
+    {
+      // The last batch is padded by repeating the last sample.
+      const auto& sample = samples[minimalSamples[std::min(first + l,nMinimal - 1)]];
+      matchedPointsCenteringMatrix<true>(pts1,matches,sample,&C1[l]);
+      matchedPointsCenteringMatrix<false>(pts2,matches,sample,&C2[l]);
+      for(int i = 0; i < minPts; i++)
+      {
+        Vector3d pt1 = C1[l] * pts1[matches[sample[i]].first].homogeneous();
+        Vector3d pt2 = C2[l] * pts2[matches[sample[i]].second].homogeneous();
+        for(int j = 0; j < 3; j++)
+        {
+          At(j,i,l) = pt1(j);
+          At(3 + j,i,l) = 0.;
+          At(6 + j,i,l) = -pt2(0) * pt1(j);
+          At(j,i + minPts,l) = 0.;
+          At(3 + j,i + minPts,l) = pt1(j);
+          At(6 + j,i + minPts,l) = -pt2(1) * pt1(j);
+        }
+      }
+    }
+
+    qr.compute(At);
+    qr.columnOfQ(8,&h);
+
+    for(int l = 0; l < batchLanes && first + l < nMinimal; l++)
+    {
+      Matrix3d H0;
+      for(int r = 0; r < 3; r++)
+        for(int c = 0; c < 3; c++)
+          H0(r,c) = h(3*r + c,0,l);
+      Hs[minimalSamples[first + l]] = C2[l].inverse() * H0 * C1[l];
+    }
+  }
+}
+
 int findHomographyInliers(double thresh,const vector<Vector2d>& pts1,
   const vector<Vector2d>& pts2,const vector<IntPair>& matches,const Matrix3d& H,
   vector<int> *pinliers)
@@ -1767,6 +2005,15 @@ void Mediator7ptRANSAC::computeTransformation(const vector<int>& idxs,vector<Mat
   estimateRelativePose7pt(keys1_,keys2_,selectedMatches,Fs);
 }
 
+int Mediator7ptRANSAC::batchSize() const
+{ return 2*batchLanes; }
+
+void Mediator7ptRANSAC::computeTransformations(const vector<vector<int>>& samples,
+  vector<vector<Matrix3d>> *Fs) const
+{
+  estimateRelativePose7ptBatch(keys1_,keys2_,matches_,samples,Fs);
+}
+
 double Mediator7ptRANSAC::computeSquaredError(const Matrix3d& F,int matchIdx) const
 {
   IntPair match = matches_[matchIdx];
@@ -1788,6 +2035,8 @@ Mediator5ptRANSAC::Mediator5ptRANSAC(const Camera& cam1,const Camera& cam2,
 {
   invK1_ = cam1_.K().inverse();
   invK2_ = cam2_.K().inverse();
+  invK1TTop_ = invK1_.transpose().topRows(2);
+  invK2TTop_ = invK2_.transpose().topRows(2);
 
   pts1Norm_.resize(cam1_.keys().size());
   pts2Norm_.resize(cam2_.keys().size());
@@ -1798,28 +2047,33 @@ Mediator5ptRANSAC::Mediator5ptRANSAC(const Camera& cam1,const Camera& cam2,
   }
 }
 
-void Mediator5ptRANSAC::computeTransformation(const vector<int>& idxs,vector<Matrix3d> *pFs) const
+void Mediator5ptRANSAC::computeTransformation(const vector<int>& idxs,vector<Matrix3d> *Es) const
 {
-  auto& Fs = *pFs;
-  vector<IntPair> selectedMatches;
-  selectedMatches.reserve(minMatches_);
-  for(int idx : idxs)
-    selectedMatches.push_back(matches_[idx]);
-  // Compute Es.
-  estimateRelativePose5pt(pts1Norm_,pts2Norm_,selectedMatches,&Fs);
-  // Go from Es to Fs.
-  for(size_t i = 0; i < Fs.size(); i++)
+  Vector3d pts1[5],pts2[5];
+  for(int i = 0; i < minMatches_; i++)
   {
-    Fs[i] = invK2_.transpose() * Fs[i] * invK1_;
+    pts1[i] = pts1Norm_[matches_[idxs[i]].first];
+    pts2[i] = pts2Norm_[matches_[idxs[i]].second];
   }
+  Matrix3d EsRaw[maxNumSolutions5pt];
+  int nSolutions = solveRelativePose5pt(pts1,pts2,EsRaw);
+  Es->assign(EsRaw,EsRaw + nSolutions);
 }
 
-double Mediator5ptRANSAC::computeSquaredError(const Matrix3d& F,int matchIdx) const
+double Mediator5ptRANSAC::computeSquaredError(const Matrix3d& E,int matchIdx) const
 {
-  return computeFundMatSampsonDistSquared(
-    cam2_.key(matches_[matchIdx].second),
-    F,
-    cam1_.key(matches_[matchIdx].first));
+  // Same as computeFundMatSampsonDistSquared with F = inv(K2)'*E*inv(K1),
+  // since F*pt1 = inv(K2)'*E*pt1Norm and pt2'*F*pt1 = pt2Norm'*E*pt1Norm.
+  const auto& pt1 = pts1Norm_[matches_[matchIdx].first];
+  const auto& pt2 = pts2Norm_[matches_[matchIdx].second];
+  Vector3d Ept1 = E*pt1;
+  Vector3d ETpt2 = E.transpose()*pt2;
+  double pt2Ept1 = pt2.dot(Ept1);
+  double sqNorm = (invK2TTop_*Ept1).squaredNorm() + (invK1TTop_*ETpt2).squaredNorm();
+  if(sqNorm == 0.)
+    return (pt2Ept1*pt2Ept1) * 1e100;
+  else
+    return (pt2Ept1*pt2Ept1) / sqNorm;
 }
 
 int Mediator5ptRANSAC::numMatches() const
@@ -1829,13 +2083,11 @@ int Mediator5ptRANSAC::minMatches() const
 { return minMatches_; }
 
 void Mediator5ptRANSAC::refine(double tolerance,const vector<int>& inliers,
-  Matrix3d *F) const
+  Matrix3d *E) const
 {
-  Matrix3d E = cam2_.K().transpose() * (*F) * cam1_.K();
   refineEssentialMatrixNonLinear(cam1_.keys(),cam2_.keys(),
     invK1_,invK2_,matches_,inliers,
-    tolerance,&E);
-  F->noalias() = invK2_.transpose() * E * invK1_;
+    tolerance,E);
 }
 
 MediatorHomographyRANSAC::MediatorHomographyRANSAC(const vector<Vector2d>& keys1,
@@ -1861,6 +2113,22 @@ void MediatorHomographyRANSAC::computeTransformation(const vector<int>& idxs,
   estimateHomography(keys1_,keys2_,matches_,idxs,&(*Hs)[0]);
 }
 
+int MediatorHomographyRANSAC::batchSize() const
+{
+  return 2*batchLanes;
+}
+
+void MediatorHomographyRANSAC::computeTransformations(const vector<vector<int>>& samples,
+  vector<vector<Matrix3d>> *pHs) const
+{
+  auto& Hs = *pHs;
+  vector<Matrix3d> HsFlat;
+  estimateHomographyBatch(keys1_,keys2_,matches_,samples,&HsFlat);
+  Hs.resize(HsFlat.size());
+  for(size_t i = 0; i < HsFlat.size(); i++)
+    Hs[i].assign(1,HsFlat[i]);
+}
+
 double MediatorHomographyRANSAC::computeSquaredError(const Matrix3d& H,int matchIdx) const
 {
   IntPair match = matches_[matchIdx];
@@ -1878,6 +2146,70 @@ void MediatorHomographyRANSAC::refine(double tolerance,const vector<int>& inlier
 namespace
 {
 
+/// Number of candidate initial pairs scored at once.
+const int initPairCandidatesBatch = 8;
+
+void countPairsMatches(int nCams,const vector<NViewMatch>& nViewMatches,
+  ArrayXXi *pnumMatches)
+{
+  auto& numMatches = *pnumMatches;
+  numMatches.setZero(nCams,nCams);
+  for(const auto& nViewMatch : nViewMatches)
+  {
+    for(auto camKey1 = nViewMatch.begin(); camKey1 != nViewMatch.end(); ++camKey1)
+    {
+      int cam1 = camKey1->first;
+      auto camKey2(camKey1);
+      ++camKey2;
+      for(; camKey2 != nViewMatch.end(); ++camKey2)
+      {
+        int cam2 = camKey2->first;
+        numMatches(cam1,cam2)++;
+        numMatches(cam2,cam1)++;
+      }
+    }
+  }
+}
+
+IntPair chooseInitialCameraPair(int minMatches,double maxProportion,
+  int maxCandidates,const uset<int>& camsToUse,HomographyProportions *pproportions)
+{
+  auto& proportions = *pproportions;
+  const auto& numMatches = proportions.numMatches();
+
+  vector<int> cams(camsToUse.begin(),camsToUse.end());
+  std::sort(cams.begin(),cams.end());
+  vector<IntPair> candidates;
+  for(size_t i = 0; i < cams.size(); i++)
+  {
+    for(size_t j = i + 1; j < cams.size(); j++)
+    {
+      if(numMatches(cams[i],cams[j]) >= minMatches)
+        candidates.emplace_back(cams[i],cams[j]);
+    }
+  }
+  std::stable_sort(candidates.begin(),candidates.end(),
+    [&](const IntPair& p1,const IntPair& p2)
+  {
+    return numMatches(p1.first,p1.second) > numMatches(p2.first,p2.second);
+  });
+  if(maxCandidates > 0 && static_cast<int>(candidates.size()) > maxCandidates)
+    candidates.resize(maxCandidates);
+
+  for(size_t start = 0; start < candidates.size(); start += initPairCandidatesBatch)
+  {
+    size_t end = std::min(candidates.size(),start + initPairCandidatesBatch);
+    vector<IntPair> batch(candidates.begin() + start,candidates.begin() + end);
+    proportions.compute(batch);
+    for(const auto& pair : batch)
+    {
+      if(proportions.proportion(pair) <= maxProportion)
+        return pair;
+    }
+  }
+  return IntPair(-1,-1);
+}
+
 // Check: http://stackoverflow.com/questions/13328676/c-solving-cubic-equations
 // and http://mathworld.wolfram.com/CubicFormula.html
 void solveThirdOrderPoly(const Vector4d& coeffs,VectorXd *proots)
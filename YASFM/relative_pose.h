@@ -157,6 +157,66 @@ is searched while having at least minMatches.
 YASFM_API IntPair chooseInitialCameraPair(int minMatches,double minScore,
   const uset<int>& camsToUse,const ArrayXXi& numMatches,const ArrayXXd& scores);
 
+/// Homography inliers proportions of camera pairs computed on demand.
+/**
+The homographies are estimated from the n-view matches of the pairs using RANSAC
+and the proportions numInliers/numMatches are memoized. The cameras, the n-view
+matches and the options have to outlive the object.
+*/
+class HomographyProportions
+{
+public:
+  /// Constructor. Counts matches of all camera pairs.
+  /**
+  \param[in] opt Options for estimating homographies.
+  \param[in] cams Cameras needed for the keys.
+  \param[in] nViewMatches N-View matches.
+  */
+  YASFM_API HomographyProportions(const OptionsRANSAC& opt,
+    const ptr_vector<Camera>& cams,const vector<NViewMatch>& nViewMatches);
+
+  /// \return Numbers of n-view matches for every camera pair.
+  YASFM_API const ArrayXXi& numMatches() const;
+
+  /// Compute proportions of pairs which were not computed yet (in parallel).
+  /// \param[in] pairs Camera pairs.
+  YASFM_API void compute(const vector<IntPair>& pairs);
+
+  /// \return Proportion of a computed pair. 1 if the homography was not found.
+  YASFM_API double proportion(const IntPair& pair) const;
+
+  /// \return Number of pairs for which the proportion was computed.
+  YASFM_API int numComputed() const;
+
+private:
+  const OptionsRANSAC& opt_;
+  const ptr_vector<Camera>& cams_;
+  const vector<NViewMatch>& nViewMatches_;
+  ArrayXXi numMatches_;
+  pair_umap<double> proportions_; ///< Key is a pair with the smaller index first.
+};
+
+/// Choose good camera pair for initialization and score homographies on demand.
+/**
+Finds the pair with the most matches whose homography proportion is at most
+maxProportion. First tries pairs where both cameras are calibrated and if
+unsuccessful then other pairs are tried. Candidates are scored in batches in the
+order of decreasing number of matches until a good pair is found. Only the
+maxCandidates pairs with most matches are scored.
+
+\param[in] minMatches Minimum matches needed for a camera pair to be enough.
+\param[in] maxProportion Maximum homography inliers proportion of a good pair.
+\param[in] maxCandidates Maximum number of scored pairs (in every of the two
+tries). Non-positive means all.
+\param[in] isCalibrated Which cameras are calibrated.
+\param[in] camsToIgnore Which cameras should not be considered.
+\param[in,out] proportions Memoized homography proportions.
+\return Good initial camera pair. Returns (-1,-1) if there is no such pair.
+*/
+YASFM_API IntPair chooseInitialCameraPair(int minMatches,double maxProportion,
+  int maxCandidates,const vector<bool>& isCalibrated,const uset<int>& camsToIgnore,
+  HomographyProportions *proportions);
+
 /// Initialize reconstruction using uncalibrated camera pair.
 /**
 1) Initialize the initial pair cameras based on their relative position estimated 
@@ -323,6 +383,21 @@ computing support.
 YASFM_API void estimateRelativePose7pt(const vector<Vector2d>& keys1, 
   const vector<Vector2d>& keys2,const vector<IntPair>& matches,vector<Matrix3d> *Fs);
 
+/// Estimate fundamental matrices for a batch of samples (minimal solver).
+/**
+Batched version of estimateRelativePose7pt. batchLanes samples are solved at once.
+The nullspace is found by Householder QR of the transposed equations instead of SVD.
+
+\param[in] keys1 Keys in the first camera (see estimateRelativePose7pt).
+\param[in] keys2 Keys in the second camera (see estimateRelativePose7pt).
+\param[in] matches Keys matches.
+\param[in] samples Samples of 7 indices to matches.
+\param[out] Fs Fundamental matrices, one vector per sample.
+*/
+YASFM_API void estimateRelativePose7ptBatch(const vector<Vector2d>& keys1,
+  const vector<Vector2d>& keys2,const vector<IntPair>& matches,
+  const vector<vector<int>>& samples,vector<vector<Matrix3d>> *Fs);
+
 /// Estimate essential matrix using RANSAC.
 /**
 Robust estimator, which finds such an essential matrix that 
@@ -693,6 +768,7 @@ YASFM_API void computeSimilarityFromMatch(const Vector2d& coord1,double scale1,
 /**
 Computes affinity A using least squares such that:
 A*pt1 = lambda*pt2.
+The points are normalized and the normal equations are solved.
 
 \param[in] keys1 First keys.
 \param[in] keys2 Second keys.
@@ -706,7 +782,8 @@ YASFM_API void estimateAffinity(const vector<Vector2d>& keys1,
 
 /// Compute homography.
 /**
-Computes homography H from matches using svd decomposition.
+Computes homography H from matches using normalized DLT. The solution is the
+eigenvector of the smallest eigenvalue of the (9x9) normal matrix.
 H*pt1 = lambda*pt2.
 
 \param[in] pts1 Points 1 (see function description).
@@ -719,6 +796,21 @@ YASFM_API void estimateHomography(const vector<Vector2d>& pts1,
   const vector<Vector2d>& pts2,const vector<IntPair>& matches,
   const vector<int>& matchesToUse,Matrix3d *H);
 
+/// Compute homographies for a batch of samples.
+/**
+Batched version of estimateHomography. Samples of 4 matches are solved batchLanes
+at once using Householder QR. Other samples are passed to estimateHomography.
+
+\param[in] pts1 Points 1 (see estimateHomography).
+\param[in] pts2 Points 2 (see estimateHomography).
+\param[in] matches Points matches.
+\param[in] samples Samples of indices to matches.
+\param[out] Hs Homography matrices, one per sample.
+*/
+YASFM_API void estimateHomographyBatch(const vector<Vector2d>& pts1,
+  const vector<Vector2d>& pts2,const vector<IntPair>& matches,
+  const vector<vector<int>>& samples,vector<Matrix3d> *Hs);
+
 /// Find homography inliers.
 /**
 H*pt1 = lambda*pt2.
@@ -760,6 +852,17 @@ public:
   */
   virtual void computeTransformation(const vector<int>& idxs,vector<Matrix3d> *Fs) const;
 
+  /// \return Number of samples passed to computeTransformations at once.
+  virtual int batchSize() const;
+
+  /// Compute transformations from a batch of minimal samples.
+  /**
+  \param[in] samples Samples of indices of matches.
+  \param[out] Fs Resulting fundamental matrices, one vector per sample.
+  */
+  virtual void computeTransformations(const vector<vector<int>>& samples,
+    vector<vector<Matrix3d>> *Fs) const;
+
   /// Compute symmetric squared distance.
   /**
   \param[in] F Fundamental matrix.
@@ -786,10 +889,9 @@ private:
 
 /// Implementation of mediator for 5pt solver.
 /**
-Even though this mediator estimates E (essential matrix) it works with 
-corresponding F fundamental matrices. That is due to simplification of call to 
-computation of squared error. Therefore, you should transform the resulting F to E
-after running RANSAC.
+The mediator works directly with E (essential matrix). The squared error is the
+Sampson distance in pixels of the corresponding fundamental matrix, but it is
+evaluated using E and the normalized keys so that F never has to be formed.
 */
 class Mediator5ptRANSAC : public MediatorRANSAC<Matrix3d>
 {
@@ -813,20 +915,20 @@ public:
   /// Compute transformation from a minimal sample.
   /**
   \param[in] idxs Indices of matches from which to compute the transformation.
-  \param[out] Fs Resulting fundamental matrices.
+  \param[out] Es Resulting essential matrices.
   */
-  virtual void computeTransformation(const vector<int>& idxs,vector<Matrix3d> *Fs) const;
+  virtual void computeTransformation(const vector<int>& idxs,vector<Matrix3d> *Es) const;
 
-  /// Compute symmetric squared distance.
+  /// Compute squared Sampson distance (in pixels).
   /**
-  \param[in] F Fundamental matrix.
+  \param[in] E Essential matrix.
   \param[in] matchIdx Index of the match.
   \return Squared error.
   */
-  virtual double computeSquaredError(const Matrix3d& F,int matchIdx) const;
+  virtual double computeSquaredError(const Matrix3d& E,int matchIdx) const;
 
-  /// Refine. Does nothing for now.
-  virtual void refine(double tolerance,const vector<int>& inliers,Matrix3d *F) const;
+  /// Refine the essential matrix using its inliers.
+  virtual void refine(double tolerance,const vector<int>& inliers,Matrix3d *E) const;
 
 private:
   const int minMatches_;
@@ -837,6 +939,10 @@ private:
   const vector<IntPair>& matches_;
   Matrix3d invK1_; ///< Inverted K1.
   Matrix3d invK2_; ///< Inverted K2.
+  /// Top rows of inv(K1)'. Maps E'*pt2Norm to the top rows of F'*pt2.
+  Eigen::Matrix<double,2,3> invK1TTop_;
+  /// Top rows of inv(K2)'. Maps E*pt1Norm to the top rows of F*pt1.
+  Eigen::Matrix<double,2,3> invK2TTop_;
 };
 
 /// Implementation of mediator for homography minimal solver.
@@ -865,6 +971,17 @@ public:
   */
   virtual void computeTransformation(const vector<int>& idxs,vector<Matrix3d> *Hs) const;
 
+  /// \return Number of samples passed to computeTransformations at once.
+  virtual int batchSize() const;
+
+  /// Compute transformations from a batch of minimal samples.
+  /**
+  \param[in] samples Samples of indices of matches.
+  \param[out] Hs Resulting transformations, one vector per sample.
+  */
+  virtual void computeTransformations(const vector<vector<int>>& samples,
+    vector<vector<Matrix3d>> *Hs) const;
+
   /// Compute squared error for one match.
   /**
   \param[in] H A transformation.
@@ -902,6 +1019,22 @@ private:
 namespace
 {
 
+/// Count n-view matches of every camera pair.
+/**
+\param[in] nCams Number of cameras.
+\param[in] nViewMatches N-View matches.
+\param[out] numMatches Symmetric matrix with numbers of matches.
+*/
+void countPairsMatches(int nCams,const vector<NViewMatch>& nViewMatches,
+  ArrayXXi *numMatches);
+
+/// Choose good camera pair for initialization and score homographies on demand.
+/**
+See the public function of the same name. This is one try over given cameras.
+*/
+IntPair chooseInitialCameraPair(int minMatches,double maxProportion,
+  int maxCandidates,const uset<int>& camsToUse,HomographyProportions *proportions);
+
 /// Compute symmetric epipolar distance.
 /**
 See Hartley & Zisserman p. 278.
@@ -956,6 +1089,17 @@ p(x) = 5x^3 - x has representation [5 0 -1 0]
 */
 void solveThirdOrderPoly(const Vector4d& coeffs, VectorXd *roots);
 
+/// Compute fundamental matrices from the nullspace of the 7pt equations.
+/**
+Finds all combinations of the two nullspace vectors which have rank 2.
+
+\param[in] f1 First nullspace vector (row-wise fundamental matrix).
+\param[in] f2 Second nullspace vector (row-wise fundamental matrix).
+\param[out] Fs Fundamental matrices.
+*/
+void fundamentalMatricesFrom7ptNullspace(const VectorXd& f1,const VectorXd& f2,
+  vector<Matrix3d> *Fs);
+
 /// Solve second order polynomial.
 /**
 Accepts coefficients ordered by descending powers, i.e.
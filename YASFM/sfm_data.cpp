@@ -4,6 +4,10 @@
 #include <fstream>
 #include <direct.h>
 #include <iomanip>
+#include <algorithm>
+#include <numeric>
+#include <cstdint>
+#include <cstdio>
 
 #include "camera_factory.h"
 
@@ -16,20 +20,32 @@ using std::getline;
 using std::ifstream;
 using std::stoi;
 using std::ofstream;
+using std::lock_guard;
+using std::mutex;
 
 namespace yasfm
 {
 Dataset::Dataset(const string& dir)
-  : dir_(dir)
+  : dir_(dir),arePairsSpillable_(false),arePairsSpilled_(false),
+  isPairsSpillFileWritten_(false),pairsMemoryUsage_(0)
 {
   makeDirRecursive(featsDir());
 }
 
 Dataset::Dataset(const Dataset& o)
+  : arePairsSpillable_(false),arePairsSpilled_(false),
+  isPairsSpillFileWritten_(false),pairsMemoryUsage_(0)
 {
   copyIn(o);
 }
 
+Dataset::~Dataset()
+{
+  memoryBudget().unregisterConsumer(this);
+  if(isPairsSpillFileWritten_)
+    std::remove(pairsSpillFilename().c_str());
+}
+
 Dataset& Dataset::operator = (const Dataset& o)
 {
   copyIn(o);
@@ -45,7 +61,20 @@ void Dataset::copyIn(const Dataset& o)
     cams_.push_back(cam->clone());
   }
   queries_ = o.queries_;
-  pairs_ = o.pairs_;
+  pair_umap<CameraPair> pairs;
+  {
+    lock_guard<mutex> lock(o.pairsMtx_);
+    o.unspillPairs();
+    pairs = o.pairs_;
+  }
+  {
+    lock_guard<mutex> lock(pairsMtx_);
+    pairs_ = std::move(pairs);
+    arePairsSpilled_ = false;
+    isPairsSpillFileWritten_ = false;
+    if(arePairsSpillable_)
+      pairsMemoryUsage_ = estimatePairsMemoryUsage(pairs_);
+  }
   reconstructedCams_ = o.reconstructedCams_;
   nViewMatches_ = o.nViewMatches_;
   pts_ = o.pts_;
@@ -57,6 +86,14 @@ void Dataset::clearDescriptors()
     cam->clearDescriptors();
   }
 }
+void Dataset::clearReconstruction()
+{
+  for(int camIdx : reconstructedCams_)
+    cams_[camIdx]->visiblePoints().clear();
+  reconstructedCams_.clear();
+  pts_.clear();
+}
+
 void Dataset::markCamAsReconstructed(int camIdx)
 {
   reconstructedCams_.insert(camIdx);
@@ -158,6 +195,8 @@ void Dataset::writeASCII(const string& filename) const
     file << "\n";
   }
 
+  lock_guard<mutex> lock(pairsMtx_);
+  unspillPairs();
   const int nFieldsCameraPair = 3;
   const int nFieldsMatchGroup = 3;
   file << "pairs_ " << pairs_.size() << " " << nFieldsCameraPair << "\n";
@@ -207,6 +246,7 @@ void Dataset::readASCII(const string& filename)
   dir_.clear();
   cams_.clear();
   queries_.clear();
+  setPairsSpillable(false);
   pairs_.clear();
   reconstructedCams_.clear();
   nViewMatches_.clear();
@@ -448,6 +488,7 @@ void Dataset::readMatches(istream& file)
         }
       }
     }
+    sortMatchesByDists(&pair);
   }
 }
 void Dataset::readPointsOld(istream& file)
@@ -540,8 +581,204 @@ Camera& Dataset::cam(int idx) { return *cams_[idx]; }
 Camera& Dataset::cam(size_t idx) { return *cams_[idx]; }
 const ptr_vector<Camera>& Dataset::cams() const { return cams_; }
 ptr_vector<Camera>& Dataset::cams() { return cams_; }
-const pair_umap<CameraPair>& Dataset::pairs() const { return pairs_; }
-pair_umap<CameraPair>& Dataset::pairs() { return pairs_; }
+
+const pair_umap<CameraPair>& Dataset::pairs() const
+{
+  lock_guard<mutex> lock(pairsMtx_);
+  unspillPairs();
+  return pairs_;
+}
+
+pair_umap<CameraPair>& Dataset::pairs()
+{
+  lock_guard<mutex> lock(pairsMtx_);
+  unspillPairs();
+  return pairs_;
+}
+
+void Dataset::setPairsSpillable(bool spillable)
+{
+  {
+    lock_guard<mutex> lock(pairsMtx_);
+    if(arePairsSpillable_ == spillable)
+      return;
+    arePairsSpillable_ = spillable;
+    if(spillable)
+    {
+      pairsMemoryUsage_ = estimatePairsMemoryUsage(pairs_);
+    } else
+    {
+      unspillPairs();
+      if(isPairsSpillFileWritten_)
+        std::remove(pairsSpillFilename().c_str());
+      isPairsSpillFileWritten_ = false;
+    }
+  }
+  // Not registered under pairsMtx_ because the budget locks it when releasing.
+  if(spillable)
+    memoryBudget().registerConsumer(this,MemoryPrioritySpillable);
+  else
+    memoryBudget().unregisterConsumer(this);
+}
+
+bool Dataset::arePairsSpilled() const
+{
+  lock_guard<mutex> lock(pairsMtx_);
+  return arePairsSpilled_;
+}
+
+void Dataset::clearPairs()
+{
+  lock_guard<mutex> lock(pairsMtx_);
+  pair_umap<CameraPair>().swap(pairs_);
+  arePairsSpilled_ = false;
+  pairsMemoryUsage_ = 0;
+  if(isPairsSpillFileWritten_)
+    std::remove(pairsSpillFilename().c_str());
+  isPairsSpillFileWritten_ = false;
+}
+
+string Dataset::memoryConsumerName() const
+{
+  return "pairs";
+}
+
+size_t Dataset::memoryUsage() const
+{
+  lock_guard<mutex> lock(pairsMtx_);
+  return arePairsSpilled_ ? 0 : pairsMemoryUsage_;
+}
+
+size_t Dataset::releaseMemory(size_t nBytes)
+{
+  lock_guard<mutex> lock(pairsMtx_);
+  if(!arePairsSpillable_ || arePairsSpilled_ || pairs_.empty())
+    return 0;
+  if(!isPairsSpillFileWritten_)
+  {
+    string fn = pairsSpillFilename();
+    ofstream file(fn,std::ios::binary);
+    if(!file.is_open())
+    {
+      YASFM_PRINT_ERROR_FILE_OPEN(fn);
+      return 0;
+    }
+    writePairsBinary(pairs_,file);
+    if(!file)
+    {
+      YASFM_PRINT_ERROR("Could not spill pairs to:\n" << fn);
+      return 0;
+    }
+    isPairsSpillFileWritten_ = true;
+  }
+  pair_umap<CameraPair>().swap(pairs_);
+  arePairsSpilled_ = true;
+  return pairsMemoryUsage_;
+}
+
+void Dataset::unspillPairs() const
+{
+  if(!arePairsSpilled_)
+    return;
+  string fn = pairsSpillFilename();
+  ifstream file(fn,std::ios::binary);
+  if(!file.is_open() || !readPairsBinary(file,&pairs_))
+    YASFM_PRINT_ERROR("Could not read spilled pairs from:\n" << fn);
+  arePairsSpilled_ = false;
+}
+
+string Dataset::pairsSpillFilename() const
+{
+  // The address distinguishes datasets sharing the working directory.
+  return joinPaths(dir_,"pairs_spill_" +
+    std::to_string(reinterpret_cast<uintptr_t>(this)) + ".bin");
+}
+
+void Dataset::writePairsBinary(const pair_umap<CameraPair>& pairs,ostream& file)
+{
+  uint64_t nPairs = pairs.size();
+  file.write(reinterpret_cast<const char *>(&nPairs),sizeof(uint64_t));
+  for(const auto& entry : pairs)
+  {
+    const auto& pair = entry.second;
+    int header[] = {entry.first.first,entry.first.second,int(pair.matches.size()),
+      int(pair.dists.size()),int(pair.groups.size())};
+    file.write(reinterpret_cast<const char *>(header),sizeof(header));
+    if(!pair.matches.empty())
+    {
+      file.write(reinterpret_cast<const char *>(&pair.matches[0]),
+        sizeof(IntPair)*pair.matches.size());
+    }
+    if(!pair.dists.empty())
+    {
+      file.write(reinterpret_cast<const char *>(&pair.dists[0]),
+        sizeof(double)*pair.dists.size());
+    }
+    for(const auto& g : pair.groups)
+    {
+      int groupHeader[] = {g.size,int(g.type),int(g.T.rows()),int(g.T.cols())};
+      file.write(reinterpret_cast<const char *>(groupHeader),sizeof(groupHeader));
+      file.write(reinterpret_cast<const char *>(g.T.data()),sizeof(double)*g.T.size());
+    }
+  }
+}
+
+bool Dataset::readPairsBinary(istream& file,pair_umap<CameraPair> *ppairs)
+{
+  auto& pairs = *ppairs;
+  uint64_t nPairs = 0;
+  file.read(reinterpret_cast<char *>(&nPairs),sizeof(uint64_t));
+  pairs.clear();
+  pairs.reserve(size_t(nPairs));
+  for(uint64_t iPair = 0; iPair < nPairs && file; iPair++)
+  {
+    int header[5];
+    file.read(reinterpret_cast<char *>(header),sizeof(header));
+    if(!file)
+      break;
+    auto& pair = pairs[IntPair(header[0],header[1])];
+    pair.matches.resize(header[2]);
+    pair.dists.resize(header[3]);
+    pair.groups.resize(header[4]);
+    if(!pair.matches.empty())
+    {
+      file.read(reinterpret_cast<char *>(&pair.matches[0]),
+        sizeof(IntPair)*pair.matches.size());
+    }
+    if(!pair.dists.empty())
+    {
+      file.read(reinterpret_cast<char *>(&pair.dists[0]),
+        sizeof(double)*pair.dists.size());
+    }
+    for(auto& g : pair.groups)
+    {
+      int groupHeader[4];
+      file.read(reinterpret_cast<char *>(groupHeader),sizeof(groupHeader));
+      g.size = groupHeader[0];
+      g.type = char(groupHeader[1]);
+      g.T.resize(groupHeader[2],groupHeader[3]);
+      file.read(reinterpret_cast<char *>(g.T.data()),sizeof(double)*g.T.size());
+    }
+  }
+  return bool(file);
+}
+
+size_t Dataset::estimatePairsMemoryUsage(const pair_umap<CameraPair>& pairs)
+{
+  // Every entry of the map is a node with the key, the pair and a pointer.
+  size_t nBytes = pairs.bucket_count() * sizeof(void *);
+  for(const auto& entry : pairs)
+  {
+    const auto& pair = entry.second;
+    nBytes += sizeof(entry) + sizeof(void *) +
+      pair.matches.capacity() * sizeof(IntPair) +
+      pair.dists.capacity() * sizeof(double) +
+      pair.groups.capacity() * sizeof(MatchGroup);
+    for(const auto& g : pair.groups)
+      nBytes += g.T.size() * sizeof(double);
+  }
+  return nBytes;
+}
 const uset<int>& Dataset::reconstructedCams() const { return reconstructedCams_; }
 const vector<set<int>>& Dataset::queries() const { return queries_; }
 vector<set<int>>& Dataset::queries() { return queries_; }
@@ -555,4 +792,48 @@ string Dataset::featsDir() const
   return joinPaths(dir_,"keys");
 }
 
+void sortMatchesByDists(CameraPair *ppair)
+{
+  auto& pair = *ppair;
+  int nMatches = static_cast<int>(pair.matches.size());
+  if(pair.dists.size() != pair.matches.size())
+    return;
+  int groupStart = 0;
+  for(size_t ig = 0; ig <= pair.groups.size() && groupStart < nMatches; ig++)
+  {
+    int groupEnd = (ig < pair.groups.size()) ?
+      std::min(nMatches,groupStart + pair.groups[ig].size) : nMatches;
+    const double *dists = &pair.dists[groupStart];
+    int n = groupEnd - groupStart;
+    if(!std::is_sorted(dists,dists + n))
+    {
+      vector<int> order(n);
+      quicksort(n,dists,&order[0]);
+      vector<IntPair> matches(n);
+      vector<double> sortedDists(n);
+      for(int i = 0; i < n; i++)
+      {
+        matches[i] = pair.matches[groupStart + order[i]];
+        sortedDists[i] = dists[order[i]];
+      }
+      std::copy(matches.begin(),matches.end(),pair.matches.begin() + groupStart);
+      std::copy(sortedDists.begin(),sortedDists.end(),pair.dists.begin() + groupStart);
+    }
+    groupStart = groupEnd;
+  }
+}
+
+void findMatchesOrderByDists(const CameraPair& pair,vector<int> *porder)
+{
+  auto& order = *porder;
+  if(std::is_sorted(pair.dists.begin(),pair.dists.end()))
+  {
+    order.resize(pair.dists.size());
+    std::iota(order.begin(),order.end(),0);
+  } else
+  {
+    quicksort(pair.dists,&order);
+  }
+}
+
 } // namespace yasfm
\ No newline at end of file
@@ -11,6 +11,7 @@
 #pragma once
 
 #include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 #include <istream>
@@ -21,6 +22,7 @@
 
 #include "defines.h"
 #include "camera.h"
+#include "memory_budget.h"
 #include "utils.h"
 #include "utils_io.h"
 
@@ -59,17 +61,39 @@ typedef struct CameraPair
   /// This can be any score. The smaller the better.
   vector<double> dists;
   /// matches and dists are ordered wrt to groups, i.e. indices [0,groups[0].size)
-  /// belong to the first group.
+  /// belong to the first group. Within a group, they are in ascending order of
+  /// dists (see sortMatchesByDists()).
   vector<MatchGroup> groups;
 } CameraPair;
 
+/// Sort matches and dists in ascending order of dists.
+/**
+This is the canonical order kept by the matchers and filters so that PROSAC
+does not need to sort. Every group is sorted separately so that the matches
+stay ordered wrt groups.
+
+\param[in,out] pair Camera pair.
+*/
+YASFM_API void sortMatchesByDists(CameraPair *pair);
+
+/// Find ascending order of matches wrt dists.
+/**
+The identity is returned without sorting when the matches are in the
+canonical order, i.e. sorted as a whole.
+
+\param[in] pair Camera pair.
+\param[out] order Mapping from the ordered indices to the indices of the matches.
+*/
+YASFM_API void findMatchesOrderByDists(const CameraPair& pair,vector<int> *order);
+
 /// Main class for storing results of the reconstruction.
 /**
 Class used for storing results of the reconstruction. Able to copy itself using
 copy constructor or assignment operator, write itself into file and read itself
-again.
+again. Can spill the pairs to a file when asked by the memory budget, see
+setPairsSpillable().
 */
-class Dataset
+class Dataset : public MemoryConsumer
 {
 public:
   /// Constructor.
@@ -88,6 +112,9 @@ public:
   /// \param[in] o Other dataset.
   /// \return Reference to this.
   YASFM_API Dataset& operator=(const Dataset& o);
+
+  /// Destructor. Removes the file with spilled pairs.
+  YASFM_API virtual ~Dataset();
   
   /// Add one camera to the dataset.
   /**
@@ -99,12 +126,28 @@ public:
 
   /// Add all images in a directory to the dataset as cameras.
   /**
+  Image dimensions are read in parallel.
+
   \param[in] imgsDir Directory with the images.
   \param[in] isSubdir true if the imgsDir is relative to the working dir.
   */
   template<class T>
   void addCameras(const string& imgsDir,bool isSubdir = true);
 
+  /// Add all images in a directory to the dataset as cameras.
+  /**
+  Image dimensions are taken from imgDims when available and read in parallel
+  otherwise.
+
+  \param[in] imgsDir Directory with the images.
+  \param[in] imgDims Known dimensions (width,height) indexed by image filenames
+  (without directories), e.g. read by readImgDimsManifest().
+  \param[in] isSubdir true if the imgsDir is relative to the working dir.
+  */
+  template<class T>
+  void addCameras(const string& imgsDir,const umap<string,IntPair>& imgDims,
+    bool isSubdir = true);
+
   /// Erase all the descriptors to release memory.
   YASFM_API void clearDescriptors();
 
@@ -126,6 +169,10 @@ public:
     const vector<int>& correspondingPoints,
     const vector<int>& correspondingPointsInliers);
 
+  /// Remove all the points and mark all the cameras as not reconstructed.
+  /// Parameters of the cameras are kept.
+  YASFM_API void clearReconstruction();
+
   /// Go through all the points and count number of reconstructed views/observations.
   /// \return Total number of observations/views.
   YASFM_API int countReconstructedObservations() const;
@@ -177,12 +224,53 @@ public:
   /// \return Cameras.
   YASFM_API ptr_vector<Camera>& cams();
 
-  /// \return Camera pairs.
+  /// Camera pairs.
+  /**
+  Reads the pairs back if they are spilled. While the pairs are spillable (see
+  setPairsSpillable()), the returned reference is emptied by the next
+  memoryBudget().makeRoom(), so it must not be used after anything which may ask
+  for memory.
+  \return Camera pairs.
+  */
   YASFM_API const pair_umap<CameraPair>& pairs() const;
 
+  /// Camera pairs. See the const version.
   /// \return Camera pairs.
   YASFM_API pair_umap<CameraPair>& pairs();
 
+  /// Allow the memory budget to spill the pairs to a file.
+  /**
+  While spillable, the pairs are written to a file in the working directory and
+  released whenever some component makes room in the memory budget. pairs() reads
+  them back, but the returned reference is valid only until the next request for
+  memory. Hence, make the pairs spillable only while no stage works with them.
+  The pairs are not modified while spillable, so the file is written only once.
+  Making the pairs not spillable reads them back.
+
+  \param[in] spillable Spillable or not.
+  */
+  YASFM_API void setPairsSpillable(bool spillable);
+
+  /// \return True if the pairs are released and stored in a file.
+  YASFM_API bool arePairsSpilled() const;
+
+  /// Remove all the pairs. Spilled pairs are not read back.
+  YASFM_API void clearPairs();
+
+  /// \return Name used in reports of the memory budget.
+  YASFM_API virtual string memoryConsumerName() const override;
+
+  /// \return Estimated number of bytes taken by the pairs (0 when spilled).
+  YASFM_API virtual size_t memoryUsage() const override;
+
+  /// Spill the pairs if they are spillable.
+  /**
+  \param[in] nBytes Number of bytes which should be released (ignored, all the
+  pairs are spilled).
+  \return Number of bytes released.
+  */
+  YASFM_API virtual size_t releaseMemory(size_t nBytes) override;
+
   /// \return Reconstructed cameras.
   YASFM_API const uset<int>& reconstructedCams() const;
 
@@ -214,6 +302,30 @@ private:
   void readPts(istream& file);
   void readMatches(istream& file);
 
+  /// Read back the pairs if they are spilled. Requires pairsMtx_ locked.
+  void unspillPairs() const;
+
+  /// \return Path to the file with spilled pairs.
+  string pairsSpillFilename() const;
+
+  /// Write pairs in binary format.
+  /**
+  \param[in] pairs Pairs.
+  \param[in,out] file Opened binary file.
+  */
+  static void writePairsBinary(const pair_umap<CameraPair>& pairs,ostream& file);
+
+  /// Read pairs as written by writePairsBinary().
+  /**
+  \param[in,out] file Opened binary file.
+  \param[out] pairs Pairs.
+  \return False if the file could not be read.
+  */
+  static bool readPairsBinary(istream& file,pair_umap<CameraPair> *pairs);
+
+  /// \return Estimated number of bytes taken by pairs.
+  static size_t estimatePairsMemoryUsage(const pair_umap<CameraPair>& pairs);
+
   // Keep this for a while and remove when that format is not used anywhere.
   void readPointsOld(istream& file);
 
@@ -221,7 +333,12 @@ private:
   /// The cameras stored as pointers to Camera.
   ptr_vector<Camera> cams_;
   vector<set<int>> queries_; ///< Which pairs should be matched. 
-  pair_umap<CameraPair> pairs_;
+  mutable pair_umap<CameraPair> pairs_; ///< Empty when spilled.
+  mutable std::mutex pairsMtx_; ///< Guards pairs_ and the spilling state.
+  bool arePairsSpillable_;
+  mutable bool arePairsSpilled_;
+  bool isPairsSpillFileWritten_; ///< The file is up to date with the pairs.
+  size_t pairsMemoryUsage_; ///< Estimated when the pairs are made spillable.
   uset<int> reconstructedCams_;
   vector<NViewMatch> nViewMatches_; ///< Only matches not converted to points yet.
   vector<Point> pts_;
@@ -244,6 +361,13 @@ void Dataset::addCamera(const string& filename,bool isSubdir)
 }
 template<class T>
 void Dataset::addCameras(const string& imgsDir,bool isSubdir)
+{
+  addCameras<T>(imgsDir,umap<string,IntPair>(),isSubdir);
+}
+
+template<class T>
+void Dataset::addCameras(const string& imgsDir,const umap<string,IntPair>& imgDims,
+  bool isSubdir)
 {
   string imgsDirAbs;
   if(isSubdir)
@@ -254,11 +378,19 @@ void Dataset::addCameras(const string& imgsDir,bool isSubdir)
   vector<string> filenames;
   listImgFilenames(imgsDirAbs,&filenames);
 
-  size_t nImgs = filenames.size();
-  cams_.reserve(cams_.capacity() + nImgs);
-  for(size_t i = 0; i < nImgs; i++)
+  int nImgs = static_cast<int>(filenames.size());
+  size_t firstCam = cams_.size();
+  cams_.resize(firstCam + nImgs);
+  // Reading the dimensions is dominated by opening the files.
+#pragma omp parallel for schedule(dynamic)
+  for(int i = 0; i < nImgs; i++)
   {
-    cams_.push_back(make_unique<T>(joinPaths(imgsDirAbs,filenames[i]),featsDir()));
+    IntPair dims(-1,-1);
+    auto it = imgDims.find(filenames[i]);
+    if(it != imgDims.end())
+      dims = it->second;
+    cams_[firstCam + i] = make_unique<T>(joinPaths(imgsDirAbs,filenames[i]),featsDir(),
+      dims.first,dims.second);
   }
 }
 
@@ -2,7 +2,9 @@
 
 #include "utils.h"
 
+using Eigen::Dynamic;
 using Eigen::Map;
+using Eigen::Matrix;
 using std::make_unique;
 
 namespace yasfm
@@ -23,13 +25,14 @@ StandardCamera::StandardCamera()
 	x0_(1) = -1;
 }
 
-StandardCamera::StandardCamera(const string& imgFilename,const string& featuresDir)
-  : Camera(imgFilename,featuresDir),params_(nParams_,0.),
+StandardCamera::StandardCamera(const string& imgFilename,const string& featuresDir,
+  int imgWidth,int imgHeight)
+  : Camera(imgFilename,featuresDir,imgWidth,imgHeight),params_(nParams_,0.),
   paramsConstraints_(nParams_,0.),paramsConstraintsWeights_(nParams_,0.)
 {
   // assume the image center to be the principal point
-  x0_(0) = 0.5 * (imgWidth() - 1);
-  x0_(1) = 0.5 * (imgHeight() - 1);
+  x0_(0) = 0.5 * (this->imgWidth() - 1);
+  x0_(1) = 0.5 * (this->imgHeight() - 1);
 }
 
 StandardCamera::StandardCamera(istream& file)
@@ -53,9 +56,16 @@ StandardCamera::~StandardCamera()
 
 }
 
-unique_ptr<Camera> StandardCamera::clone() const
+StandardCamera::StandardCamera(const StandardCamera& o,bool copyDescr)
+  : Camera(o,copyDescr),x0_(o.x0_),params_(o.params_),
+  paramsConstraints_(o.paramsConstraints_),
+  paramsConstraintsWeights_(o.paramsConstraintsWeights_)
 {
-  return make_unique<StandardCamera>(*this);
+}
+
+unique_ptr<Camera> StandardCamera::clone(bool withDescr) const
+{
+  return make_unique<StandardCamera>(*this,withDescr);
 }
 
 Vector2d StandardCamera::project(const Point& pt) const
@@ -72,6 +82,16 @@ ceres::CostFunction* StandardCamera::costFunction(int keyIdx) const
     new ReprojectionErrorFunctor(k(0),k(1),*this)));
 }
 
+bool StandardCamera::evaluateReprojectionErrorFloat(int keyIdx,
+  const float* const camParams,const float* const point,float *residuals,
+  float *jacobianCam,float *jacobianPoint) const
+{
+  const auto& k = key(keyIdx);
+  ReprojectionErrorFunctor functor(k(0),k(1),*this);
+  return evaluateFunctorWithJets<nParams_>(functor,camParams,point,residuals,
+    jacobianCam,jacobianPoint);
+}
+
 ceres::CostFunction* StandardCamera::constraintsCostFunction() const
 {
   return generateConstraintsCostFunction<nParams_>(&paramsConstraints_[0],
@@ -88,6 +108,18 @@ Vector2d StandardCamera::keyNormalized(int i) const
   return (key(i) - x0_) / f();
 }
 
+void StandardCamera::keysNormalized(vector<Vector2d> *pnormKeys) const
+{
+  auto& normKeys = *pnormKeys;
+  int nKeys = static_cast<int>(keys().size());
+  normKeys.resize(nKeys);
+  if(nKeys == 0)
+    return;
+  Map<const Matrix<double,2,Dynamic>> keysMapped(&keys()[0](0),2,nKeys);
+  Map<Matrix<double,2,Dynamic>> normKeysMapped(&normKeys[0](0),2,nKeys);
+  normKeysMapped = (keysMapped.colwise() - x0_) / f();
+}
+
 Matrix34d StandardCamera::P() const
 {
   return K()*pose();
@@ -139,8 +171,8 @@ void StandardCamera::setImage(const string& filename,int width,int height)
 {
   Camera::setImage(filename,width,height);
   // assume the image center to be the principal point
-  x0_(0) = 0.5 * (imgWidth() - 1);
-  x0_(1) = 0.5 * (imgHeight() - 1);
+  x0_(0) = 0.5 * (this->imgWidth() - 1);
+  x0_(1) = 0.5 * (this->imgHeight() - 1);
 }
 
 void StandardCamera::setParams(const vector<double>& params)
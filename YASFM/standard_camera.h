@@ -12,6 +12,7 @@
 
 #include <memory>
 #include <istream>
+#include <limits>
 #include <ostream>
 #include <string>
 #include <vector>
@@ -64,8 +65,11 @@ public:
 
   \param[in] imgFilename Path to the image file.
   \param[in] featuresDir Directory containg files with features.
+  \param[in] imgWidth Image width. Read from the image if not positive.
+  \param[in] imgHeight Image height. Read from the image if not positive.
   */
-  YASFM_API StandardCamera(const string& imgFilename,const string& featuresDir);
+  YASFM_API StandardCamera(const string& imgFilename,const string& featuresDir,
+    int imgWidth = -1,int imgHeight = -1);
 
   /// Constructor. (Reads everything from the file.)
   /**
@@ -76,6 +80,13 @@ public:
   */
   YASFM_API StandardCamera(istream& file);
 
+  /// Copy constructor optionally skipping the descriptors. (Used by clone().)
+  /**
+  \param[in] o Other camera.
+  \param[in] copyDescr Copy also the descriptors?
+  */
+  YASFM_API StandardCamera(const StandardCamera& o,bool copyDescr);
+
   /// Destructor.
   /**
   Seems like the destructor has to be virtual so that the destruction
@@ -94,12 +105,14 @@ public:
   /// Cloning. !! HAS TO BE OVERRIDEN BY EVERY DERIVED CLASS IN HIERARCHY !!
   /**
   This is used for cloning when one has only pointer to the Camera.
-  DerivedCamera has to implement clone() like this:
-  { return make_unique<DerivedCamera>(*this); }
+  DerivedCamera has to provide a constructor DerivedCamera(const DerivedCamera& o,
+  bool copyDescr) forwarding copyDescr to its base class and implement clone() like this:
+  { return make_unique<DerivedCamera>(*this,withDescr); }
 
+  \param[in] withDescr Copy also the descriptors?
   \return Base class pointer to the clone of the DerivedCamera.
   */
-  YASFM_API virtual unique_ptr<Camera> clone() const;
+  YASFM_API virtual unique_ptr<Camera> clone(bool withDescr = true) const;
 
   /// Class name. !! HAS TO BE OVERRIDEN BY EVERY DERIVED CLASS IN HIERARCHY !!
   /// \return "DerivedCamera" for DerivedCamera.
@@ -131,6 +144,15 @@ public:
   */
   YASFM_API virtual ceres::CostFunction* costFunction(int keyIdx) const;
 
+  /// Evaluate the reprojection error in single precision (see Camera).
+  /**
+  Uses the functor of costFunction() with ceres::Jet<float>, so the derivative
+  parts are small fixed size Eigen vectors which get vectorized.
+  */
+  YASFM_API virtual bool evaluateReprojectionErrorFloat(int keyIdx,
+    const float* const camParams,const float* const point,float *residuals,
+    float *jacobianCam,float *jacobianPoint) const;
+
   /// Generate ceres parameters cost function.
   /**
   This cost function accepts camera parameters and returns the same
@@ -150,6 +172,10 @@ public:
   /// \return Key with undone calibration.
   YASFM_API virtual Vector2d keyNormalized(int i) const;
 
+  /// Undo calibration of all the keys at once.
+  /// \param[out] normKeys Keys with undone calibration.
+  YASFM_API virtual void keysNormalized(vector<Vector2d> *normKeys) const;
+
   /// \return Projection matrix.
   YASFM_API virtual Matrix34d P() const;
 
@@ -244,6 +270,30 @@ protected:
   /// Index of the focal length in the export ordex.
   static const int fIdx_ = 6;
 
+  /// Evaluate a reprojection error functor and its Jacobians using ceres::Jet.
+  /**
+  \param[in] functor Functor as used by costFunction().
+  \param[in] camParams Camera parameters.
+  \param[in] point 3D point.
+  \param[out] residuals 2 residuals.
+  \param[out] jacobianCam Row major 2 x NParams Jacobian. Nothing computed if NULL.
+  \param[out] jacobianPoint Row major 2 x 3 Jacobian.
+  \return The functor's result.
+  */
+  template<int NParams,typename T,class Functor>
+  static bool evaluateFunctorWithJets(const Functor& functor,const T* const camParams,
+    const T* const point,T *residuals,T *jacobianCam,T *jacobianPoint);
+
+  /// Rotate a point. Same as ceres::AngleAxisRotatePoint but works also with
+  /// ceres::Jet<float>, i.e., uses no double constants.
+  /**
+  \param[in] angleAxis Rotation as angle axis.
+  \param[in] pt Point.
+  \param[out] result Rotated point.
+  */
+  template<typename T>
+  static void angleAxisRotatePoint(const T angleAxis[3],const T pt[3],T result[3]);
+
 private:
 
   static const int nParams_ = 7; ///< Total number of parameters.
@@ -314,7 +364,7 @@ void StandardCamera::projectWithExternalParams(const T* const camera,
 
   // Rotate.
   T pCam[3];
-  ceres::AngleAxisRotatePoint(&camera[rotIdx_],p,pCam);
+  angleAxisRotatePoint(&camera[rotIdx_],p,pCam);
 
   T xp = pCam[0] / pCam[2];
   T yp = pCam[1] / pCam[2];
@@ -324,6 +374,66 @@ void StandardCamera::projectWithExternalParams(const T* const camera,
   projection[1] = camera[fIdx_] * yp + T(x0_(1));
 }
 
+template<int NParams,typename T,class Functor>
+bool StandardCamera::evaluateFunctorWithJets(const Functor& functor,
+  const T* const camParams,const T* const point,T *residuals,T *jacobianCam,
+  T *jacobianPoint)
+{
+  if(!jacobianCam)
+    return functor(camParams,point,residuals);
+
+  typedef ceres::Jet<T,NParams + 3> JetT;
+  JetT camJets[NParams];
+  JetT pointJets[3];
+  for(int i = 0; i < NParams; i++)
+    camJets[i] = JetT(camParams[i],i);
+  for(int i = 0; i < 3; i++)
+    pointJets[i] = JetT(point[i],NParams + i);
+
+  JetT residualJets[2];
+  if(!functor(camJets,pointJets,residualJets))
+    return false;
+  for(int r = 0; r < 2; r++)
+  {
+    residuals[r] = residualJets[r].a;
+    for(int i = 0; i < NParams; i++)
+      jacobianCam[r*NParams + i] = residualJets[r].v(i);
+    for(int i = 0; i < 3; i++)
+      jacobianPoint[r*3 + i] = residualJets[r].v(NParams + i);
+  }
+  return true;
+}
+
+template<typename T>
+void StandardCamera::angleAxisRotatePoint(const T angleAxis[3],const T pt[3],
+  T result[3])
+{
+  const T theta2 = angleAxis[0]*angleAxis[0] + angleAxis[1]*angleAxis[1] +
+    angleAxis[2]*angleAxis[2];
+  if(theta2 > T(std::numeric_limits<double>::epsilon()))
+  {
+    // Rodrigues' formula.
+    const T theta = sqrt(theta2);
+    const T costheta = cos(theta);
+    const T sintheta = sin(theta);
+    const T thetaInv = T(1.) / theta;
+    const T w[3] = {angleAxis[0] * thetaInv,angleAxis[1] * thetaInv,
+      angleAxis[2] * thetaInv};
+    const T wCrossPt[3] = {w[1] * pt[2] - w[2] * pt[1],
+      w[2] * pt[0] - w[0] * pt[2],
+      w[0] * pt[1] - w[1] * pt[0]};
+    const T tmp = (w[0] * pt[0] + w[1] * pt[1] + w[2] * pt[2]) * (T(1.) - costheta);
+    for(int i = 0; i < 3; i++)
+      result[i] = pt[i] * costheta + wCrossPt[i] * sintheta + w[i] * tmp;
+  } else
+  {
+    // First order Taylor approximation near zero, i.e., R * pt = pt + w x pt.
+    result[0] = pt[0] + angleAxis[1] * pt[2] - angleAxis[2] * pt[1];
+    result[1] = pt[1] + angleAxis[2] * pt[0] - angleAxis[0] * pt[2];
+    result[2] = pt[2] + angleAxis[0] * pt[1] - angleAxis[1] * pt[0];
+  }
+}
+
 template<typename T>
 bool StandardCamera::ReprojectionErrorFunctor::operator()(const T* const camera,
   const T* const point,T* residuals) const
@@ -1,7 +1,14 @@
 #include "standard_camera_radial.h"
 
+#include <cmath>
+#include <limits>
+
 #include "utils.h"
 
+using Eigen::ArrayXd;
+using Eigen::Dynamic;
+using Eigen::Map;
+using Eigen::Matrix;
 using std::make_unique;
 
 namespace yasfm
@@ -15,7 +22,8 @@ string StandardCameraRadial::className() const
 CameraRegister<StandardCameraRadial> StandardCameraRadial::reg_("StandardCameraRadial");
 
 StandardCameraRadial::StandardCameraRadial()
-	: StandardCamera()
+	: StandardCamera(),invRadMaxRadius_(std::numeric_limits<double>::infinity()),
+  undistortionTableSize_(0),undistortionTableStep_(0.)
 {
   for(int i = 0; i < 2; i++)
   {
@@ -24,11 +32,14 @@ StandardCameraRadial::StandardCameraRadial()
     paramsConstraintsWeights_.push_back(0.);
   }
 	invRadParams_.fill(0.);
+  invRadParamsFittedFor_.fill(0.);
 }
 
 StandardCameraRadial::StandardCameraRadial(const string& imgFilename,
-  const string& featuresDir)
-  : StandardCamera(imgFilename,featuresDir)
+  const string& featuresDir,int imgWidth,int imgHeight)
+  : StandardCamera(imgFilename,featuresDir,imgWidth,imgHeight),
+  invRadMaxRadius_(std::numeric_limits<double>::infinity()),
+  undistortionTableSize_(0),undistortionTableStep_(0.)
 {
   for(int i = 0; i < 2; i++)
   {
@@ -37,24 +48,38 @@ StandardCameraRadial::StandardCameraRadial(const string& imgFilename,
     paramsConstraintsWeights_.push_back(0.);
   }
   invRadParams_.fill(0.);
+  invRadParamsFittedFor_.fill(0.);
 }
 
 StandardCameraRadial::StandardCameraRadial(istream& file)
-  : StandardCamera(file)
+  : StandardCamera(file),undistortionTableSize_(0),undistortionTableStep_(0.)
 {  
   file >> invRadParams_[0] 
     >> invRadParams_[1] 
     >> invRadParams_[2]
     >> invRadParams_[3];
+  // The written inverse is used as it is.
+  invRadParamsFittedFor_[0] = params_[radIdx_ + 0];
+  invRadParamsFittedFor_[1] = params_[radIdx_ + 1];
+  invRadMaxRadius_ = maxRadiusNormalized();
 }
 
 StandardCameraRadial::~StandardCameraRadial()
 {
 }
 
-unique_ptr<Camera> StandardCameraRadial::clone() const
+StandardCameraRadial::StandardCameraRadial(const StandardCameraRadial& o,bool copyDescr)
+  : StandardCamera(o,copyDescr),invRadParams_(o.invRadParams_),
+  invRadParamsFittedFor_(o.invRadParamsFittedFor_),invRadMaxRadius_(o.invRadMaxRadius_),
+  undistortionTableSize_(o.undistortionTableSize_),
+  undistortionTable_(o.undistortionTable_),
+  undistortionTableStep_(o.undistortionTableStep_)
+{
+}
+
+unique_ptr<Camera> StandardCameraRadial::clone(bool withDescr) const
 {
-  return make_unique<StandardCameraRadial>(*this);
+  return make_unique<StandardCameraRadial>(*this,withDescr);
 }
 
 Vector2d StandardCameraRadial::project(const Point& pt) const
@@ -71,6 +96,16 @@ ceres::CostFunction* StandardCameraRadial::costFunction(int keyIdx) const
     new ReprojectionErrorFunctor(k(0),k(1),*this)));
 }
 
+bool StandardCameraRadial::evaluateReprojectionErrorFloat(int keyIdx,
+  const float* const camParams,const float* const point,float *residuals,
+  float *jacobianCam,float *jacobianPoint) const
+{
+  const auto& k = key(keyIdx);
+  ReprojectionErrorFunctor functor(k(0),k(1),*this);
+  return evaluateFunctorWithJets<nParams_>(functor,camParams,point,residuals,
+    jacobianCam,jacobianPoint);
+}
+
 ceres::CostFunction* StandardCameraRadial::constraintsCostFunction() const
 {
   return generateConstraintsCostFunction<nParams_>(&paramsConstraints_[0],
@@ -88,21 +123,44 @@ Vector2d StandardCameraRadial::keyNormalized(int i) const
   return undistortFactor*distorted;
 }
 
+void StandardCameraRadial::keysNormalized(vector<Vector2d> *pnormKeys) const
+{
+  auto& normKeys = *pnormKeys;
+  StandardCamera::keysNormalized(&normKeys);
+  int nKeys = static_cast<int>(normKeys.size());
+  if(nKeys == 0)
+    return;
+
+  Map<Matrix<double,2,Dynamic>> normKeysMapped(&normKeys[0](0),2,nKeys);
+  ArrayXd radius = normKeysMapped.colwise().norm().transpose().array();
+  ArrayXd undistortFactor = 1. + radius *
+    (invRadParams_[0] + radius *
+    (invRadParams_[1] + radius *
+    (invRadParams_[2] + radius * invRadParams_[3])));
+  if(!undistortionTable_.empty())
+  {
+    int nEntries = static_cast<int>(undistortionTable_.size());
+    for(int i = 0; i < nKeys; i++)
+    {
+      // The polynomial is kept outside of the table.
+      double t = radius(i) / undistortionTableStep_;
+      int idx = static_cast<int>(t);
+      if(idx < nEntries - 1)
+      {
+        undistortFactor(i) = undistortionTable_[idx] +
+          (t - idx) * (undistortionTable_[idx + 1] - undistortionTable_[idx]);
+      }
+    }
+  }
+  normKeysMapped.array().rowwise() *= undistortFactor.transpose();
+}
+
 void StandardCameraRadial::setParams(const vector<double>& params)
 {
   StandardCamera::setParams(params);
   params_[radIdx_ + 0] = params[radIdx_ + 0];
   params_[radIdx_ + 1] = params[radIdx_ + 1];
-
-  // update inverse parameters
-  array<double,4> radParamsFull = {0.,params_[radIdx_ + 0],0.,params_[radIdx_ + 1]};
-  double xMax = imgWidth() - x0_(0);
-  double yMax = imgHeight() - x0_(1);
-  double maxRadius = sqrt(xMax*xMax + yMax*yMax);
-  int nForward = static_cast<int>(radParamsFull.size());
-  int nInverse = static_cast<int>(invRadParams_.size());
-  approximateInverseRadialDistortion(nForward,nInverse,maxRadius,&radParamsFull[0],
-    &invRadParams_[0]);
+  updateInverseRadialDistortion(false);
 }
 
 void StandardCameraRadial::setParams(const Matrix34d& P)
@@ -110,7 +168,82 @@ void StandardCameraRadial::setParams(const Matrix34d& P)
   StandardCamera::setParams(P);
   params_[radIdx_ + 0] = 0.;
   params_[radIdx_ + 1] = 0.;
-  invRadParams_.fill(0.);
+  updateInverseRadialDistortion(false);
+}
+
+void StandardCameraRadial::setFocal(double f)
+{
+  StandardCamera::setFocal(f);
+  updateInverseRadialDistortion(false);
+}
+
+void StandardCameraRadial::setUndistortionTableSize(int size)
+{
+  undistortionTableSize_ = size;
+  updateInverseRadialDistortion(true);
+}
+
+void StandardCameraRadial::updateInverseRadialDistortion(bool force)
+{
+  double k1 = params_[radIdx_ + 0];
+  double k2 = params_[radIdx_ + 1];
+  double maxRadius = maxRadiusNormalized();
+  bool isRangeOk = std::isinf(invRadMaxRadius_) ||
+    (maxRadius <= invRadMaxRadius_ && 2. * maxRadius >= invRadMaxRadius_);
+  if(!force && isRangeOk && k1 == invRadParamsFittedFor_[0] &&
+    k2 == invRadParamsFittedFor_[1])
+    return;
+
+  invRadParamsFittedFor_[0] = k1;
+  invRadParamsFittedFor_[1] = k2;
+  undistortionTable_.clear();
+  if(k1 == 0. && k2 == 0.)
+  {
+    // No distortion, the inverse is valid everywhere.
+    invRadParams_.fill(0.);
+    invRadMaxRadius_ = std::numeric_limits<double>::infinity();
+    return;
+  }
+  // The margin avoids refitting after every small change of the focal.
+  invRadMaxRadius_ = 1.25 * maxRadius;
+  if(invRadMaxRadius_ <= 0.)
+  {
+    // The focal is unknown. Fitted once it is set.
+    invRadParams_.fill(0.);
+    return;
+  }
+
+  array<double,4> radParamsFull = {0.,k1,0.,k2};
+  int nForward = static_cast<int>(radParamsFull.size());
+  int nInverse = static_cast<int>(invRadParams_.size());
+  approximateInverseRadialDistortion(nForward,nInverse,invRadMaxRadius_,
+    &radParamsFull[0],&invRadParams_[0]);
+
+  if(undistortionTableSize_ > 1)
+  {
+    double r2 = invRadMaxRadius_ * invRadMaxRadius_;
+    double maxRadiusDistorted = invRadMaxRadius_ * (1. + r2 * (k1 + r2 * k2));
+    if(maxRadiusDistorted <= 0.)
+      return;
+    undistortionTableStep_ = maxRadiusDistorted / (undistortionTableSize_ - 1);
+    undistortionTable_.resize(undistortionTableSize_);
+    undistortionTable_[0] = 1.;
+    for(int i = 1; i < undistortionTableSize_; i++)
+    {
+      double radiusDistorted = i * undistortionTableStep_;
+      undistortionTable_[i] = undistortRadiusNewton(nForward,&radParamsFull[0],
+        radiusDistorted) / radiusDistorted;
+    }
+  }
+}
+
+double StandardCameraRadial::maxRadiusNormalized() const
+{
+  if(f() <= 0.)
+    return 0.;
+  double xMax = std::max(x0_(0),imgWidth() - x0_(0));
+  double yMax = std::max(x0_(1),imgHeight() - x0_(1));
+  return sqrt(xMax*xMax + yMax*yMax) / f();
 }
 
 void StandardCameraRadial::constrainRadial(double *constraints,double *weights)
@@ -66,8 +66,11 @@ public:
 
   \param[in] imgFilename Path to the image file.
   \param[in] featuresDir Directory containg files with features.
+  \param[in] imgWidth Image width. Read from the image if not positive.
+  \param[in] imgHeight Image height. Read from the image if not positive.
   */
-  YASFM_API StandardCameraRadial(const string& imgFilename,const string& featuresDir);
+  YASFM_API StandardCameraRadial(const string& imgFilename,const string& featuresDir,
+    int imgWidth = -1,int imgHeight = -1);
 
   /// Constructor. (Reads everything from the file.)
   /**
@@ -78,6 +81,13 @@ public:
   */
   YASFM_API StandardCameraRadial(istream& file);
 
+  /// Copy constructor optionally skipping the descriptors. (Used by clone().)
+  /**
+  \param[in] o Other camera.
+  \param[in] copyDescr Copy also the descriptors?
+  */
+  YASFM_API StandardCameraRadial(const StandardCameraRadial& o,bool copyDescr);
+
   /// Destructor.
   /**
   Seems like the destructor has to be virtual so that the destruction
@@ -96,12 +106,14 @@ public:
   /// Cloning. !! HAS TO BE OVERRIDEN BY EVERY DERIVED CLASS IN HIERARCHY !!
   /**
   This is used for cloning when one has only pointer to the Camera.
-  DerivedCamera has to implement clone() like this:
-  { return make_unique<DerivedCamera>(*this); }
+  DerivedCamera has to provide a constructor DerivedCamera(const DerivedCamera& o,
+  bool copyDescr) forwarding copyDescr to its base class and implement clone() like this:
+  { return make_unique<DerivedCamera>(*this,withDescr); }
 
+  \param[in] withDescr Copy also the descriptors?
   \return Base class pointer to the clone of the DerivedCamera.
   */
-  YASFM_API virtual unique_ptr<Camera> clone() const;
+  YASFM_API virtual unique_ptr<Camera> clone(bool withDescr = true) const;
 
   /// Class name. !! HAS TO BE OVERRIDEN BY EVERY DERIVED CLASS IN HIERARCHY !!
   /// \return "DerivedCamera" for DerivedCamera.
@@ -133,6 +145,11 @@ public:
   */
   YASFM_API virtual ceres::CostFunction* costFunction(int keyIdx) const;
 
+  /// Evaluate the reprojection error in single precision (see StandardCamera).
+  YASFM_API virtual bool evaluateReprojectionErrorFloat(int keyIdx,
+    const float* const camParams,const float* const point,float *residuals,
+    float *jacobianCam,float *jacobianPoint) const;
+
   /// Generate ceres parameters cost function.
   /**
   This cost function accepts camera parameters and returns the same
@@ -146,6 +163,15 @@ public:
   /// \return Key with undone calibration.
   YASFM_API virtual Vector2d keyNormalized(int i) const;
 
+  /// Undo calibration and radial distortion of all the keys at once.
+  /**
+  Uses the undistortion table when enabled by setUndistortionTableSize() and
+  the inverse polynomial of keyNormalized() otherwise.
+
+  \param[out] normKeys Keys with undone calibration.
+  */
+  YASFM_API virtual void keysNormalized(vector<Vector2d> *normKeys) const;
+
   /// Set parameters from exported ones (same format as params()).
   /// \param[in] params New camera parameters.
   YASFM_API virtual void setParams(const vector<double>& params);
@@ -158,6 +184,20 @@ public:
   */
   YASFM_API virtual void setParams(const Matrix34d& P);
 
+  /// Set focal length.
+  /// \param[in] f Focal length.
+  YASFM_API virtual void setFocal(double f);
+
+  /// Enable undistortion of keysNormalized() through a table.
+  /**
+  The table holds undistortion factors computed by Newton's method (exact up to
+  the interpolation) at uniformly spaced distorted radii and it is interpolated
+  linearly. It is rebuilt together with the inverse polynomial.
+
+  \param[in] size Number of entries. 0 disables the table.
+  */
+  YASFM_API void setUndistortionTableSize(int size);
+
   /// Constrain radial parameters.
   /**
   \param[in] constraints Two reference radial distortion parameters (try 0).
@@ -180,7 +220,28 @@ protected:
   */
   virtual void writeASCII(ostream& file) const;
 
+  /// Refit the inverse radial distortion if it is outdated.
+  /**
+  The inverse does not depend on the focal length, only its range does. Hence,
+  it is refit only when the radial parameters change or when the normalized
+  radius of the image corners leaves the fitted range considerably.
+
+  \param[in] force Refit even if the inverse is up to date.
+  */
+  void updateInverseRadialDistortion(bool force);
+
+  /// \return Normalized (undistorted) radius of the image corners.
+  double maxRadiusNormalized() const;
+
   array<double,4> invRadParams_; ///< Inverse radial distortion parameters.
+  /// Radial parameters for which invRadParams_ were fitted.
+  array<double,2> invRadParamsFittedFor_;
+  /// Normalized radius up to which invRadParams_ were fitted.
+  double invRadMaxRadius_;
+  int undistortionTableSize_;
+  /// Undistortion factors at distorted radii i*undistortionTableStep_.
+  vector<double> undistortionTable_;
+  double undistortionTableStep_;
   
   /// Index of the first radial parameter in the params export ordering.
   static const int radIdx_ = 7;
@@ -255,7 +316,7 @@ void StandardCameraRadial::projectWithExternalParams(const T* const camera,
 
   // Rotate.
   T pCam[3];
-  ceres::AngleAxisRotatePoint(&camera[rotIdx_],p,pCam);
+  angleAxisRotatePoint(&camera[rotIdx_],p,pCam);
 
   T xp = pCam[0] / pCam[2];
   T yp = pCam[1] / pCam[2];
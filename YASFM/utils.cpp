@@ -196,4 +196,32 @@ void approximateInverseRadialDistortion(int nForwardParams,int nInverseParams,
   invRadParamsMap = A.jacobiSvd(Eigen::ComputeThinU | Eigen::ComputeThinV).solve(b);
 }
 
+double undistortRadiusNewton(int nForwardParams,const double* const radParams,
+  double radiusDistorted)
+{
+  const int cMaxIters = 20;
+  double radius = radiusDistorted;
+  for(int iter = 0; iter < cMaxIters; iter++)
+  {
+    // f(r) = r*d(r) - radiusDistorted and its derivative
+    double radiusPower = radius;
+    double value = radius;
+    double derivative = 1.;
+    for(int i = 0; i < nForwardParams; i++)
+    {
+      value += radiusPower*radius*radParams[i];
+      derivative += (i + 2)*radiusPower*radParams[i];
+      radiusPower *= radius;
+    }
+    value -= radiusDistorted;
+    if(derivative == 0.)
+      break;
+    double step = value / derivative;
+    radius -= step;
+    if(std::abs(step) <= 1e-14 * std::max(1.,radius))
+      break;
+  }
+  return radius;
+}
+
 } //namespace yasfm
\ No newline at end of file
@@ -10,6 +10,7 @@
 
 #pragma once
 
+#include <algorithm>
 #include <string>
 #include <utility>
 #include <vector>
@@ -74,13 +75,16 @@ inline double rad2Deg(double r);
 
 /// Finds ascending ordering.
 /**
+Introsort of the indices, i.e. O(n log n) also for sorted or tied elements.
+Tied elements keep their original order.
+
 \param[in] arr Array of elements.
 \param[out] order Mapping from the new ordered indices to the original ones. 
 */
 template<typename T>
 void quicksort(int n,const T* const arr,int *order);
 
-/// Finds ascending ordering.
+/// Finds ascending ordering. See quicksort(int,const T* const,int*).
 /**
 \param[in] arr Array of elements.
 \param[out] order Mapping from the new ordered indices to the original ones.
@@ -219,6 +223,21 @@ direction.
 YASFM_API void approximateInverseRadialDistortion(int nForwardParams,int nInverseParams,
   double maxRadius,const double* const radParams,double* invRadParams);
 
+/// Invert radial distortion of one radius using Newton's method.
+/**
+Finds the radius r such that r*d = radiusDistorted, where
+d = 1 + r*radParams[0] + r*r*radParams[1] + ... (see
+approximateInverseRadialDistortion()). Starts from radiusDistorted, which is
+close to the solution for the usual distortions.
+
+\param[in] nForwardParams Number of parameters of the radial distortion.
+\param[in] radParams Parameters of the radial distortion in forward direction.
+\param[in] radiusDistorted Distorted radius.
+\return Undistorted radius.
+*/
+YASFM_API double undistortRadiusNewton(int nForwardParams,
+  const double* const radParams,double radiusDistorted);
+
 /// Transforms x in a way that large values get mapped to some constant value.
 /**
 Robustifier taken from TDV course lectures of Radim Sara.
@@ -238,10 +257,6 @@ T robustify(double softThresh,T x);
 namespace
 {
 
-/// Main function for the header in the yasfm namespace. Sorts in ascending order.
-template<typename T>
-void quicksort(int left,int right,const T* const arr,int* order);
-
 /// Functor for computing error using ceres cost function.
 template<unsigned int N>
 class CameraConstraintsFunctor
@@ -291,7 +306,10 @@ void quicksort(int nElem,const T* const arr,int *order)
   {
     order[i] = i;
   }
-  ::quicksort(0,nElem - 1,arr,order);
+  std::sort(order,order + nElem,[arr](int i,int j)
+  {
+    return arr[i] < arr[j] || (!(arr[j] < arr[i]) && i < j);
+  });
 }
 
 // order is the output. It is the mapping from the new ordered indices
@@ -301,7 +319,7 @@ void quicksort(const vector<T>& arr,vector<int> *order)
 {
   int n = static_cast<int>(arr.size());
   order->resize(n);
-  ::quicksort(n,arr.data(),order->data());
+  quicksort(n,arr.data(),order->data());
 }
 
 template<typename T>
@@ -365,22 +383,6 @@ ceres::CostFunction* generateConstraintsCostFunction(const double* const constra
 namespace
 {
 
-template<typename T>
-void quicksort(int left,int right,const T* const arr,int* order)
-{
-  if(left >= right)
-    return;
-  int mid = left;
-  for(int i = left + 1; i <= right; i++)
-  {
-    if(arr[order[i]] < arr[order[left]])
-      std::swap(order[++mid],order[i]);
-  }
-  std::swap(order[mid],order[left]);
-  quicksort(left,mid - 1,arr,order);
-  quicksort(mid + 1,right,arr,order);
-}
-
 template<unsigned int N>
 CameraConstraintsFunctor<N>::CameraConstraintsFunctor(const double* const constraints,
   const double* const weights)
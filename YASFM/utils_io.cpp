@@ -3,12 +3,17 @@
 #include <direct.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <cctype>
 #include <climits>
+#include <cstdio>
+#include <cstdlib>
 #include <algorithm>
 #include <memory>
 #include <iostream>
 #include <iomanip>
 #include <fstream>
+#include <limits>
+#include <mutex>
 #include <sstream>
 
 #include "IL\il.h"
@@ -25,6 +30,7 @@ extern "C"
   extern ImageInfo_t ImageInfo;
   }
 }
+#include "logging.h"
 #include "utils.h"
 #include "standard_camera_radial.h"
 
@@ -35,6 +41,16 @@ using std::ofstream;
 using std::setprecision;
 using std::getline;
 using std::istringstream;
+using std::lock_guard;
+using std::mutex;
+
+namespace
+{
+
+/// Guards the image decoders (jhead and DevIL) which are not thread safe.
+mutex decoderMtx;
+
+} // namespace
 
 namespace yasfm
 {
@@ -141,17 +157,63 @@ void listFilenames(const string& dir,
 
 void getImgDims(const string& filename,int *width,int *height)
 {
+  int w,h;
+  if(getImgDimsFromHeader(filename,&w,&h))
+  {
+    if(width)
+      *width = w;
+    if(height)
+      *height = h;
+    return;
+  }
+
+  // jhead and DevIL keep global state
+  lock_guard<mutex> lock(decoderMtx);
   if(hasExtension(filename,"jpg") || hasExtension(filename,"jpeg"))
     getImgDimsJPG(filename,width,height);
   else
     getImgDimsAny(filename,width,height);
 }
 
+bool readImgDimsManifest(const string& filename,umap<string,IntPair> *pimgDims)
+{
+  auto& imgDims = *pimgDims;
+  ifstream file(filename);
+  if(!file.is_open())
+  {
+    YASFM_PRINT_ERROR_FILE_OPEN(filename);
+    return false;
+  }
+  string imgFilename;
+  IntPair dims;
+  while(file >> imgFilename >> dims.first >> dims.second)
+    imgDims[imgFilename] = dims;
+  file.close();
+  return true;
+}
+
+void writeImgDimsManifest(const string& filename,const ptr_vector<Camera>& cams)
+{
+  ofstream file(filename);
+  if(!file.is_open())
+  {
+    YASFM_PRINT_ERROR_FILE_OPEN(filename);
+    return;
+  }
+  for(const auto& cam : cams)
+  {
+    file << extractFilename(cam->imgFilename()) << " " << cam->imgWidth() << " "
+      << cam->imgHeight() << "\n";
+  }
+  file.close();
+}
+
 void readColors(const string& filename,const vector<Vector2d>& coord,
   vector<Vector3uc> *pcolors)
 {
   auto& colors = *pcolors;
 
+  lock_guard<mutex> lock(decoderMtx);
   initDevIL();
 
   ILuint imId; // will be used to store image name
@@ -197,9 +259,12 @@ void findFocalLengthInEXIF(const string& ccdDBFilename,const ptr_vector<Camera>&
   for(size_t i = 0; i < cams.size(); i++)
   {
     if(verbose)
-      cout << "searching for focal of img " << i << "\n";
+      YASFM_LOG_TAGGED(LogLevelVerbose,"focal search",0.,
+        "searching for focal of img " << i);
     (*focals)[i] = findFocalLengthInEXIF(ccdDBFilename,*cams[i],verbose);
   }
+  if(verbose)
+    logger().flush();
 }
 double findFocalLengthInEXIF(const string& ccdDBFilename,const Camera& cam,bool verbose)
 {
@@ -216,13 +281,14 @@ double findFocalLengthInEXIF(const string& ccdDBFilename,const string& imgFilena
   if(jhead::ImageInfo.FocalLength == 0.f)
   {
     if(verbose)
-      cout << "  focal [mm] not found in EXIF\n";
+      YASFM_LOG_TAGGED(LogLevelVerbose,"focal search",0.,
+        "  focal [mm] not found in EXIF");
     return 0.;
   } else
   {
     double focalMM = jhead::ImageInfo.FocalLength;
     if(verbose)
-      cout << "  focal [mm] found in EXIF\n";
+      YASFM_LOG_TAGGED(LogLevelVerbose,"focal search",0.,"  focal [mm] found in EXIF");
 
     string cameraMake(jhead::ImageInfo.CameraMake);
     string cameraModel(jhead::ImageInfo.CameraModel);
@@ -232,33 +298,91 @@ double findFocalLengthInEXIF(const string& ccdDBFilename,const string& imgFilena
       CCDWidth = jhead::ImageInfo.CCDWidth;
       if(verbose)
       {
-        cout << "  ccd width not found in DB\n";
+        YASFM_LOG_TAGGED(LogLevelVerbose,"focal search",0.,"  ccd width not found in DB");
         if(CCDWidth > 0.)
-          cout << "  ccd width computed from EXIF\n";
+          YASFM_LOG_TAGGED(LogLevelVerbose,"focal search",0.,
+            "  ccd width computed from EXIF");
       }
     } else if(verbose)
     {
-      cout << "  ccd width found in DB\n";
+      YASFM_LOG_TAGGED(LogLevelVerbose,"focal search",0.,"  ccd width found in DB");
     }
 
     if(CCDWidth == 0.)
     {
       if(verbose)
       {
-        cout << "  ccd width not computed from EXIF\n";
-        cout << "  unable to compute focal [px]\n";
+        YASFM_LOG_TAGGED(LogLevelVerbose,"focal search",0.,
+          "  ccd width not computed from EXIF");
+        YASFM_LOG_TAGGED(LogLevelVerbose,"focal search",0.,
+          "  unable to compute focal [px]");
       }
       return 0.;
     } else
     {
       double focalPX = ((double)maxImgDim) * (focalMM / CCDWidth);
       if(verbose)
-        cout << "  focal [px] computed: " << focalPX << "\n";
+        YASFM_LOG_TAGGED(LogLevelVerbose,"focals found",0.,
+          "  focal [px] computed: " << focalPX);
       return focalPX;
     }
   }
 }
 
+int findGPSInEXIF(bool verbose,ptr_vector<Camera> *pcams)
+{
+  auto& cams = *pcams;
+  int nFound = 0;
+  for(auto& cam : cams)
+  {
+    Vector3d latLonAlt;
+    if(findGPSInEXIF(cam->imgFilename(),&latLonAlt))
+    {
+      cam->setGPS(latLonAlt);
+      nFound++;
+    }
+  }
+  if(verbose)
+    cout << "GPS found in EXIF of " << nFound << "/" << cams.size() << " images\n";
+  return nFound;
+}
+
+bool findGPSInEXIF(const string& imgFilename,Vector3d *platLonAlt)
+{
+  auto& latLonAlt = *platLonAlt;
+  jhead::ResetJpgfile();
+  jhead::ImageInfo = jhead::ImageInfo_t();
+  jhead::ReadJpegFile(imgFilename.c_str(),jhead::ReadMode_t::READ_METADATA);
+
+  if(!jhead::ImageInfo.GpsInfoPresent)
+    return false;
+
+  // jhead formats the coordinates as "N 50d 5m 12.34s".
+  const char *coords[2] = {jhead::ImageInfo.GpsLat,jhead::ImageInfo.GpsLong};
+  for(int i = 0; i < 2; i++)
+  {
+    char ref;
+    double deg,min,sec;
+    if(sscanf(coords[i],"%c %lfd %lfm %lfs",&ref,&deg,&min,&sec) != 4)
+      return false;
+    latLonAlt(i) = deg + min / 60. + sec / 3600.;
+    if(ref == 'S' || ref == 'W')
+      latLonAlt(i) = -latLonAlt(i);
+  }
+
+  // jhead formats the altitude as " 123.45m" or "-123.45m".
+  double alt;
+  if(jhead::ImageInfo.GpsAlt[0] != 0 &&
+    sscanf(jhead::ImageInfo.GpsAlt + 1,"%lfm",&alt) == 1)
+  {
+    latLonAlt(2) = (jhead::ImageInfo.GpsAlt[0] == '-') ? -alt : alt;
+  } else
+  {
+    latLonAlt(2) = 0.;
+  }
+  return true;
+}
+
 void readCMPSFMFormat(double focalConstraintWeight,double radConstraint,
   double radConstraintWeight,ReadCMPSFMMode readMode,
   Dataset *pdata,ArrayXXd *homographyProportion)
@@ -406,6 +530,7 @@ void readCMPSFMMatches(const string& matchesFn,
     pair.dists.resize(n);
     for(int i = 0; i < n; i++)
       file >> pair.matches[i].first >> pair.matches[i].second >> pair.dists[i];
+    sortMatchesByDists(&pair);
     
     if(isMatchesEG)
       getline(file,line);
@@ -484,6 +609,84 @@ void readCMPSFMTracks(const string& tracksFn,
   file.close();
 }
 
+bool readBALProblem(const string& filename,ptr_vector<Camera> *pcams,
+  vector<Point> *ppts)
+{
+  auto& cams = *pcams;
+  auto& pts = *ppts;
+  ifstream file(filename);
+  if(!file.is_open())
+  {
+    YASFM_PRINT_ERROR_FILE_OPEN(filename);
+    return false;
+  }
+  int nCams,nPts,nObs;
+  file >> nCams >> nPts >> nObs;
+
+  struct Observation
+  {
+    int camIdx,ptIdx;
+    Vector2d key;
+  };
+  vector<Observation> obs(nObs);
+  vector<int> nCamObs(nCams,0);
+  for(auto& o : obs)
+  {
+    file >> o.camIdx >> o.ptIdx >> o.key(0) >> o.key(1);
+    if(o.camIdx < 0 || o.camIdx >= nCams || o.ptIdx < 0 || o.ptIdx >= nPts)
+    {
+      YASFM_PRINT_ERROR("Invalid observation in: " << filename);
+      return false;
+    }
+    nCamObs[o.camIdx]++;
+  }
+
+  Matrix3d flip = Vector3d(1.,-1.,-1.).asDiagonal();
+  cams.clear();
+  cams.reserve(nCams);
+  for(int camIdx = 0; camIdx < nCams; camIdx++)
+  {
+    Vector3d aa,t;
+    double f,k1,k2;
+    file >> aa(0) >> aa(1) >> aa(2) >> t(0) >> t(1) >> t(2) >> f >> k1 >> k2;
+    Matrix3d RBAL;
+    ceres::AngleAxisToRotationMatrix(aa.data(),RBAL.data()); // column major
+
+    auto cam = std::make_unique<StandardCameraRadial>();
+    cam->setImage("",1,1); // principal point in the origin
+    cam->resizeFeatures(nCamObs[camIdx],0);
+    cam->setRotation(flip*RBAL);
+    cam->setC(-RBAL.transpose()*t);
+    cam->setFocal(f);
+    vector<double> params;
+    cam->params(&params);
+    params[params.size() - 2] = k1;
+    params[params.size() - 1] = k2;
+    cam->setParams(params);
+    cams.push_back(std::move(cam));
+  }
+
+  pts.clear();
+  pts.resize(nPts);
+  for(auto& pt : pts)
+    file >> pt.coord(0) >> pt.coord(1) >> pt.coord(2);
+  if(file.fail())
+  {
+    YASFM_PRINT_ERROR("Unexpected end of file: " << filename);
+    return false;
+  }
+  file.close();
+
+  std::fill(nCamObs.begin(),nCamObs.end(),0);
+  for(const auto& o : obs)
+  {
+    int keyIdx = nCamObs[o.camIdx]++;
+    cams[o.camIdx]->key(keyIdx) = Vector2d(o.key(0),-o.key(1));
+    pts[o.ptIdx].views.emplace(o.camIdx,keyIdx);
+  }
+  return true;
+}
+
 void writeSFMBundlerFormat(const string& filename,const uset<int>& reconstructedCams,
   const ptr_vector<Camera>& cams,const vector<Point>& pts)
 {
@@ -605,6 +808,191 @@ istream& operator>>(istream& file,NViewMatch& m)
 namespace
 {
 
+bool getImgDimsFromHeader(const string& filename,int *width,int *height)
+{
+  ifstream file(filename,std::ios::binary);
+  if(!file.is_open())
+    return false;
+
+  unsigned char magic[4];
+  if(!file.read(reinterpret_cast<char *>(magic),4))
+    return false;
+  file.seekg(0);
+
+  bool success = false;
+  if(magic[0] == 0x89 && magic[1] == 'P' && magic[2] == 'N' && magic[3] == 'G')
+    success = readImgDimsPNG(file,width,height);
+  else if(magic[0] == 0xFF && magic[1] == 0xD8)
+    success = readImgDimsJPG(file,width,height);
+  else if(magic[0] == 'B' && magic[1] == 'M')
+    success = readImgDimsBMP(file,width,height);
+  else if((magic[0] == 'I' && magic[1] == 'I' && magic[2] == 42 && magic[3] == 0) ||
+    (magic[0] == 'M' && magic[1] == 'M' && magic[2] == 0 && magic[3] == 42))
+    success = readImgDimsTIFF(file,width,height);
+  else if(magic[0] == 'P' && magic[1] >= '1' && magic[1] <= '6')
+    success = readImgDimsPNM(file,width,height);
+
+  return success && *width > 0 && *height > 0;
+}
+
+unsigned readUInt(const unsigned char *data,int nBytes,bool bigEndian)
+{
+  unsigned val = 0;
+  for(int i = 0; i < nBytes; i++)
+  {
+    int byteIdx = bigEndian ? i : (nBytes - 1 - i);
+    val = (val << 8) | data[byteIdx];
+  }
+  return val;
+}
+
+bool readImgDimsPNG(istream& file,int *width,int *height)
+{
+  // signature (8), chunk length (4), chunk type (4), width (4), height (4)
+  unsigned char header[24];
+  if(!file.read(reinterpret_cast<char *>(header),24))
+    return false;
+  if(header[12] != 'I' || header[13] != 'H' || header[14] != 'D' || header[15] != 'R')
+    return false;
+  *width = static_cast<int>(readUInt(&header[16],4,true));
+  *height = static_cast<int>(readUInt(&header[20],4,true));
+  return true;
+}
+
+bool readImgDimsJPG(istream& file,int *width,int *height)
+{
+  file.ignore(2); // SOI
+  while(file)
+  {
+    int marker = file.get();
+    if(marker != 0xFF)
+      return false;
+    // markers can be padded by any number of 0xFF
+    while(marker == 0xFF)
+      marker = file.get();
+    if(marker == EOF)
+      return false;
+    // standalone markers: TEM and RST0-RST7
+    if(marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7))
+      continue;
+    // EOI or SOS before SOF
+    if(marker == 0xD9 || marker == 0xDA)
+      return false;
+
+    unsigned char lengthBytes[2];
+    if(!file.read(reinterpret_cast<char *>(lengthBytes),2))
+      return false;
+    unsigned length = readUInt(lengthBytes,2,true);
+    if(length < 2)
+      return false;
+
+    // SOF0-SOF15 except DHT, JPG and DAC
+    if(marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 &&
+      marker != 0xCC)
+    {
+      // precision (1), height (2), width (2)
+      unsigned char sof[5];
+      if(!file.read(reinterpret_cast<char *>(sof),5))
+        return false;
+      *height = static_cast<int>(readUInt(&sof[1],2,true));
+      *width = static_cast<int>(readUInt(&sof[3],2,true));
+      return true;
+    }
+    file.ignore(length - 2);
+  }
+  return false;
+}
+
+bool readImgDimsBMP(istream& file,int *width,int *height)
+{
+  // file header (14), info header size (4), dimensions
+  unsigned char header[26];
+  if(!file.read(reinterpret_cast<char *>(header),26))
+    return false;
+  unsigned infoSize = readUInt(&header[14],4,false);
+  if(infoSize == 12)
+  {
+    // BITMAPCOREHEADER with 16 bit dimensions
+    *width = static_cast<int>(readUInt(&header[18],2,false));
+    *height = static_cast<int>(readUInt(&header[20],2,false));
+  } else if(infoSize >= 40)
+  {
+    // negative height means top-down image
+    *width = static_cast<int>(readUInt(&header[18],4,false));
+    *height = std::abs(static_cast<int>(readUInt(&header[22],4,false)));
+  } else
+  {
+    return false;
+  }
+  return true;
+}
+
+bool readImgDimsTIFF(istream& file,int *width,int *height)
+{
+  const unsigned tagWidth = 256,tagHeight = 257;
+  const unsigned typeShort = 3,typeLong = 4;
+
+  unsigned char header[8];
+  if(!file.read(reinterpret_cast<char *>(header),8))
+    return false;
+  bool bigEndian = header[0] == 'M';
+  file.seekg(readUInt(&header[4],4,bigEndian));
+
+  unsigned char countBytes[2];
+  if(!file.read(reinterpret_cast<char *>(countBytes),2))
+    return false;
+  unsigned nEntries = readUInt(countBytes,2,bigEndian);
+
+  *width = -1;
+  *height = -1;
+  for(unsigned i = 0; i < nEntries && (*width < 0 || *height < 0); i++)
+  {
+    // tag (2), type (2), count (4), value (4)
+    unsigned char entry[12];
+    if(!file.read(reinterpret_cast<char *>(entry),12))
+      return false;
+    unsigned tag = readUInt(&entry[0],2,bigEndian);
+    if(tag != tagWidth && tag != tagHeight)
+      continue;
+    unsigned type = readUInt(&entry[2],2,bigEndian);
+    int val;
+    if(type == typeShort)
+      val = static_cast<int>(readUInt(&entry[8],2,bigEndian));
+    else if(type == typeLong)
+      val = static_cast<int>(readUInt(&entry[8],4,bigEndian));
+    else
+      return false;
+    if(tag == tagWidth)
+      *width = val;
+    else
+      *height = val;
+  }
+  return *width > 0 && *height > 0;
+}
+
+bool readImgDimsPNM(istream& file,int *width,int *height)
+{
+  file.ignore(2); // magic number
+  int dims[2];
+  for(int i = 0; i < 2; i++)
+  {
+    // skip whitespace and comments
+    int c = file.get();
+    while(c == '#' || std::isspace(c))
+    {
+      if(c == '#')
+        file.ignore(std::numeric_limits<std::streamsize>::max(),'\n');
+      c = file.get();
+    }
+    file.unget();
+    if(!(file >> dims[i]))
+      return false;
+  }
+  *width = dims[0];
+  *height = dims[1];
+  return true;
+}
+
 void getImgDimsJPG(const string& filename,int *width,int *height)
 {
   jhead::ResetJpgfile();
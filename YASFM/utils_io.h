@@ -75,14 +75,35 @@ means that all files will be listed.
 YASFM_API void listFilenames(const string& dir,
   const vector<string>& filenameExtensions,vector<string> *filenames);
 
-/// Load image and read dimensions.
+/// Read image dimensions.
 /**
+JPEG, PNG, BMP, TIFF and PPM/PGM/PBM dimensions are read from the file header.
+Other images, or those with headers which cannot be parsed, are decoded.
+Can be called from multiple threads, decoding is serialized.
+
 \param[in] filename Image filename.
 \param[out] width Image width.
 \param[out] height Image height.
 */
 YASFM_API void getImgDims(const string& filename,int *width,int *height);
 
+/// Read a manifest of image dimensions.
+/**
+Every line has the format: filename width height
+
+\param[in] filename Manifest filename.
+\param[out] imgDims Dimensions (width,height) indexed by image filenames.
+\return False if the file could not be read.
+*/
+YASFM_API bool readImgDimsManifest(const string& filename,umap<string,IntPair> *imgDims);
+
+/// Write a manifest of image dimensions which can be read by readImgDimsManifest().
+/**
+\param[in] filename Manifest filename.
+\param[in] cams Cameras. Image filenames without directories are written.
+*/
+YASFM_API void writeImgDimsManifest(const string& filename,const ptr_vector<Camera>& cams);
+
 /// Read colors of specified locations.
 /**
 \param[in] filename Image filename.
@@ -134,6 +155,23 @@ YASFM_API double findFocalLengthInEXIF(const string& ccdDBFilename,const Camera&
 YASFM_API double findFocalLengthInEXIF(const string& ccdDBFilename,
   const string& imgFilename,int maxImgDim,bool verbose);
 
+/// Finds GPS positions in EXIF and sets them to cameras.
+/**
+\param[in] verbose Print status?
+\param[in,out] cams Cameras with filenames. GPS is set to those which have it in EXIF.
+\return Number of cameras with GPS found.
+*/
+YASFM_API int findGPSInEXIF(bool verbose,ptr_vector<Camera> *cams);
+
+/// Finds GPS position in EXIF.
+/**
+\param[in] imgFilename Image filename.
+\param[out] latLonAlt Latitude and longitude in degrees (south and west are negative)
+and altitude in meters. Altitude is 0 if it is not in EXIF.
+\return True if latitude and longitude were found.
+*/
+YASFM_API bool findGPSInEXIF(const string& imgFilename,Vector3d *latLonAlt);
+
 enum ReadCMPSFMMode
 {
   /// Reads only images and keys.
@@ -218,6 +256,22 @@ YASFM_API void readCMPSFMTransforms(const string& transformsFn,
 YASFM_API void readCMPSFMTracks(const string& tracksFn,
   vector<NViewMatch> *tracks);
 
+/// Read a problem in the Bundle Adjustment in the Large (BAL) format.
+/**
+See: http://grail.cs.washington.edu/projects/bal/
+Every camera is converted into StandardCameraRadial with the principal point
+in the origin. BAL cameras look along -z and their y axis goes from bottom to
+the top, hence the rotation gets flipped around the x axis and the keys' y
+coordinates get negated.
+
+\param[in] filename Problem filename.
+\param[out] cams Cameras with keys set to the observations.
+\param[out] pts Points.
+\return False if the file could not be read.
+*/
+YASFM_API bool readBALProblem(const string& filename,ptr_vector<Camera> *cams,
+  vector<Point> *pts);
+
 /// Writes data into Bundler's Bundle format
 /**
 See: http://www.cs.cornell.edu/~snavely/bundler/bundler-v0.4-manual.html
@@ -261,6 +315,35 @@ public:
 /// Initialize DevIL library if not already initialized.
 void initDevIL();
 
+/// Read image dimensions from the file header without decoding the image.
+/**
+The format is recognized by the magic number.
+
+\param[in] filename Image filename.
+\param[out] width Image width.
+\param[out] height Image height.
+\return False if the format is not supported or the header is invalid.
+*/
+bool getImgDimsFromHeader(const string& filename,int *width,int *height);
+
+/// \return Unsigned integer stored in nBytes (at most 4) bytes.
+unsigned readUInt(const unsigned char *data,int nBytes,bool bigEndian);
+
+/// Read dimensions from the IHDR chunk of a PNG file (file is at the beginning).
+bool readImgDimsPNG(istream& file,int *width,int *height);
+
+/// Read dimensions from the first SOF segment of a JPEG file (file is at the beginning).
+bool readImgDimsJPG(istream& file,int *width,int *height);
+
+/// Read dimensions from the info header of a BMP file (file is at the beginning).
+bool readImgDimsBMP(istream& file,int *width,int *height);
+
+/// Read dimensions from the first IFD of a TIFF file (file is at the beginning).
+bool readImgDimsTIFF(istream& file,int *width,int *height);
+
+/// Read dimensions from the header of a PPM/PGM/PBM file (file is at the beginning).
+bool readImgDimsPNM(istream& file,int *width,int *height);
+
 /// Read JPG header and return dimensions (using jhead).
 /**
 \param[in] filename Image filename.